@@ -0,0 +1,662 @@
+// ------------------------------------------------------------------------------
+// Library catalog module
+// ------------------------------------------------------------------------------
+#include "psiso_catalog.h"
+#include "psiso_reader.h"
+#include "psiso_cue.h"
+#include "psiso_sfo.h"
+
+#ifdef WIN
+#include <windows.h>
+#endif
+#include <sys/stat.h>
+#include <errno.h>
+
+#define CATALOG_MAX_FILE	(1024 * 1024 * 1024)
+
+static uint32_t catalog_hash(const char* szPath)
+{
+	uint32_t h = 2166136261U;
+	while(*szPath) {
+		h ^= (uint8_t)*szPath++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void put_le16(uint8_t* p, uint32_t n)
+{
+	p[0] = (uint8_t)(n);
+	p[1] = (uint8_t)(n >> 8);
+}
+
+static void put_le32(uint8_t* p, uint32_t n)
+{
+	p[0] = (uint8_t)(n);
+	p[1] = (uint8_t)(n >> 8);
+	p[2] = (uint8_t)(n >> 16);
+	p[3] = (uint8_t)(n >> 24);
+}
+
+static void put_le64(uint8_t* p, uint64_t n)
+{
+	put_le32(p, (uint32_t)n);
+	put_le32(p + 4, (uint32_t)(n >> 32));
+}
+
+static uint64_t get_le64(const uint8_t* p)
+{
+	return (uint64_t)psx_le32(p) | ((uint64_t)psx_le32(p + 4) << 32);
+}
+
+// ------------------------------------------------------------------------------
+// Entries & index
+
+static int catalog_reindex(psiso_catalog* cat, uint32_t nSlots)
+{
+	uint32_t* pSlots = (uint32_t*)calloc(nSlots, sizeof(uint32_t));
+	if(!pSlots) return 0;
+
+	for(uint32_t i = 0; i < cat->nCount; i++)
+	{
+		uint32_t s = catalog_hash(cat->pEntries[i].szPath) & (nSlots - 1);
+		while(pSlots[s]) s = (s + 1) & (nSlots - 1);
+		pSlots[s] = i + 1;
+	}
+	SAFE_FREE(cat->pSlots);
+	cat->pSlots = pSlots;
+	cat->nSlots = nSlots;
+	return 1;
+}
+
+// slot of szPath, or of the empty slot where it would go
+static uint32_t catalog_slot(const psiso_catalog* cat, const char* szPath)
+{
+	uint32_t s = catalog_hash(szPath) & (cat->nSlots - 1);
+	while(cat->pSlots[s] && strcmp(cat->pEntries[cat->pSlots[s] - 1].szPath, szPath) != 0) {
+		s = (s + 1) & (cat->nSlots - 1);
+	}
+	return s;
+}
+
+const psiso_catalog_entry* psxCatalogFind(const psiso_catalog* cat, const char* szPath)
+{
+	if(!cat || !cat->nSlots) return NULL;
+
+	uint32_t nEntry = cat->pSlots[catalog_slot(cat, szPath)];
+	return nEntry ? &cat->pEntries[nEntry - 1] : NULL;
+}
+
+void psxCatalogEntryFree(psiso_catalog_entry* entry)
+{
+	SAFE_FREE(entry->szPath);
+	SAFE_FREE(entry->pSFO);
+	entry->nSFOSize = 0;
+}
+
+static int entry_copy(psiso_catalog_entry* dst, const psiso_catalog_entry* src)
+{
+	*dst = *src;
+	dst->szPath = (char*)malloc(strlen(src->szPath) + 1);
+	dst->pSFO = src->nSFOSize ? (uint8_t*)malloc(src->nSFOSize) : NULL;
+	if(!dst->szPath || (src->nSFOSize && !dst->pSFO)) {
+		psxCatalogEntryFree(dst);
+		return 0;
+	}
+	strcpy(dst->szPath, src->szPath);
+	if(src->nSFOSize) memcpy(dst->pSFO, src->pSFO, src->nSFOSize);
+	return 1;
+}
+
+int psxCatalogSet(psiso_catalog* cat, const psiso_catalog_entry* entry)
+{
+	psiso_catalog_entry copy;
+	if(!entry_copy(&copy, entry)) return 0;
+
+	const psiso_catalog_entry* old = psxCatalogFind(cat, entry->szPath);
+	if(old) {
+		psiso_catalog_entry* dst = &cat->pEntries[old - cat->pEntries];
+		psxCatalogEntryFree(dst);
+		*dst = copy;
+		return 1;
+	}
+
+	if(cat->nCount == cat->nCapacity)
+	{
+		uint32_t nCapacity = cat->nCapacity ? cat->nCapacity * 2 : 256;
+		psiso_catalog_entry* pEntries = (psiso_catalog_entry*)realloc(cat->pEntries, nCapacity * sizeof(psiso_catalog_entry));
+		if(!pEntries) {
+			psxCatalogEntryFree(&copy);
+			return 0;
+		}
+		cat->pEntries = pEntries;
+		cat->nCapacity = nCapacity;
+	}
+
+	// index at most half full
+	if((cat->nCount + 1) * 2 > cat->nSlots)
+	{
+		cat->pEntries[cat->nCount++] = copy;
+		if(!catalog_reindex(cat, cat->nSlots ? cat->nSlots * 2 : 512)) {
+			psxCatalogEntryFree(&cat->pEntries[--cat->nCount]);
+			return 0;
+		}
+		return 1;
+	}
+
+	cat->pSlots[catalog_slot(cat, copy.szPath)] = cat->nCount + 1;
+	cat->pEntries[cat->nCount++] = copy;
+	return 1;
+}
+
+// drop the entries flagged in pRemove (keeping the order of the others) and rebuild the index
+static uint32_t catalog_compact(psiso_catalog* cat, const bool* pRemove, psiso_catalog* removed)
+{
+	uint32_t nKept = 0;
+	for(uint32_t i = 0; i < cat->nCount; i++) {
+		if(pRemove[i]) {
+			if(removed) psxCatalogSet(removed, &cat->pEntries[i]);
+			psxCatalogEntryFree(&cat->pEntries[i]);
+		} else {
+			cat->pEntries[nKept++] = cat->pEntries[i];
+		}
+	}
+	uint32_t nRemoved = cat->nCount - nKept;
+	cat->nCount = nKept;
+
+	// same slot count, it can not fail once the old index is released
+	if(nRemoved) {
+		uint32_t nSlots = cat->nSlots;
+		SAFE_FREE(cat->pSlots);
+		catalog_reindex(cat, nSlots);
+	}
+	return nRemoved;
+}
+
+int psxCatalogRemove(psiso_catalog* cat, const char* szPath)
+{
+	const psiso_catalog_entry* entry = psxCatalogFind(cat, szPath);
+	if(!entry) return 0;
+
+	bool* pRemove = (bool*)calloc(cat->nCount, sizeof(bool));
+	if(!pRemove) return 0;
+	pRemove[entry - cat->pEntries] = true;
+
+	catalog_compact(cat, pRemove, NULL);
+	free(pRemove);
+	return 1;
+}
+
+static bool is_path_sep(char c)
+{
+	return c == '/' || c == '\\';
+}
+
+uint32_t psxCatalogRemoveDir(psiso_catalog* cat, const char* szDir, psiso_catalog* removed)
+{
+	size_t nLen = strlen(szDir);
+	while(nLen > 1 && is_path_sep(szDir[nLen - 1])) nLen--;
+
+	bool* pRemove = (bool*)calloc(cat->nCount ? cat->nCount : 1, sizeof(bool));
+	if(!pRemove) return 0;
+
+	for(uint32_t i = 0; i < cat->nCount; i++) {
+		const char* szPath = cat->pEntries[i].szPath;
+		pRemove[i] = (strncmp(szPath, szDir, nLen) == 0 && is_path_sep(szPath[nLen]));
+	}
+
+	uint32_t nRemoved = catalog_compact(cat, pRemove, removed);
+	free(pRemove);
+	return nRemoved;
+}
+
+void psxCatalogFree(psiso_catalog* cat)
+{
+	for(uint32_t i = 0; i < cat->nCount; i++) {
+		psxCatalogEntryFree(&cat->pEntries[i]);
+	}
+	SAFE_FREE(cat->pEntries);
+	SAFE_FREE(cat->pSlots);
+	memset(cat, 0, sizeof(psiso_catalog));
+}
+
+// ------------------------------------------------------------------------------
+// Catalog file
+
+static uint8_t* catalog_read_file(const char* szPath, uint32_t* pnLen, bool* pbMissing)
+{
+	uint8_t* pData = NULL;
+	int64_t nSize = 0;
+	*pbMissing = false;
+
+#ifdef WIN
+	FILE* fp = fopen(szPath, "rb");
+	if(!fp) {
+		*pbMissing = (errno == ENOENT);
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	nSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if(nSize >= 0 && nSize <= CATALOG_MAX_FILE) {
+		pData = (uint8_t*)malloc((size_t)nSize + 1);
+	}
+	if(pData && fread(pData, 1, (size_t)nSize, fp) != (size_t)nSize) {
+		SAFE_FREE(pData);
+	}
+	SAFE_FCLOSE(fp);
+#else
+	int fd = _open(szPath, O_RDONLY);
+	if(fd == -1) {
+		*pbMissing = (errno == ENOENT);
+		return NULL;
+	}
+
+	nSize = _lseek64(fd, 0, SEEK_END);
+	_lseek64(fd, 0, SEEK_SET);
+
+	if(nSize >= 0 && nSize <= CATALOG_MAX_FILE) {
+		pData = (uint8_t*)malloc((size_t)nSize + 1);
+	}
+	int64_t nDone = 0;
+	while(pData && nDone < nSize)
+	{
+		ssize_t nRead = _read(fd, pData + nDone, (size_t)(nSize - nDone));
+		if(nRead <= 0) {
+			SAFE_FREE(pData);
+			break;
+		}
+		nDone += nRead;
+	}
+	_close(fd);
+#endif
+
+	*pnLen = (uint32_t)nSize;
+	return pData;
+}
+
+// one record at p (nLeft bytes available), returns its size or 0 if it is not valid
+static uint32_t parse_record(const uint8_t* p, uint32_t nLeft, psiso_catalog_entry* entry)
+{
+	if(nLeft < PSISO_CATALOG_RECORD_SIZE) return 0;
+
+	uint32_t nSize		= psx_le32(p + 0x00);
+	uint32_t nStrings	= psx_le32(p + 0x04);
+	uint32_t nPathLen	= psx_le16(p + 0x44);
+	uint32_t nIDLen		= psx_le16(p + 0x46);
+	uint32_t nTitleLen	= psx_le16(p + 0x48);
+	uint32_t nSFOSize	= psx_le32(p + 0x4C);
+
+	if(nSize > nLeft || nStrings < PSISO_CATALOG_RECORD_SIZE || nStrings > nSize ||
+		(uint64_t)nPathLen + nIDLen + nTitleLen + nSFOSize > nSize - nStrings ||
+		!nPathLen || nIDLen >= PSISO_TITLE_ID_SIZE || nTitleLen >= PSISO_TITLE_SIZE || nSFOSize > PSISO_SFO_MAX_SIZE)
+	{
+		return 0;
+	}
+
+	memset(entry, 0, sizeof(psiso_catalog_entry));
+	entry->key.nDev			= get_le64(p + 0x08);
+	entry->key.nInode		= get_le64(p + 0x10);
+	entry->key.nSize		= get_le64(p + 0x18);
+	entry->key.nMTime		= (int64_t)get_le64(p + 0x20);
+	entry->nFingerprint		= get_le64(p + 0x28);
+	entry->nRet				= (int32_t)psx_le32(p + 0x30);
+	entry->nProbeSystem		= (int32_t)psx_le32(p + 0x34);
+	entry->res.nSystem		= (int32_t)psx_le32(p + 0x38);
+	entry->res.nSectorSize	= psx_le32(p + 0x3C);
+	entry->res.nVolumeSectors = psx_le32(p + 0x40);
+
+	// the systems index szISOSystem[], a foreign or damaged file must not get past here
+	if(entry->nProbeSystem < ISO_SYSTEM_AUTO || entry->nProbeSystem > ISO_SYSTEM_PSP ||
+		(entry->nRet == 1 && (entry->res.nSystem < ISO_SYSTEM_PS1 || entry->res.nSystem > ISO_SYSTEM_PSP)))
+	{
+		return 0;
+	}
+
+	const uint8_t* s = p + nStrings;
+	entry->szPath = (char*)malloc(nPathLen + 1);
+	if(!entry->szPath) return 0;
+	memcpy(entry->szPath, s, nPathLen);
+	entry->szPath[nPathLen] = 0;
+	s += nPathLen;
+
+	memcpy(entry->res.szTitleID, s, nIDLen);
+	s += nIDLen;
+	memcpy(entry->res.szTitle, s, nTitleLen);
+	s += nTitleLen;
+
+	if(nSFOSize) {
+		entry->pSFO = (uint8_t*)malloc(nSFOSize);
+		if(!entry->pSFO) {
+			psxCatalogEntryFree(entry);
+			return 0;
+		}
+		memcpy(entry->pSFO, s, nSFOSize);
+		entry->nSFOSize = nSFOSize;
+	}
+	return nSize;
+}
+
+int psxCatalogLoad(psiso_catalog* cat, const char* szPath)
+{
+	memset(cat, 0, sizeof(psiso_catalog));
+
+	uint32_t nLen = 0;
+	bool bMissing = false;
+	uint8_t* pData = catalog_read_file(szPath, &nLen, &bMissing);
+	if(!pData) {
+		return bMissing ? 0 : -1;
+	}
+
+	uint32_t nHeaderSize = (nLen >= PSISO_CATALOG_HEADER_SIZE) ? psx_le32(pData + 0x0C) : 0;
+	if(nLen < PSISO_CATALOG_HEADER_SIZE || memcmp(pData, PSISO_CATALOG_MAGIC, 8) != 0 ||
+		psx_le32(pData + 0x08) != PSISO_CATALOG_VERSION || nHeaderSize < PSISO_CATALOG_HEADER_SIZE || nHeaderSize > nLen)
+	{
+		free(pData);
+		return -1;
+	}
+
+	uint32_t nRecords = psx_le32(pData + 0x10);
+	uint32_t nPos = nHeaderSize;
+
+	for(uint32_t i = 0; i < nRecords; i++)
+	{
+		psiso_catalog_entry entry;
+		uint32_t nSize = parse_record(pData + nPos, nLen - nPos, &entry);
+		int ret = nSize ? psxCatalogSet(cat, &entry) : 0;
+		if(nSize) psxCatalogEntryFree(&entry);
+		if(!ret) {
+			free(pData);
+			psxCatalogFree(cat);
+			return -1;
+		}
+		nPos += nSize;
+	}
+
+	free(pData);
+	return 1;
+}
+
+static int catalog_write_file(const char* szPath, const uint8_t* pData, size_t nLen)
+{
+	bool bWritten = false;
+#ifdef WIN
+	FILE* fp = fopen(szPath, "wb");
+	if(fp) {
+		bWritten = (fwrite(pData, 1, nLen, fp) == nLen);
+		if(fclose(fp) != 0) bWritten = false;
+	}
+#else
+	int fd = _open(szPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd != -1) {
+		size_t nDone = 0;
+		while(nDone < nLen)
+		{
+			ssize_t nWritten = _write(fd, pData + nDone, nLen - nDone);
+			if(nWritten <= 0) break;
+			nDone += (size_t)nWritten;
+		}
+		bWritten = (nDone == nLen);
+		if(_close(fd) != 0) bWritten = false;
+	}
+#endif
+	return bWritten ? 1 : 0;
+}
+
+int psxCatalogSave(const psiso_catalog* cat, const char* szPath)
+{
+	size_t nLen = PSISO_CATALOG_HEADER_SIZE;
+	for(uint32_t i = 0; i < cat->nCount; i++) {
+		const psiso_catalog_entry* e = &cat->pEntries[i];
+		nLen += PSISO_CATALOG_RECORD_SIZE + strlen(e->szPath) + strlen(e->res.szTitleID) + strlen(e->res.szTitle) + e->nSFOSize;
+	}
+
+	uint8_t* pData = (uint8_t*)calloc(nLen, 1);
+	if(!pData) return 0;
+
+	memcpy(pData, PSISO_CATALOG_MAGIC, 8);
+	put_le32(pData + 0x08, PSISO_CATALOG_VERSION);
+	put_le32(pData + 0x0C, PSISO_CATALOG_HEADER_SIZE);
+	put_le32(pData + 0x10, cat->nCount);
+
+	uint8_t* p = pData + PSISO_CATALOG_HEADER_SIZE;
+	for(uint32_t i = 0; i < cat->nCount; i++)
+	{
+		const psiso_catalog_entry* e = &cat->pEntries[i];
+		uint32_t nPathLen	= (uint32_t)strlen(e->szPath);
+		uint32_t nIDLen		= (uint32_t)strlen(e->res.szTitleID);
+		uint32_t nTitleLen	= (uint32_t)strlen(e->res.szTitle);
+		uint32_t nSize		= PSISO_CATALOG_RECORD_SIZE + nPathLen + nIDLen + nTitleLen + e->nSFOSize;
+
+		put_le32(p + 0x00, nSize);
+		put_le32(p + 0x04, PSISO_CATALOG_RECORD_SIZE);
+		put_le64(p + 0x08, e->key.nDev);
+		put_le64(p + 0x10, e->key.nInode);
+		put_le64(p + 0x18, e->key.nSize);
+		put_le64(p + 0x20, (uint64_t)e->key.nMTime);
+		put_le64(p + 0x28, e->nFingerprint);
+		put_le32(p + 0x30, (uint32_t)e->nRet);
+		put_le32(p + 0x34, (uint32_t)e->nProbeSystem);
+		put_le32(p + 0x38, (uint32_t)e->res.nSystem);
+		put_le32(p + 0x3C, e->res.nSectorSize);
+		put_le32(p + 0x40, e->res.nVolumeSectors);
+		put_le16(p + 0x44, nPathLen);
+		put_le16(p + 0x46, nIDLen);
+		put_le16(p + 0x48, nTitleLen);
+		put_le32(p + 0x4C, e->nSFOSize);
+
+		uint8_t* s = p + PSISO_CATALOG_RECORD_SIZE;
+		memcpy(s, e->szPath, nPathLen);				s += nPathLen;
+		memcpy(s, e->res.szTitleID, nIDLen);		s += nIDLen;
+		memcpy(s, e->res.szTitle, nTitleLen);		s += nTitleLen;
+		if(e->nSFOSize) memcpy(s, e->pSFO, e->nSFOSize);
+
+		p += nSize;
+	}
+
+	// the old catalog stays until the new one is complete
+	char szTmp[4096];
+	snprintf(szTmp, sizeof(szTmp), "%s.tmp", szPath);
+
+	int ret = catalog_write_file(szTmp, pData, nLen);
+	free(pData);
+
+#ifdef WIN
+	if(ret && !MoveFileExA(szTmp, szPath, MOVEFILE_REPLACE_EXISTING)) ret = 0;
+#else
+	if(ret && _rename(szTmp, szPath) != 0) ret = 0;
+#endif
+	if(!ret) _unlink(szTmp);
+	return ret;
+}
+
+// ------------------------------------------------------------------------------
+// File identity & fingerprint
+
+static int stat_key(const char* szPath, psiso_file_key* key)
+{
+	memset(key, 0, sizeof(psiso_file_key));
+
+#ifdef WIN
+	struct _stati64 st;
+	if(_stati64(szPath, &st) != 0) return 0;
+#else
+	struct stat st;
+	if(stat(szPath, &st) != 0) return 0;
+#endif
+	if((st.st_mode & S_IFMT) != S_IFREG) return 0;
+
+	key->nDev	= (uint64_t)st.st_dev;
+	key->nInode	= (uint64_t)st.st_ino;
+	key->nSize	= (uint64_t)st.st_size;
+	key->nMTime	= (int64_t)st.st_mtime * 1000000000;
+#ifdef __linux__
+	key->nMTime	+= st.st_mtim.tv_nsec;
+#endif
+	return 1;
+}
+
+static void quiet_log_sink(void* pUser, int nLevel, const char* szMsg)
+{
+	(void)pUser;
+	(void)nLevel;
+	(void)szMsg;
+}
+
+int psxCatalogFileKey(const char* szPath, psiso_file_key* key)
+{
+	if(!stat_key(szPath, key)) return 0;
+	if(!psxCUEIsSheet(szPath)) return 1;
+
+	// a rebuilt BIN does not touch its sheet
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.log = quiet_log_sink;
+	ctx.bNoMap = true;
+
+	psiso_cue cue;
+	if(!psxCUELoad(&ctx, &cue, szPath)) return 1; // probed (and failed) as is
+
+	for(uint32_t f = 0; f < cue.nFiles; f++)
+	{
+		psiso_file_key bin;
+		if(!stat_key(cue.pFiles[f].szPath, &bin)) continue;
+		key->nSize += bin.nSize;
+		if(bin.nMTime > key->nMTime) key->nMTime = bin.nMTime;
+	}
+	psxCUEFree(&cue);
+	return 1;
+}
+
+int psxCatalogFingerprint(const char* szPath, uint64_t* pnFingerprint)
+{
+	psiso_reader reader;
+
+	if(psxCUEIsSheet(szPath))
+	{
+		psiso_ctx ctx;
+		psxCtxInit(&ctx);
+		ctx.log = quiet_log_sink;
+		ctx.bNoMap = true;
+
+		psiso_cue cue;
+		if(!psxCUELoad(&ctx, &cue, szPath)) return 0;
+		int nTrack = psxCUEDataTrack(&cue);
+		int ret = (nTrack >= 0 && psxCUEOpenTrack(&cue, (uint32_t)nTrack, &reader));
+		psxCUEFree(&cue);
+		if(!ret) return 0;
+	}
+	else if(!psxReaderOpenEx(&reader, szPath, 0, (uint64_t)-1, false)) {
+		return 0;
+	}
+
+	uint8_t buf[PSISO_CATALOG_FP_SIZE];
+	size_t nRead = psxReaderReadRaw(&reader, PSISO_CATALOG_FP_OFFSET, buf, sizeof(buf));
+	psxReaderClose(&reader);
+
+	// FNV-1a 64, the length tells apart images too small to have a PVD
+	uint64_t h = 14695981039346656037ULL;
+	for(size_t i = 0; i < nRead; i++) {
+		h ^= buf[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= (uint64_t)nRead;
+	h *= 1099511628211ULL;
+
+	*pnFingerprint = h;
+	return 1;
+}
+
+int psxCatalogProbe(psiso_ctx* ctx, const psiso_catalog* cat, const char* szPath, int nSystem, psiso_catalog_entry* entry, bool* pbCached)
+{
+	memset(entry, 0, sizeof(psiso_catalog_entry));
+	if(pbCached) *pbCached = false;
+
+	psiso_file_key key;
+	uint64_t nFingerprint = 0;
+	bool bKey = (psxCatalogFileKey(szPath, &key) == 1);
+	if(!bKey) memset(&key, 0, sizeof(key));
+	if(bKey) psxCatalogFingerprint(szPath, &nFingerprint);
+
+	const psiso_catalog_entry* old = bKey ? psxCatalogFind(cat, szPath) : NULL;
+	if(old && old->nProbeSystem == nSystem && old->nFingerprint == nFingerprint &&
+		memcmp(&old->key, &key, sizeof(psiso_file_key)) == 0)
+	{
+		if(!entry_copy(entry, old)) return 0;
+		if(pbCached) *pbCached = true;
+		return 1;
+	}
+
+	entry->szPath = (char*)malloc(strlen(szPath) + 1);
+	uint8_t* pSFO = (uint8_t*)malloc(PSISO_SFO_MAX_SIZE);
+	if(!entry->szPath || !pSFO) {
+		SAFE_FREE(pSFO);
+		psxCatalogEntryFree(entry);
+		return 0;
+	}
+	strcpy(entry->szPath, szPath);
+
+	// PARAM.SFO is kept whole, the caller context is restored after the probe
+	uint8_t* pSFOBuf		= ctx->pSFOBuf;
+	uint32_t nSFOBufSize	= ctx->nSFOBufSize;
+	ctx->pSFOBuf		= pSFO;
+	ctx->nSFOBufSize	= PSISO_SFO_MAX_SIZE;
+
+	entry->nRet			= psxProcessISOEx(ctx, szPath, nSystem, false, &entry->res);
+	entry->nProbeSystem	= nSystem;
+	entry->key			= key;
+	entry->nFingerprint	= nFingerprint;
+
+	if(ctx->nSFOLen) {
+		entry->pSFO = (uint8_t*)realloc(pSFO, ctx->nSFOLen);
+		entry->nSFOSize = entry->pSFO ? ctx->nSFOLen : 0;
+		if(!entry->pSFO) free(pSFO);
+	} else {
+		free(pSFO);
+	}
+	ctx->pSFOBuf		= pSFOBuf;
+	ctx->nSFOBufSize	= nSFOBufSize;
+	ctx->nSFOLen		= 0;
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+// Listing
+
+void psxCatalogPrint(const psiso_catalog* cat, bool bVerbose)
+{
+	for(uint32_t i = 0; i < cat->nCount; i++)
+	{
+		const psiso_catalog_entry* e = &cat->pEntries[i];
+		if(e->nRet == 1 && e->res.szTitleID[0]) {
+			printf("OK\t%s\t%s\t%s\t%s\n", szISOSystem[e->res.nSystem], e->res.szTitleID, e->res.szTitle, e->szPath);
+		} else {
+			printf("FAIL\t\t\t\t%s\n", e->szPath);
+		}
+		if(!bVerbose || e->nRet != 1) continue;
+
+		printf("\tSector Size: 0x%X \n", e->res.nSectorSize);
+		printf("\tVolume Size: (0x%08X sectors) \n", e->res.nVolumeSectors);
+
+		psiso_sfo sfo;
+		if(!e->nSFOSize || !psxSFOParse(&sfo, e->pSFO, e->nSFOSize)) continue;
+
+		for(uint32_t k = 0; k < sfo.nKeys; k++)
+		{
+			psiso_sfo_key key;
+			psxSFOKeyAt(&sfo, k, &key);
+
+			if(key.nFormat == SFO_FORMAT_INT32) {
+				printf("\t%s: 0x%04X \n", key.szName, key.nValue);
+			} else {
+				char szText[1024];
+				psxSFOGetString(&sfo, key.szName, szText, sizeof(szText));
+				printf("\t%s: %s \n", key.szName, szText);
+			}
+		}
+	}
+	printf(SEP_LINE_2);
+	printf("%u images in the catalog. \n", cat->nCount);
+}
@@ -0,0 +1,147 @@
+#ifndef PSISO_CATALOG_H
+#define PSISO_CATALOG_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// Library catalog module
+// ------------------------------------------------------------------------------------------------
+// Keeps the probe results of a whole library on disk, so a rescan only probes the images that
+// changed since the last one. Every image is keyed by its path, its file identity (device, inode,
+// size, modification time) and a fingerprint of the sectors around the Primary Volume Descriptor
+// (FNV-1a 64 of bytes 0x8000 - 0x932F of the image, which hold sector 16 on both 2048 and 2352
+// byte images). An image is only probed again when one of them changes, or when it is scanned
+// with a different system option. Failed images are kept too (they are not retried until they
+// change).
+//
+// CUE sheets are keyed by the sheet and the BIN files it lists (sizes added up, latest
+// modification time), the fingerprint comes from the first data track.
+//
+// The catalog is read in one go and written to "<file>.tmp" then renamed over the old one, so an
+// interrupted scan never leaves a broken catalog behind. All values are little-endian:
+//
+//		header		PSISO_CATALOG_HEADER_SIZE bytes
+//			0x00	char[8]		PSISO_CATALOG_MAGIC
+//			0x08	uint32		Version (PSISO_CATALOG_VERSION)
+//			0x0C	uint32		Header size (offset of the first record)
+//			0x10	uint32		Number of records
+//
+//		records, one per image:
+//			0x00	uint32		Record size (including this field, newer versions may only
+//								append fields before the strings)
+//			0x04	uint32		Offset of the strings from the start of the record
+//			0x08	uint64		Device
+//			0x10	uint64		Inode
+//			0x18	uint64		Size
+//			0x20	int64		Modification time (nanoseconds since the epoch)
+//			0x28	uint64		PVD fingerprint
+//			0x30	int32		psxProcessISOEx() result (1 = OK)
+//			0x34	int32		System option used for the probe (ISO_SYSTEM_*)
+//			0x38	int32		Detected system (ISO_SYSTEM_*)
+//			0x3C	uint32		Sector size (0x800, 0x930, 0x920)
+//			0x40	uint32		Volume sectors
+//			0x44	uint16		Path length
+//			0x46	uint16		Title ID length
+//			0x48	uint16		Title length
+//			0x4A	uint16		Reserved
+//			0x4C	uint32		PARAM.SFO length (PS3 / PSP, 0 = none)
+//			0x50	path, title ID, title (not terminated) and the whole PARAM.SFO
+
+#define PSISO_CATALOG_MAGIC				"PSISOCAT"
+#define PSISO_CATALOG_VERSION			1
+#define PSISO_CATALOG_HEADER_SIZE		0x20
+#define PSISO_CATALOG_RECORD_SIZE		0x50
+#define PSISO_CATALOG_FP_OFFSET			0x8000	// sector 16 (2048)
+#define PSISO_CATALOG_FP_SIZE			0x1330	// up to the end of sector 16 (2352)
+
+struct psiso_file_key
+{
+	uint64_t	nDev;
+	uint64_t	nInode;
+	uint64_t	nSize;
+	int64_t		nMTime;			// nanoseconds since the epoch
+};
+
+struct psiso_catalog_entry
+{
+	char*			szPath;
+	psiso_file_key	key;
+	uint64_t		nFingerprint;	// PVD fingerprint (see above)
+	int				nRet;			// psxProcessISOEx() result
+	int				nProbeSystem;	// system option of the probe (ISO_SYSTEM_AUTO = detected)
+	psiso_result	res;
+	uint8_t*		pSFO;			// whole PARAM.SFO (PS3 / PSP), see psiso_sfo.h
+	uint32_t		nSFOSize;
+};
+
+struct psiso_catalog
+{
+	psiso_catalog_entry*	pEntries;
+	uint32_t				nCount;
+	uint32_t				nCapacity;
+	uint32_t*				pSlots;		// open addressing index by path (entry + 1, 0 = empty)
+	uint32_t				nSlots;		// power of two
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(out)	cat				- Catalog, release with psxCatalogFree()
+(in)	szPath			- Catalog file
+
+(out)	return			- Will return 1 for success, 0 if the file does not exist yet (cat is an
+						  empty catalog) and -1 if the file could not be read or is not a valid
+						  catalog (cat is left empty, the file should not be overwritten).
+-------------------------------------------------------------------------------------------------
+*/
+int psxCatalogLoad(psiso_catalog* cat, const char* szPath);
+
+// Write the catalog to szPath (through "<szPath>.tmp"), returns 1 for success and 0 on failure
+int psxCatalogSave(const psiso_catalog* cat, const char* szPath);
+
+void psxCatalogFree(psiso_catalog* cat);
+
+// Entry of an image path, or NULL
+const psiso_catalog_entry* psxCatalogFind(const psiso_catalog* cat, const char* szPath);
+
+// Add a copy of entry (replaces the one with the same path), returns 0 if out of memory
+int psxCatalogSet(psiso_catalog* cat, const psiso_catalog_entry* entry);
+
+// Remove the entry of szPath, returns 0 if there was none
+int psxCatalogRemove(psiso_catalog* cat, const char* szPath);
+
+// Remove every entry under the directory szDir (any depth), returns the number removed. They are
+// added to removed when it is not NULL.
+uint32_t psxCatalogRemoveDir(psiso_catalog* cat, const char* szDir, psiso_catalog* removed);
+
+// Release what an entry owns (path and PARAM.SFO)
+void psxCatalogEntryFree(psiso_catalog_entry* entry);
+
+// File identity of an image (CUE sheets include their BIN files), returns 0 if it can not be read
+int psxCatalogFileKey(const char* szPath, psiso_file_key* key);
+
+// PVD fingerprint of an image (see above), returns 0 if it can not be read
+int psxCatalogFingerprint(const char* szPath, uint64_t* pnFingerprint);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+Probe an image unless cat already has it with the same key, fingerprint and system option.
+Reads cat only, so several threads can call it at once on the same catalog.
+
+(in)	ctx				- Context of the probe (see psxProcessISOEx())
+(in)	cat				- Catalog of the previous scan (NULL = always probe)
+(in)	szPath			- Disc image
+(in)	nSystem			- One of the ISO_SYSTEM_* values (ISO_SYSTEM_AUTO to detect it)
+(out)	entry			- Result for the catalog, release with psxCatalogEntryFree()
+(out)	pbCached		- true if the result was taken from cat (optional)
+
+(out)	return			- Will return 1 for success and 0 if out of memory (entry->nRet holds the
+						  psxProcessISOEx() result, it may be a failed probe).
+-------------------------------------------------------------------------------------------------
+*/
+int psxCatalogProbe(psiso_ctx* ctx, const psiso_catalog* cat, const char* szPath, int nSystem, psiso_catalog_entry* entry, bool* pbCached);
+
+// Display all the entries, one line per image like psxScanLibrary() does, followed by the
+// sector size, volume size and every PARAM.SFO field when bVerbose is set
+void psxCatalogPrint(const psiso_catalog* cat, bool bVerbose);
+
+#endif
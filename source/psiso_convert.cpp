@@ -0,0 +1,639 @@
+// ------------------------------------------------------------------------------
+// Sector format conversion module
+// ------------------------------------------------------------------------------
+#include "psiso_convert.h"
+#include "psiso_reader.h"
+#include "psiso_iso9660.h"
+#include "psiso_cue.h"
+#include "psiso_thread.h"
+
+// what the workers found on each sector
+#define CONVERT_DATA		0		// Mode 1 / Mode 2 Form 1
+#define CONVERT_ZERO		1		// zero filled Mode 0 / Mode 2 Form 2
+#define CONVERT_AUDIO		2		// no sync pattern
+#define CONVERT_FORM2		3		// Mode 2 Form 2 with data
+#define CONVERT_MODE		4		// unknown mode byte
+#define CONVERT_BAD_EDC		0x80
+
+#define CONVERT_MAX_DEPTH		64		// directory nesting (submode map walk)
+#define CONVERT_MAX_VD			64		// volume descriptors before the set terminator
+
+void psxConvertOptsInit(psiso_convert_opts* opts)
+{
+	memset(opts, 0, sizeof(psiso_convert_opts));
+	opts->nSectorType = PSISO_SECTOR_MODE2_FORM1;
+}
+
+struct convert_slot
+{
+	bool		bDone;
+	bool		bFailed;		// read error
+	uint32_t	nFirst;			// first sector of the chunk
+	uint32_t	nCount;
+	uint8_t*	pOut;			// user data (2048 bytes per sector) or raw sectors
+	uint8_t*	pClass;			// CONVERT_* of each sector (to ISO)
+	uint8_t*	pType;			// PSISO_SECTOR_* of each sector (to ISO)
+};
+
+struct convert_worker
+{
+	psiso_reader	r;
+	bool			bOpen;
+	uint8_t*		pBuf;		// chunk of input sectors (unmapped images)
+};
+
+struct convert_job
+{
+	bool			bToRaw;
+	uint32_t		nSectors;
+	uint32_t		nInSize;		// bytes per sector on the image
+	uint32_t		nOutSize;		// bytes per sector on the output
+	int				nSectorType;	// PSISO_SECTOR_* of the rebuilt sectors (to raw)
+	const uint8_t*	pSubmode;		// Mode 2 submode of each sector (to raw)
+
+	convert_slot*	slots;
+	uint32_t		nSlots;
+	convert_worker*	workers;
+	int				nWorkers;
+	psx_mutex		m;
+	psx_sem			done;
+};
+
+static bool zero_filled(const uint8_t* p, size_t nLen)
+{
+	for(size_t i = 0; i < nLen; i++) {
+		if(p[i]) return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------
+// Pipeline
+
+// Raw sectors to user data, checking the EDC
+static void convert_deframe(convert_slot* slot, const uint8_t* pRaw)
+{
+	for(uint32_t i = 0; i < slot->nCount; i++)
+	{
+		const uint8_t* pSector = pRaw + (size_t)i * PSISO_RAW_SECTOR_SIZE;
+		uint8_t* pOut = slot->pOut + (size_t)i * PSISO_SECTOR_SIZE;
+		uint8_t nClass = CONVERT_DATA;
+
+		int nType = psxSectorType(pSector);
+		switch(nType)
+		{
+			case PSISO_SECTOR_MODE1:
+			{
+				memcpy(pOut, pSector + 0x010, PSISO_SECTOR_SIZE);
+				if(psxEDC(0, pSector, 0x810) != psx_le32(pSector + 0x810)) nClass |= CONVERT_BAD_EDC;
+				break;
+			}
+			case PSISO_SECTOR_MODE2_FORM1:
+			{
+				memcpy(pOut, pSector + 0x018, PSISO_SECTOR_SIZE);
+				if(psxEDC(0, pSector + 0x010, 0x808) != psx_le32(pSector + 0x818)) nClass |= CONVERT_BAD_EDC;
+				break;
+			}
+			case PSISO_SECTOR_MODE2_FORM2:
+			{
+				nClass = zero_filled(pSector + 0x018, 2324) ? CONVERT_ZERO : CONVERT_FORM2;
+				memset(pOut, 0, PSISO_SECTOR_SIZE);
+				break;
+			}
+			case PSISO_SECTOR_MODE0:
+			{
+				// also unknown mode bytes
+				nClass = (pSector[0x00F] == 0 && zero_filled(pSector + 0x010, 2336)) ? CONVERT_ZERO : CONVERT_MODE;
+				memset(pOut, 0, PSISO_SECTOR_SIZE);
+				break;
+			}
+			default:
+			{
+				nClass = CONVERT_AUDIO;
+				break;
+			}
+		}
+		slot->pClass[i]	= nClass;
+		slot->pType[i]	= (uint8_t)nType;
+	}
+}
+
+// User data to raw sectors
+static void convert_build(const convert_job* job, convert_slot* slot, const uint8_t* pData)
+{
+	for(uint32_t i = 0; i < slot->nCount; i++)
+	{
+		uint32_t nLBA = slot->nFirst + i;
+		uint8_t* pSector = slot->pOut + (size_t)i * PSISO_RAW_SECTOR_SIZE;
+		const uint8_t* pIn = pData + (size_t)i * PSISO_SECTOR_SIZE;
+
+		if(job->nSectorType == PSISO_SECTOR_MODE1) {
+			memcpy(pSector + 0x010, pIn, PSISO_SECTOR_SIZE);
+		}
+		else
+		{
+			// file number, channel, submode, coding info, twice
+			pSector[0x010] = 0;
+			pSector[0x011] = 0;
+			pSector[0x012] = job->pSubmode ? job->pSubmode[nLBA] : PSISO_SUBMODE_DATA;
+			pSector[0x013] = 0;
+			memcpy(pSector + 0x014, pSector + 0x010, 4);
+			memcpy(pSector + 0x018, pIn, PSISO_SECTOR_SIZE);
+		}
+		psxSectorBuild(pSector, nLBA, job->nSectorType);
+	}
+}
+
+static void convert_worker_main(void* pUser, uint32_t nJob, int nWorker)
+{
+	convert_job* job = (convert_job*)pUser;
+	convert_worker* w = &job->workers[nWorker];
+
+	// only this worker touches the slot until bDone is set
+	convert_slot* slot = &job->slots[nJob];
+
+	uint64_t nOffset = (uint64_t)slot->nFirst * job->nInSize;
+	size_t nLen = (size_t)slot->nCount * job->nInSize;
+	bool bOK = true;
+
+	const uint8_t* pIn = psxReaderViewRaw(&w->r, nOffset, nLen);
+	if(pIn) {
+		psxReaderAdvise(&w->r, nOffset, nLen, PSISO_ADVISE_WILLNEED);
+	}
+	else if(psxReaderReadRaw(&w->r, nOffset, w->pBuf, nLen) == nLen) {
+		pIn = w->pBuf;
+	}
+	else {
+		bOK = false;
+	}
+
+	if(bOK) {
+		if(job->bToRaw) {
+			convert_build(job, slot, pIn);
+		} else {
+			convert_deframe(slot, pIn);
+		}
+	}
+
+	if(w->r.pMap) {
+		psxReaderAdvise(&w->r, nOffset, nLen, PSISO_ADVISE_DONTNEED);
+	}
+
+	psxMutexLock(job->m);
+	slot->bFailed = !bOK;
+	slot->bDone = true;
+	psxMutexUnlock(job->m);
+
+	psxSemPost(job->done);
+}
+
+// Called by the writer with every chunk, in image order
+typedef int (*convert_commit_func)(convert_job* job, convert_slot* slot, void* pUser);
+
+// All the chunks of the image, a window of job->nSlots at a time
+static int convert_run(convert_job* job, convert_commit_func commit, void* pUser)
+{
+	uint32_t nChunks = (job->nSectors + PSISO_CONVERT_CHUNK_SECTORS - 1) / PSISO_CONVERT_CHUNK_SECTORS;
+	int ret = 1;
+
+	for(uint32_t nFirst = 0; nFirst < nChunks && ret; nFirst += job->nSlots)
+	{
+		uint32_t nJobs = job->nSlots;
+		if(nJobs > nChunks - nFirst) nJobs = nChunks - nFirst;
+
+		for(uint32_t i = 0; i < nJobs; i++)
+		{
+			convert_slot* slot = &job->slots[i];
+			slot->bDone		= false;
+			slot->bFailed	= false;
+			slot->nFirst	= (nFirst + i) * PSISO_CONVERT_CHUNK_SECTORS;
+			slot->nCount	= job->nSectors - slot->nFirst;
+			if(slot->nCount > PSISO_CONVERT_CHUNK_SECTORS) slot->nCount = PSISO_CONVERT_CHUNK_SECTORS;
+		}
+
+		psx_pool* pool = psxPoolStart(nJobs, job->nWorkers, convert_worker_main, job);
+		if(!pool) return 0;
+
+		// single writer, chunks go out in image order as soon as they are ready
+		uint32_t nNext = 0;
+		while(nNext < nJobs)
+		{
+			psxSemWait(job->done);
+
+			while(nNext < nJobs)
+			{
+				psxMutexLock(job->m);
+				bool bDone = job->slots[nNext].bDone;
+				psxMutexUnlock(job->m);
+				if(!bDone) break;
+
+				convert_slot* slot = &job->slots[nNext];
+				if(ret && (slot->bFailed || !commit(job, slot, pUser))) {
+					ret = 0;
+				}
+				nNext++;
+			}
+		}
+		psxPoolWait(pool);
+	}
+	return ret;
+}
+
+// Reader on the image: the data track of a CUE sheet (cue not NULL) or the whole file
+static int convert_open(const char* szImage, const psiso_cue* cue, int nTrack, psiso_reader* r)
+{
+	if(cue) return psxCUEOpenTrack(cue, (uint32_t)nTrack, r);
+	return psxReaderOpen(r, szImage, false);
+}
+
+// Workers, slots and readers, nThreads is clamped to the number of chunks
+static int convert_job_init(convert_job* job, const char* szImage, const psiso_cue* cue, int nTrack, int nThreads)
+{
+	uint32_t nChunks = (job->nSectors + PSISO_CONVERT_CHUNK_SECTORS - 1) / PSISO_CONVERT_CHUNK_SECTORS;
+
+	// same worker count psxPoolStart() ends up with
+	if(nThreads <= 0) nThreads = psxCpuCount();
+	if((uint32_t)nThreads > nChunks) nThreads = (int)nChunks;
+	if(nThreads < 1) nThreads = 1;
+
+	uint32_t nSlots = (uint32_t)nThreads * PSISO_CONVERT_WINDOW_CHUNKS;
+	if(nSlots > nChunks) nSlots = nChunks;
+
+	job->nSlots		= nSlots;
+	job->slots		= (convert_slot*)calloc(job->nSlots, sizeof(convert_slot));
+	job->workers	= (convert_worker*)calloc(nThreads, sizeof(convert_worker));
+	job->m			= psxMutexCreate();
+	job->done		= psxSemCreate(0);
+	if(!job->slots || !job->workers || !job->m || !job->done) return 0;
+
+	for(uint32_t i = 0; i < job->nSlots; i++)
+	{
+		convert_slot* slot = &job->slots[i];
+		slot->pOut		= (uint8_t*)malloc((size_t)PSISO_CONVERT_CHUNK_SECTORS * job->nOutSize);
+		slot->pClass	= (uint8_t*)malloc(PSISO_CONVERT_CHUNK_SECTORS);
+		slot->pType		= (uint8_t*)malloc(PSISO_CONVERT_CHUNK_SECTORS);
+		if(!slot->pOut || !slot->pClass || !slot->pType) return 0;
+	}
+
+	job->nWorkers = nThreads;
+
+	// each worker reads through its own reader (unmapped reads seek)
+	for(int i = 0; i < nThreads; i++)
+	{
+		convert_worker* w = &job->workers[i];
+		if(!convert_open(szImage, cue, nTrack, &w->r)) return 0;
+		w->bOpen = true;
+		psxReaderAdvise(&w->r, 0, 0, PSISO_ADVISE_SEQUENTIAL);
+
+		if(!w->r.pMap) {
+			w->pBuf = (uint8_t*)malloc((size_t)PSISO_CONVERT_CHUNK_SECTORS * job->nInSize);
+			if(!w->pBuf) return 0;
+		}
+	}
+	return 1;
+}
+
+static void convert_job_free(convert_job* job)
+{
+	if(job->slots) {
+		for(uint32_t i = 0; i < job->nSlots; i++) {
+			SAFE_FREE(job->slots[i].pOut);
+			SAFE_FREE(job->slots[i].pClass);
+			SAFE_FREE(job->slots[i].pType);
+		}
+	}
+	if(job->workers) {
+		for(int i = 0; i < job->nWorkers; i++) {
+			if(job->workers[i].bOpen) psxReaderClose(&job->workers[i].r);
+			SAFE_FREE(job->workers[i].pBuf);
+		}
+	}
+	SAFE_FREE(job->slots);
+	SAFE_FREE(job->workers);
+	if(job->m) psxMutexDestroy(job->m);
+	if(job->done) psxSemDestroy(job->done);
+}
+
+// ------------------------------------------------------------------------------
+// Writers
+
+struct convert_writer
+{
+	psiso_ctx*					ctx;
+	const psiso_convert_opts*	opts;
+	psiso_convert_stats*		stats;
+	bool						bOpen;
+#ifdef WIN
+	FILE*						fp;
+#else
+	int							fd;
+#endif
+};
+
+static int writer_open(convert_writer* c, const char* szPath)
+{
+#ifdef WIN
+	c->fp = fopen(szPath, "wb");
+	c->bOpen = (c->fp != NULL);
+#else
+	c->fd = _open(szPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	c->bOpen = (c->fd != -1);
+#endif
+	return c->bOpen;
+}
+
+// Output chunk of a slot, then progress
+static int writer_put(convert_writer* c, const convert_job* job, const convert_slot* slot)
+{
+	const uint8_t* p = slot->pOut;
+	size_t nLen = (size_t)slot->nCount * job->nOutSize;
+#ifdef WIN
+	if(fwrite(p, 1, nLen, c->fp) != nLen) return 0;
+#else
+	size_t nDone = 0;
+	while(nDone < nLen)
+	{
+		ssize_t n = _write(c->fd, p + nDone, nLen - nDone);
+		if(n <= 0) return 0;
+		nDone += (size_t)n;
+	}
+#endif
+	c->stats->nWritten += slot->nCount;
+
+	if(c->opts->progress) {
+		c->opts->progress(c->opts->pProgressUser, c->stats->nWritten, job->nSectors);
+	}
+	return 1;
+}
+
+static int writer_close(convert_writer* c)
+{
+	if(!c->bOpen) return 1;
+	c->bOpen = false;
+#ifdef WIN
+	return fclose(c->fp) == 0;
+#else
+	return _close(c->fd) == 0;
+#endif
+}
+
+static int convert_commit_iso(convert_job* job, convert_slot* slot, void* pUser)
+{
+	convert_writer* c = (convert_writer*)pUser;
+	psiso_convert_stats* stats = c->stats;
+
+	for(uint32_t i = 0; i < slot->nCount; i++)
+	{
+		uint32_t nLBA = slot->nFirst + i;
+		uint8_t nClass = slot->pClass[i];
+
+		stats->nTypes[slot->pType[i]]++;
+
+		if(nClass & CONVERT_BAD_EDC)
+		{
+			stats->nBadEDC++;
+			psxLog(c->ctx, c->opts->bForce ? PSISO_LOG_VERBOSE : PSISO_LOG_INFO, "%s: Bad EDC on sector %u. \n",
+				c->opts->bForce ? "Warning" : "Error", nLBA);
+			if(!c->opts->bForce) return 0;
+			continue;
+		}
+
+		switch(nClass)
+		{
+			case CONVERT_DATA:
+				break;
+			case CONVERT_ZERO:
+				stats->nZero++;
+				break;
+			default:
+				psxLog(c->ctx, PSISO_LOG_INFO, "Error: Sector %u is %s, it can not be stored on a 2048 byte image. \n", nLBA,
+					nClass == CONVERT_AUDIO ? "an audio sector" : (nClass == CONVERT_FORM2 ? "a Mode 2 Form 2 sector" : "of an unknown mode"));
+				return 0;
+		}
+	}
+	return writer_put(c, job, slot);
+}
+
+static int convert_commit_raw(convert_job* job, convert_slot* slot, void* pUser)
+{
+	convert_writer* c = (convert_writer*)pUser;
+	c->stats->nTypes[job->nSectorType] += slot->nCount;
+	return writer_put(c, job, slot);
+}
+
+// Runs the job with commit into szOut, deleted on failure
+static int convert_write(psiso_ctx* ctx, convert_job* job, convert_commit_func commit, const char* szImage, const char* szOut,
+	const psiso_convert_opts* opts, psiso_convert_stats* stats)
+{
+	convert_writer c;
+	memset(&c, 0, sizeof(convert_writer));
+	c.ctx	= ctx;
+	c.opts	= opts;
+	c.stats	= stats;
+
+	if(!writer_open(&c, szOut)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOut);
+		return 0;
+	}
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Converting %u sectors of \"%s\" (%d threads) \n", job->nSectors, szImage, job->nWorkers);
+
+	stats->nSectors = job->nSectors;
+	stats->nThreads = job->nWorkers;
+
+	int ret = convert_run(job, commit, &c);
+	if(!writer_close(&c)) ret = 0;
+	if(!ret) remove(szOut);
+	return ret;
+}
+
+int psxConvertToISO(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_convert_opts* opts, psiso_convert_stats* stats)
+{
+	memset(stats, 0, sizeof(psiso_convert_stats));
+
+	// CUE sheets are converted on their first data track
+	psiso_cue cue;
+	bool bCUE = psxCUEIsSheet(szImage);
+	int nTrack = 0;
+
+	if(bCUE)
+	{
+		if(!psxCUELoad(ctx, &cue, szImage)) return 0;
+
+		nTrack = psxCUEDataTrack(&cue);
+		if(nTrack < 0 || cue.tracks[nTrack].nSectorSize != PSISO_RAW_SECTOR_SIZE) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" has no raw (2352 bytes per sector) data track. \n", szImage);
+			psxCUEFree(&cue);
+			return 0;
+		}
+		if(cue.nTracks > 1) {
+			psxLog(ctx, PSISO_LOG_INFO, "Converting track %02u of %u, the other tracks are not part of the ISO. \n",
+				cue.tracks[nTrack].nNumber, cue.nTracks);
+		}
+	}
+
+	psiso_reader r;
+	if(!convert_open(szImage, bCUE ? &cue : NULL, nTrack, &r)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szImage);
+		if(bCUE) psxCUEFree(&cue);
+		return 0;
+	}
+	uint64_t nFileSize = r.nFileSize;
+	psxReaderClose(&r);
+
+	if(nFileSize == 0 || (nFileSize % PSISO_RAW_SECTOR_SIZE) != 0 || nFileSize / PSISO_RAW_SECTOR_SIZE > 0xFFFFFFFF) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is not a raw (2352 bytes per sector) image. \n", szImage);
+		if(bCUE) psxCUEFree(&cue);
+		return 0;
+	}
+
+	convert_job job;
+	memset(&job, 0, sizeof(convert_job));
+	job.nSectors	= (uint32_t)(nFileSize / PSISO_RAW_SECTOR_SIZE);
+	job.nInSize		= PSISO_RAW_SECTOR_SIZE;
+	job.nOutSize	= PSISO_SECTOR_SIZE;
+
+	int ret = 0;
+	if(!convert_job_init(&job, szImage, bCUE ? &cue : NULL, nTrack, opts->nThreads)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not set up the conversion of \"%s\" (memory / file handles). \n", szImage);
+	} else {
+		ret = convert_write(ctx, &job, convert_commit_iso, szImage, szOut, opts, stats);
+	}
+
+	convert_job_free(&job);
+	if(bCUE) psxCUEFree(&cue);
+	return ret;
+}
+
+// ------------------------------------------------------------------------------
+// Mode 2 submode map
+
+static void submode_end(uint8_t* pSubmode, uint32_t nSectors, uint32_t nExtent, uint64_t nLen)
+{
+	uint64_t nLast = (uint64_t)nExtent + (nLen + PSISO_SECTOR_SIZE - 1) / PSISO_SECTOR_SIZE;
+	if(nLen && nLast <= nSectors) {
+		pSubmode[nLast - 1] |= PSISO_SUBMODE_EOR | PSISO_SUBMODE_EOF;
+	}
+}
+
+static void submode_tree(psiso_ctx* ctx, psiso_reader* r, const psiso_dirent* dir, uint8_t* pSubmode, uint32_t nSectors, int nDepth)
+{
+	submode_end(pSubmode, nSectors, dir->nExtent, dir->nDataLen);
+	if(nDepth > CONVERT_MAX_DEPTH) return;
+
+	psiso_dir it;
+	if(!psxDirOpen(r, dir, &it)) return;
+
+	psiso_dirent ent;
+	while(psxDirNext(&it, &ent))
+	{
+		if(ent.nFlags & ISO_DR_FLAG_DIRECTORY) {
+			submode_tree(ctx, r, &ent, pSubmode, nSectors, nDepth + 1);
+			continue;
+		}
+		if(ent.nXAAttr & ISO_XA_CDDA) continue;
+
+		if(ent.nXAAttr & (ISO_XA_FORM2 | ISO_XA_INTERLEAVED)) {
+			psxLog(ctx, PSISO_LOG_INFO, "Warning: \"%s\" has Form 2 sectors (XA audio / STR video), they can not be rebuilt from a 2048 byte image. \n", ent.szName);
+		}
+		submode_end(pSubmode, nSectors, ent.nExtent, ent.nDataLen);
+	}
+	psxDirClose(&it);
+}
+
+// Submode of every sector from the ISO9660 layout, NULL when the image has no volume descriptor
+static uint8_t* submode_map(psiso_ctx* ctx, psiso_reader* r, uint32_t nSectors)
+{
+	const uint8_t* pvd = psxReaderSector(r, ISO_PVD_SECTOR);
+	if(!pvd || memcmp(pvd + 1, "CD001", 5) != 0) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "No ISO9660 volume descriptor, every sector is written as plain data. \n");
+		return NULL;
+	}
+
+	uint8_t* pSubmode = (uint8_t*)malloc(nSectors);
+	if(!pSubmode) return NULL;
+	memset(pSubmode, PSISO_SUBMODE_DATA, nSectors);
+
+	// keep our own copy, the cached block can be recycled by the next reads
+	uint8_t vd[PSISO_SECTOR_SIZE];
+	memcpy(vd, pvd, PSISO_SECTOR_SIZE);
+
+	// volume descriptors up to the set terminator
+	for(uint32_t i = ISO_PVD_SECTOR; i < ISO_PVD_SECTOR + CONVERT_MAX_VD && i < nSectors; i++)
+	{
+		const uint8_t* p = psxReaderSector(r, i);
+		if(!p || memcmp(p + 1, "CD001", 5) != 0) break;
+
+		pSubmode[i] |= PSISO_SUBMODE_EOR;
+		if(p[0] == 0xFF) {
+			pSubmode[i] |= PSISO_SUBMODE_EOF;
+			break;
+		}
+	}
+
+	// path tables (L, optional L, M, optional M)
+	uint32_t nTableLen = psx_le32(vd + ISO_PVD_PT_SIZE_OFFSET);
+	uint32_t nTables[4] = {
+		psx_le32(vd + ISO_PVD_PT_L_OFFSET), psx_le32(vd + ISO_PVD_PT_L_OFFSET + 4),
+		psx_be32(vd + ISO_PVD_PT_M_OFFSET), psx_be32(vd + ISO_PVD_PT_M_OFFSET + 4)
+	};
+	for(int i = 0; i < 4; i++) {
+		if(nTables[i]) submode_end(pSubmode, nSectors, nTables[i], nTableLen);
+	}
+
+	psiso_dirent root;
+	if(psxParseDirRecord(vd + ISO_PVD_ROOT_DR_OFFSET, ISO_DR_MIN_LEN + 1, &root) > 0) {
+		submode_tree(ctx, r, &root, pSubmode, nSectors, 0);
+	}
+	return pSubmode;
+}
+
+int psxConvertToRaw(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_convert_opts* opts, psiso_convert_stats* stats)
+{
+	memset(stats, 0, sizeof(psiso_convert_stats));
+
+	if(opts->nSectorType != PSISO_SECTOR_MODE1 && opts->nSectorType != PSISO_SECTOR_MODE2_FORM1) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Raw images can only be rebuilt as Mode 1 or Mode 2 Form 1 sectors. \n");
+		return 0;
+	}
+
+	psiso_reader r;
+	if(!psxReaderOpen(&r, szImage, false)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szImage);
+		return 0;
+	}
+
+	uint64_t nFileSize = r.nFileSize;
+	if(nFileSize == 0 || (nFileSize % PSISO_SECTOR_SIZE) != 0 || nFileSize / PSISO_SECTOR_SIZE > 0xFFFFFFFF) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is not a 2048 bytes per sector image. \n", szImage);
+		psxReaderClose(&r);
+		return 0;
+	}
+
+	convert_job job;
+	memset(&job, 0, sizeof(convert_job));
+	job.bToRaw		= true;
+	job.nSectors	= (uint32_t)(nFileSize / PSISO_SECTOR_SIZE);
+	job.nInSize		= PSISO_SECTOR_SIZE;
+	job.nOutSize	= PSISO_RAW_SECTOR_SIZE;
+	job.nSectorType	= opts->nSectorType;
+
+	uint8_t* pSubmode = NULL;
+	if(job.nSectorType == PSISO_SECTOR_MODE2_FORM1) {
+		psxReaderAdvise(&r, 0, 0, PSISO_ADVISE_RANDOM);
+		pSubmode = submode_map(ctx, &r, job.nSectors);
+		job.pSubmode = pSubmode;
+	}
+	psxReaderClose(&r);
+
+	int ret = 0;
+	if(!convert_job_init(&job, szImage, NULL, 0, opts->nThreads)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not set up the conversion of \"%s\" (memory / file handles). \n", szImage);
+	} else {
+		ret = convert_write(ctx, &job, convert_commit_raw, szImage, szOut, opts, stats);
+	}
+
+	convert_job_free(&job);
+	SAFE_FREE(pSubmode);
+	return ret;
+}
@@ -0,0 +1,85 @@
+#ifndef PSISO_CONVERT_H
+#define PSISO_CONVERT_H
+
+#include "psiso_tool.h"
+#include "psiso_ecc.h"
+
+// ------------------------------------------------------------------------------------------------
+// Sector format conversion module
+// ------------------------------------------------------------------------------------------------
+// Converts raw (MODE1 / 2352 or MODE2 / 2352) images to plain (ISO9660 / MODE1 / 2048) ones: the
+// sync, header, subheader, EDC and ECC of every sector (about 13% of a raw image) are dropped.
+//
+// The image is cut in chunks of PSISO_CONVERT_CHUNK_SECTORS sectors. Workers (each with its own
+// reader) read a chunk, check the EDC of every sector and copy out its user data, while the
+// calling thread writes the finished chunks in image order. Only a window of
+// PSISO_CONVERT_WINDOW_CHUNKS chunks per worker is ever in memory.
+//
+// A 2048 byte image can only hold Mode 1 / Mode 2 Form 1 sectors, so images with audio or Form 2
+// sectors (XA audio, STR video) are refused. The exception are zero filled Form 2 / Mode 0
+// sectors (system area of PS1 discs, track gaps) that become zero filled sectors, nothing is
+// lost. Sectors with a bad EDC fail the conversion unless bForce is set.
+//
+// The other way, psxConvertToRaw() rebuilds the raw sectors of a 2048 byte image on the same
+// pipeline: sync, MSF header, subheader (Mode 2), EDC and P / Q parity (see psxSectorBuild()).
+// Mode 1 sectors only depend on the user data and their address, so they come out exactly as on
+// the disc. Mode 2 Form 1 subheaders are not stored on the ISO, they are set the way PlayStation
+// discs are mastered: data, end of record on the volume descriptors, and end of record / end of
+// file on the set terminator and on the last sector of every path table, directory and file.
+
+#define PSISO_CONVERT_CHUNK_SECTORS		512		// sectors per job (1.15MB raw)
+#define PSISO_CONVERT_WINDOW_CHUNKS		4		// chunks in flight per worker
+
+struct psiso_convert_opts
+{
+	int					nThreads;		// 0 = one per CPU
+	bool				bForce;			// write sectors with a bad EDC anyway (false)
+	int					nSectorType;	// psxConvertToRaw(): PSISO_SECTOR_MODE1 / PSISO_SECTOR_MODE2_FORM1 (MODE2_FORM1)
+	psiso_progress_func	progress;		// called as chunks are written (optional)
+	void*				pProgressUser;
+};
+
+struct psiso_convert_stats
+{
+	uint32_t	nSectors;						// sectors read
+	uint32_t	nWritten;						// sectors written
+	uint32_t	nZero;							// zero filled Form 2 / Mode 0 sectors
+	uint32_t	nBadEDC;						// sectors with a bad EDC
+	uint32_t	nTypes[PSISO_SECTOR_TYPES];		// sectors per PSISO_SECTOR_*
+	int			nThreads;						// workers used
+};
+
+// Initialize the options with the default settings
+void psxConvertOptsInit(psiso_convert_opts* opts);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and bad sectors go to its log sink)
+(in)	szImage			- Raw image (BIN, or CUE sheet: its first data track is converted)
+(in)	szOut			- ISO to create (overwritten if it exists)
+(in)	opts			- Options (see psxConvertOptsInit())
+(out)	stats			- Sector counts
+
+(out)	return			- Will return 1 for success and 0 if the image could not be read, is not
+						  made of raw sectors, has audio / Form 2 sectors, bad sectors (without
+						  bForce) or the ISO could not be written (it is deleted then).
+-------------------------------------------------------------------------------------------------
+*/
+int psxConvertToISO(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_convert_opts* opts, psiso_convert_stats* stats);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and details go to its log sink)
+(in)	szImage			- Image with 2048 byte sectors (ISO, or CSO / ZSO)
+(in)	szOut			- Raw image to create (overwritten if it exists)
+(in)	opts			- Options (see psxConvertOptsInit(), bForce is not used)
+(out)	stats			- Sector counts
+
+(out)	return			- Will return 1 for success and 0 if the image could not be read, its size
+						  is not a multiple of 2048 or the raw image could not be written (it is
+						  deleted then).
+-------------------------------------------------------------------------------------------------
+*/
+int psxConvertToRaw(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_convert_opts* opts, psiso_convert_stats* stats);
+
+#endif
@@ -0,0 +1,1062 @@
+// ------------------------------------------------------------------------------
+// Compressed image module (CSO / ZSO)
+// ------------------------------------------------------------------------------
+#include "psiso_cso.h"
+#include "psiso_reader.h"
+#include "psiso_thread.h"
+
+#include <zlib.h>
+
+bool psxCSOIsHeader(const uint8_t* pHeader)
+{
+	return memcmp(pHeader, "CISO", 4) == 0 || memcmp(pHeader, "ZISO", 4) == 0;
+}
+
+int psxCSOOpen(psiso_cso* cso, psiso_cso_read_func read, void* pUser, uint64_t nFileSize)
+{
+	memset(cso, 0, sizeof(psiso_cso));
+	cso->read = read;
+	cso->pReadUser = pUser;
+
+	uint8_t hdr[PSISO_CSO_HEADER_SIZE];
+	if(read(pUser, 0, hdr, sizeof(hdr)) != sizeof(hdr) || !psxCSOIsHeader(hdr)) {
+		return 0;
+	}
+
+	cso->nFormat		= (hdr[0] == 'Z') ? PSISO_CSO_FORMAT_ZSO : PSISO_CSO_FORMAT_CSO;
+	cso->nTotalBytes	= (uint64_t)psx_le32(hdr + 0x08) | ((uint64_t)psx_le32(hdr + 0x0C) << 32);
+	cso->nBlockSize		= psx_le32(hdr + 0x10);
+	cso->nVersion		= hdr[0x14];
+	cso->nAlign			= hdr[0x15];
+
+	// some old tools leave the header size at 0
+	uint32_t nHeaderSize = psx_le32(hdr + 0x04);
+	if(nHeaderSize != 0 && nHeaderSize != PSISO_CSO_HEADER_SIZE) return 0;
+
+	if(cso->nBlockSize == 0 || cso->nBlockSize > PSISO_CSO_MAX_BLOCK_SIZE || cso->nAlign > 24 || cso->nVersion > 2) {
+		return 0;
+	}
+
+	uint64_t nBlocks = (cso->nTotalBytes + cso->nBlockSize - 1) / cso->nBlockSize;
+	if(nBlocks >= 0x3FFFFFFF || (nBlocks + 1) * 4 > nFileSize) {
+		return 0;
+	}
+	cso->nBlocks = (uint32_t)nBlocks;
+
+	size_t nIndexLen = (size_t)(nBlocks + 1) * 4;
+	uint8_t* pRaw = (uint8_t*)malloc(nIndexLen);
+	cso->pIndex = (uint32_t*)malloc(nIndexLen);
+	if(!pRaw || !cso->pIndex || read(pUser, PSISO_CSO_HEADER_SIZE, pRaw, nIndexLen) != nIndexLen) {
+		SAFE_FREE(pRaw);
+		psxCSOClose(cso);
+		return 0;
+	}
+
+	// offsets must go forward and stay inside the file, so block reads never need checking again
+	uint64_t nPrev = 0;
+	for(uint32_t i = 0; i <= cso->nBlocks; i++)
+	{
+		cso->pIndex[i] = psx_le32(pRaw + (size_t)i * 4);
+		uint64_t nPos = (uint64_t)(cso->pIndex[i] & ~PSISO_CSO_FLAG) << cso->nAlign;
+		if(nPos < nPrev || nPos > nFileSize) {
+			SAFE_FREE(pRaw);
+			psxCSOClose(cso);
+			return 0;
+		}
+		nPrev = nPos;
+	}
+	SAFE_FREE(pRaw);
+
+	// deflate never grows a block by much, compressors store those blocks as is
+	cso->nCompSize = (size_t)cso->nBlockSize * 2 + ((size_t)1 << cso->nAlign);
+	cso->pComp = (uint8_t*)malloc(cso->nCompSize);
+	cso->pCacheMem = (uint8_t*)malloc((size_t)PSISO_CSO_CACHE_BLOCKS * cso->nBlockSize);
+	if(!cso->pComp || !cso->pCacheMem) {
+		psxCSOClose(cso);
+		return 0;
+	}
+
+	for(int i = 0; i < PSISO_CSO_CACHE_BLOCKS; i++) {
+		cso->cache[i].nBlock = -1;
+		cso->cache[i].pData = cso->pCacheMem + (size_t)i * cso->nBlockSize;
+	}
+	return 1;
+}
+
+void psxCSOClose(psiso_cso* cso)
+{
+	if(cso->pInflate) {
+		inflateEnd((z_stream*)cso->pInflate);
+		SAFE_FREE(cso->pInflate);
+	}
+	SAFE_FREE(cso->pIndex);
+	SAFE_FREE(cso->pComp);
+	SAFE_FREE(cso->pCacheMem);
+}
+
+// ------------------------------------------------------------------------------
+// Block decoders
+
+int psxLZ4Decompress(const uint8_t* pSrc, size_t nSrcLen, uint8_t* pDst, size_t nDstLen)
+{
+	const uint8_t* ip = pSrc;
+	const uint8_t* pSrcEnd = pSrc + nSrcLen;
+	uint8_t* op = pDst;
+	uint8_t* pDstEnd = pDst + nDstLen;
+
+	while(ip < pSrcEnd && op < pDstEnd)
+	{
+		uint32_t nToken = *ip++;
+
+		// literals
+		size_t nLit = nToken >> 4;
+		if(nLit == 15) {
+			uint8_t b;
+			do {
+				if(ip >= pSrcEnd) return -1;
+				b = *ip++;
+				nLit += b;
+			} while(b == 255);
+		}
+		if(nLit > (size_t)(pSrcEnd - ip) || nLit > (size_t)(pDstEnd - op)) return -1;
+		memcpy(op, ip, nLit);
+		ip += nLit;
+		op += nLit;
+
+		// the last sequence has no match
+		if(ip >= pSrcEnd || op >= pDstEnd) break;
+
+		// match
+		if(pSrcEnd - ip < 2) return -1;
+		size_t nDist = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if(nDist == 0 || nDist > (size_t)(op - pDst)) return -1;
+
+		size_t nMatch = nToken & 15;
+		if(nMatch == 15) {
+			uint8_t b;
+			do {
+				if(ip >= pSrcEnd) return -1;
+				b = *ip++;
+				nMatch += b;
+			} while(b == 255);
+		}
+		nMatch += 4;
+		if(nMatch > (size_t)(pDstEnd - op)) return -1;
+
+		// byte by byte, matches may overlap the bytes they produce
+		const uint8_t* pMatch = op - nDist;
+		if(nDist >= nMatch) {
+			memcpy(op, pMatch, nMatch);
+			op += nMatch;
+		} else {
+			while(nMatch--) *op++ = *pMatch++;
+		}
+	}
+	return (int)(op - pDst);
+}
+
+static bool cso_inflate(psiso_cso* cso, const uint8_t* pSrc, size_t nSrcLen, uint8_t* pDst, size_t nDstLen)
+{
+	z_stream* zs = (z_stream*)cso->pInflate;
+	if(!zs)
+	{
+		zs = (z_stream*)calloc(1, sizeof(z_stream));
+		if(!zs) return false;
+		if(inflateInit2(zs, -15) != Z_OK) {
+			free(zs);
+			return false;
+		}
+		cso->pInflate = zs;
+	}
+	else if(inflateReset(zs) != Z_OK) {
+		return false;
+	}
+
+	zs->next_in		= (Bytef*)pSrc;
+	zs->avail_in	= (uInt)nSrcLen;
+	zs->next_out	= pDst;
+	zs->avail_out	= (uInt)nDstLen;
+
+	// blocks may be followed by alignment padding, a full output is enough
+	int ret = inflate(zs, Z_FINISH);
+	return ret != Z_DATA_ERROR && ret != Z_MEM_ERROR && zs->avail_out == 0;
+}
+
+// Decompress block nBlock into pOut (block size bytes, less for the last block)
+static bool cso_decode(psiso_cso* cso, uint32_t nBlock, uint8_t* pOut)
+{
+	uint32_t nEntry = cso->pIndex[nBlock];
+	uint64_t nPos = (uint64_t)(nEntry & ~PSISO_CSO_FLAG) << cso->nAlign;
+	uint64_t nEnd = (uint64_t)(cso->pIndex[nBlock + 1] & ~PSISO_CSO_FLAG) << cso->nAlign;
+	uint64_t nStored = nEnd - nPos;
+
+	uint64_t nOutLen = cso->nTotalBytes - (uint64_t)nBlock * cso->nBlockSize;
+	if(nOutLen > cso->nBlockSize) nOutLen = cso->nBlockSize;
+
+	bool bFlag = (nEntry & PSISO_CSO_FLAG) != 0;
+	bool bPlain = (cso->nVersion == 2) ? (nStored >= cso->nBlockSize) : bFlag;
+	bool bLZ4 = (cso->nVersion == 2) ? bFlag : (cso->nFormat == PSISO_CSO_FORMAT_ZSO);
+
+	if(bPlain) {
+		return nStored >= nOutLen && cso->read(cso->pReadUser, nPos, pOut, (size_t)nOutLen) == nOutLen;
+	}
+
+	if(nStored > cso->nCompSize) return false;
+	if(cso->read(cso->pReadUser, nPos, cso->pComp, (size_t)nStored) != nStored) return false;
+
+	if(bLZ4) {
+		return psxLZ4Decompress(cso->pComp, (size_t)nStored, pOut, (size_t)nOutLen) == (int)nOutLen;
+	}
+	return cso_inflate(cso, cso->pComp, (size_t)nStored, pOut, (size_t)nOutLen);
+}
+
+// Cached copy of block nBlock, NULL if it can not be decompressed
+static const uint8_t* cso_block(psiso_cso* cso, uint32_t nBlock)
+{
+	psiso_cso_block* victim = &cso->cache[0];
+
+	for(int i = 0; i < PSISO_CSO_CACHE_BLOCKS; i++)
+	{
+		if(cso->cache[i].nBlock == (int64_t)nBlock) {
+			cso->cache[i].nStamp = ++cso->nStamp;
+			return cso->cache[i].pData;
+		}
+		if(cso->cache[i].nStamp < victim->nStamp) {
+			victim = &cso->cache[i];
+		}
+	}
+
+	victim->nBlock = -1;
+	if(!cso_decode(cso, nBlock, victim->pData)) {
+		return NULL;
+	}
+	victim->nBlock = nBlock;
+	victim->nStamp = ++cso->nStamp;
+	return victim->pData;
+}
+
+size_t psxCSORead(psiso_cso* cso, uint64_t nOffset, void* pOut, size_t nLen)
+{
+	if(nOffset >= cso->nTotalBytes) return 0;
+	if(nLen > cso->nTotalBytes - nOffset) nLen = (size_t)(cso->nTotalBytes - nOffset);
+
+	uint8_t* out = (uint8_t*)pOut;
+	size_t nDone = 0;
+
+	while(nDone < nLen)
+	{
+		uint32_t nBlock = (uint32_t)(nOffset / cso->nBlockSize);
+		size_t nSkip = (size_t)(nOffset % cso->nBlockSize);
+		size_t nCopy = cso->nBlockSize - nSkip;
+		if(nCopy > nLen - nDone) nCopy = nLen - nDone;
+
+		// whole blocks of long reads (Ex. hashing) go straight to the destination
+		bool bCached = false;
+		for(int i = 0; i < PSISO_CSO_CACHE_BLOCKS; i++) {
+			if(cso->cache[i].nBlock == (int64_t)nBlock) bCached = true;
+		}
+		if(!bCached && nSkip == 0 && nCopy == cso->nBlockSize)
+		{
+			if(!cso_decode(cso, nBlock, out + nDone)) break;
+		}
+		else
+		{
+			const uint8_t* pBlock = cso_block(cso, nBlock);
+			if(!pBlock) break;
+			memcpy(out + nDone, pBlock + nSkip, nCopy);
+		}
+
+		nDone += nCopy;
+		nOffset += nCopy;
+	}
+	return nDone;
+}
+
+// ------------------------------------------------------------------------------
+// LZ4 block encoder (greedy, one hash probe per position)
+
+#define LZ4_MIN_MATCH		4
+#define LZ4_LAST_LITERALS	5		// the last 5 bytes are always literals
+#define LZ4_MF_LIMIT		12		// and no match starts in the last 12
+#define LZ4_HASH_BITS		12
+
+static inline uint32_t lz4_read32(const uint8_t* p)
+{
+	uint32_t n;
+	memcpy(&n, p, 4);
+	return n;
+}
+
+static uint8_t* lz4_put_len(uint8_t* op, size_t nLen)
+{
+	while(nLen >= 255) {
+		*op++ = 255;
+		nLen -= 255;
+	}
+	*op++ = (uint8_t)nLen;
+	return op;
+}
+
+// One sequence (literals + match, nMatch 0 for the last one), NULL if it does not fit
+static uint8_t* lz4_put_seq(uint8_t* op, const uint8_t* pOutEnd, const uint8_t* pLit, size_t nLit, size_t nMatch, size_t nDist)
+{
+	size_t nNeed = 1 + nLit + (nLit / 255) + 1 + (nMatch ? 2 + (nMatch / 255) + 1 : 0);
+	if(nNeed > (size_t)(pOutEnd - op)) return NULL;
+
+	uint8_t* pToken = op++;
+	*pToken = (uint8_t)((nLit >= 15 ? 15 : nLit) << 4);
+	if(nLit >= 15) op = lz4_put_len(op, nLit - 15);
+	memcpy(op, pLit, nLit);
+	op += nLit;
+
+	if(nMatch)
+	{
+		*op++ = (uint8_t)nDist;
+		*op++ = (uint8_t)(nDist >> 8);
+
+		nMatch -= LZ4_MIN_MATCH;
+		*pToken |= (uint8_t)(nMatch >= 15 ? 15 : nMatch);
+		if(nMatch >= 15) op = lz4_put_len(op, nMatch - 15);
+	}
+	return op;
+}
+
+size_t psxLZ4Compress(const uint8_t* pSrc, size_t nSrcLen, uint8_t* pDst, size_t nDstLen)
+{
+	uint32_t table[1 << LZ4_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	const uint8_t* ip = pSrc;
+	const uint8_t* anchor = pSrc;
+	const uint8_t* pEnd = pSrc + nSrcLen;
+	uint8_t* op = pDst;
+	const uint8_t* pOutEnd = pDst + nDstLen;
+
+	if(nSrcLen > LZ4_MF_LIMIT)
+	{
+		const uint8_t* pMatchStart = pEnd - LZ4_MF_LIMIT;
+		const uint8_t* pMatchEnd = pEnd - LZ4_LAST_LITERALS;
+		uint32_t nMiss = 0;
+
+		while(ip <= pMatchStart)
+		{
+			uint32_t nSeq = lz4_read32(ip);
+			uint32_t h = (nSeq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+			const uint8_t* ref = pSrc + table[h];
+			table[h] = (uint32_t)(ip - pSrc);
+
+			if(ref >= ip || ip - ref > 0xFFFF || lz4_read32(ref) != nSeq) {
+				// step up over data that does not compress
+				ip += 1 + (nMiss++ >> 6);
+				continue;
+			}
+			nMiss = 0;
+
+			size_t nMatch = LZ4_MIN_MATCH;
+			while(ip + nMatch < pMatchEnd && ip[nMatch] == ref[nMatch]) nMatch++;
+
+			op = lz4_put_seq(op, pOutEnd, anchor, (size_t)(ip - anchor), nMatch, (size_t)(ip - ref));
+			if(!op) return 0;
+
+			ip += nMatch;
+			anchor = ip;
+		}
+	}
+
+	op = lz4_put_seq(op, pOutEnd, anchor, (size_t)(pEnd - anchor), 0, 0);
+	return op ? (size_t)(op - pDst) : 0;
+}
+
+// ------------------------------------------------------------------------------
+// Compressor / decompressor
+
+#define CSO_BLOCK_PLAIN			0
+#define CSO_BLOCK_DEFLATE		1
+#define CSO_BLOCK_LZ4			2
+
+#define CSO_OUT_BUFFER_SIZE		(1024 * 1024)
+
+void psxCSOOptsInit(psiso_cso_opts* opts)
+{
+	memset(opts, 0, sizeof(psiso_cso_opts));
+	opts->nFormat		= PSISO_CSO_FORMAT_CSO;
+	opts->nVersion		= 1;
+	opts->nBlockSize	= PSISO_CSO_BLOCK_SIZE;
+	opts->nLevel		= PSISO_CSO_DEFAULT_LEVEL;
+	opts->bVerify		= true;
+}
+
+struct cso_slot
+{
+	bool		bDone;
+	bool		bFailed;
+	uint64_t	nOffset;		// first byte of the batch on the image
+	size_t		nLen;
+	uint32_t	nBlocks;
+	uint8_t*	pData;			// uncompressed batch
+	uint8_t*	pOut;			// stored blocks back to back (compressor)
+	uint32_t*	pSizes;			// stored size of each block
+	uint8_t*	pKinds;			// CSO_BLOCK_* of each block
+};
+
+struct cso_worker
+{
+	psiso_reader	r;
+	bool			bOpen;
+	z_stream*		zs;
+	uint8_t*		pDeflate;	// one block of scratch per codec
+	uint8_t*		pLZ4;
+};
+
+struct cso_job
+{
+	bool			bCompress;
+	int				nFormat;
+	uint32_t		nVersion;
+	uint32_t		nBlockSize;
+	uint32_t		nAlign;
+	int				nLevel;
+	uint64_t		nImageBytes;
+	uint32_t		nBatchBlocks;
+
+	cso_slot*		slots;
+	uint32_t		nSlots;
+	cso_worker*		workers;
+	int				nWorkers;
+	psx_mutex		m;
+	psx_sem			done;
+};
+
+// Compressed copy of one block, stored as is when neither codec makes it smaller
+static void cso_pack_block(const cso_job* job, cso_worker* w, const uint8_t* pIn, size_t nLen, uint8_t* pOut, uint32_t* pnSize, uint8_t* pnKind)
+{
+	size_t nLimit = nLen - 1;
+	if(job->nVersion == 2)
+	{
+		// v2 tells stored blocks by their size, so a compressed block must stay under the block
+		// size with its alignment padding
+		size_t nPad = ((size_t)1 << job->nAlign) - 1;
+		size_t nMax = (job->nBlockSize > nPad + 1) ? job->nBlockSize - 1 - nPad : 0;
+		if(nLimit > nMax) nLimit = nMax;
+	}
+
+	bool bDeflate	= (job->nFormat == PSISO_CSO_FORMAT_CSO);
+	bool bLZ4		= (job->nFormat == PSISO_CSO_FORMAT_ZSO || job->nVersion == 2);
+	size_t nDeflate = 0;
+	size_t nLZ4 = 0;
+
+	if(bDeflate && nLimit && deflateReset(w->zs) == Z_OK)
+	{
+		w->zs->next_in		= (Bytef*)pIn;
+		w->zs->avail_in		= (uInt)nLen;
+		w->zs->next_out		= w->pDeflate;
+		w->zs->avail_out	= (uInt)nLimit;
+		if(deflate(w->zs, Z_FINISH) == Z_STREAM_END) {
+			nDeflate = nLimit - w->zs->avail_out;
+		}
+	}
+	if(bLZ4 && nLimit) {
+		nLZ4 = psxLZ4Compress(pIn, nLen, w->pLZ4, nLimit);
+	}
+
+	// ties go to LZ4, it decodes faster
+	if(nLZ4 && (!nDeflate || nLZ4 <= nDeflate)) {
+		memcpy(pOut, w->pLZ4, nLZ4);
+		*pnSize = (uint32_t)nLZ4;
+		*pnKind = CSO_BLOCK_LZ4;
+	} else if(nDeflate) {
+		memcpy(pOut, w->pDeflate, nDeflate);
+		*pnSize = (uint32_t)nDeflate;
+		*pnKind = CSO_BLOCK_DEFLATE;
+	} else {
+		memcpy(pOut, pIn, nLen);
+		*pnSize = (uint32_t)nLen;
+		*pnKind = CSO_BLOCK_PLAIN;
+	}
+}
+
+static void cso_worker_main(void* pUser, uint32_t nJob, int nWorker)
+{
+	cso_job* job = (cso_job*)pUser;
+	cso_worker* w = &job->workers[nWorker];
+
+	// only this worker touches the slot until bDone is set
+	cso_slot* slot = &job->slots[nJob];
+
+	bool bOK = (psxReaderReadRaw(&w->r, slot->nOffset, slot->pData, slot->nLen) == slot->nLen);
+
+	if(bOK && job->bCompress)
+	{
+		size_t nOut = 0;
+		for(uint32_t i = 0; i < slot->nBlocks; i++)
+		{
+			size_t nPos = (size_t)i * job->nBlockSize;
+			size_t nLen = slot->nLen - nPos;
+			if(nLen > job->nBlockSize) nLen = job->nBlockSize;
+
+			cso_pack_block(job, w, slot->pData + nPos, nLen, slot->pOut + nOut, &slot->pSizes[i], &slot->pKinds[i]);
+			nOut += slot->pSizes[i];
+		}
+	}
+
+	psxMutexLock(job->m);
+	slot->bFailed = !bOK;
+	slot->bDone = true;
+	psxMutexUnlock(job->m);
+
+	psxSemPost(job->done);
+}
+
+// Called by the writer with every batch, in image order
+typedef int (*cso_commit_func)(cso_job* job, cso_slot* slot, void* pUser);
+
+// All the batches of the image, a window of job->nSlots at a time
+static int cso_run(cso_job* job, cso_commit_func commit, void* pUser)
+{
+	size_t nBatchLen = (size_t)job->nBatchBlocks * job->nBlockSize;
+	uint64_t nBatches = (job->nImageBytes + nBatchLen - 1) / nBatchLen;
+	int ret = 1;
+
+	for(uint64_t nFirst = 0; nFirst < nBatches && ret; nFirst += job->nSlots)
+	{
+		uint32_t nJobs = job->nSlots;
+		if(nJobs > nBatches - nFirst) nJobs = (uint32_t)(nBatches - nFirst);
+
+		for(uint32_t i = 0; i < nJobs; i++)
+		{
+			cso_slot* slot = &job->slots[i];
+			slot->bDone		= false;
+			slot->bFailed	= false;
+			slot->nOffset	= (nFirst + i) * nBatchLen;
+			slot->nLen		= (size_t)((job->nImageBytes - slot->nOffset < nBatchLen) ? job->nImageBytes - slot->nOffset : nBatchLen);
+			slot->nBlocks	= (uint32_t)((slot->nLen + job->nBlockSize - 1) / job->nBlockSize);
+		}
+
+		psx_pool* pool = psxPoolStart(nJobs, job->nWorkers, cso_worker_main, job);
+		if(!pool) return 0;
+
+		// single writer, batches go out in image order as soon as they are ready
+		uint32_t nNext = 0;
+		while(nNext < nJobs)
+		{
+			psxSemWait(job->done);
+
+			while(nNext < nJobs)
+			{
+				psxMutexLock(job->m);
+				bool bDone = job->slots[nNext].bDone;
+				psxMutexUnlock(job->m);
+				if(!bDone) break;
+
+				cso_slot* slot = &job->slots[nNext];
+				if(ret && (slot->bFailed || !commit(job, slot, pUser))) {
+					ret = 0;
+				}
+				nNext++;
+			}
+		}
+		psxPoolWait(pool);
+	}
+	return ret;
+}
+
+// Workers, slots and readers for szImage, nThreads is clamped to the number of batches
+static int cso_job_init(cso_job* job, const char* szImage, int nThreads)
+{
+	size_t nBatchLen = (size_t)job->nBatchBlocks * job->nBlockSize;
+	uint64_t nBatches = (job->nImageBytes + nBatchLen - 1) / nBatchLen;
+
+	// same worker count psxPoolStart() ends up with
+	if(nThreads <= 0) nThreads = psxCpuCount();
+	if((uint64_t)nThreads > nBatches) nThreads = (int)nBatches;
+	if(nThreads < 1) nThreads = 1;
+
+	uint64_t nSlots = (uint64_t)nThreads * PSISO_CSO_WINDOW_BATCHES;
+	if(nSlots > nBatches) nSlots = nBatches;
+
+	job->nSlots		= (uint32_t)nSlots;
+	job->slots		= (cso_slot*)calloc(job->nSlots, sizeof(cso_slot));
+	job->workers	= (cso_worker*)calloc(nThreads, sizeof(cso_worker));
+	job->m			= psxMutexCreate();
+	job->done		= psxSemCreate(0);
+	if(!job->slots || !job->workers || !job->m || !job->done) return 0;
+
+	for(uint32_t i = 0; i < job->nSlots; i++)
+	{
+		cso_slot* slot = &job->slots[i];
+		slot->pData = (uint8_t*)malloc(nBatchLen);
+		if(!slot->pData) return 0;
+
+		if(job->bCompress) {
+			slot->pOut		= (uint8_t*)malloc(nBatchLen);
+			slot->pSizes	= (uint32_t*)malloc(job->nBatchBlocks * sizeof(uint32_t));
+			slot->pKinds	= (uint8_t*)malloc(job->nBatchBlocks);
+			if(!slot->pOut || !slot->pSizes || !slot->pKinds) return 0;
+		}
+	}
+
+	job->nWorkers = nThreads;
+
+	// each worker reads through its own reader (and its own block cache on CSO sources)
+	for(int i = 0; i < nThreads; i++)
+	{
+		cso_worker* w = &job->workers[i];
+		if(!psxReaderOpen(&w->r, szImage, false)) return 0;
+		w->bOpen = true;
+		psxReaderAdvise(&w->r, 0, 0, PSISO_ADVISE_SEQUENTIAL);
+
+		if(job->bCompress)
+		{
+			w->pDeflate	= (uint8_t*)malloc(job->nBlockSize);
+			w->pLZ4		= (uint8_t*)malloc(job->nBlockSize);
+			w->zs		= (z_stream*)calloc(1, sizeof(z_stream));
+			if(!w->pDeflate || !w->pLZ4 || !w->zs) return 0;
+			if(deflateInit2(w->zs, job->nLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+				SAFE_FREE(w->zs);
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+static void cso_job_free(cso_job* job)
+{
+	if(job->slots) {
+		for(uint32_t i = 0; i < job->nSlots; i++) {
+			SAFE_FREE(job->slots[i].pData);
+			SAFE_FREE(job->slots[i].pOut);
+			SAFE_FREE(job->slots[i].pSizes);
+			SAFE_FREE(job->slots[i].pKinds);
+		}
+	}
+	if(job->workers) {
+		for(int i = 0; i < job->nWorkers; i++)
+		{
+			cso_worker* w = &job->workers[i];
+			if(w->bOpen) psxReaderClose(&w->r);
+			if(w->zs) {
+				deflateEnd(w->zs);
+				SAFE_FREE(w->zs);
+			}
+			SAFE_FREE(w->pDeflate);
+			SAFE_FREE(w->pLZ4);
+		}
+	}
+	SAFE_FREE(job->slots);
+	SAFE_FREE(job->workers);
+	if(job->m) psxMutexDestroy(job->m);
+	if(job->done) psxSemDestroy(job->done);
+}
+
+// ------------------------------------------------------------------------------
+// Output file
+
+struct cso_out
+{
+#ifdef WIN
+	FILE*		fp;
+#else
+	int			fd;
+#endif
+	bool		bOpen;
+	uint8_t*	pBuf;
+	size_t		nFill;
+	uint64_t	nPos;			// bytes handed to out_put()
+};
+
+static int out_open(cso_out* o, const char* szPath)
+{
+	memset(o, 0, sizeof(cso_out));
+	o->pBuf = (uint8_t*)malloc(CSO_OUT_BUFFER_SIZE);
+#ifdef WIN
+	o->fp = fopen(szPath, "wb");
+	o->bOpen = (o->fp != NULL);
+#else
+	o->fd = _open(szPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	o->bOpen = (o->fd != -1);
+#endif
+	return o->pBuf && o->bOpen;
+}
+
+static int out_write(cso_out* o, const uint8_t* p, size_t nLen)
+{
+#ifdef WIN
+	return fwrite(p, 1, nLen, o->fp) == nLen;
+#else
+	size_t nDone = 0;
+	while(nDone < nLen)
+	{
+		ssize_t n = _write(o->fd, p + nDone, nLen - nDone);
+		if(n <= 0) return 0;
+		nDone += (size_t)n;
+	}
+	return 1;
+#endif
+}
+
+static int out_flush(cso_out* o)
+{
+	if(!o->nFill) return 1;
+	int ret = out_write(o, o->pBuf, o->nFill);
+	o->nFill = 0;
+	return ret;
+}
+
+// p NULL writes zeros
+static int out_put(cso_out* o, const void* pData, size_t nLen)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	o->nPos += nLen;
+	while(nLen)
+	{
+		size_t n = CSO_OUT_BUFFER_SIZE - o->nFill;
+		if(n > nLen) n = nLen;
+		if(p) {
+			memcpy(o->pBuf + o->nFill, p, n);
+			p += n;
+		} else {
+			memset(o->pBuf + o->nFill, 0, n);
+		}
+		o->nFill += n;
+		nLen -= n;
+		if(o->nFill == CSO_OUT_BUFFER_SIZE && !out_flush(o)) return 0;
+	}
+	return 1;
+}
+
+// Flushed file, rewrite bytes already written (the index)
+static int out_put_at(cso_out* o, uint64_t nPos, const uint8_t* p, size_t nLen)
+{
+	if(!out_flush(o)) return 0;
+#ifdef WIN
+	if(_fseeki64(o->fp, (int64_t)nPos, SEEK_SET) != 0) return 0;
+#else
+	if(_lseek64(o->fd, nPos, SEEK_SET) == -1) return 0;
+#endif
+	return out_write(o, p, nLen);
+}
+
+// Safe to call more than once, and on an output that was never opened
+static int out_close(cso_out* o)
+{
+	int ret = 1;
+	if(o->bOpen)
+	{
+		ret = out_flush(o);
+#ifdef WIN
+		if(fclose(o->fp) != 0) ret = 0;
+#else
+		if(_close(o->fd) != 0) ret = 0;
+#endif
+		o->bOpen = false;
+	}
+	SAFE_FREE(o->pBuf);
+	return ret;
+}
+
+// ------------------------------------------------------------------------------
+// Writers
+
+struct cso_pack
+{
+	cso_out				out;
+	uint32_t*			pIndex;
+	uint32_t			nBlock;
+	psiso_sha1			sha;
+	psiso_cso_stats*	stats;
+	const psiso_cso_opts* opts;
+};
+
+static int cso_commit_pack(cso_job* job, cso_slot* slot, void* pUser)
+{
+	cso_pack* pack = (cso_pack*)pUser;
+	psiso_cso_stats* stats = pack->stats;
+	uint64_t nAlignMask = ((uint64_t)1 << job->nAlign) - 1;
+
+	psxSHA1Update(&pack->sha, slot->pData, slot->nLen);
+
+	const uint8_t* p = slot->pOut;
+	for(uint32_t i = 0; i < slot->nBlocks; i++)
+	{
+		uint32_t nSize = slot->pSizes[i];
+		int nKind = slot->pKinds[i];
+
+		// plain blocks are flagged on v1 / ZSO, LZ4 blocks on v2
+		uint32_t nEntry = (uint32_t)(pack->out.nPos >> job->nAlign);
+		if(job->nVersion == 2) {
+			if(nKind == CSO_BLOCK_LZ4) nEntry |= PSISO_CSO_FLAG;
+		} else if(nKind == CSO_BLOCK_PLAIN) {
+			nEntry |= PSISO_CSO_FLAG;
+		}
+		pack->pIndex[pack->nBlock++] = nEntry;
+
+		if(!out_put(&pack->out, p, nSize)) return 0;
+		p += nSize;
+
+		// v2 tells stored blocks by their size, a short last block is stored as a full one
+		if(job->nVersion == 2 && nKind == CSO_BLOCK_PLAIN && nSize < job->nBlockSize) {
+			if(!out_put(&pack->out, NULL, job->nBlockSize - nSize)) return 0;
+		}
+		if(pack->out.nPos & nAlignMask) {
+			if(!out_put(&pack->out, NULL, (size_t)(nAlignMask + 1 - (pack->out.nPos & nAlignMask)))) return 0;
+		}
+
+		switch(nKind) {
+			case CSO_BLOCK_PLAIN:	stats->nPlain++; break;
+			case CSO_BLOCK_DEFLATE:	stats->nDeflate++; break;
+			case CSO_BLOCK_LZ4:		stats->nLZ4++; break;
+		}
+	}
+
+	if(pack->opts->progress) {
+		pack->opts->progress(pack->opts->pProgressUser, slot->nOffset + slot->nLen, job->nImageBytes);
+	}
+	return 1;
+}
+
+struct cso_unpack
+{
+	cso_out				out;
+	bool				bOut;
+	psiso_sha1			sha;
+	const psiso_cso_opts* opts;
+};
+
+static int cso_commit_unpack(cso_job* job, cso_slot* slot, void* pUser)
+{
+	cso_unpack* unpack = (cso_unpack*)pUser;
+
+	psxSHA1Update(&unpack->sha, slot->pData, slot->nLen);
+	if(unpack->bOut && !out_put(&unpack->out, slot->pData, slot->nLen)) return 0;
+
+	if(unpack->opts->progress) {
+		unpack->opts->progress(unpack->opts->pProgressUser, slot->nOffset + slot->nLen, job->nImageBytes);
+	}
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+// Compress / decompress
+
+int psxCSOCompress(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_cso_opts* opts, psiso_cso_stats* stats)
+{
+	memset(stats, 0, sizeof(psiso_cso_stats));
+
+	if(opts->nBlockSize == 0 || (opts->nBlockSize % PSISO_SECTOR_SIZE) != 0 || opts->nBlockSize > PSISO_CSO_MAX_BLOCK_SIZE ||
+		opts->nVersion < 1 || opts->nVersion > 2 || (opts->nFormat == PSISO_CSO_FORMAT_ZSO && opts->nVersion != 1))
+	{
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Invalid compression settings (block size / version). \n");
+		return 0;
+	}
+
+	psiso_reader r;
+	if(!psxReaderOpen(&r, szImage, false)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szImage);
+		return 0;
+	}
+	uint64_t nImageBytes = r.nFileSize;
+	psxReaderClose(&r);
+
+	uint64_t nBlocks = (nImageBytes + opts->nBlockSize - 1) / opts->nBlockSize;
+	if(nBlocks == 0 || nBlocks >= 0x3FFFFFFF) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is empty or too big to compress. \n", szImage);
+		return 0;
+	}
+
+	cso_job job;
+	memset(&job, 0, sizeof(cso_job));
+	job.bCompress	= true;
+	job.nFormat		= opts->nFormat;
+	job.nVersion	= opts->nVersion;
+	job.nBlockSize	= opts->nBlockSize;
+	job.nLevel		= (opts->nLevel < 1 || opts->nLevel > 9) ? PSISO_CSO_DEFAULT_LEVEL : opts->nLevel;
+	job.nImageBytes	= nImageBytes;
+	job.nBatchBlocks = (opts->nBlockSize >= PSISO_CSO_BATCH_SIZE) ? 1 : PSISO_CSO_BATCH_SIZE / opts->nBlockSize;
+
+	// index entries are 31 bit, big images need the offsets aligned (worst case: every block stored
+	// as is with a full alignment padding)
+	uint64_t nIndexEnd = PSISO_CSO_HEADER_SIZE + (nBlocks + 1) * 4;
+	while((nIndexEnd + nBlocks * ((uint64_t)opts->nBlockSize + ((uint64_t)1 << job.nAlign))) >> job.nAlign >= PSISO_CSO_FLAG) {
+		job.nAlign++;
+	}
+
+	cso_pack pack;
+	memset(&pack, 0, sizeof(cso_pack));
+	pack.stats	= stats;
+	pack.opts	= opts;
+	pack.pIndex	= (uint32_t*)malloc((size_t)(nBlocks + 1) * sizeof(uint32_t));
+	psxSHA1Init(&pack.sha);
+
+	int ret = 0;
+	bool bCreated = false;
+
+	if(!pack.pIndex || !cso_job_init(&job, szImage, opts->nThreads)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Not enough memory to compress \"%s\". \n", szImage);
+		goto done;
+	}
+
+	bCreated = true;
+	if(!out_open(&pack.out, szOut)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOut);
+		goto done;
+	}
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Compressing \"%s\" to %s v%u (%u byte blocks, align %u, level %d, %d threads) \n", szImage,
+		job.nFormat == PSISO_CSO_FORMAT_ZSO ? "ZSO" : "CSO", job.nVersion, job.nBlockSize, job.nAlign, job.nLevel, job.nWorkers);
+
+	{
+		uint8_t hdr[PSISO_CSO_HEADER_SIZE];
+		ZERO(hdr);
+		memcpy(hdr, job.nFormat == PSISO_CSO_FORMAT_ZSO ? "ZISO" : "CISO", 4);
+		hdr[0x04] = PSISO_CSO_HEADER_SIZE;
+		for(int i = 0; i < 8; i++) hdr[0x08 + i] = (uint8_t)(nImageBytes >> (i * 8));
+		for(int i = 0; i < 4; i++) hdr[0x10 + i] = (uint8_t)(job.nBlockSize >> (i * 8));
+		hdr[0x14] = (uint8_t)job.nVersion;
+		hdr[0x15] = (uint8_t)job.nAlign;
+
+		// the index is written once all the blocks are in place, the first block is aligned too
+		uint64_t nAlignMask = ((uint64_t)1 << job.nAlign) - 1;
+		uint64_t nFirst = (nIndexEnd + nAlignMask) & ~nAlignMask;
+		if(!out_put(&pack.out, hdr, sizeof(hdr)) || !out_put(&pack.out, NULL, (size_t)(nFirst - sizeof(hdr)))) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot write \"%s\". \n", szOut);
+			goto done;
+		}
+	}
+
+	if(!cso_run(&job, cso_commit_pack, &pack)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not compress \"%s\" (read / write failed). \n", szImage);
+		goto done;
+	}
+	pack.pIndex[pack.nBlock] = (uint32_t)(pack.out.nPos >> job.nAlign);
+
+	{
+		// little-endian in place
+		uint8_t* p = (uint8_t*)pack.pIndex;
+		for(uint64_t i = 0; i <= nBlocks; i++) {
+			uint32_t n = pack.pIndex[i];
+			p[i * 4 + 0] = (uint8_t)n;
+			p[i * 4 + 1] = (uint8_t)(n >> 8);
+			p[i * 4 + 2] = (uint8_t)(n >> 16);
+			p[i * 4 + 3] = (uint8_t)(n >> 24);
+		}
+		stats->nOutBytes = pack.out.nPos;
+		if(!out_put_at(&pack.out, PSISO_CSO_HEADER_SIZE, p, (size_t)(nBlocks + 1) * 4) || !out_close(&pack.out)) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot write \"%s\". \n", szOut);
+			goto done;
+		}
+	}
+
+	psxSHA1Final(&pack.sha, stats->sha1);
+	stats->nInBytes		= nImageBytes;
+	stats->nImageBytes	= nImageBytes;
+	stats->nBlocks		= (uint32_t)nBlocks;
+	stats->nThreads		= job.nWorkers;
+	ret = 1;
+
+done:
+	out_close(&pack.out);
+	cso_job_free(&job);
+	SAFE_FREE(pack.pIndex);
+
+	if(ret && opts->bVerify)
+	{
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Verifying \"%s\" \n", szOut);
+
+		psiso_cso_stats check;
+		if(!psxCSODecompress(ctx, szOut, NULL, opts, &check) || check.nImageBytes != nImageBytes ||
+			memcmp(check.sha1, stats->sha1, PSISO_SHA1_SIZE) != 0)
+		{
+			psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" does not decompress to the source image. \n", szOut);
+			ret = 0;
+		}
+		stats->bVerified = (ret == 1);
+	}
+
+	if(!ret && bCreated) {
+		remove(szOut);
+	}
+	return ret;
+}
+
+int psxCSODecompress(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_cso_opts* opts, psiso_cso_stats* stats)
+{
+	memset(stats, 0, sizeof(psiso_cso_stats));
+
+	psiso_reader r;
+	if(!psxReaderOpen(&r, szImage, false)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szImage);
+		return 0;
+	}
+	if(!r.cso) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is not a CSO / ZSO image. \n", szImage);
+		psxReaderClose(&r);
+		return 0;
+	}
+
+	cso_job job;
+	memset(&job, 0, sizeof(cso_job));
+	job.nFormat		= r.cso->nFormat;
+	job.nVersion	= r.cso->nVersion;
+	job.nBlockSize	= r.cso->nBlockSize;
+	job.nAlign		= r.cso->nAlign;
+	job.nImageBytes	= r.cso->nTotalBytes;
+	job.nBatchBlocks = (job.nBlockSize >= PSISO_CSO_BATCH_SIZE) ? 1 : PSISO_CSO_BATCH_SIZE / job.nBlockSize;
+
+	stats->nInBytes	= (uint64_t)(r.cso->pIndex[r.cso->nBlocks] & ~PSISO_CSO_FLAG) << r.cso->nAlign;
+	stats->nBlocks	= r.cso->nBlocks;
+	psxReaderClose(&r);
+
+	cso_unpack unpack;
+	memset(&unpack, 0, sizeof(cso_unpack));
+	unpack.opts = opts;
+	psxSHA1Init(&unpack.sha);
+
+	int ret = 0;
+
+	if(job.nImageBytes == 0) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is empty. \n", szImage);
+		return 0;
+	}
+	if(!cso_job_init(&job, szImage, opts->nThreads)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Not enough memory to decompress \"%s\". \n", szImage);
+		goto done;
+	}
+
+	if(szOut)
+	{
+		unpack.bOut = true;
+		if(!out_open(&unpack.out, szOut)) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOut);
+			goto done;
+		}
+	}
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Decompressing \"%s\" (%s v%u, %u byte blocks, %d threads) \n", szImage,
+		job.nFormat == PSISO_CSO_FORMAT_ZSO ? "ZSO" : "CSO", job.nVersion, job.nBlockSize, job.nWorkers);
+
+	if(!cso_run(&job, cso_commit_unpack, &unpack)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not decompress \"%s\" (damaged block or write failed). \n", szImage);
+		goto done;
+	}
+	if(unpack.bOut && !out_close(&unpack.out)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot write \"%s\". \n", szOut);
+		goto done;
+	}
+
+	psxSHA1Final(&unpack.sha, stats->sha1);
+	stats->nOutBytes	= unpack.bOut ? job.nImageBytes : 0;
+	stats->nImageBytes	= job.nImageBytes;
+	stats->nThreads		= job.nWorkers;
+	ret = 1;
+
+done:
+	out_close(&unpack.out);
+	cso_job_free(&job);
+
+	if(!ret && szOut) {
+		remove(szOut);
+	}
+	return ret;
+}
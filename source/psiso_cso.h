@@ -0,0 +1,174 @@
+#ifndef PSISO_CSO_H
+#define PSISO_CSO_H
+
+#include "psiso_tool.h"
+#include "psiso_hash.h"
+
+// ------------------------------------------------------------------------------------------------
+// Compressed image module (CSO / ZSO)
+// ------------------------------------------------------------------------------------------------
+// PSP and PS2 libraries are often stored compressed, the image is split in fixed size blocks and
+// every block is compressed on its own so any sector can be reached without decompressing the
+// blocks before it:
+//
+//	0x00	"CISO" (CSO) or "ZISO" (ZSO)
+//	0x04	uint32		Header size (0x18)
+//	0x08	uint64		Size of the uncompressed image
+//	0x10	uint32		Block size (2048 on CSO v1 / ZSO)
+//	0x14	uint8		Version (1 or 2)
+//	0x15	uint8		Index alignment (offsets are stored >> align)
+//	0x18	uint32		Index, one entry per block + 1 (end of the last block)
+//
+// Index entries are (offset >> align) | flag, the flag (bit 31) means:
+//
+//	CSO v1 / ZSO	block stored as is
+//	CSO v2			block compressed with LZ4 instead of deflate (blocks stored as is are the
+//					ones whose compressed size is the block size or more)
+//
+// Deflate blocks are raw deflate streams (zlib), LZ4 blocks are raw LZ4 blocks (decoded in
+// tree). All values are little-endian.
+//
+// psxCSOOpen() loads the index once, psxCSORead() then serves any byte range of the image: only
+// the blocks touched are read and decompressed, the last PSISO_CSO_CACHE_BLOCKS of them are kept
+// in an LRU cache (directory sectors, PARAM.SFO, etc... are hit again and again by a probe).
+// The sector reader uses it transparently, see psxReaderOpen().
+//
+// psxCSOCompress() / psxCSODecompress() convert whole images. The image is cut in batches of
+// blocks (PSISO_CSO_BATCH_SIZE) that the workers compress / decompress in parallel, each with its
+// own reader, while the calling thread writes the finished batches in image order (index entries,
+// payload, alignment) and hashes the uncompressed data. Only a window of PSISO_CSO_WINDOW_BATCHES
+// batches per worker is ever in memory. Blocks that do not get smaller are stored as is.
+
+#define PSISO_CSO_HEADER_SIZE		0x18
+#define PSISO_CSO_CACHE_BLOCKS		16
+#define PSISO_CSO_MAX_BLOCK_SIZE	(1024 * 1024)
+
+#define PSISO_CSO_FORMAT_CSO		0	// "CISO"
+#define PSISO_CSO_FORMAT_ZSO		1	// "ZISO"
+
+#define PSISO_CSO_FLAG				0x80000000
+
+#define PSISO_CSO_BLOCK_SIZE		2048				// default block size (one sector)
+#define PSISO_CSO_BATCH_SIZE		(1024 * 1024)		// uncompressed bytes per job
+#define PSISO_CSO_WINDOW_BATCHES	4					// batches in flight per worker
+#define PSISO_CSO_DEFAULT_LEVEL		9					// deflate level
+
+// Reads nLen bytes of the compressed file at nOffset, returns the number of bytes read
+typedef size_t (*psiso_cso_read_func)(void* pUser, uint64_t nOffset, void* pOut, size_t nLen);
+
+struct psiso_cso_block
+{
+	int64_t		nBlock;		// block index on the image (-1 if unused)
+	uint32_t	nStamp;		// last access (LRU)
+	uint8_t*	pData;
+};
+
+struct psiso_cso
+{
+	int					nFormat;		// PSISO_CSO_FORMAT_*
+	uint32_t			nVersion;
+	uint64_t			nTotalBytes;	// size of the uncompressed image
+	uint32_t			nBlockSize;
+	uint32_t			nAlign;
+	uint32_t			nBlocks;
+	uint32_t*			pIndex;			// nBlocks + 1 entries
+
+	psiso_cso_read_func	read;
+	void*				pReadUser;
+
+	uint8_t*			pComp;			// compressed block buffer
+	size_t				nCompSize;
+	void*				pInflate;		// z_stream, created on the first deflate block
+
+	uint32_t			nStamp;
+	uint8_t*			pCacheMem;
+	psiso_cso_block		cache[PSISO_CSO_CACHE_BLOCKS];
+};
+
+// True if pHeader (at least 4 bytes) starts with the CSO / ZSO magic
+bool psxCSOIsHeader(const uint8_t* pHeader);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(out)	cso				- Compressed image, release with psxCSOClose()
+(in)	read			- Reads bytes of the compressed file
+(in)	pUser			- User data passed to read
+(in)	nFileSize		- Size of the compressed file (the index is checked against it)
+
+(out)	return			- Will return 1 for success and 0 if the header or the index are not valid.
+-------------------------------------------------------------------------------------------------
+*/
+int psxCSOOpen(psiso_cso* cso, psiso_cso_read_func read, void* pUser, uint64_t nFileSize);
+void psxCSOClose(psiso_cso* cso);
+
+// Bytes [nOffset, nOffset + nLen) of the uncompressed image, returns the number of bytes read
+// (less than nLen at the end of the image or if a block is damaged)
+size_t psxCSORead(psiso_cso* cso, uint64_t nOffset, void* pOut, size_t nLen);
+
+// -----------------------------------------------------------------------------------------------
+// Compressor / decompressor
+// -----------------------------------------------------------------------------------------------
+struct psiso_cso_opts
+{
+	int					nFormat;		// PSISO_CSO_FORMAT_* (CSO)
+	uint32_t			nVersion;		// 1 or 2, ZSO is always 1 (1)
+	uint32_t			nBlockSize;		// multiple of 2048 up to PSISO_CSO_MAX_BLOCK_SIZE (PSISO_CSO_BLOCK_SIZE)
+	int					nLevel;			// deflate level 1-9 (PSISO_CSO_DEFAULT_LEVEL)
+	int					nThreads;		// 0 = one per CPU
+	bool				bVerify;		// decompress the new image and compare it with the source (true)
+	psiso_progress_func	progress;		// called as batches are written (optional)
+	void*				pProgressUser;
+};
+
+struct psiso_cso_stats
+{
+	uint64_t	nInBytes;				// bytes read (compressed size when decompressing)
+	uint64_t	nOutBytes;				// bytes written
+	uint64_t	nImageBytes;			// size of the uncompressed image
+	uint32_t	nBlocks;
+	uint32_t	nPlain;					// blocks stored as is
+	uint32_t	nDeflate;
+	uint32_t	nLZ4;
+	int			nThreads;				// workers used
+	uint8_t		sha1[PSISO_SHA1_SIZE];	// of the uncompressed image
+	bool		bVerified;				// new image decompressed to the same SHA-1
+};
+
+// Initialize the options with the default settings
+void psxCSOOptsInit(psiso_cso_opts* opts);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and details go to its log sink)
+(in)	szImage			- Image to compress (ISO, BIN, or a CSO / ZSO to convert)
+(in)	szOut			- Compressed image to create (overwritten if it exists)
+(in)	opts			- Options (see psxCSOOptsInit())
+(out)	stats			- Sizes, block counts and SHA-1 of the image
+
+(out)	return			- Will return 1 for success and 0 for failure (the partial image, or one
+						  that fails the verification, is deleted).
+-------------------------------------------------------------------------------------------------
+*/
+int psxCSOCompress(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_cso_opts* opts, psiso_cso_stats* stats);
+
+// Same as psxCSOCompress() the other way, szImage must be a CSO / ZSO. With szOut NULL nothing is
+// written, the image is only decompressed and hashed (verification). Only nThreads, progress and
+// pProgressUser are used from opts.
+int psxCSODecompress(psiso_ctx* ctx, const char* szImage, const char* szOut, const psiso_cso_opts* opts, psiso_cso_stats* stats);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	pSrc			- Raw LZ4 block
+(in)	nSrcLen			- Length of pSrc (trailing padding is ignored once pDst is full)
+(out)	pDst			- Output buffer
+(in)	nDstLen			- Size of pDst
+
+(out)	return			- Number of bytes decoded, or -1 if the block is corrupt.
+-------------------------------------------------------------------------------------------------
+*/
+int psxLZ4Decompress(const uint8_t* pSrc, size_t nSrcLen, uint8_t* pDst, size_t nDstLen);
+
+// Raw LZ4 block of pSrc into pDst, returns the compressed size or 0 if it does not fit in nDstLen
+size_t psxLZ4Compress(const uint8_t* pSrc, size_t nSrcLen, uint8_t* pDst, size_t nDstLen);
+
+#endif
@@ -0,0 +1,377 @@
+// ------------------------------------------------------------------------------
+// CUE sheet module
+// ------------------------------------------------------------------------------
+#include "psiso_cue.h"
+
+#define CUE_MAX_TOKEN		1024
+
+// state of one TRACK while the sheet is parsed (frames are relative to the start of its FILE)
+struct cue_track_info
+{
+	int64_t		nIndex0;		// INDEX 00, -1 if none
+	int64_t		nIndex1;		// INDEX 01, -1 if none
+	uint32_t	nPregap;		// PREGAP (not on the file)
+	uint32_t	nPostgap;		// POSTGAP (not on the file)
+};
+
+static const struct {
+	const char*	szName;
+	int			nType;
+	uint32_t	nSectorSize;
+	uint32_t	nSectorHeader;
+} track_types[] = {
+	{ "AUDIO",		PSISO_TRACK_AUDIO,		PSISO_RAW_SECTOR_SIZE,	0 },
+	{ "MODE1/2048",	PSISO_TRACK_MODE1_2048,	PSISO_SECTOR_SIZE,		0 },
+	{ "MODE1/2352",	PSISO_TRACK_MODE1_2352,	PSISO_RAW_SECTOR_SIZE,	0x10 },
+	{ "MODE2/2336",	PSISO_TRACK_MODE2_2336,	0x920,					0x08 },
+	{ "MODE2/2352",	PSISO_TRACK_MODE2_2352,	PSISO_RAW_SECTOR_SIZE,	PSISO_RAW_SECTOR_HEADER },
+};
+
+static bool cue_equal(const char* a, const char* b)
+{
+	for(; *a && *b; a++, b++) {
+		char ca = (*a >= 'a' && *a <= 'z') ? (char)(*a - ('a' - 'A')) : *a;
+		char cb = (*b >= 'a' && *b <= 'z') ? (char)(*b - ('a' - 'A')) : *b;
+		if(ca != cb) return false;
+	}
+	return *a == *b;
+}
+
+bool psxCUEIsSheet(const char* szPath)
+{
+	const char* ext = strrchr(szPath, '.');
+	return ext && cue_equal(ext, ".cue");
+}
+
+const char* psxCUETrackType(int nType)
+{
+	for(size_t i = 0; i < sizeof(track_types) / sizeof(track_types[0]); i++) {
+		if(track_types[i].nType == nType) return track_types[i].szName;
+	}
+	return "";
+}
+
+// Next token of the line (quoted strings keep their spaces), false at the end of the line
+static bool cue_token(const char** pp, char* szOut)
+{
+	const char* p = *pp;
+	while(*p == ' ' || *p == '\t') p++;
+	if(!*p || *p == '\r' || *p == '\n') {
+		*pp = p;
+		return false;
+	}
+
+	size_t nLen = 0;
+	if(*p == '"')
+	{
+		p++;
+		while(*p && *p != '"' && *p != '\r' && *p != '\n') {
+			if(nLen < CUE_MAX_TOKEN - 1) szOut[nLen++] = *p;
+			p++;
+		}
+		if(*p == '"') p++;
+	}
+	else
+	{
+		while(*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+			if(nLen < CUE_MAX_TOKEN - 1) szOut[nLen++] = *p;
+			p++;
+		}
+	}
+	szOut[nLen] = 0;
+	*pp = p;
+	return true;
+}
+
+// "mm:ss:ff" to frames, -1 if malformed
+static int64_t cue_msf(const char* sz)
+{
+	uint32_t n[3] = { 0, 0, 0 };
+	int nField = 0;
+	bool bDigit = false;
+
+	for(; *sz; sz++)
+	{
+		if(*sz >= '0' && *sz <= '9') {
+			n[nField] = n[nField] * 10 + (uint32_t)(*sz - '0');
+			if(n[nField] > 100000) return -1;
+			bDigit = true;
+		} else if(*sz == ':' && bDigit && nField < 2) {
+			nField++;
+			bDigit = false;
+		} else {
+			return -1;
+		}
+	}
+	if(nField != 2 || !bDigit || n[1] >= 60 || n[2] >= 75) return -1;
+	return ((int64_t)n[0] * 60 + n[1]) * 75 + n[2];
+}
+
+// FILE names are relative to the directory of the sheet
+static void cue_resolve(const char* szSheet, const char* szName, char* szOut, size_t nOutSize)
+{
+	bool bAbsolute = (szName[0] == '/' || szName[0] == '\\' || (szName[0] && szName[1] == ':'));
+
+	size_t nDirLen = 0;
+	if(!bAbsolute) {
+		for(size_t i = 0; szSheet[i]; i++) {
+			if(szSheet[i] == '/' || szSheet[i] == '\\') nDirLen = i + 1;
+		}
+	}
+	if(nDirLen >= nOutSize) nDirLen = 0;
+
+	memcpy(szOut, szSheet, nDirLen);
+	size_t nLen = nDirLen;
+	for(const char* p = szName; *p && nLen < nOutSize - 1; p++) {
+#ifdef WIN
+		szOut[nLen++] = (*p == '/') ? '\\' : *p;
+#else
+		szOut[nLen++] = (*p == '\\') ? '/' : *p;
+#endif
+	}
+	szOut[nLen] = 0;
+}
+
+static int cue_fail(psiso_ctx* ctx, psiso_cue* cue, const char* szPath, uint32_t nLine, const char* szWhat)
+{
+	if(nLine) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: %s on line %u of \"%s\". \n", szWhat, nLine, szPath);
+	} else {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: %s on \"%s\". \n", szWhat, szPath);
+	}
+	psxCUEFree(cue);
+	return 0;
+}
+
+int psxCUELoad(psiso_ctx* ctx, psiso_cue* cue, const char* szPath)
+{
+	memset(cue, 0, sizeof(psiso_cue));
+	cue->bNoMap = ctx->bNoMap;
+
+	psiso_reader r;
+	if(!psxReaderOpenEx(&r, szPath, 0, (uint64_t)-1, !ctx->bNoMap)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szPath);
+		return 0;
+	}
+	char* pText = NULL;
+	size_t nLen = (size_t)r.nFileSize;
+	if(r.nFileSize <= PSISO_CUE_MAX_SIZE) {
+		pText = (char*)malloc(nLen + 1);
+	}
+	if(pText && psxReaderReadRaw(&r, 0, pText, nLen) != nLen) {
+		SAFE_FREE(pText);
+	}
+	psxReaderClose(&r);
+	if(!pText) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is not a CUE sheet. \n", szPath);
+		return 0;
+	}
+	pText[nLen] = 0;
+
+	cue->pFiles = (psiso_cue_file*)calloc(PSISO_CUE_MAX_TRACKS, sizeof(psiso_cue_file));
+	if(!cue->pFiles) {
+		free(pText);
+		return 0;
+	}
+
+	cue_track_info info[PSISO_CUE_MAX_TRACKS];
+	memset(info, 0, sizeof(info));
+
+	char szToken[CUE_MAX_TOKEN];
+	char szArg[CUE_MAX_TOKEN];
+	uint32_t nLine = 0;
+	const char* p = pText;
+
+	// skip an UTF-8 BOM
+	if(nLen >= 3 && (uint8_t)p[0] == 0xEF && (uint8_t)p[1] == 0xBB && (uint8_t)p[2] == 0xBF) p += 3;
+
+	while(*p)
+	{
+		nLine++;
+		const char* pNext = p;
+		while(*pNext && *pNext != '\n') pNext++;
+		if(*pNext) pNext++;
+
+		psiso_cue_track* track = cue->nTracks ? &cue->tracks[cue->nTracks - 1] : NULL;
+		cue_track_info* ti = cue->nTracks ? &info[cue->nTracks - 1] : NULL;
+
+		if(!cue_token(&p, szToken)) {
+			p = pNext;
+			continue;
+		}
+
+		if(cue_equal(szToken, "FILE"))
+		{
+			if(cue->nFiles == PSISO_CUE_MAX_TRACKS || !cue_token(&p, szArg)) {
+				free(pText);
+				return cue_fail(ctx, cue, szPath, nLine, "Invalid FILE");
+			}
+			if(cue_token(&p, szToken) && !cue_equal(szToken, "BINARY") && !cue_equal(szToken, "MOTOROLA")) {
+				free(pText);
+				return cue_fail(ctx, cue, szPath, nLine, "Unsupported FILE type (only BINARY images)");
+			}
+			cue_resolve(szPath, szArg, cue->pFiles[cue->nFiles].szPath, sizeof(cue->pFiles[0].szPath));
+			cue->nFiles++;
+		}
+		else if(cue_equal(szToken, "TRACK"))
+		{
+			if(!cue->nFiles || cue->nTracks == PSISO_CUE_MAX_TRACKS || !cue_token(&p, szArg) || !cue_token(&p, szToken)) {
+				free(pText);
+				return cue_fail(ctx, cue, szPath, nLine, "Invalid TRACK");
+			}
+
+			track = &cue->tracks[cue->nTracks];
+			ti = &info[cue->nTracks];
+			track->nNumber = (uint32_t)atoi(szArg);
+			track->nFile = cue->nFiles - 1;
+			ti->nIndex0 = -1;
+			ti->nIndex1 = -1;
+
+			size_t k = 0;
+			for(; k < sizeof(track_types) / sizeof(track_types[0]); k++) {
+				if(cue_equal(szToken, track_types[k].szName)) break;
+			}
+			if(k == sizeof(track_types) / sizeof(track_types[0])) {
+				free(pText);
+				return cue_fail(ctx, cue, szPath, nLine, "Unsupported TRACK type");
+			}
+			track->nType = track_types[k].nType;
+			track->nSectorSize = track_types[k].nSectorSize;
+			track->nSectorHeader = track_types[k].nSectorHeader;
+			cue->nTracks++;
+		}
+		else if(cue_equal(szToken, "INDEX") || cue_equal(szToken, "PREGAP") || cue_equal(szToken, "POSTGAP"))
+		{
+			bool bIndex = cue_equal(szToken, "INDEX");
+			int nIndex = 0;
+			if(bIndex) {
+				nIndex = cue_token(&p, szArg) ? atoi(szArg) : -1;
+			}
+
+			int64_t nFrames = cue_token(&p, szArg) ? cue_msf(szArg) : -1;
+			if(!track || nFrames < 0 || nIndex < 0) {
+				free(pText);
+				return cue_fail(ctx, cue, szPath, nLine, "Invalid INDEX / PREGAP / POSTGAP");
+			}
+
+			if(!bIndex) {
+				if(szToken[1] == 'R' || szToken[1] == 'r') ti->nPregap = (uint32_t)nFrames;
+				else ti->nPostgap = (uint32_t)nFrames;
+			} else if(nIndex == 0) {
+				ti->nIndex0 = nFrames;
+			} else if(nIndex == 1) {
+				ti->nIndex1 = nFrames;
+			}
+		}
+		// anything else (REM, CATALOG, TITLE, PERFORMER, FLAGS, ISRC, ...) is not needed
+
+		p = pNext;
+	}
+	free(pText);
+
+	if(!cue->nTracks) {
+		return cue_fail(ctx, cue, szPath, 0, "No TRACK");
+	}
+
+	for(uint32_t i = 0; i < cue->nFiles; i++)
+	{
+		if(!psxReaderOpenEx(&r, cue->pFiles[i].szPath, 0, (uint64_t)-1, !ctx->bNoMap)) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\" (listed on \"%s\"). \n", cue->pFiles[i].szPath, szPath);
+			psxCUEFree(cue);
+			return 0;
+		}
+		cue->pFiles[i].nSize = r.nFileSize;
+		psxReaderClose(&r);
+	}
+
+	// byte ranges: a track runs from its first INDEX up to the first INDEX of the next track on
+	// the same file, or up to the end of the file
+	uint64_t nFileLBA = 0;		// disc LBA of the first sector of the current file
+	uint64_t nGaps = 0;			// PREGAP / POSTGAP sectors so far
+	uint64_t nPos = 0;			// byte offset of the current track on its file
+	int64_t nStart = 0;			// frame of the current track on its file
+
+	for(uint32_t i = 0; i < cue->nTracks; i++)
+	{
+		psiso_cue_track* track = &cue->tracks[i];
+		cue_track_info* ti = &info[i];
+
+		if(ti->nIndex1 < 0 || (ti->nIndex0 > ti->nIndex1)) {
+			return cue_fail(ctx, cue, szPath, 0, "Missing or invalid INDEX 01");
+		}
+
+		int64_t nFirst = (ti->nIndex0 >= 0) ? ti->nIndex0 : ti->nIndex1;
+
+		if(i == 0 || track->nFile != cue->tracks[i - 1].nFile) {
+			nPos = (uint64_t)nFirst * track->nSectorSize;
+		} else {
+			if(nFirst < nStart) {
+				return cue_fail(ctx, cue, szPath, 0, "Tracks out of order");
+			}
+			nPos += (uint64_t)(nFirst - nStart) * cue->tracks[i - 1].nSectorSize;
+		}
+		nStart = nFirst;
+
+		uint64_t nEnd = cue->pFiles[track->nFile].nSize;
+		if(i + 1 < cue->nTracks && cue->tracks[i + 1].nFile == track->nFile) {
+			int64_t nNext = (info[i + 1].nIndex0 >= 0) ? info[i + 1].nIndex0 : info[i + 1].nIndex1;
+			if(nNext >= nFirst) {
+				nEnd = nPos + (uint64_t)(nNext - nFirst) * track->nSectorSize;
+			}
+		}
+		if(nEnd > cue->pFiles[track->nFile].nSize) nEnd = cue->pFiles[track->nFile].nSize;
+		if(nPos > nEnd) nPos = nEnd;
+
+		nGaps += ti->nPregap;
+
+		track->nFileOffset	= nPos;
+		track->nFileLen		= nEnd - nPos;
+		track->nDataOffset	= nPos + (uint64_t)(ti->nIndex1 - nFirst) * track->nSectorSize;
+		if(track->nDataOffset > nEnd) track->nDataOffset = nEnd;
+		track->nSectors		= (uint32_t)((nEnd - track->nDataOffset) / track->nSectorSize);
+		track->nLBA			= (uint32_t)(nFileLBA + nGaps + (uint64_t)ti->nIndex1);
+
+		nGaps += ti->nPostgap;
+
+		// last track of the file, the next file starts after all of its sectors
+		if(i + 1 == cue->nTracks || cue->tracks[i + 1].nFile != track->nFile)
+		{
+			uint64_t nSectors = 0;
+			for(uint32_t k = 0; k <= i; k++) {
+				const psiso_cue_track* t = &cue->tracks[k];
+				if(t->nFile != track->nFile) continue;
+				if(nSectors == 0) nSectors = t->nFileOffset / t->nSectorSize;	// data before the first track
+				nSectors += t->nFileLen / t->nSectorSize;
+			}
+			nFileLBA += nSectors;
+		}
+	}
+	return 1;
+}
+
+void psxCUEFree(psiso_cue* cue)
+{
+	SAFE_FREE(cue->pFiles);
+	cue->nFiles = 0;
+	cue->nTracks = 0;
+}
+
+int psxCUEDataTrack(const psiso_cue* cue)
+{
+	for(uint32_t i = 0; i < cue->nTracks; i++) {
+		if(cue->tracks[i].nType != PSISO_TRACK_AUDIO) return (int)i;
+	}
+	return -1;
+}
+
+int psxCUEOpenTrack(const psiso_cue* cue, uint32_t nTrack, psiso_reader* r)
+{
+	if(nTrack >= cue->nTracks) return 0;
+
+	const psiso_cue_track* track = &cue->tracks[nTrack];
+	if(!psxReaderOpenEx(r, cue->pFiles[track->nFile].szPath, track->nDataOffset, (uint64_t)track->nSectors * track->nSectorSize, !cue->bNoMap)) {
+		return 0;
+	}
+	psxReaderSetMode(r, track->nSectorSize, track->nSectorHeader);
+	return 1;
+}
@@ -0,0 +1,100 @@
+#ifndef PSISO_CUE_H
+#define PSISO_CUE_H
+
+#include "psiso_tool.h"
+#include "psiso_reader.h"
+
+// ------------------------------------------------------------------------------------------------
+// CUE sheet module
+// ------------------------------------------------------------------------------------------------
+// Multi-track discs (PS1 games with CD audio) are usually kept as a .cue plus one .bin per track
+// (Redump) or a single .bin with all the tracks. The sheet is parsed once into a track list with
+// the byte range of every track on its file and its LBA on the disc:
+//
+//	FILE "Game (Track 1).bin" BINARY
+//	  TRACK 01 MODE2/2352
+//	    INDEX 01 00:00:00
+//	FILE "Game (Track 2).bin" BINARY
+//	  TRACK 02 AUDIO
+//	    INDEX 00 00:00:00		pregap, stored on the file
+//	    INDEX 01 00:02:00
+//
+// Each track can then be opened as its own image (see psxCUEOpenTrack()), so the ISO9660 probe
+// only ever reads the data track, and hashed on its own (Redump lists one hash per track file).
+//
+// Supported track types: AUDIO, MODE1/2048, MODE1/2352, MODE2/2336 and MODE2/2352 on BINARY (or
+// MOTOROLA) files. PREGAP / POSTGAP (not stored on the files) are only counted on the LBAs.
+
+#define PSISO_CUE_MAX_TRACKS		99
+#define PSISO_CUE_MAX_SIZE			(64 * 1024)	// sheets are a few hundred bytes
+
+#define PSISO_TRACK_AUDIO			0
+#define PSISO_TRACK_MODE1_2048		1
+#define PSISO_TRACK_MODE1_2352		2
+#define PSISO_TRACK_MODE2_2336		3
+#define PSISO_TRACK_MODE2_2352		4
+
+struct psiso_cue_file
+{
+	char		szPath[1024];		// resolved against the directory of the sheet
+	uint64_t	nSize;
+};
+
+struct psiso_cue_track
+{
+	uint32_t	nNumber;			// TRACK number
+	int			nType;				// PSISO_TRACK_*
+	uint32_t	nSectorSize;		// bytes per sector on the file
+	uint32_t	nSectorHeader;		// bytes before the user data on each sector
+	uint32_t	nFile;				// index on psiso_cue::pFiles
+	uint64_t	nFileOffset;		// first byte of the track on its file (pregap included)
+	uint64_t	nFileLen;			// bytes of the track on its file (pregap included)
+	uint64_t	nDataOffset;		// INDEX 01 on the file
+	uint32_t	nSectors;			// sectors from INDEX 01 to the end of the track
+	uint32_t	nLBA;				// disc LBA of INDEX 01
+};
+
+struct psiso_cue
+{
+	psiso_cue_file*		pFiles;
+	uint32_t			nFiles;
+	psiso_cue_track		tracks[PSISO_CUE_MAX_TRACKS];
+	uint32_t			nTracks;
+	bool				bNoMap;		// tracks are not mapped (psiso_ctx::bNoMap of psxCUELoad())
+};
+
+// True if szPath has the .cue extension
+bool psxCUEIsSheet(const char* szPath);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors go to its log sink)
+(out)	cue				- Track list, release with psxCUEFree()
+(in)	szPath			- CUE sheet
+
+(out)	return			- Will return 1 for success and 0 if the sheet could not be read, has an
+						  unsupported FILE / TRACK type, or one of its files is missing.
+-------------------------------------------------------------------------------------------------
+*/
+int psxCUELoad(psiso_ctx* ctx, psiso_cue* cue, const char* szPath);
+void psxCUEFree(psiso_cue* cue);
+
+// Name of a PSISO_TRACK_* type as written on the sheet (Ex. "MODE2/2352")
+const char* psxCUETrackType(int nType);
+
+// Index on cue->tracks of the first data track, -1 if all the tracks are audio
+int psxCUEDataTrack(const psiso_cue* cue);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	cue				- Track list
+(in)	nTrack			- Index on cue->tracks
+(out)	r				- Read only reader on the track: LBA 0 is INDEX 01 of the track and the
+						  sector framing is set from the track type
+
+(out)	return			- Will return 1 for success and 0 for failure.
+-------------------------------------------------------------------------------------------------
+*/
+int psxCUEOpenTrack(const psiso_cue* cue, uint32_t nTrack, psiso_reader* r);
+
+#endif
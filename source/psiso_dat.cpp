@@ -0,0 +1,578 @@
+// ------------------------------------------------------------------------------
+// DAT identification module
+// ------------------------------------------------------------------------------
+#include "psiso_dat.h"
+#include "psiso_reader.h"
+
+#define DAT_MAX_VALUE		1024
+
+void psxDATInit(psiso_dat* dat)
+{
+	memset(dat, 0, sizeof(psiso_dat));
+}
+
+void psxDATFree(psiso_dat* dat)
+{
+	SAFE_FREE(dat->pPool);
+	SAFE_FREE(dat->pRoms);
+	SAFE_FREE(dat->pCRCSlots);
+	SAFE_FREE(dat->pSHA1Slots);
+	SAFE_FREE(dat->pSizes);
+	psxDATInit(dat);
+}
+
+const char* psxDATString(const psiso_dat* dat, uint32_t nOffset)
+{
+	return (dat->pPool && nOffset < dat->nPoolLen) ? dat->pPool + nOffset : "";
+}
+
+// ------------------------------------------------------------------------------
+// Pool / ROM list
+
+static uint32_t pool_add(psiso_dat* dat, const char* szText)
+{
+	size_t nLen = strlen(szText);
+	if(nLen == 0 && dat->nPoolLen) return 0;
+
+	if(dat->nPoolLen + nLen + 1 > dat->nPoolCapacity)
+	{
+		uint32_t nCapacity = dat->nPoolCapacity ? dat->nPoolCapacity : 64 * 1024;
+		while(dat->nPoolLen + nLen + 1 > nCapacity) nCapacity *= 2;
+		char* pPool = (char*)realloc(dat->pPool, nCapacity);
+		if(!pPool) return 0;
+		dat->pPool = pPool;
+		dat->nPoolCapacity = nCapacity;
+	}
+	if(dat->nPoolLen == 0) {
+		dat->pPool[dat->nPoolLen++] = 0; // offset 0 = ""
+		if(nLen == 0) return 0;
+	}
+
+	uint32_t nOffset = dat->nPoolLen;
+	memcpy(dat->pPool + nOffset, szText, nLen + 1);
+	dat->nPoolLen += (uint32_t)(nLen + 1);
+	return nOffset;
+}
+
+static bool rom_add(psiso_dat* dat, const psiso_dat_rom* rom)
+{
+	if(dat->nRoms == dat->nRomCapacity)
+	{
+		uint32_t nCapacity = dat->nRomCapacity ? dat->nRomCapacity * 2 : 1024;
+		psiso_dat_rom* pRoms = (psiso_dat_rom*)realloc(dat->pRoms, nCapacity * sizeof(psiso_dat_rom));
+		if(!pRoms) return false;
+		dat->pRoms = pRoms;
+		dat->nRomCapacity = nCapacity;
+	}
+	dat->pRoms[dat->nRoms++] = *rom;
+	return true;
+}
+
+// ------------------------------------------------------------------------------
+// Field values
+
+static bool parse_hex(const char* szValue, uint8_t* pOut, size_t nBytes)
+{
+	if(strlen(szValue) != nBytes * 2) return false;
+
+	for(size_t i = 0; i < nBytes * 2; i++)
+	{
+		char c = szValue[i];
+		int n = -1;
+		if(c >= '0' && c <= '9') n = c - '0';
+		if(c >= 'a' && c <= 'f') n = c - 'a' + 10;
+		if(c >= 'A' && c <= 'F') n = c - 'A' + 10;
+		if(n < 0) return false;
+
+		if(i & 1) {
+			pOut[i / 2] |= (uint8_t)n;
+		} else {
+			pOut[i / 2] = (uint8_t)(n << 4);
+		}
+	}
+	return true;
+}
+
+// one "key value" pair of a ROM (both formats use the same keys)
+static void rom_field(psiso_dat_rom* rom, const char* szKey, const char* szValue, char* szName)
+{
+	if(strcmp(szKey, "name") == 0) {
+		strncpy(szName, szValue, DAT_MAX_VALUE - 1);
+		szName[DAT_MAX_VALUE - 1] = 0;
+	}
+	else if(strcmp(szKey, "size") == 0) {
+		rom->nSize = 0;
+		for(const char* p = szValue; *p; p++) {
+			if(*p < '0' || *p > '9') {
+				rom->nSize = 0;
+				break;
+			}
+			rom->nSize = rom->nSize * 10 + (uint64_t)(*p - '0');
+		}
+	}
+	else if(strcmp(szKey, "crc") == 0) {
+		uint8_t crc[4];
+		if(parse_hex(szValue, crc, 4)) {
+			rom->nCRC32 = psx_be32(crc);
+			rom->bCRC32 = true;
+		}
+	}
+	else if(strcmp(szKey, "sha1") == 0) {
+		rom->bSHA1 = parse_hex(szValue, rom->sha1, PSISO_SHA1_SIZE);
+	}
+}
+
+static int rom_finish(psiso_dat* dat, psiso_dat_rom* rom, uint32_t nGame, const char* szName)
+{
+	if(!rom->nSize || (!rom->bCRC32 && !rom->bSHA1)) return 0;
+
+	rom->nGame = nGame;
+	rom->nName = pool_add(dat, szName);
+	return rom_add(dat, rom) ? 1 : 0;
+}
+
+// ------------------------------------------------------------------------------
+// Logiqx XML
+
+// copy an attribute value / text decoding the XML entities
+static void xml_decode(const char* p, const char* pEnd, char* szOut)
+{
+	size_t n = 0;
+	while(p < pEnd && n < DAT_MAX_VALUE - 1)
+	{
+		if(*p != '&') {
+			szOut[n++] = *p++;
+			continue;
+		}
+
+		const char* pSemi = p;
+		while(pSemi < pEnd && *pSemi != ';' && pSemi - p < 10) pSemi++;
+		if(pSemi >= pEnd || *pSemi != ';') {
+			szOut[n++] = *p++;
+			continue;
+		}
+
+		size_t nLen = (size_t)(pSemi - p) + 1;
+		unsigned long nChar = 0;
+		if(nLen == 5 && strncmp(p, "&amp;", 5) == 0) nChar = '&';
+		else if(nLen == 4 && strncmp(p, "&lt;", 4) == 0) nChar = '<';
+		else if(nLen == 4 && strncmp(p, "&gt;", 4) == 0) nChar = '>';
+		else if(nLen == 6 && strncmp(p, "&quot;", 6) == 0) nChar = '"';
+		else if(nLen == 6 && strncmp(p, "&apos;", 6) == 0) nChar = '\'';
+		else if(p[1] == '#' && (p[2] == 'x' || p[2] == 'X')) nChar = strtoul(p + 3, NULL, 16);
+		else if(p[1] == '#') nChar = strtoul(p + 2, NULL, 10);
+
+		if(nChar == 0 || nChar > 0x10FFFF || n + 4 >= DAT_MAX_VALUE) {
+			szOut[n++] = *p++;
+			continue;
+		}
+
+		// UTF-8
+		if(nChar < 0x80) {
+			szOut[n++] = (char)nChar;
+		} else if(nChar < 0x800) {
+			szOut[n++] = (char)(0xC0 | (nChar >> 6));
+			szOut[n++] = (char)(0x80 | (nChar & 0x3F));
+		} else if(nChar < 0x10000) {
+			szOut[n++] = (char)(0xE0 | (nChar >> 12));
+			szOut[n++] = (char)(0x80 | ((nChar >> 6) & 0x3F));
+			szOut[n++] = (char)(0x80 | (nChar & 0x3F));
+		} else {
+			szOut[n++] = (char)(0xF0 | (nChar >> 18));
+			szOut[n++] = (char)(0x80 | ((nChar >> 12) & 0x3F));
+			szOut[n++] = (char)(0x80 | ((nChar >> 6) & 0x3F));
+			szOut[n++] = (char)(0x80 | (nChar & 0x3F));
+		}
+		p = pSemi + 1;
+	}
+	szOut[n] = 0;
+}
+
+// next attribute of a tag, p points after the tag name, returns NULL when there are no more
+static const char* xml_attr(const char* p, const char* pEnd, char* szKey, char* szValue)
+{
+	while(p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+
+	const char* pKey = p;
+	while(p < pEnd && *p != '=' && *p != ' ' && *p != '>' && *p != '/') p++;
+	if(p >= pEnd || *p != '=' || p == pKey || p - pKey >= 32) return NULL;
+
+	memcpy(szKey, pKey, (size_t)(p - pKey));
+	szKey[p - pKey] = 0;
+
+	p++;
+	if(p >= pEnd || (*p != '"' && *p != '\'')) return NULL;
+	char cQuote = *p++;
+
+	const char* pValue = p;
+	while(p < pEnd && *p != cQuote) p++;
+	if(p >= pEnd) return NULL;
+
+	xml_decode(pValue, p, szValue);
+	return p + 1;
+}
+
+static bool xml_is_tag(const char* p, const char* pEnd, const char* szName)
+{
+	size_t nLen = strlen(szName);
+	if((size_t)(pEnd - p) <= nLen || strncmp(p, szName, nLen) != 0) return false;
+	char c = p[nLen];
+	return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '>' || c == '/');
+}
+
+static int xml_parse(psiso_dat* dat, const char* p, const char* pEnd)
+{
+	char szKey[32];
+	char* szValue = (char*)malloc(DAT_MAX_VALUE * 2);
+	if(!szValue) return -1;
+	char* szName = szValue + DAT_MAX_VALUE;
+
+	uint32_t nGame = 0;
+	int nAdded = 0;
+
+	while((p = (const char*)memchr(p, '<', (size_t)(pEnd - p))) != NULL)
+	{
+		p++;
+		const char* pTagEnd = (const char*)memchr(p, '>', (size_t)(pEnd - p));
+		if(!pTagEnd) break;
+
+		if(xml_is_tag(p, pTagEnd + 1, "game") || xml_is_tag(p, pTagEnd + 1, "machine"))
+		{
+			nGame = 0;
+			const char* pAttr = p + (p[0] == 'g' ? 4 : 7);
+			while((pAttr = xml_attr(pAttr, pTagEnd, szKey, szValue)) != NULL) {
+				if(strcmp(szKey, "name") == 0) nGame = pool_add(dat, szValue);
+			}
+		}
+		else if(xml_is_tag(p, pTagEnd + 1, "rom"))
+		{
+			psiso_dat_rom rom;
+			memset(&rom, 0, sizeof(psiso_dat_rom));
+			szName[0] = 0;
+
+			const char* pAttr = p + 3;
+			while((pAttr = xml_attr(pAttr, pTagEnd, szKey, szValue)) != NULL) {
+				rom_field(&rom, szKey, szValue, szName);
+			}
+			nAdded += rom_finish(dat, &rom, nGame, szName);
+		}
+		else if(strncmp(p, "!--", 3) == 0)
+		{
+			// comments may hold '>'
+			const char* pClose = p;
+			while(pClose + 3 <= pEnd && strncmp(pClose, "-->", 3) != 0) pClose++;
+			pTagEnd = (pClose + 3 <= pEnd) ? pClose + 2 : pEnd - 1;
+		}
+		p = pTagEnd + 1;
+	}
+
+	free(szValue);
+	return nAdded;
+}
+
+// ------------------------------------------------------------------------------
+// ClrMamePro
+
+#define CMP_END		0
+#define CMP_OPEN	1	// (
+#define CMP_CLOSE	2	// )
+#define CMP_WORD	3	// bare word or "quoted string"
+
+static int cmp_token(const char** pp, const char* pEnd, char* szOut)
+{
+	const char* p = *pp;
+	while(p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+	if(p >= pEnd) {
+		*pp = p;
+		return CMP_END;
+	}
+
+	int nType = CMP_WORD;
+	if(*p == '(' || *p == ')')
+	{
+		nType = (*p == '(') ? CMP_OPEN : CMP_CLOSE;
+		p++;
+	}
+	else if(*p == '"')
+	{
+		const char* pStart = ++p;
+		while(p < pEnd && *p != '"') p++;
+		size_t nLen = (size_t)(p - pStart);
+		if(nLen > DAT_MAX_VALUE - 1) nLen = DAT_MAX_VALUE - 1;
+		memcpy(szOut, pStart, nLen);
+		szOut[nLen] = 0;
+		if(p < pEnd) p++;
+	}
+	else
+	{
+		const char* pStart = p;
+		while(p < pEnd && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '(' && *p != ')') p++;
+		size_t nLen = (size_t)(p - pStart);
+		if(nLen > DAT_MAX_VALUE - 1) nLen = DAT_MAX_VALUE - 1;
+		memcpy(szOut, pStart, nLen);
+		szOut[nLen] = 0;
+	}
+	*pp = p;
+	return nType;
+}
+
+// skip the rest of a block whose '(' was already read
+static void cmp_skip(const char** pp, const char* pEnd, char* szTmp)
+{
+	int nDepth = 1;
+	while(nDepth > 0)
+	{
+		int nType = cmp_token(pp, pEnd, szTmp);
+		if(nType == CMP_END) return;
+		if(nType == CMP_OPEN) nDepth++;
+		if(nType == CMP_CLOSE) nDepth--;
+	}
+}
+
+static int cmp_parse(psiso_dat* dat, const char* p, const char* pEnd)
+{
+	char* szKey = (char*)malloc(DAT_MAX_VALUE * 3);
+	if(!szKey) return -1;
+	char* szValue = szKey + DAT_MAX_VALUE;
+	char* szName = szValue + DAT_MAX_VALUE;
+
+	int nAdded = 0;
+	int nType;
+
+	// top level: "keyword ( ... )"
+	while((nType = cmp_token(&p, pEnd, szKey)) != CMP_END)
+	{
+		if(nType != CMP_WORD) continue;
+		bool bGame = (strcmp(szKey, "game") == 0 || strcmp(szKey, "machine") == 0);
+
+		if(cmp_token(&p, pEnd, szValue) != CMP_OPEN) continue;
+		if(!bGame) {
+			cmp_skip(&p, pEnd, szValue);
+			continue;
+		}
+
+		uint32_t nGame = 0;
+		while((nType = cmp_token(&p, pEnd, szKey)) == CMP_WORD)
+		{
+			nType = cmp_token(&p, pEnd, szValue);
+			if(nType == CMP_OPEN && strcmp(szKey, "rom") == 0)
+			{
+				psiso_dat_rom rom;
+				memset(&rom, 0, sizeof(psiso_dat_rom));
+				szName[0] = 0;
+
+				// key value pairs up to ')'
+				while(cmp_token(&p, pEnd, szKey) == CMP_WORD) {
+					if(cmp_token(&p, pEnd, szValue) != CMP_WORD) break;
+					rom_field(&rom, szKey, szValue, szName);
+				}
+				nAdded += rom_finish(dat, &rom, nGame, szName);
+			}
+			else if(nType == CMP_OPEN) {
+				cmp_skip(&p, pEnd, szValue);
+			}
+			else if(nType == CMP_WORD && strcmp(szKey, "name") == 0) {
+				nGame = pool_add(dat, szValue);
+			}
+			else if(nType != CMP_WORD) {
+				break;
+			}
+		}
+	}
+
+	free(szKey);
+	return nAdded;
+}
+
+// ------------------------------------------------------------------------------
+// Index
+
+static uint32_t crc_key(uint64_t nSize, uint32_t nCRC32)
+{
+	return nCRC32 ^ (uint32_t)(nSize * 2654435761U) ^ (uint32_t)(nSize >> 32);
+}
+
+static void slot_insert(psiso_dat_slot* pSlots, uint32_t nSlots, uint32_t nHash, uint32_t nRom)
+{
+	uint32_t nMask = nSlots - 1;
+	for(uint32_t i = nHash & nMask; ; i = (i + 1) & nMask)
+	{
+		if(!pSlots[i].nRom) {
+			pSlots[i].nHash = nHash;
+			pSlots[i].nRom = nRom + 1;
+			return;
+		}
+	}
+}
+
+static int size_compare(const void* a, const void* b)
+{
+	uint64_t nA = *(const uint64_t*)a;
+	uint64_t nB = *(const uint64_t*)b;
+	return (nA < nB) ? -1 : (nA > nB) ? 1 : 0;
+}
+
+// rebuilt from scratch after each DAT, ROMs keep the order they were listed in
+static bool dat_index(psiso_dat* dat)
+{
+	SAFE_FREE(dat->pCRCSlots);
+	SAFE_FREE(dat->pSHA1Slots);
+	SAFE_FREE(dat->pSizes);
+	dat->nSlots = 0;
+	dat->nSizes = 0;
+
+	uint32_t nSlots = 16;
+	while(nSlots < dat->nRoms * 2) nSlots *= 2;
+
+	dat->pCRCSlots = (psiso_dat_slot*)calloc(nSlots, sizeof(psiso_dat_slot));
+	dat->pSHA1Slots = (psiso_dat_slot*)calloc(nSlots, sizeof(psiso_dat_slot));
+	dat->pSizes = (uint64_t*)malloc((dat->nRoms ? dat->nRoms : 1) * sizeof(uint64_t));
+	if(!dat->pCRCSlots || !dat->pSHA1Slots || !dat->pSizes) return false;
+	dat->nSlots = nSlots;
+
+	for(uint32_t i = 0; i < dat->nRoms; i++)
+	{
+		const psiso_dat_rom* rom = &dat->pRoms[i];
+		if(rom->bCRC32) {
+			slot_insert(dat->pCRCSlots, nSlots, crc_key(rom->nSize, rom->nCRC32), i);
+		}
+		if(rom->bSHA1) {
+			slot_insert(dat->pSHA1Slots, nSlots, psx_le32(rom->sha1), i);
+		}
+		dat->pSizes[i] = rom->nSize;
+	}
+
+	qsort(dat->pSizes, dat->nRoms, sizeof(uint64_t), size_compare);
+	for(uint32_t i = 0; i < dat->nRoms; i++) {
+		if(dat->nSizes == 0 || dat->pSizes[dat->nSizes - 1] != dat->pSizes[i]) {
+			dat->pSizes[dat->nSizes++] = dat->pSizes[i];
+		}
+	}
+	return true;
+}
+
+int psxDATLoad(psiso_dat* dat, const char* szPath)
+{
+	psiso_reader r;
+	if(!psxReaderOpen(&r, szPath, false)) return -1;
+
+	char* pText = NULL;
+	if(r.nFileSize <= PSISO_DAT_MAX_FILE) {
+		pText = (char*)malloc((size_t)r.nFileSize + 1);
+	}
+	if(pText && psxReaderReadRaw(&r, 0, pText, (size_t)r.nFileSize) != (size_t)r.nFileSize) {
+		SAFE_FREE(pText);
+	}
+	size_t nLen = (size_t)r.nFileSize;
+	psxReaderClose(&r);
+	if(!pText) return -1;
+	pText[nLen] = 0;
+
+	// XML starts with '<' (after an optional UTF-8 BOM), anything else is ClrMamePro
+	const char* p = pText;
+	const char* pEnd = pText + nLen;
+	if(nLen >= 3 && (uint8_t)p[0] == 0xEF && (uint8_t)p[1] == 0xBB && (uint8_t)p[2] == 0xBF) p += 3;
+	while(p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+
+	uint32_t nRoms = dat->nRoms;
+	uint32_t nPoolLen = dat->nPoolLen;
+
+	int nAdded = (p < pEnd && *p == '<') ? xml_parse(dat, p, pEnd) : cmp_parse(dat, p, pEnd);
+	free(pText);
+
+	if(nAdded < 0 || !dat_index(dat))
+	{
+		// back to the previous DATs
+		dat->nRoms = nRoms;
+		dat->nPoolLen = nPoolLen;
+		dat_index(dat);
+		return -1;
+	}
+	return nAdded;
+}
+
+// ------------------------------------------------------------------------------
+// Lookups
+
+bool psxDATHasSize(const psiso_dat* dat, uint64_t nSize)
+{
+	uint32_t nLow = 0;
+	uint32_t nHigh = dat->nSizes;
+	while(nLow < nHigh)
+	{
+		uint32_t nMid = nLow + (nHigh - nLow) / 2;
+		if(dat->pSizes[nMid] == nSize) return true;
+		if(dat->pSizes[nMid] < nSize) nLow = nMid + 1;
+		else nHigh = nMid;
+	}
+	return false;
+}
+
+const psiso_dat_rom* psxDATFind(const psiso_dat* dat, uint64_t nSize, uint32_t nCRC32, const uint8_t* pSHA1, int* pnStatus)
+{
+	if(pnStatus) *pnStatus = PSISO_DAT_UNKNOWN;
+	if(!dat->nSlots) return NULL;
+
+	uint32_t nMask = dat->nSlots - 1;
+	const psiso_dat_rom* bad = NULL;
+
+	// (size, CRC32), then SHA-1 when the DAT has it
+	uint32_t nHash = crc_key(nSize, nCRC32);
+	for(uint32_t i = nHash & nMask; dat->pCRCSlots[i].nRom; i = (i + 1) & nMask)
+	{
+		const psiso_dat_slot* slot = &dat->pCRCSlots[i];
+		const psiso_dat_rom* rom = &dat->pRoms[slot->nRom - 1];
+		if(slot->nHash != nHash || rom->nSize != nSize || rom->nCRC32 != nCRC32) continue;
+
+		if(!pSHA1 || !rom->bSHA1 || memcmp(rom->sha1, pSHA1, PSISO_SHA1_SIZE) == 0) {
+			if(pnStatus) *pnStatus = PSISO_DAT_MATCH;
+			return rom;
+		}
+		if(!bad) bad = rom;
+	}
+
+	// DATs with SHA-1 only
+	if(pSHA1)
+	{
+		nHash = psx_le32(pSHA1);
+		for(uint32_t i = nHash & nMask; dat->pSHA1Slots[i].nRom; i = (i + 1) & nMask)
+		{
+			const psiso_dat_slot* slot = &dat->pSHA1Slots[i];
+			const psiso_dat_rom* rom = &dat->pRoms[slot->nRom - 1];
+			if(slot->nHash == nHash && rom->nSize == nSize && memcmp(rom->sha1, pSHA1, PSISO_SHA1_SIZE) == 0) {
+				if(pnStatus) *pnStatus = PSISO_DAT_MATCH;
+				return rom;
+			}
+		}
+	}
+
+	if(bad && pnStatus) *pnStatus = PSISO_DAT_BAD;
+	return bad;
+}
+
+int psxDATIdentify(psiso_ctx* ctx, const psiso_dat* dat, const char* szPath, psiso_dat_match* match)
+{
+	memset(match, 0, sizeof(psiso_dat_match));
+
+	psiso_reader r;
+	if(!psxReaderOpen(&r, szPath, false)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szPath);
+		return 0;
+	}
+	match->nSize = r.nFileSize;
+	psxReaderClose(&r);
+
+	// most images of a library are not covered by a given DAT, do not read those
+	if(!psxDATHasSize(dat, match->nSize)) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "No ROM of %llu bytes, \"%s\" skipped \n", (unsigned long long)match->nSize, szPath);
+		match->nStatus = PSISO_DAT_SKIPPED;
+		return 1;
+	}
+
+	if(!psxHashFile(ctx, szPath, PSISO_HASH_CRC32 | PSISO_HASH_SHA1, &match->hash, NULL, NULL)) {
+		return 0;
+	}
+
+	match->rom = psxDATFind(dat, match->nSize, match->hash.nCRC32, match->hash.sha1, &match->nStatus);
+	return 1;
+}
@@ -0,0 +1,126 @@
+#ifndef PSISO_DAT_H
+#define PSISO_DAT_H
+
+#include "psiso_tool.h"
+#include "psiso_hash.h"
+
+// ------------------------------------------------------------------------------------------------
+// DAT identification module
+// ------------------------------------------------------------------------------------------------
+// Identifies images by their contents against local DAT files (Redump / No-Intro), so discs that
+// can not be identified by ID (Ex. early PS1 titles booting PSX.EXE without a SYSTEM.CNF, damaged
+// directories) still get their name, and every image gets verified.
+//
+// Both DAT formats are supported, the format is detected from the first character:
+//
+//	Logiqx XML		<game name="..."><rom name="..." size="..." crc="..." sha1="..."/></game>
+//	ClrMamePro		game ( name "..." rom ( name "..." size ... crc ... sha1 ... ) )
+//
+// Game and file names are interned in a single string pool. ROMs are indexed twice with open
+// addressing hash tables, by (size, CRC32) and by SHA-1, and the sizes of all the ROMs are kept
+// sorted: images of a size no ROM has are rejected without reading them, which skips most of a
+// library that is not covered by the DAT.
+
+#define PSISO_DAT_MAX_FILE			(512 * 1024 * 1024)
+
+#define PSISO_DAT_SKIPPED			0	// no ROM of this size, the image was not read
+#define PSISO_DAT_UNKNOWN			1	// hashed, not in the DAT
+#define PSISO_DAT_MATCH				2	// size, CRC32 and SHA-1 (when the DAT has it) match
+#define PSISO_DAT_BAD				3	// size and CRC32 match but SHA-1 does not
+
+struct psiso_dat_rom
+{
+	uint64_t	nSize;
+	uint32_t	nCRC32;
+	uint8_t		sha1[PSISO_SHA1_SIZE];
+	bool		bCRC32;		// DAT lists the CRC32
+	bool		bSHA1;		// DAT lists the SHA-1
+	uint32_t	nGame;		// game name (pool offset)
+	uint32_t	nName;		// file name (pool offset)
+};
+
+struct psiso_dat_slot
+{
+	uint32_t	nHash;
+	uint32_t	nRom;		// ROM index + 1 (0 = empty slot)
+};
+
+struct psiso_dat
+{
+	char*			pPool;			// interned strings, offset 0 is always ""
+	uint32_t		nPoolLen;
+	uint32_t		nPoolCapacity;
+
+	psiso_dat_rom*	pRoms;
+	uint32_t		nRoms;
+	uint32_t		nRomCapacity;
+
+	psiso_dat_slot*	pCRCSlots;		// by (size, CRC32)
+	psiso_dat_slot*	pSHA1Slots;		// by SHA-1
+	uint32_t		nSlots;			// power of two, per table
+
+	uint64_t*		pSizes;			// sorted, unique
+	uint32_t		nSizes;
+};
+
+struct psiso_dat_match
+{
+	int						nStatus;	// PSISO_DAT_*
+	uint64_t				nSize;
+	const psiso_dat_rom*	rom;		// PSISO_DAT_MATCH / PSISO_DAT_BAD, NULL otherwise
+	psiso_hash_result		hash;		// CRC32 and SHA-1 of the image (unless skipped)
+};
+
+// Empty index, ready for psxDATLoad()
+void psxDATInit(psiso_dat* dat);
+void psxDATFree(psiso_dat* dat);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	dat				- Index (see psxDATInit()), can be loaded with several DATs
+(in)	szPath			- DAT file (Logiqx XML or ClrMamePro)
+
+(out)	return			- Number of ROMs added, or -1 if the file could not be read (the index is
+						  left as it was). ROMs without a size or without both CRC32 and SHA-1
+						  (Ex. status="nodump") are not added.
+-------------------------------------------------------------------------------------------------
+*/
+int psxDATLoad(psiso_dat* dat, const char* szPath);
+
+// Game / file name of a ROM
+const char* psxDATString(const psiso_dat* dat, uint32_t nOffset);
+
+// True if at least one ROM has this size (cheap, no hashing needed)
+bool psxDATHasSize(const psiso_dat* dat, uint64_t nSize);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	dat				- Index
+(in)	nSize			- Size of the image in bytes
+(in)	nCRC32			- CRC32 of the image
+(in)	pSHA1			- SHA-1 of the image, or NULL to match by size and CRC32 only
+(out)	pnStatus		- PSISO_DAT_MATCH, PSISO_DAT_BAD or PSISO_DAT_UNKNOWN (optional)
+
+(out)	return			- Matching ROM (the first one listed when several DATs have it), the ROM
+						  with the same size and CRC32 for PSISO_DAT_BAD, or NULL.
+-------------------------------------------------------------------------------------------------
+*/
+const psiso_dat_rom* psxDATFind(const psiso_dat* dat, uint64_t nSize, uint32_t nCRC32, const uint8_t* pSHA1, int* pnStatus);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and details go to its log sink)
+(in)	dat				- Index
+(in)	szPath			- Image to identify
+(out)	match			- Result
+
+(out)	return			- Will return 1 when the image was checked (see match->nStatus) and 0 if
+						  it could not be opened or read.
+
+The image is only read (once, CRC32 and SHA-1 together, see psxHashFile()) when some ROM has
+its size.
+-------------------------------------------------------------------------------------------------
+*/
+int psxDATIdentify(psiso_ctx* ctx, const psiso_dat* dat, const char* szPath, psiso_dat_match* match);
+
+#endif
@@ -0,0 +1,469 @@
+// ------------------------------------------------------------------------------
+// CD-ROM sector EDC / ECC module
+// ------------------------------------------------------------------------------
+#include "psiso_ecc.h"
+#include "psiso_thread.h"
+
+#define ECC_P_COLUMNS		86		// P: 86 columns of 24 bytes (2 parity bytes each)
+#define ECC_P_ROWS			24
+#define ECC_Q_DIAGONALS		52		// Q: 52 diagonals of 43 bytes (2 parity bytes each)
+#define ECC_Q_ROWS			43
+#define ECC_Q_SIZE			(ECC_Q_DIAGONALS * ECC_Q_ROWS)	// bytes covered by Q (0x00C - 0x8C7)
+
+static psx_once ecc_once = PSX_ONCE_INIT;
+static uint32_t edc_table[8][256];
+static uint8_t ecc_f_lut[256];		// x * 2 in GF(2^8), polynomial 0x11D
+static uint8_t ecc_b_lut[256];		// x / 3
+static uint16_t ecc_q_index[ECC_Q_ROWS][ECC_Q_DIAGONALS];
+
+static const uint8_t sector_sync[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+static void ecc_init()
+{
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t nEDC = i;
+		for(int k = 0; k < 8; k++) {
+			nEDC = (nEDC >> 1) ^ ((nEDC & 1) ? 0xD8018001 : 0);
+		}
+		edc_table[0][i] = nEDC;
+
+		uint8_t f = (uint8_t)((i << 1) ^ ((i & 0x80) ? 0x11D : 0));
+		ecc_f_lut[i] = f;
+		ecc_b_lut[i ^ f] = (uint8_t)i;
+	}
+
+	for(uint32_t i = 0; i < 256; i++) {
+		for(int k = 1; k < 8; k++) {
+			edc_table[k][i] = (edc_table[k - 1][i] >> 8) ^ edc_table[0][edc_table[k - 1][i] & 0xFF];
+		}
+	}
+
+	// Q diagonals wrap around the covered area, precompute where each of their bytes is
+	for(uint32_t nMajor = 0; nMajor < ECC_Q_DIAGONALS; nMajor++)
+	{
+		uint32_t nIndex = (nMajor >> 1) * ECC_P_COLUMNS + (nMajor & 1);
+		for(uint32_t nMinor = 0; nMinor < ECC_Q_ROWS; nMinor++)
+		{
+			ecc_q_index[nMinor][nMajor] = (uint16_t)nIndex;
+			nIndex += ECC_P_COLUMNS + 2;
+			if(nIndex >= ECC_Q_SIZE) nIndex -= ECC_Q_SIZE;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+// EDC
+
+static uint32_t edc_update(uint32_t nEDC, const uint8_t* p, size_t nLen)
+{
+	// slice-by-8
+	while(nLen >= 8)
+	{
+		uint32_t a = nEDC ^ psx_le32(p);
+		uint32_t b = psx_le32(p + 4);
+		nEDC =	edc_table[7][a & 0xFF] ^ edc_table[6][(a >> 8) & 0xFF] ^
+				edc_table[5][(a >> 16) & 0xFF] ^ edc_table[4][a >> 24] ^
+				edc_table[3][b & 0xFF] ^ edc_table[2][(b >> 8) & 0xFF] ^
+				edc_table[1][(b >> 16) & 0xFF] ^ edc_table[0][b >> 24];
+		p += 8;
+		nLen -= 8;
+	}
+	while(nLen--) {
+		nEDC = (nEDC >> 8) ^ edc_table[0][(nEDC ^ *p++) & 0xFF];
+	}
+	return nEDC;
+}
+
+uint32_t psxEDC(uint32_t nEDC, const void* pData, size_t nLen)
+{
+	psxOnce(&ecc_once, ecc_init);
+	return edc_update(nEDC, (const uint8_t*)pData, nLen);
+}
+
+// ------------------------------------------------------------------------------
+// ECC
+//
+// Both codes are computed one row at a time with an accumulator pair per column / diagonal, so
+// the inner loops have no dependency between iterations (the reference walks one column at a
+// time, a lookup chain of 24 / 43 steps).
+
+// pSrc = sector + 0x00C, pP = 172 bytes
+static void ecc_compute_p(const uint8_t* pSrc, uint8_t* pP)
+{
+	uint8_t a[ECC_P_COLUMNS];
+	uint8_t b[ECC_P_COLUMNS];
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+
+	for(uint32_t nMinor = 0; nMinor < ECC_P_ROWS; nMinor++)
+	{
+		const uint8_t* pRow = pSrc + nMinor * ECC_P_COLUMNS;
+		for(uint32_t nMajor = 0; nMajor < ECC_P_COLUMNS; nMajor++) {
+			uint8_t v = pRow[nMajor];
+			a[nMajor] = ecc_f_lut[a[nMajor] ^ v];
+			b[nMajor] ^= v;
+		}
+	}
+
+	for(uint32_t nMajor = 0; nMajor < ECC_P_COLUMNS; nMajor++) {
+		uint8_t x = ecc_b_lut[ecc_f_lut[a[nMajor]] ^ b[nMajor]];
+		pP[nMajor] = x;
+		pP[nMajor + ECC_P_COLUMNS] = x ^ b[nMajor];
+	}
+}
+
+// pSrc = sector + 0x00C (P parity included), pQ = 104 bytes
+static void ecc_compute_q(const uint8_t* pSrc, uint8_t* pQ)
+{
+	uint8_t a[ECC_Q_DIAGONALS];
+	uint8_t b[ECC_Q_DIAGONALS];
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+
+	for(uint32_t nMinor = 0; nMinor < ECC_Q_ROWS; nMinor++)
+	{
+		const uint16_t* pIndex = ecc_q_index[nMinor];
+		for(uint32_t nMajor = 0; nMajor < ECC_Q_DIAGONALS; nMajor++) {
+			uint8_t v = pSrc[pIndex[nMajor]];
+			a[nMajor] = ecc_f_lut[a[nMajor] ^ v];
+			b[nMajor] ^= v;
+		}
+	}
+
+	for(uint32_t nMajor = 0; nMajor < ECC_Q_DIAGONALS; nMajor++) {
+		uint8_t x = ecc_b_lut[ecc_f_lut[a[nMajor]] ^ b[nMajor]];
+		pQ[nMajor] = x;
+		pQ[nMajor + ECC_Q_DIAGONALS] = x ^ b[nMajor];
+	}
+}
+
+// PSISO_SECTOR_ERR_ECC_* flags of a sector whose ECC area (0x00C - 0x92F) is as it was encoded
+static uint32_t ecc_check(const uint8_t* pSector)
+{
+	uint8_t parity[ECC_P_COLUMNS * 2];
+	uint32_t nErrors = 0;
+
+	ecc_compute_p(pSector + 0x00C, parity);
+	if(memcmp(parity, pSector + 0x81C, ECC_P_COLUMNS * 2) != 0) nErrors |= PSISO_SECTOR_ERR_ECC_P;
+
+	ecc_compute_q(pSector + 0x00C, parity);
+	if(memcmp(parity, pSector + 0x8C8, ECC_Q_DIAGONALS * 2) != 0) nErrors |= PSISO_SECTOR_ERR_ECC_Q;
+
+	return nErrors;
+}
+
+static void ecc_write(uint8_t* pSector)
+{
+	ecc_compute_p(pSector + 0x00C, pSector + 0x81C);
+	ecc_compute_q(pSector + 0x00C, pSector + 0x8C8);
+}
+
+// ------------------------------------------------------------------------------
+// Sectors
+
+int psxSectorType(const uint8_t* pSector)
+{
+	if(memcmp(pSector, sector_sync, sizeof(sector_sync)) != 0) {
+		return PSISO_SECTOR_AUDIO;
+	}
+
+	switch(pSector[0x00F])
+	{
+		case 1: return PSISO_SECTOR_MODE1;
+		case 2: return (pSector[0x012] & 0x20) ? PSISO_SECTOR_MODE2_FORM2 : PSISO_SECTOR_MODE2_FORM1;
+	}
+	return PSISO_SECTOR_MODE0;
+}
+
+uint32_t psxSectorVerify(const uint8_t* pSector, int* pnType)
+{
+	psxOnce(&ecc_once, ecc_init);
+
+	int nType = psxSectorType(pSector);
+	if(pnType) *pnType = nType;
+
+	uint32_t nErrors = 0;
+
+	switch(nType)
+	{
+		case PSISO_SECTOR_MODE0:
+		{
+			if(pSector[0x00F] != 0) nErrors |= PSISO_SECTOR_ERR_MODE;
+			break;
+		}
+		case PSISO_SECTOR_MODE1:
+		{
+			if(edc_update(0, pSector, 0x810) != psx_le32(pSector + 0x810)) nErrors |= PSISO_SECTOR_ERR_EDC;
+			nErrors |= ecc_check(pSector);
+			break;
+		}
+		case PSISO_SECTOR_MODE2_FORM1:
+		{
+			if(memcmp(pSector + 0x010, pSector + 0x014, 4) != 0) nErrors |= PSISO_SECTOR_ERR_SUBHEADER;
+			if(edc_update(0, pSector + 0x010, 0x808) != psx_le32(pSector + 0x818)) nErrors |= PSISO_SECTOR_ERR_EDC;
+
+			// Mode 2 parity is computed with the header taken as zero
+			uint8_t sector[PSISO_RAW_SECTOR_SIZE];
+			memcpy(sector, pSector, PSISO_RAW_SECTOR_SIZE);
+			memset(sector + 0x00C, 0, 4);
+			nErrors |= ecc_check(sector);
+			break;
+		}
+		case PSISO_SECTOR_MODE2_FORM2:
+		{
+			if(memcmp(pSector + 0x010, pSector + 0x014, 4) != 0) nErrors |= PSISO_SECTOR_ERR_SUBHEADER;
+
+			uint32_t nEDC = psx_le32(pSector + 0x92C);
+			if(nEDC && edc_update(0, pSector + 0x010, 0x91C) != nEDC) nErrors |= PSISO_SECTOR_ERR_EDC;
+			break;
+		}
+	}
+	return nErrors;
+}
+
+static void edc_write(uint8_t* p, uint32_t nEDC)
+{
+	p[0] = (uint8_t)(nEDC);
+	p[1] = (uint8_t)(nEDC >> 8);
+	p[2] = (uint8_t)(nEDC >> 16);
+	p[3] = (uint8_t)(nEDC >> 24);
+}
+
+static uint8_t to_bcd(uint32_t n)
+{
+	return (uint8_t)(((n / 10) << 4) | (n % 10));
+}
+
+void psxSectorBuild(uint8_t* pSector, uint32_t nLBA, int nType)
+{
+	psxOnce(&ecc_once, ecc_init);
+
+	uint32_t nAddress = nLBA + 150;	// 2 second pre-gap
+
+	memcpy(pSector, sector_sync, sizeof(sector_sync));
+	pSector[0x00C] = to_bcd(nAddress / (60 * 75));
+	pSector[0x00D] = to_bcd((nAddress / 75) % 60);
+	pSector[0x00E] = to_bcd(nAddress % 75);
+
+	switch(nType)
+	{
+		case PSISO_SECTOR_MODE1:
+		{
+			pSector[0x00F] = 1;
+			edc_write(pSector + 0x810, edc_update(0, pSector, 0x810));
+			memset(pSector + 0x814, 0, 8);
+			ecc_write(pSector);
+			break;
+		}
+		case PSISO_SECTOR_MODE2_FORM1:
+		{
+			pSector[0x00F] = 2;
+			edc_write(pSector + 0x818, edc_update(0, pSector + 0x010, 0x808));
+
+			uint8_t header[4];
+			memcpy(header, pSector + 0x00C, 4);
+			memset(pSector + 0x00C, 0, 4);
+			ecc_write(pSector);
+			memcpy(pSector + 0x00C, header, 4);
+			break;
+		}
+		case PSISO_SECTOR_MODE2_FORM2:
+		{
+			pSector[0x00F] = 2;
+			edc_write(pSector + 0x92C, edc_update(0, pSector + 0x010, 0x91C));
+			break;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Parallel verification
+
+struct verify_bad
+{
+	uint32_t	nLBA;
+	uint8_t		nType;
+	uint8_t		nErrors;
+};
+
+// results of one chunk, only touched by the worker that runs it
+struct verify_chunk
+{
+	bool			bFailed;	// read error
+	uint32_t		nTypes[PSISO_SECTOR_TYPES];
+	verify_bad*		pBad;
+	uint32_t		nBad;
+	uint32_t		nBadCapacity;
+};
+
+struct verify_job
+{
+	psiso_reader*	readers;	// one per worker
+	uint8_t**		ppBuffers;	// one per worker, NULL on mapped images
+	verify_chunk*	chunks;
+	uint32_t		nSectors;
+};
+
+static void verify_worker(void* pUser, uint32_t nJob, int nWorker)
+{
+	verify_job* job = (verify_job*)pUser;
+	verify_chunk* chunk = &job->chunks[nJob];
+	psiso_reader* r = &job->readers[nWorker];
+
+	uint32_t nFirst = nJob * PSISO_ECC_CHUNK_SECTORS;
+	uint32_t nCount = job->nSectors - nFirst;
+	if(nCount > PSISO_ECC_CHUNK_SECTORS) nCount = PSISO_ECC_CHUNK_SECTORS;
+
+	uint64_t nOffset = (uint64_t)nFirst * PSISO_RAW_SECTOR_SIZE;
+	size_t nLen = (size_t)nCount * PSISO_RAW_SECTOR_SIZE;
+
+	const uint8_t* pData = psxReaderViewRaw(r, nOffset, nLen);
+	if(pData) {
+		psxReaderAdvise(r, nOffset, nLen, PSISO_ADVISE_WILLNEED);
+	}
+	else
+	{
+		if(psxReaderReadRaw(r, nOffset, job->ppBuffers[nWorker], nLen) != nLen) {
+			chunk->bFailed = true;
+			return;
+		}
+		pData = job->ppBuffers[nWorker];
+	}
+
+	for(uint32_t i = 0; i < nCount; i++)
+	{
+		int nType;
+		uint32_t nErrors = psxSectorVerify(pData + (size_t)i * PSISO_RAW_SECTOR_SIZE, &nType);
+		chunk->nTypes[nType]++;
+		if(!nErrors) continue;
+
+		if(chunk->nBad == chunk->nBadCapacity)
+		{
+			uint32_t nCapacity = chunk->nBadCapacity ? chunk->nBadCapacity * 2 : 64;
+			verify_bad* pBad = (verify_bad*)realloc(chunk->pBad, nCapacity * sizeof(verify_bad));
+			if(!pBad) {
+				chunk->bFailed = true;
+				return;
+			}
+			chunk->pBad = pBad;
+			chunk->nBadCapacity = nCapacity;
+		}
+		chunk->pBad[chunk->nBad].nLBA		= nFirst + i;
+		chunk->pBad[chunk->nBad].nType		= (uint8_t)nType;
+		chunk->pBad[chunk->nBad].nErrors	= (uint8_t)nErrors;
+		chunk->nBad++;
+	}
+
+	if(r->pMap) {
+		psxReaderAdvise(r, nOffset, nLen, PSISO_ADVISE_DONTNEED);
+	}
+}
+
+int psxVerifySectors(psiso_ctx* ctx, const char* szPath, int nThreads, psiso_verify_result* res, psiso_bad_sector_func bad, void* pUser)
+{
+	memset(res, 0, sizeof(psiso_verify_result));
+	psxOnce(&ecc_once, ecc_init);
+
+	psiso_reader r;
+	if(!psxReaderOpen(&r, szPath, false)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szPath);
+		return 0;
+	}
+
+	uint64_t nFileSize = r.nFileSize;
+	psxReaderClose(&r);
+
+	if(nFileSize == 0 || (nFileSize % PSISO_RAW_SECTOR_SIZE) != 0 || nFileSize / PSISO_RAW_SECTOR_SIZE > 0xFFFFFFFF) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is not a raw (2352 bytes per sector) image. \n", szPath);
+		return 0;
+	}
+
+	verify_job job;
+	memset(&job, 0, sizeof(verify_job));
+	job.nSectors = (uint32_t)(nFileSize / PSISO_RAW_SECTOR_SIZE);
+
+	uint32_t nChunks = (job.nSectors + PSISO_ECC_CHUNK_SECTORS - 1) / PSISO_ECC_CHUNK_SECTORS;
+
+	// same worker count psxPoolStart() ends up with
+	if(nThreads <= 0) nThreads = psxCpuCount();
+	if((uint32_t)nThreads > nChunks) nThreads = (int)nChunks;
+	if(nThreads < 1) nThreads = 1;
+
+	int nReaders = 0;
+	int ret = 0;
+
+	job.chunks		= (verify_chunk*)calloc(nChunks, sizeof(verify_chunk));
+	job.readers		= (psiso_reader*)calloc(nThreads, sizeof(psiso_reader));
+	job.ppBuffers	= (uint8_t**)calloc(nThreads, sizeof(uint8_t*));
+	if(!job.chunks || !job.readers || !job.ppBuffers) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Not enough memory to verify \"%s\". \n", szPath);
+		goto done;
+	}
+
+	// each worker reads through its own handle (unmapped reads seek)
+	for(; nReaders < nThreads; nReaders++)
+	{
+		if(!psxReaderOpen(&job.readers[nReaders], szPath, false)) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szPath);
+			goto done;
+		}
+		if(!job.readers[nReaders].pMap) {
+			job.ppBuffers[nReaders] = (uint8_t*)malloc((size_t)PSISO_ECC_CHUNK_SECTORS * PSISO_RAW_SECTOR_SIZE);
+			if(!job.ppBuffers[nReaders]) {
+				psxLog(ctx, PSISO_LOG_INFO, "Error: Not enough memory to verify \"%s\". \n", szPath);
+				nReaders++;
+				goto done;
+			}
+		}
+	}
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Verifying %u sectors of \"%s\" (%u chunks, %d threads) \n", job.nSectors, szPath, nChunks, nThreads);
+
+	{
+		psx_pool* pool = psxPoolStart(nChunks, nThreads, verify_worker, &job);
+		if(!pool) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Could not start the worker threads. \n");
+			goto done;
+		}
+		psxPoolWait(pool);
+	}
+
+	ret = 1;
+	res->nSectors = job.nSectors;
+
+	// chunks are in LBA order, so are the bad sectors inside each of them
+	for(uint32_t i = 0; i < nChunks; i++)
+	{
+		verify_chunk* chunk = &job.chunks[i];
+		if(chunk->bFailed) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Read failed at sector %u on \"%s\". \n", i * PSISO_ECC_CHUNK_SECTORS, szPath);
+			ret = 0;
+			continue;
+		}
+
+		for(int k = 0; k < PSISO_SECTOR_TYPES; k++) {
+			res->nTypes[k] += chunk->nTypes[k];
+		}
+		for(uint32_t k = 0; k < chunk->nBad; k++) {
+			if(bad) bad(pUser, chunk->pBad[k].nLBA, chunk->pBad[k].nType, chunk->pBad[k].nErrors);
+		}
+		res->nBad += chunk->nBad;
+	}
+
+done:
+	for(int i = 0; i < nReaders; i++) {
+		psxReaderClose(&job.readers[i]);
+		SAFE_FREE(job.ppBuffers[i]);
+	}
+	if(job.chunks) {
+		for(uint32_t i = 0; i < nChunks; i++) {
+			SAFE_FREE(job.chunks[i].pBad);
+		}
+	}
+	SAFE_FREE(job.chunks);
+	SAFE_FREE(job.readers);
+	SAFE_FREE(job.ppBuffers);
+
+	return ret;
+}
@@ -0,0 +1,114 @@
+#ifndef PSISO_ECC_H
+#define PSISO_ECC_H
+
+#include "psiso_tool.h"
+#include "psiso_reader.h"
+
+// ------------------------------------------------------------------------------------------------
+// CD-ROM sector EDC / ECC module (ECMA-130)
+// ------------------------------------------------------------------------------------------------
+// Raw (2352 byte) data sectors:
+//
+//	0x000	sync (00 FF x 10 00)
+//	0x00C	header: minute, second, frame (BCD, LBA + 150), mode
+//
+//	Mode 1			0x010	user data (2048)
+//					0x810	EDC of 0x000 - 0x80F
+//					0x814	zero (8)
+//					0x81C	P parity (172), Q parity (104), both over 0x00C - 0x8C7
+//
+//	Mode 2 Form 1	0x010	subheader (8, twice the same 4 bytes, submode bit 5 clear)
+//					0x018	user data (2048)
+//					0x818	EDC of 0x010 - 0x817
+//					0x81C	P / Q parity, computed with the header taken as zero
+//
+//	Mode 2 Form 2	0x010	subheader (submode bit 5 set)
+//					0x018	user data (2324)
+//					0x92C	EDC of 0x010 - 0x92B (0 = not used)
+//
+// The EDC is a CRC32 (polynomial 0x8001801B, reflected) computed with slice-by-8 tables, P / Q
+// are Reed-Solomon product codes over GF(2^8) computed with lookup tables.
+//
+// psxVerifySectors() splits the image in chunks of PSISO_ECC_CHUNK_SECTORS sectors over a
+// thread pool, each worker with its own reader.
+
+#define PSISO_ECC_CHUNK_SECTORS		4096	// sectors per job (9.2MB)
+
+#define PSISO_SECTOR_AUDIO			0	// no sync pattern (audio, or not a data sector)
+#define PSISO_SECTOR_MODE0			1	// mode 0 (zero filled), or an unknown mode byte
+#define PSISO_SECTOR_MODE1			2
+#define PSISO_SECTOR_MODE2_FORM1	3
+#define PSISO_SECTOR_MODE2_FORM2	4
+#define PSISO_SECTOR_TYPES			5
+
+#define PSISO_SECTOR_ERR_EDC		0x01	// EDC does not match
+#define PSISO_SECTOR_ERR_ECC_P		0x02	// P parity does not match
+#define PSISO_SECTOR_ERR_ECC_Q		0x04	// Q parity does not match
+#define PSISO_SECTOR_ERR_MODE		0x08	// unknown mode byte
+#define PSISO_SECTOR_ERR_SUBHEADER	0x10	// Mode 2 subheader copies differ
+
+// Mode 2 subheader submode bits (CD-XA)
+#define PSISO_SUBMODE_EOR			0x01	// end of record
+#define PSISO_SUBMODE_VIDEO			0x02
+#define PSISO_SUBMODE_AUDIO			0x04
+#define PSISO_SUBMODE_DATA			0x08
+#define PSISO_SUBMODE_TRIGGER		0x10
+#define PSISO_SUBMODE_FORM2			0x20
+#define PSISO_SUBMODE_REALTIME		0x40
+#define PSISO_SUBMODE_EOF			0x80	// end of file
+
+// EDC (CRC32 of ECMA-130), start with nEDC = 0 and pass the previous result to continue
+uint32_t psxEDC(uint32_t nEDC, const void* pData, size_t nLen);
+
+// Type of a raw sector (PSISO_SECTOR_*)
+int psxSectorType(const uint8_t* pSector);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	pSector			- Raw sector (PSISO_RAW_SECTOR_SIZE bytes)
+(out)	pnType			- PSISO_SECTOR_* (optional)
+
+(out)	return			- PSISO_SECTOR_ERR_* flags, 0 if the sector is good (audio and Mode 0
+						  sectors are never reported, Mode 2 Form 2 sectors without EDC neither).
+-------------------------------------------------------------------------------------------------
+*/
+uint32_t psxSectorVerify(const uint8_t* pSector, int* pnType);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in/out)	pSector		- Raw sector with the user data (and the subheader for Mode 2) in place
+(in)		nLBA		- Sector address for the header
+(in)		nType		- PSISO_SECTOR_MODE1 / PSISO_SECTOR_MODE2_FORM1 / PSISO_SECTOR_MODE2_FORM2
+
+Writes the sync, the header, the EDC and the P / Q parity (when the type has them), so the
+sector is valid for its contents. Used when converting images to raw sectors.
+-------------------------------------------------------------------------------------------------
+*/
+void psxSectorBuild(uint8_t* pSector, uint32_t nLBA, int nType);
+
+struct psiso_verify_result
+{
+	uint32_t	nSectors;
+	uint32_t	nTypes[PSISO_SECTOR_TYPES];	// sectors per PSISO_SECTOR_*
+	uint32_t	nBad;						// sectors with errors
+};
+
+// Called for every bad sector, in LBA order, from the thread that called psxVerifySectors()
+typedef void (*psiso_bad_sector_func)(void* pUser, uint32_t nLBA, int nType, uint32_t nErrors);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and details go to its log sink)
+(in)	szPath			- Raw image (MODE1 / 2352 or MODE2 / 2352)
+(in)	nThreads		- Number of worker threads, 0 = one per CPU
+(out)	res				- Sector counts
+(in)	bad				- Called for each bad sector (optional)
+(in)	pUser			- User data passed to bad
+
+(out)	return			- Will return 1 for success and 0 if the image could not be read or is
+						  not made of raw sectors.
+-------------------------------------------------------------------------------------------------
+*/
+int psxVerifySectors(psiso_ctx* ctx, const char* szPath, int nThreads, psiso_verify_result* res, psiso_bad_sector_func bad, void* pUser);
+
+#endif
@@ -0,0 +1,580 @@
+// ------------------------------------------------------------------------------------------------
+// File extraction module
+// ------------------------------------------------------------------------------------------------
+#include "psiso_extract.h"
+#include "psiso_reader.h"
+#include "psiso_iso9660.h"
+#include "psiso_cue.h"
+
+#ifdef WIN
+#include <direct.h>
+#define PATH_SEP	'\\'
+#else
+#include <errno.h>
+#define PATH_SEP	'/'
+#endif
+#include <sys/stat.h>
+
+#if defined(__linux__) && !defined(PSISOTOOL_PS3BUILD)
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#ifdef __NR_copy_file_range
+#define EXTRACT_COPY_RANGE
+#endif
+#define EXTRACT_SENDFILE
+#endif
+
+#define EXTRACT_SENDFILE_MAX	0x7FFFF000	// largest transfer of one sendfile() call
+
+struct extract_job
+{
+	psiso_ctx*				ctx;
+	psiso_reader*			r;
+	psiso_extract_stats*	stats;
+	uint8_t*				pRaw;		// PSISO_EXTRACT_CHUNK_SECTORS raw sectors (unmapped images)
+	uint8_t*				pOut;		// PSISO_EXTRACT_CHUNK_SECTORS de-framed sectors
+	bool					bCopyRange;	// still trying copy_file_range()
+	bool					bSendFile;	// still trying sendfile()
+};
+
+struct extract_out
+{
+#ifdef WIN
+	FILE*		fp;
+#else
+	int			fd;
+#endif
+	uint64_t	nPos;		// end of the file (extents are appended)
+};
+
+// ------------------------------------------------------------------------------
+// Output
+
+// returns 1 if szPath is (now) a directory
+static int make_dir(const char* szPath)
+{
+#ifdef WIN
+	_mkdir(szPath);
+#else
+	_mkdir(szPath, 0755);
+#endif
+	struct _stat st;
+	return _stat(szPath, &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+// szPath and all its parents
+static int make_dirs(const char* szPath)
+{
+	char szDir[1024];
+	size_t nLen = strlen(szPath);
+	if(!nLen || nLen >= sizeof(szDir)) return 0;
+	memcpy(szDir, szPath, nLen + 1);
+
+	for(size_t i = 1; i < nLen; i++)
+	{
+		if(szDir[i] != '/' && szDir[i] != '\\') continue;
+		if(szDir[i - 1] == ':') continue; // drive letter
+		char c = szDir[i];
+		szDir[i] = 0;
+		make_dir(szDir);
+		szDir[i] = c;
+	}
+	return make_dir(szDir);
+}
+
+// file identifiers come from the image, keep them inside the output directory
+static void safe_name(const char* szName, char* szOut, size_t nOutSize)
+{
+	size_t n = 0;
+	for(; szName[n] && n + 1 < nOutSize; n++)
+	{
+		char c = szName[n];
+		szOut[n] = (c == '/' || c == '\\' || c == ':' || (uint8_t)c < 0x20) ? '_' : c;
+	}
+	szOut[n] = 0;
+
+	if(!n || strcmp(szOut, ".") == 0 || strcmp(szOut, "..") == 0) {
+		strcpy(szOut, "_");
+	}
+}
+
+static int out_open(extract_out* o, const char* szPath, bool bAppend)
+{
+	ZERO(*o);
+#ifdef WIN
+	o->fp = fopen(szPath, bAppend ? "ab" : "wb");
+	if(!o->fp) return 0;
+	_fseeki64(o->fp, 0, SEEK_END);
+	o->nPos = (uint64_t)_ftelli64(o->fp);
+#else
+	// no O_APPEND, copy_file_range() does not take it
+	o->fd = _open(szPath, O_WRONLY | O_CREAT | (bAppend ? 0 : O_TRUNC), 0644);
+	if(o->fd == -1) return 0;
+	o->nPos = (uint64_t)_lseek64(o->fd, 0, SEEK_END);
+#endif
+	return 1;
+}
+
+static int out_write(extract_job* job, extract_out* o, const uint8_t* p, size_t nLen)
+{
+#ifdef WIN
+	if(fwrite(p, 1, nLen, o->fp) != nLen) return 0;
+#else
+	size_t nDone = 0;
+	while(nDone < nLen)
+	{
+		ssize_t n = _write(o->fd, p + nDone, nLen - nDone);
+		if(n <= 0) return 0;
+		nDone += (size_t)n;
+	}
+#endif
+	o->nPos += nLen;
+	job->stats->nBytes += nLen;
+	return 1;
+}
+
+static int out_close(extract_out* o)
+{
+#ifdef WIN
+	return fclose(o->fp) == 0;
+#else
+	return _close(o->fd) == 0;
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// Copy
+
+#ifndef WIN
+// Image bytes [nOffset, nOffset + nLen) at the end of o without going through user space,
+// returns the number of bytes done (the rest is written from user space)
+static uint64_t copy_kernel(extract_job* job, extract_out* o, uint64_t nOffset, uint64_t nLen)
+{
+	uint64_t nDone = 0;
+	int fd = job->r->fd;
+
+#ifdef EXTRACT_COPY_RANGE
+	while(job->bCopyRange && nDone < nLen)
+	{
+		loff_t nIn = (loff_t)(job->r->nBase + nOffset + nDone);
+		loff_t nOut = (loff_t)o->nPos;
+		long n = syscall(__NR_copy_file_range, fd, &nIn, o->fd, &nOut, (size_t)(nLen - nDone), 0);
+		if(n <= 0) {
+			// not supported here (older kernel, other filesystem, ...), do not try again
+			if(n < 0 && nDone == 0 && errno != EIO && errno != ENOSPC) job->bCopyRange = false;
+			break;
+		}
+		nDone += (uint64_t)n;
+		o->nPos += (uint64_t)n;
+	}
+	// the position is explicit above, move the file past the data
+	if(nDone) _lseek64(o->fd, o->nPos, SEEK_SET);
+#endif
+
+#ifdef EXTRACT_SENDFILE
+	// writes at the file position
+	while(job->bSendFile && nDone < nLen)
+	{
+		off_t nIn = (off_t)(job->r->nBase + nOffset + nDone);
+		uint64_t nWant = nLen - nDone;
+		if(nWant > EXTRACT_SENDFILE_MAX) nWant = EXTRACT_SENDFILE_MAX;
+		ssize_t n = sendfile(o->fd, fd, &nIn, (size_t)nWant);
+		if(n <= 0) {
+			if(n < 0 && nDone == 0 && errno != EIO && errno != ENOSPC) job->bSendFile = false;
+			break;
+		}
+		nDone += (uint64_t)n;
+		o->nPos += (uint64_t)n;
+	}
+#endif
+
+	job->stats->nBytes += nDone;
+	job->stats->nKernelBytes += nDone;
+	return nDone;
+}
+#endif
+
+// (MODE1 / 2048) file data is a plain byte range of the image
+static int copy_plain(extract_job* job, extract_out* o, uint64_t nOffset, uint64_t nLen)
+{
+	psiso_reader* r = job->r;
+	uint64_t nDone = 0;
+
+#ifndef WIN
+	if(!r->cso && (job->bCopyRange || job->bSendFile)) {
+		nDone = copy_kernel(job, o, nOffset, nLen);
+	}
+#endif
+
+	while(nDone < nLen)
+	{
+		size_t nWant = PSISO_EXTRACT_CHUNK_SECTORS * PSISO_SECTOR_SIZE;
+		if(nWant > nLen - nDone) nWant = (size_t)(nLen - nDone);
+
+		const uint8_t* p = psxReaderViewRaw(r, nOffset + nDone, nWant);
+		if(!p) {
+			if(psxReaderReadRaw(r, nOffset + nDone, job->pOut, nWant) != nWant) return 0;
+			p = job->pOut;
+		}
+		if(!out_write(job, o, p, nWant)) return 0;
+		nDone += nWant;
+	}
+	return 1;
+}
+
+// nSectors raw sectors from nLBA, de-framed (bRaw false) or as they are on the image
+static int copy_sectors(extract_job* job, extract_out* o, uint32_t nLBA, uint64_t nLen, bool bRaw)
+{
+	psiso_reader* r = job->r;
+	uint64_t nDone = 0;
+
+	while(nDone < nLen)
+	{
+		uint64_t nLeft = nLen - nDone;
+		uint32_t nSectors = PSISO_EXTRACT_CHUNK_SECTORS;
+		if((uint64_t)nSectors * PSISO_SECTOR_SIZE > nLeft) {
+			nSectors = (uint32_t)((nLeft + PSISO_SECTOR_SIZE - 1) / PSISO_SECTOR_SIZE);
+		}
+
+		uint64_t nOffset = (uint64_t)nLBA * r->nSectorSize;
+		size_t nRawLen = (size_t)nSectors * r->nSectorSize;
+
+		const uint8_t* pRaw = psxReaderViewRaw(r, nOffset, nRawLen);
+		if(!pRaw) {
+			if(psxReaderReadRaw(r, nOffset, job->pRaw, nRawLen) != nRawLen) return 0;
+			pRaw = job->pRaw;
+		}
+
+		if(bRaw) {
+			if(!out_write(job, o, pRaw, nRawLen)) return 0;
+		} else {
+			psxReaderDeframe(r, pRaw, nSectors, job->pOut);
+			size_t nWant = (size_t)nSectors * PSISO_SECTOR_SIZE;
+			if(nWant > nLeft) nWant = (size_t)nLeft;
+			if(!out_write(job, o, job->pOut, nWant)) return 0;
+		}
+
+		nLBA += nSectors;
+		nDone += (uint64_t)nSectors * PSISO_SECTOR_SIZE;
+	}
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+// Walk
+
+// one extent of a file (bAppend for the extents after the first of a multi-extent file)
+static int extract_file(extract_job* job, const psiso_dirent* ent, const char* szOut, bool bAppend)
+{
+	psiso_reader* r = job->r;
+
+	if(ent->nXAAttr & ISO_XA_CDDA) {
+		psxLog(job->ctx, PSISO_LOG_VERBOSE, "Skipped \"%s\" (CD audio) \n", szOut);
+		if(!bAppend) job->stats->nSkipped++;
+		return 1;
+	}
+
+	// Form 2 payloads do not fit in 2048 byte sectors, keep the whole raw sectors
+	bool bRaw = r->nSectorSize != PSISO_SECTOR_SIZE && (ent->nXAAttr & (ISO_XA_FORM2 | ISO_XA_INTERLEAVED));
+
+	// whole raw sectors are read on (MODE2 / 2352) images
+	uint64_t nOffset = (uint64_t)ent->nExtent * r->nSectorSize;
+	uint64_t nEnd = nOffset + ent->nDataLen;
+	if(r->nSectorSize != PSISO_SECTOR_SIZE) {
+		nEnd = nOffset + ((uint64_t)ent->nDataLen + PSISO_SECTOR_SIZE - 1) / PSISO_SECTOR_SIZE * r->nSectorSize;
+	}
+	if(nEnd > r->nFileSize) {
+		psxLog(job->ctx, PSISO_LOG_INFO, "Error: \"%s\" is beyond the end of the image (truncated image?). \n", szOut);
+		return 0;
+	}
+
+	extract_out o;
+	if(!out_open(&o, szOut, bAppend)) {
+		psxLog(job->ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOut);
+		return 0;
+	}
+	psxLog(job->ctx, PSISO_LOG_VERBOSE, "%s (%u bytes%s) \n", szOut, ent->nDataLen, bRaw ? ", raw sectors" : "");
+
+	int ret;
+	if(r->nSectorSize == PSISO_SECTOR_SIZE) {
+		ret = copy_plain(job, &o, nOffset, ent->nDataLen);
+	} else {
+		ret = copy_sectors(job, &o, ent->nExtent, ent->nDataLen, bRaw);
+	}
+	if(!out_close(&o)) ret = 0;
+
+	if(!ret) {
+		psxLog(job->ctx, PSISO_LOG_INFO, "Error: Could not extract \"%s\". \n", szOut);
+		return 0;
+	}
+
+	if(!bAppend) {
+		job->stats->nFiles++;
+		if(bRaw) job->stats->nRawFiles++;
+	}
+	return 1;
+}
+
+static int extract_tree(extract_job* job, const psiso_dirent* dir, const char* szOutDir, int nDepth)
+{
+	if(nDepth > PSISO_EXTRACT_MAX_DEPTH) {
+		psxLog(job->ctx, PSISO_LOG_INFO, "Error: Directories nested too deep at \"%s\". \n", szOutDir);
+		return 0;
+	}
+	if(!make_dir(szOutDir)) {
+		psxLog(job->ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOutDir);
+		return 0;
+	}
+	job->stats->nDirs++;
+
+	psiso_dir it;
+	if(!psxDirOpen(job->r, dir, &it)) {
+		psxLog(job->ctx, PSISO_LOG_INFO, "Error: Could not read the directory \"%s\". \n", szOutDir);
+		return 0;
+	}
+
+	int ret = 1;
+	psiso_dirent ent;
+	char szPrev[ISO_MAX_NAME] = {0};
+	bool bPrevMulti = false;
+
+	while(psxDirNext(&it, &ent))
+	{
+		char szName[ISO_MAX_NAME];
+		safe_name(ent.szName, szName, sizeof(szName));
+
+		char szOut[1024];
+		if(snprintf(szOut, sizeof(szOut), "%s%c%s", szOutDir, PATH_SEP, szName) >= (int)sizeof(szOut)) {
+			psxLog(job->ctx, PSISO_LOG_INFO, "Error: Path too long for \"%s\". \n", ent.szName);
+			ret = 0;
+			continue;
+		}
+
+		if(ent.nFlags & ISO_DR_FLAG_DIRECTORY) {
+			if(!extract_tree(job, &ent, szOut, nDepth + 1)) ret = 0;
+			bPrevMulti = false;
+			continue;
+		}
+
+		// the extents of a multi-extent file are consecutive records with the same name, every
+		// one but the last with ISO_DR_FLAG_MULTI_EXTENT
+		bool bAppend = bPrevMulti && strcmp(szPrev, ent.szName) == 0;
+		if(!extract_file(job, &ent, szOut, bAppend)) ret = 0;
+
+		bPrevMulti = (ent.nFlags & ISO_DR_FLAG_MULTI_EXTENT) != 0;
+		strcpy(szPrev, ent.szName);
+	}
+	psxDirClose(&it);
+	return ret;
+}
+
+// all the extents of the file ent (found on dir) into szOut
+static int extract_named(extract_job* job, const psiso_dirent* dir, const psiso_dirent* file, const char* szOut)
+{
+	if(!(file->nFlags & ISO_DR_FLAG_MULTI_EXTENT)) {
+		return extract_file(job, file, szOut, false);
+	}
+
+	psiso_dir it;
+	if(!psxDirOpen(job->r, dir, &it)) return 0;
+
+	int ret = 1;
+	bool bFound = false;
+	psiso_dirent ent;
+
+	while(ret && psxDirNext(&it, &ent))
+	{
+		if(ent.nFlags & ISO_DR_FLAG_DIRECTORY) continue;
+		if(!bFound && ent.nExtent != file->nExtent) continue;
+		if(bFound && strcmp(ent.szName, file->szName) != 0) break;
+
+		ret = extract_file(job, &ent, szOut, bFound);
+		bFound = true;
+		if(!(ent.nFlags & ISO_DR_FLAG_MULTI_EXTENT)) break;
+	}
+	psxDirClose(&it);
+	return ret && bFound;
+}
+
+// ------------------------------------------------------------------------------
+
+// Reader on the image with the framing set, like the probe: data track of a CUE sheet, 2048, then
+// raw 2352 (MODE2, or MODE1 from the sector header)
+static int extract_open(psiso_ctx* ctx, const char* szImage, psiso_reader* r)
+{
+	if(psxCUEIsSheet(szImage))
+	{
+		psiso_cue cue;
+		if(!psxCUELoad(ctx, &cue, szImage)) return 0;
+
+		int nTrack = psxCUEDataTrack(&cue);
+		int ret = nTrack >= 0 && psxCUEOpenTrack(&cue, (uint32_t)nTrack, r);
+		psxCUEFree(&cue);
+		if(!ret) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: No readable data track on \"%s\". \n", szImage);
+			return 0;
+		}
+	}
+	else if(!psxReaderOpen(r, szImage, false)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot open \"%s\". \n", szImage);
+		return 0;
+	}
+
+	const uint8_t* pvd = psxReaderSector(r, ISO_PVD_SECTOR);
+	if((!pvd || memcmp(pvd + 1, "CD001", 5) != 0) && r->nSectorSize == PSISO_SECTOR_SIZE)
+	{
+		// sector header mode byte (0x0F) of the raw PVD
+		uint8_t nMode = 2;
+		psxReaderReadRaw(r, (uint64_t)ISO_PVD_SECTOR * PSISO_RAW_SECTOR_SIZE + 15, &nMode, 1);
+
+		psxReaderSetMode(r, PSISO_RAW_SECTOR_SIZE, nMode == 1 ? 0x10 : PSISO_RAW_SECTOR_HEADER);
+		pvd = psxReaderSector(r, ISO_PVD_SECTOR);
+	}
+
+	if(!pvd || memcmp(pvd + 1, "CD001", 5) != 0) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" is not a supported ISO9660 image. \n", szImage);
+		psxReaderClose(r);
+		return 0;
+	}
+	return 1;
+}
+
+int psxExtract(psiso_ctx* ctx, const char* szImage, const char* szPath, const char* szOutDir, psiso_extract_stats* stats)
+{
+	ZERO(*stats);
+
+	psiso_reader r;
+	if(!extract_open(ctx, szImage, &r)) {
+		return 0;
+	}
+
+	// ROOT DR
+	uint8_t pvd[PSISO_SECTOR_SIZE];
+	memcpy(pvd, psxReaderSector(&r, ISO_PVD_SECTOR), PSISO_SECTOR_SIZE);
+
+	psiso_dirent root;
+	if(psxParseDirRecord(pvd + ISO_PVD_ROOT_DR_OFFSET, ISO_DR_MIN_LEN + 1, &root) <= 0) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" has an invalid root directory record. \n", szImage);
+		psxReaderClose(&r);
+		return 0;
+	}
+
+	extract_job job;
+	ZERO(job);
+	job.ctx			= ctx;
+	job.r			= &r;
+	job.stats		= stats;
+	job.pRaw		= (uint8_t*)malloc((size_t)PSISO_EXTRACT_CHUNK_SECTORS * PSISO_RAW_SECTOR_SIZE);
+	job.pOut		= (uint8_t*)malloc((size_t)PSISO_EXTRACT_CHUNK_SECTORS * PSISO_SECTOR_SIZE);
+	job.bCopyRange	= true;
+	job.bSendFile	= true;
+
+	int ret = 0;
+	bool bAll = !szPath || !*szPath || strcmp(szPath, "all") == 0 || strcmp(szPath, "/") == 0;
+
+	if(!job.pRaw || !job.pOut) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Out of memory. \n");
+	}
+	else if(!make_dirs(szOutDir)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOutDir);
+	}
+	else if(bAll) {
+		psxReaderAdvise(&r, 0, 0, PSISO_ADVISE_SEQUENTIAL);
+		ret = extract_tree(&job, &root, szOutDir, 0);
+	}
+	else
+	{
+		// directories are resolved with the path table (loaded once), the directory walk is
+		// only used when it can not be read or does not match the directories
+		psiso_path_table pt;
+		psxPathTableLoad(&r, pvd, &pt);
+
+		psiso_dirent ent;
+		bool bFound = psxFindPathEx(&r, &root, &pt, szPath, &ent) || (pt.nEntries && psxFindPath(&r, &root, szPath, &ent));
+
+		if(!bFound) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" was not found on the image. \n", szPath);
+		}
+		else
+		{
+			// keep the path on the image under szOutDir, the parent directories are located and
+			// created on the way (multi-extent files are collected from their directory)
+			psiso_dirent parent = root;
+			char szOut[1024];
+			char szDirPath[1024];
+			snprintf(szOut, sizeof(szOut), "%s", szOutDir);
+			ret = 1;
+
+			const char* p = szPath;
+			while(*p && ret)
+			{
+				while(*p == '/' || *p == '\\') p++;
+				if(!*p) break;
+
+				const char* end = p;
+				while(*end && *end != '/' && *end != '\\') end++;
+
+				char szPart[ISO_MAX_NAME];
+				size_t nLen = (size_t)(end - p);
+				memcpy(szPart, p, nLen);	// psxFindPathEx() did the length check
+				szPart[nLen] = 0;
+
+				bool bLast = true;
+				for(const char* q = end; *q; q++) {
+					if(*q != '/' && *q != '\\') { bLast = false; break; }
+				}
+				if(!bLast)
+				{
+					size_t nDirLen = (size_t)(end - szPath);
+					if(nDirLen >= sizeof(szDirPath)) {
+						psxLog(ctx, PSISO_LOG_INFO, "Error: Path too long for \"%s\". \n", szPath);
+						ret = 0;
+						break;
+					}
+					memcpy(szDirPath, szPath, nDirLen);
+					szDirPath[nDirLen] = 0;
+
+					psiso_dirent dir;
+					if(!(pt.nEntries && psxFindPathEx(&r, &root, &pt, szDirPath, &dir)) && !psxDirFind(&r, &parent, szPart, &dir)) {
+						ret = 0;
+						break;
+					}
+					parent = dir;
+				}
+
+				// names as written on the image
+				char szName[ISO_MAX_NAME];
+				safe_name(bLast ? ent.szName : parent.szName, szName, sizeof(szName));
+
+				size_t nOutLen = strlen(szOut);
+				if(nOutLen + 1 + strlen(szName) >= sizeof(szOut)) {
+					psxLog(ctx, PSISO_LOG_INFO, "Error: Path too long for \"%s\". \n", szPath);
+					ret = 0;
+					break;
+				}
+				snprintf(szOut + nOutLen, sizeof(szOut) - nOutLen, "%c%s", PATH_SEP, szName);
+
+				if(!bLast && !make_dir(szOut)) {
+					psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szOut);
+					ret = 0;
+				}
+				p = end;
+			}
+
+			if(ret) {
+				if(ent.nFlags & ISO_DR_FLAG_DIRECTORY) {
+					psxReaderAdvise(&r, 0, 0, PSISO_ADVISE_SEQUENTIAL);
+					ret = extract_tree(&job, &ent, szOut, 0);
+				} else {
+					ret = extract_named(&job, &parent, &ent, szOut);
+				}
+			}
+		}
+		psxPathTableFree(&pt);
+	}
+
+	SAFE_FREE(job.pRaw);
+	SAFE_FREE(job.pOut);
+	psxReaderClose(&r);
+	return ret;
+}
@@ -0,0 +1,54 @@
+#ifndef PSISO_EXTRACT_H
+#define PSISO_EXTRACT_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// File extraction module
+// ------------------------------------------------------------------------------------------------
+// Copies files out of a disc image (one file, one directory tree or the whole image) without
+// mounting it. The image is opened like the probe does (ISO, BIN, CUE / BIN data track, CSO /
+// ZSO) and walked with the ISO9660 module, then every file extent is copied depending on the
+// framing of the image:
+//
+//	(MODE1 / 2048)		file extents are plain image bytes, they are copied by the kernel
+//						(copy_file_range(), sendfile()) so the payload never goes through user
+//						space. Written from the mapping (or read in chunks) where that fails.
+//	(MODE2 / 2352)		raw sectors are taken in chunks of PSISO_EXTRACT_CHUNK_SECTORS straight
+//						from the mapping and de-framed (psxReaderDeframe()) into the write buffer.
+//
+// Mode 2 Form 2 files (XA audio, STR video, see the CD-XA attributes of the directory record)
+// carry 2324 bytes per sector that do not fit in a 2048 byte file, they are written as whole raw
+// sectors (what XA / STR tools expect). CD audio entries are skipped.
+//
+// Files keep their path on the image under the output directory.
+
+#define PSISO_EXTRACT_CHUNK_SECTORS		256
+#define PSISO_EXTRACT_MAX_DEPTH			64
+
+struct psiso_extract_stats
+{
+	uint32_t	nFiles;
+	uint32_t	nDirs;
+	uint32_t	nRawFiles;		// Form 2 files written as raw sectors
+	uint32_t	nSkipped;		// CD audio entries
+	uint64_t	nBytes;			// bytes written
+	uint64_t	nKernelBytes;	// of those, copied by the kernel
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and extracted files go to its log sink)
+(in)	szImage			- Disc image
+(in)	szPath			- File or directory on the image (Ex. "PSP_GAME/ICON0.PNG"), NULL or
+						  "all" for the whole image
+(in)	szOutDir		- Output directory (created if needed)
+(out)	stats			- Files, directories and bytes written
+
+(out)	return			- Will return 1 for success and 0 if the image is not supported, szPath
+						  was not found, or a file could not be read / written.
+-------------------------------------------------------------------------------------------------
+*/
+int psxExtract(psiso_ctx* ctx, const char* szImage, const char* szPath, const char* szOutDir, psiso_extract_stats* stats);
+
+#endif
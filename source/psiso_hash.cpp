@@ -0,0 +1,1055 @@
+// ------------------------------------------------------------------------------
+// Hashing module
+// ------------------------------------------------------------------------------
+#include "psiso_hash.h"
+#include "psiso_reader.h"
+#include "psiso_thread.h"
+
+// SIMD paths need the target attribute and the SHA / PCLMUL intrinsics (GCC 5+ / clang)
+#if !defined(PSISO_HASH_NO_SIMD) && !defined(PSISOTOOL_PS3BUILD) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define PSISO_HASH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#define ROTL32(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+// Compress nBlocks 64 byte blocks into the state
+typedef void (*hash_blocks_func)(uint32_t* h, const uint8_t* p, size_t nBlocks);
+
+static void sha1_blocks_c(uint32_t* h, const uint8_t* p, size_t nBlocks);
+static void sha256_blocks_c(uint32_t* h, const uint8_t* p, size_t nBlocks);
+
+static psx_once hash_once = PSX_ONCE_INIT;
+static uint32_t crc_table[16][256];
+static bool bCLMUL = false;
+static bool bSHANI = false;
+static hash_blocks_func sha1_blocks = sha1_blocks_c;
+static hash_blocks_func sha256_blocks = sha256_blocks_c;
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// ------------------------------------------------------------------------------
+// SIMD implementations (x86)
+
+#ifdef PSISO_HASH_X86
+
+// CRC32 folding with carry-less multiplies ("Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction", Intel). nCRC is the raw (not inverted) register, nLen is at least 64
+// and a multiple of 16.
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32_clmul(uint32_t nCRC, const uint8_t* p, size_t nLen)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+	__m128i x5;
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)nCRC));
+	p += 64;
+	nLen -= 64;
+
+	// fold 4 x 128 bits at a time
+	while(nLen >= 64)
+	{
+		__m128i x6, x7, x8;
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+
+		p += 64;
+		nLen -= 64;
+	}
+
+	// fold the 4 lanes into one
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// remaining 128 bit blocks
+	while(nLen >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)p)), x5);
+		p += 16;
+		nLen -= 16;
+	}
+
+	// 128 -> 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1_blocks_ni(uint32_t* h, const uint8_t* p, size_t nBlocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)h), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)h[4], 0, 0, 0);
+
+	for(; nBlocks; nBlocks--, p += 64)
+	{
+		__m128i abcd_save = abcd;
+		__m128i e_save = e0;
+		__m128i e1, msg0, msg1, msg2, msg3;
+
+		// rounds 0-3
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 0)), bswap);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		// rounds 4-7
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), bswap);
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		// rounds 8-11
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 32)), bswap);
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+		// rounds 12-15
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 48)), bswap);
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+		// rounds 16-19
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+		// rounds 20-23
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+		// rounds 24-27
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+		// rounds 28-31
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+		// rounds 32-35
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+		// rounds 36-39
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+		// rounds 40-43
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+		// rounds 44-47
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+		// rounds 48-51
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+		// rounds 52-55
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+		msg3 = _mm_xor_si128(msg3, msg1);
+		// rounds 56-59
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+		// rounds 60-63
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+		msg1 = _mm_xor_si128(msg1, msg3);
+		// rounds 64-67
+		e0 = _mm_sha1nexte_epu32(e0, msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+		msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+		msg2 = _mm_xor_si128(msg2, msg0);
+		// rounds 68-71
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+		// rounds 72-75
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+		// rounds 76-79
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i*)h, _mm_shuffle_epi32(abcd, 0x1B));
+	h[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_blocks_ni(uint32_t* h, const uint8_t* p, size_t nBlocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+
+	// state as ABEF / CDGH
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[0]), 0xB1);
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[4]), 0x1B);
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	for(; nBlocks; nBlocks--, p += 64)
+	{
+		__m128i abef_save = state0;
+		__m128i cdgh_save = state1;
+		__m128i m, msg0, msg1, msg2, msg3;
+
+		// rounds 0-3
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 0)), bswap);
+		m = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&sha256_k[0]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		// rounds 4-7
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), bswap);
+		m = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&sha256_k[4]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+		// rounds 8-11
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 32)), bswap);
+		m = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&sha256_k[8]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+		// rounds 12-15
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 48)), bswap);
+		m = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&sha256_k[12]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+		// rounds 16-19
+		m = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&sha256_k[16]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+		// rounds 20-23
+		m = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&sha256_k[20]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+		// rounds 24-27
+		m = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&sha256_k[24]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+		// rounds 28-31
+		m = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&sha256_k[28]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+		// rounds 32-35
+		m = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&sha256_k[32]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+		// rounds 36-39
+		m = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&sha256_k[36]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+		// rounds 40-43
+		m = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&sha256_k[40]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+		// rounds 44-47
+		m = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&sha256_k[44]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(msg0, _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+		// rounds 48-51
+		m = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&sha256_k[48]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(msg1, _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+		// rounds 52-55
+		m = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&sha256_k[52]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		// rounds 56-59
+		m = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&sha256_k[56]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+		// rounds 60-63
+		m = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&sha256_k[60]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+	}
+
+	// back to ABCD / EFGH
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	_mm_storeu_si128((__m128i*)&h[0], _mm_blend_epi16(tmp, state1, 0xF0));
+	_mm_storeu_si128((__m128i*)&h[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static void cpu_detect()
+{
+	unsigned int a, b, c, d;
+	if(!__get_cpuid(1, &a, &b, &c, &d)) return;
+
+	bool bSSSE3	= (c & (1 << 9)) != 0;
+	bool bSSE41	= (c & (1 << 19)) != 0;
+	bCLMUL		= bSSE41 && (c & (1 << 1)) != 0;
+
+	if(__get_cpuid_max(0, NULL) < 7) return;
+	__cpuid_count(7, 0, a, b, c, d);
+	bSHANI		= bSSSE3 && bSSE41 && (b & (1 << 29)) != 0;
+}
+
+#endif // PSISO_HASH_X86
+
+static void hash_init()
+{
+	// slice-by-16 tables, crc_table[k][n] is the CRC of byte n followed by k zero bytes
+	for(uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+		for(int k = 0; k < 8; k++) {
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : (c >> 1);
+		}
+		crc_table[0][n] = c;
+	}
+	for(uint32_t n = 0; n < 256; n++) {
+		for(int k = 1; k < 16; k++) {
+			crc_table[k][n] = (crc_table[k - 1][n] >> 8) ^ crc_table[0][crc_table[k - 1][n] & 0xFF];
+		}
+	}
+
+#ifdef PSISO_HASH_X86
+	cpu_detect();
+	if(bSHANI) {
+		sha1_blocks = sha1_blocks_ni;
+		sha256_blocks = sha256_blocks_ni;
+	}
+#endif
+}
+
+const char* psxHashEngine(uint32_t nAlgo)
+{
+	psxOnce(&hash_once, hash_init);
+
+	switch(nAlgo) {
+		case PSISO_HASH_CRC32:	return bCLMUL ? "PCLMUL" : "slice-by-16";
+		case PSISO_HASH_SHA1:
+		case PSISO_HASH_SHA256:	return bSHANI ? "SHA-NI" : "portable";
+	}
+	return "portable";
+}
+
+void psxHashToHex(const uint8_t* pData, size_t nLen, char* szOut)
+{
+	static const char hex[] = "0123456789abcdef";
+	for(size_t i = 0; i < nLen; i++) {
+		szOut[i * 2 + 0] = hex[pData[i] >> 4];
+		szOut[i * 2 + 1] = hex[pData[i] & 0x0F];
+	}
+	szOut[nLen * 2] = 0;
+}
+
+// ------------------------------------------------------------------------------
+// CRC32
+
+static uint32_t crc32_slice16(uint32_t c, const uint8_t* p, size_t nLen)
+{
+	while(nLen >= 16)
+	{
+		uint32_t w0 = psx_le32(p + 0x0) ^ c;
+		uint32_t w1 = psx_le32(p + 0x4);
+		uint32_t w2 = psx_le32(p + 0x8);
+		uint32_t w3 = psx_le32(p + 0xC);
+
+		c = crc_table[15][w0 & 0xFF] ^ crc_table[14][(w0 >> 8) & 0xFF] ^ crc_table[13][(w0 >> 16) & 0xFF] ^ crc_table[12][w0 >> 24]
+		  ^ crc_table[11][w1 & 0xFF] ^ crc_table[10][(w1 >> 8) & 0xFF] ^ crc_table[ 9][(w1 >> 16) & 0xFF] ^ crc_table[ 8][w1 >> 24]
+		  ^ crc_table[ 7][w2 & 0xFF] ^ crc_table[ 6][(w2 >> 8) & 0xFF] ^ crc_table[ 5][(w2 >> 16) & 0xFF] ^ crc_table[ 4][w2 >> 24]
+		  ^ crc_table[ 3][w3 & 0xFF] ^ crc_table[ 2][(w3 >> 8) & 0xFF] ^ crc_table[ 1][(w3 >> 16) & 0xFF] ^ crc_table[ 0][w3 >> 24];
+
+		p += 16;
+		nLen -= 16;
+	}
+	while(nLen--) {
+		c = crc_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+	}
+	return c;
+}
+
+uint32_t psxCRC32(uint32_t nCRC, const void* pData, size_t nLen)
+{
+	psxOnce(&hash_once, hash_init);
+
+	const uint8_t* p = (const uint8_t*)pData;
+	uint32_t c = ~nCRC;
+
+#ifdef PSISO_HASH_X86
+	if(bCLMUL && nLen >= 64) {
+		size_t nFold = nLen & ~(size_t)15;
+		c = crc32_clmul(c, p, nFold);
+		p += nFold;
+		nLen -= nFold;
+	}
+#endif
+	return ~crc32_slice16(c, p, nLen);
+}
+
+// ------------------------------------------------------------------------------
+// Merkle-Damgard framing shared by MD5 / SHA-1 / SHA-256
+
+static void md_update(uint32_t* h, uint64_t* pnLen, uint8_t* buf, hash_blocks_func blocks, const void* pData, size_t nLen)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	size_t nFill = (size_t)(*pnLen & 63);
+	*pnLen += nLen;
+
+	if(nFill)
+	{
+		size_t n = 64 - nFill;
+		if(n > nLen) n = nLen;
+		memcpy(buf + nFill, p, n);
+		p += n;
+		nLen -= n;
+		if(nFill + n < 64) return;
+		blocks(h, buf, 1);
+	}
+	if(nLen >= 64) {
+		blocks(h, p, nLen / 64);
+		p += nLen & ~(size_t)63;
+		nLen &= 63;
+	}
+	if(nLen) {
+		memcpy(buf, p, nLen);
+	}
+}
+
+// 0x80, zeros up to 56 mod 64, then the length in bits (little-endian for MD5, big-endian for SHA)
+static void md_final(uint32_t* h, uint64_t* pnLen, uint8_t* buf, hash_blocks_func blocks, bool bBigEndian)
+{
+	uint64_t nBits = *pnLen * 8;
+	size_t nFill = (size_t)(*pnLen & 63);
+
+	uint8_t pad[72];
+	memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	size_t nPad = (nFill < 56) ? 56 - nFill : 120 - nFill;
+
+	for(int i = 0; i < 8; i++) {
+		pad[nPad + i] = (uint8_t)(nBits >> (bBigEndian ? (56 - i * 8) : (i * 8)));
+	}
+	md_update(h, pnLen, buf, blocks, pad, nPad + 8);
+}
+
+static void put_words(const uint32_t* h, int nWords, uint8_t* pOut, bool bBigEndian)
+{
+	for(int i = 0; i < nWords; i++) {
+		for(int k = 0; k < 4; k++) {
+			pOut[i * 4 + k] = (uint8_t)(h[i] >> (bBigEndian ? (24 - k * 8) : (k * 8)));
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+// MD5
+
+#define MD5_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z)	((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z)	((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z)	((y) ^ ((x) | ~(z)))
+
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+	(a) += f((b), (c), (d)) + (x) + (t); \
+	(a) = ROTL32((a), (s)) + (b);
+
+static void md5_blocks(uint32_t* h, const uint8_t* p, size_t nBlocks)
+{
+	for(; nBlocks; nBlocks--, p += 64)
+	{
+		uint32_t x[16];
+		for(int i = 0; i < 16; i++) {
+			x[i] = psx_le32(p + i * 4);
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+
+		MD5_STEP(MD5_F, a, b, c, d, x[ 0], 0xd76aa478,  7);
+		MD5_STEP(MD5_F, d, a, b, c, x[ 1], 0xe8c7b756, 12);
+		MD5_STEP(MD5_F, c, d, a, b, x[ 2], 0x242070db, 17);
+		MD5_STEP(MD5_F, b, c, d, a, x[ 3], 0xc1bdceee, 22);
+		MD5_STEP(MD5_F, a, b, c, d, x[ 4], 0xf57c0faf,  7);
+		MD5_STEP(MD5_F, d, a, b, c, x[ 5], 0x4787c62a, 12);
+		MD5_STEP(MD5_F, c, d, a, b, x[ 6], 0xa8304613, 17);
+		MD5_STEP(MD5_F, b, c, d, a, x[ 7], 0xfd469501, 22);
+		MD5_STEP(MD5_F, a, b, c, d, x[ 8], 0x698098d8,  7);
+		MD5_STEP(MD5_F, d, a, b, c, x[ 9], 0x8b44f7af, 12);
+		MD5_STEP(MD5_F, c, d, a, b, x[10], 0xffff5bb1, 17);
+		MD5_STEP(MD5_F, b, c, d, a, x[11], 0x895cd7be, 22);
+		MD5_STEP(MD5_F, a, b, c, d, x[12], 0x6b901122,  7);
+		MD5_STEP(MD5_F, d, a, b, c, x[13], 0xfd987193, 12);
+		MD5_STEP(MD5_F, c, d, a, b, x[14], 0xa679438e, 17);
+		MD5_STEP(MD5_F, b, c, d, a, x[15], 0x49b40821, 22);
+
+		MD5_STEP(MD5_G, a, b, c, d, x[ 1], 0xf61e2562,  5);
+		MD5_STEP(MD5_G, d, a, b, c, x[ 6], 0xc040b340,  9);
+		MD5_STEP(MD5_G, c, d, a, b, x[11], 0x265e5a51, 14);
+		MD5_STEP(MD5_G, b, c, d, a, x[ 0], 0xe9b6c7aa, 20);
+		MD5_STEP(MD5_G, a, b, c, d, x[ 5], 0xd62f105d,  5);
+		MD5_STEP(MD5_G, d, a, b, c, x[10], 0x02441453,  9);
+		MD5_STEP(MD5_G, c, d, a, b, x[15], 0xd8a1e681, 14);
+		MD5_STEP(MD5_G, b, c, d, a, x[ 4], 0xe7d3fbc8, 20);
+		MD5_STEP(MD5_G, a, b, c, d, x[ 9], 0x21e1cde6,  5);
+		MD5_STEP(MD5_G, d, a, b, c, x[14], 0xc33707d6,  9);
+		MD5_STEP(MD5_G, c, d, a, b, x[ 3], 0xf4d50d87, 14);
+		MD5_STEP(MD5_G, b, c, d, a, x[ 8], 0x455a14ed, 20);
+		MD5_STEP(MD5_G, a, b, c, d, x[13], 0xa9e3e905,  5);
+		MD5_STEP(MD5_G, d, a, b, c, x[ 2], 0xfcefa3f8,  9);
+		MD5_STEP(MD5_G, c, d, a, b, x[ 7], 0x676f02d9, 14);
+		MD5_STEP(MD5_G, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+		MD5_STEP(MD5_H, a, b, c, d, x[ 5], 0xfffa3942,  4);
+		MD5_STEP(MD5_H, d, a, b, c, x[ 8], 0x8771f681, 11);
+		MD5_STEP(MD5_H, c, d, a, b, x[11], 0x6d9d6122, 16);
+		MD5_STEP(MD5_H, b, c, d, a, x[14], 0xfde5380c, 23);
+		MD5_STEP(MD5_H, a, b, c, d, x[ 1], 0xa4beea44,  4);
+		MD5_STEP(MD5_H, d, a, b, c, x[ 4], 0x4bdecfa9, 11);
+		MD5_STEP(MD5_H, c, d, a, b, x[ 7], 0xf6bb4b60, 16);
+		MD5_STEP(MD5_H, b, c, d, a, x[10], 0xbebfbc70, 23);
+		MD5_STEP(MD5_H, a, b, c, d, x[13], 0x289b7ec6,  4);
+		MD5_STEP(MD5_H, d, a, b, c, x[ 0], 0xeaa127fa, 11);
+		MD5_STEP(MD5_H, c, d, a, b, x[ 3], 0xd4ef3085, 16);
+		MD5_STEP(MD5_H, b, c, d, a, x[ 6], 0x04881d05, 23);
+		MD5_STEP(MD5_H, a, b, c, d, x[ 9], 0xd9d4d039,  4);
+		MD5_STEP(MD5_H, d, a, b, c, x[12], 0xe6db99e5, 11);
+		MD5_STEP(MD5_H, c, d, a, b, x[15], 0x1fa27cf8, 16);
+		MD5_STEP(MD5_H, b, c, d, a, x[ 2], 0xc4ac5665, 23);
+
+		MD5_STEP(MD5_I, a, b, c, d, x[ 0], 0xf4292244,  6);
+		MD5_STEP(MD5_I, d, a, b, c, x[ 7], 0x432aff97, 10);
+		MD5_STEP(MD5_I, c, d, a, b, x[14], 0xab9423a7, 15);
+		MD5_STEP(MD5_I, b, c, d, a, x[ 5], 0xfc93a039, 21);
+		MD5_STEP(MD5_I, a, b, c, d, x[12], 0x655b59c3,  6);
+		MD5_STEP(MD5_I, d, a, b, c, x[ 3], 0x8f0ccc92, 10);
+		MD5_STEP(MD5_I, c, d, a, b, x[10], 0xffeff47d, 15);
+		MD5_STEP(MD5_I, b, c, d, a, x[ 1], 0x85845dd1, 21);
+		MD5_STEP(MD5_I, a, b, c, d, x[ 8], 0x6fa87e4f,  6);
+		MD5_STEP(MD5_I, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+		MD5_STEP(MD5_I, c, d, a, b, x[ 6], 0xa3014314, 15);
+		MD5_STEP(MD5_I, b, c, d, a, x[13], 0x4e0811a1, 21);
+		MD5_STEP(MD5_I, a, b, c, d, x[ 4], 0xf7537e82,  6);
+		MD5_STEP(MD5_I, d, a, b, c, x[11], 0xbd3af235, 10);
+		MD5_STEP(MD5_I, c, d, a, b, x[ 2], 0x2ad7d2bb, 15);
+		MD5_STEP(MD5_I, b, c, d, a, x[ 9], 0xeb86d391, 21);
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+	}
+}
+
+void psxMD5Init(psiso_md5* md5)
+{
+	memset(md5, 0, sizeof(psiso_md5));
+	md5->h[0] = 0x67452301;
+	md5->h[1] = 0xefcdab89;
+	md5->h[2] = 0x98badcfe;
+	md5->h[3] = 0x10325476;
+}
+
+void psxMD5Update(psiso_md5* md5, const void* pData, size_t nLen)
+{
+	md_update(md5->h, &md5->nLen, md5->buf, md5_blocks, pData, nLen);
+}
+
+void psxMD5Final(psiso_md5* md5, uint8_t* pDigest)
+{
+	md_final(md5->h, &md5->nLen, md5->buf, md5_blocks, false);
+	put_words(md5->h, 4, pDigest, false);
+}
+
+// ------------------------------------------------------------------------------
+// SHA-1
+
+static void sha1_blocks_c(uint32_t* h, const uint8_t* p, size_t nBlocks)
+{
+	for(; nBlocks; nBlocks--, p += 64)
+	{
+		uint32_t w[16];
+		for(int i = 0; i < 16; i++) {
+			w[i] = psx_be32(p + i * 4);
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+		for(int i = 0; i < 80; i++)
+		{
+			if(i >= 16) {
+				uint32_t t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+				w[i & 15] = ROTL32(t, 1);
+			}
+
+			uint32_t f, k;
+			if(i < 20)		{ f = d ^ (b & (c ^ d));			k = 0x5a827999; }
+			else if(i < 40)	{ f = b ^ c ^ d;					k = 0x6ed9eba1; }
+			else if(i < 60)	{ f = (b & c) | (d & (b | c));		k = 0x8f1bbcdc; }
+			else			{ f = b ^ c ^ d;					k = 0xca62c1d6; }
+
+			uint32_t t = ROTL32(a, 5) + f + e + k + w[i & 15];
+			e = d;
+			d = c;
+			c = ROTL32(b, 30);
+			b = a;
+			a = t;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+}
+
+void psxSHA1Init(psiso_sha1* sha)
+{
+	psxOnce(&hash_once, hash_init);
+
+	memset(sha, 0, sizeof(psiso_sha1));
+	sha->h[0] = 0x67452301;
+	sha->h[1] = 0xefcdab89;
+	sha->h[2] = 0x98badcfe;
+	sha->h[3] = 0x10325476;
+	sha->h[4] = 0xc3d2e1f0;
+}
+
+void psxSHA1Update(psiso_sha1* sha, const void* pData, size_t nLen)
+{
+	md_update(sha->h, &sha->nLen, sha->buf, sha1_blocks, pData, nLen);
+}
+
+void psxSHA1Final(psiso_sha1* sha, uint8_t* pDigest)
+{
+	md_final(sha->h, &sha->nLen, sha->buf, sha1_blocks, true);
+	put_words(sha->h, 5, pDigest, true);
+}
+
+// ------------------------------------------------------------------------------
+// SHA-256
+
+static void sha256_blocks_c(uint32_t* h, const uint8_t* p, size_t nBlocks)
+{
+	for(; nBlocks; nBlocks--, p += 64)
+	{
+		uint32_t w[64];
+		for(int i = 0; i < 16; i++) {
+			w[i] = psx_be32(p + i * 4);
+		}
+		for(int i = 16; i < 64; i++) {
+			uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+
+		for(int i = 0; i < 64; i++)
+		{
+			uint32_t S1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+			uint32_t ch = g ^ (e & (f ^ g));
+			uint32_t t1 = hh + S1 + ch + sha256_k[i] + w[i];
+			uint32_t S0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+			uint32_t maj = (a & b) | (c & (a | b));
+
+			hh = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + S0 + maj;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		h[5] += f;
+		h[6] += g;
+		h[7] += hh;
+	}
+}
+
+void psxSHA256Init(psiso_sha256* sha)
+{
+	psxOnce(&hash_once, hash_init);
+
+	memset(sha, 0, sizeof(psiso_sha256));
+	sha->h[0] = 0x6a09e667;
+	sha->h[1] = 0xbb67ae85;
+	sha->h[2] = 0x3c6ef372;
+	sha->h[3] = 0xa54ff53a;
+	sha->h[4] = 0x510e527f;
+	sha->h[5] = 0x9b05688c;
+	sha->h[6] = 0x1f83d9ab;
+	sha->h[7] = 0x5be0cd19;
+}
+
+void psxSHA256Update(psiso_sha256* sha, const void* pData, size_t nLen)
+{
+	md_update(sha->h, &sha->nLen, sha->buf, sha256_blocks, pData, nLen);
+}
+
+void psxSHA256Final(psiso_sha256* sha, uint8_t* pDigest)
+{
+	md_final(sha->h, &sha->nLen, sha->buf, sha256_blocks, true);
+	put_words(sha->h, 8, pDigest, true);
+}
+
+// ------------------------------------------------------------------------------
+// Whole file pipeline (one reader, one hasher thread per algorithm)
+
+struct hash_pipe;
+
+struct hash_block
+{
+	const uint8_t*	pData;
+	size_t			nLen;		// 0 = end of the file
+	int				nPending;	// hashers still using the block
+};
+
+struct hash_worker
+{
+	hash_pipe*		pipe;
+	uint32_t		nAlgo;		// PSISO_HASH_*
+	psx_sem			semReady;	// blocks ready for this hasher
+	psx_thread		thread;
+
+	uint32_t		nCRC32;
+	psiso_md5		md5;
+	psiso_sha1		sha1;
+	psiso_sha256	sha256;
+};
+
+struct hash_pipe
+{
+	hash_block		blocks[PSISO_HASH_BLOCKS];
+	psx_sem			semFree;	// blocks the reader can refill
+	psx_mutex		mutex;		// nPending
+	hash_worker		workers[4];
+	int				nWorkers;
+};
+
+static void hash_worker_main(void* pArg)
+{
+	hash_worker* w = (hash_worker*)pArg;
+	hash_pipe* pipe = w->pipe;
+
+	for(uint32_t n = 0; ; n++)
+	{
+		psxSemWait(w->semReady);
+
+		hash_block* block = &pipe->blocks[n % PSISO_HASH_BLOCKS];
+		size_t nLen = block->nLen;
+
+		if(nLen) {
+			switch(w->nAlgo) {
+				case PSISO_HASH_CRC32:	w->nCRC32 = psxCRC32(w->nCRC32, block->pData, nLen); break;
+				case PSISO_HASH_MD5:	psxMD5Update(&w->md5, block->pData, nLen); break;
+				case PSISO_HASH_SHA1:	psxSHA1Update(&w->sha1, block->pData, nLen); break;
+				case PSISO_HASH_SHA256:	psxSHA256Update(&w->sha256, block->pData, nLen); break;
+			}
+		}
+
+		psxMutexLock(pipe->mutex);
+		if(--block->nPending == 0) {
+			psxSemPost(pipe->semFree);
+		}
+		psxMutexUnlock(pipe->mutex);
+
+		if(nLen == 0) break;
+	}
+}
+
+static const char* hash_name(uint32_t nAlgo)
+{
+	switch(nAlgo) {
+		case PSISO_HASH_CRC32:	return "CRC32";
+		case PSISO_HASH_MD5:	return "MD5";
+		case PSISO_HASH_SHA1:	return "SHA-1";
+		case PSISO_HASH_SHA256:	return "SHA-256";
+	}
+	return "";
+}
+
+int psxHashFile(psiso_ctx* ctx, const char* szPath, uint32_t nAlgos, psiso_hash_result* res, psiso_progress_func progress, void* pProgressUser)
+{
+	return psxHashFileRange(ctx, szPath, 0, (uint64_t)-1, nAlgos, res, progress, pProgressUser);
+}
+
+int psxHashFileRange(psiso_ctx* ctx, const char* szPath, uint64_t nOffset, uint64_t nLen, uint32_t nAlgos, psiso_hash_result* res, psiso_progress_func progress, void* pProgressUser)
+{
+	memset(res, 0, sizeof(psiso_hash_result));
+	nAlgos &= PSISO_HASH_ALL;
+	if(!nAlgos) return 0;
+
+	psxOnce(&hash_once, hash_init);
+
+	psiso_reader r;
+	if(!psxReaderOpenRange(&r, szPath, nOffset, nLen)) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Could not open \"%s\". \n", szPath);
+		return 0;
+	}
+
+	hash_pipe* pipe = (hash_pipe*)calloc(1, sizeof(hash_pipe));
+	uint8_t* pMem = NULL;
+	int ret = 0;
+
+	// mapped images are hashed straight from the mapping, the rest is read into the ring
+	if(!pipe || (!r.pMap && !(pMem = (uint8_t*)malloc((size_t)PSISO_HASH_BLOCKS * PSISO_HASH_BLOCK_SIZE)))) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Not enough memory to hash \"%s\". \n", szPath);
+		goto done;
+	}
+
+	pipe->semFree = psxSemCreate(PSISO_HASH_BLOCKS);
+	pipe->mutex = psxMutexCreate();
+	if(!pipe->semFree || !pipe->mutex) goto done;
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Hashing \"%s\" (%.2f MB) \n", szPath, (double)r.nFileSize / (1024.0 * 1024.0));
+
+	for(uint32_t nAlgo = PSISO_HASH_CRC32; nAlgo <= PSISO_HASH_SHA256; nAlgo <<= 1)
+	{
+		if(!(nAlgos & nAlgo)) continue;
+
+		hash_worker* w = &pipe->workers[pipe->nWorkers];
+		w->pipe = pipe;
+		w->nAlgo = nAlgo;
+		psxMD5Init(&w->md5);
+		psxSHA1Init(&w->sha1);
+		psxSHA256Init(&w->sha256);
+
+		w->semReady = psxSemCreate(0);
+		if(!w->semReady) break;
+		w->thread = psxThreadStart(hash_worker_main, w);
+		if(!w->thread) {
+			psxSemDestroy(w->semReady);
+			break;
+		}
+		pipe->nWorkers++;
+
+		psxLog(ctx, PSISO_LOG_VERBOSE, ">> %s: %s \n", hash_name(nAlgo), psxHashEngine(nAlgo));
+	}
+
+	{
+		bool bFailed = (pipe->nWorkers == 0);
+		for(uint32_t nAlgo = PSISO_HASH_CRC32; nAlgo <= PSISO_HASH_SHA256; nAlgo <<= 1) {
+			bool bStarted = false;
+			for(int i = 0; i < pipe->nWorkers; i++) {
+				if(pipe->workers[i].nAlgo == nAlgo) bStarted = true;
+			}
+			if((nAlgos & nAlgo) && !bStarted) bFailed = true;
+		}
+
+		psxReaderAdvise(&r, 0, 0, PSISO_ADVISE_SEQUENTIAL);
+
+		uint64_t nPos = 0;
+		int nPct = -1;
+
+		// reader, the last block handed out is always the empty one that stops the hashers
+		for(uint32_t n = 0; ; n++)
+		{
+			psxSemWait(pipe->semFree);
+
+			hash_block* block = &pipe->blocks[n % PSISO_HASH_BLOCKS];
+			uint64_t nLeft = bFailed ? 0 : r.nFileSize - nPos;
+			size_t nLen = (nLeft > PSISO_HASH_BLOCK_SIZE) ? PSISO_HASH_BLOCK_SIZE : (size_t)nLeft;
+
+			if(nLen && r.pMap)
+			{
+				block->pData = psxReaderView(&r, (uint32_t)(nPos / PSISO_SECTOR_SIZE), nLen);
+				if(nPos + nLen < r.nFileSize) {
+					psxReaderAdvise(&r, nPos + nLen, PSISO_HASH_BLOCK_SIZE, PSISO_ADVISE_WILLNEED);
+				}
+			}
+			else if(nLen)
+			{
+				uint8_t* pBuf = pMem + (size_t)(n % PSISO_HASH_BLOCKS) * PSISO_HASH_BLOCK_SIZE;
+				if(psxReaderReadRaw(&r, nPos, pBuf, nLen) != nLen) {
+					psxLog(ctx, PSISO_LOG_INFO, "Error: Read failed at offset 0x%llX on \"%s\". \n", (unsigned long long)nPos, szPath);
+					bFailed = true;
+					nLen = 0;
+				}
+				block->pData = pBuf;
+			}
+
+			block->nLen = nLen;
+			block->nPending = pipe->nWorkers;
+			for(int i = 0; i < pipe->nWorkers; i++) {
+				psxSemPost(pipe->workers[i].semReady);
+			}
+			if(nLen == 0) break;
+
+			nPos += nLen;
+			int nNewPct = (int)(nPos * 100 / r.nFileSize);
+			if(progress && nNewPct != nPct) {
+				nPct = nNewPct;
+				progress(pProgressUser, nPos, r.nFileSize);
+			}
+		}
+
+		for(int i = 0; i < pipe->nWorkers; i++) {
+			psxThreadJoin(pipe->workers[i].thread);
+			psxSemDestroy(pipe->workers[i].semReady);
+		}
+		if(bFailed) goto done;
+
+		if(progress && nPct != 100) {
+			progress(pProgressUser, nPos, r.nFileSize);
+		}
+	}
+
+	for(int i = 0; i < pipe->nWorkers; i++)
+	{
+		hash_worker* w = &pipe->workers[i];
+		switch(w->nAlgo) {
+			case PSISO_HASH_CRC32:	res->nCRC32 = w->nCRC32; break;
+			case PSISO_HASH_MD5:	psxMD5Final(&w->md5, res->md5); break;
+			case PSISO_HASH_SHA1:	psxSHA1Final(&w->sha1, res->sha1); break;
+			case PSISO_HASH_SHA256:	psxSHA256Final(&w->sha256, res->sha256); break;
+		}
+	}
+	res->nAlgos = nAlgos;
+	res->nBytes = r.nFileSize;
+	ret = 1;
+
+done:
+	if(pipe) {
+		if(pipe->semFree) psxSemDestroy(pipe->semFree);
+		if(pipe->mutex) psxMutexDestroy(pipe->mutex);
+	}
+	SAFE_FREE(pipe);
+	SAFE_FREE(pMem);
+	psxReaderClose(&r);
+	return ret;
+}
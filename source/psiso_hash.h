@@ -0,0 +1,113 @@
+#ifndef PSISO_HASH_H
+#define PSISO_HASH_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// Hashing module
+// ------------------------------------------------------------------------------------------------
+// CRC32 (zlib / Redump polynomial), MD5, SHA-1 and SHA-256. Every algorithm can be used on its
+// own (Init / Update / Final) or all of them at once on a whole image with psxHashFile(), which
+// reads the image a single time:
+//
+//	reader (calling thread)		fills a ring of PSISO_HASH_BLOCKS blocks with large sequential
+//								reads (or hands out views of the mapping on mapped images)
+//	hasher (one per algorithm)	consumes every block in order, a block is reused once all the
+//								hashers are done with it
+//
+// So the image is read at the speed of the disk while each digest runs on its own core, the
+// slowest algorithm sets the pace instead of the sum of all of them.
+//
+// On x86 builds (GCC 5+ / clang) the CPU is checked once at run time: CRC32 is folded with
+// PCLMULQDQ and SHA-1 / SHA-256 use the SHA extensions when present, otherwise CRC32 uses
+// slice-by-16 tables and the SHAs the portable code. Build with -DPSISO_HASH_NO_SIMD to always
+// use the portable code.
+
+#define PSISO_HASH_BLOCK_SIZE		(8 * 1024 * 1024)	// bytes per read
+#define PSISO_HASH_BLOCKS			4					// blocks in flight
+
+#define PSISO_HASH_CRC32			0x01
+#define PSISO_HASH_MD5				0x02
+#define PSISO_HASH_SHA1				0x04
+#define PSISO_HASH_SHA256			0x08
+#define PSISO_HASH_ALL				0x0F
+
+#define PSISO_MD5_SIZE				16
+#define PSISO_SHA1_SIZE				20
+#define PSISO_SHA256_SIZE			32
+
+struct psiso_md5
+{
+	uint32_t	h[4];
+	uint64_t	nLen;		// bytes hashed so far
+	uint8_t		buf[64];	// partial block
+};
+
+struct psiso_sha1
+{
+	uint32_t	h[5];
+	uint64_t	nLen;
+	uint8_t		buf[64];
+};
+
+struct psiso_sha256
+{
+	uint32_t	h[8];
+	uint64_t	nLen;
+	uint8_t		buf[64];
+};
+
+// zlib style CRC32, start with nCRC = 0 and pass the previous result to continue
+uint32_t psxCRC32(uint32_t nCRC, const void* pData, size_t nLen);
+
+void psxMD5Init(psiso_md5* md5);
+void psxMD5Update(psiso_md5* md5, const void* pData, size_t nLen);
+void psxMD5Final(psiso_md5* md5, uint8_t* pDigest);
+
+void psxSHA1Init(psiso_sha1* sha);
+void psxSHA1Update(psiso_sha1* sha, const void* pData, size_t nLen);
+void psxSHA1Final(psiso_sha1* sha, uint8_t* pDigest);
+
+void psxSHA256Init(psiso_sha256* sha);
+void psxSHA256Update(psiso_sha256* sha, const void* pData, size_t nLen);
+void psxSHA256Final(psiso_sha256* sha, uint8_t* pDigest);
+
+// Implementation used for one of the PSISO_HASH_* algorithms (Ex. "PCLMUL", "SHA-NI", "portable")
+const char* psxHashEngine(uint32_t nAlgo);
+
+// Lower case hex of pData into szOut (nLen * 2 + 1 bytes)
+void psxHashToHex(const uint8_t* pData, size_t nLen, char* szOut);
+
+struct psiso_hash_result
+{
+	uint32_t	nAlgos;						// PSISO_HASH_* computed
+	uint64_t	nBytes;						// bytes hashed (size of the image)
+	uint32_t	nCRC32;
+	uint8_t		md5[PSISO_MD5_SIZE];
+	uint8_t		sha1[PSISO_SHA1_SIZE];
+	uint8_t		sha256[PSISO_SHA256_SIZE];
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and details go to its log sink)
+(in)	szPath			- File to hash, the whole file is hashed as is (no sector de-framing).
+						  CSO / ZSO images are opened through psxReaderOpen() and hashed
+						  decompressed, so the digests match the ones of the plain ISO.
+(in)	nAlgos			- PSISO_HASH_* flags of the digests to compute
+(out)	res				- Digests
+(in)	progress		- Called after every block (optional)
+(in)	pProgressUser	- User data passed to progress
+
+(out)	return			- Will return 1 for success and 0 for failure (file can not be opened or
+						  a read failed).
+-------------------------------------------------------------------------------------------------
+*/
+int psxHashFile(psiso_ctx* ctx, const char* szPath, uint32_t nAlgos, psiso_hash_result* res, psiso_progress_func progress, void* pProgressUser);
+
+// Same as psxHashFile() for the bytes [nOffset, nOffset + nLen) of the file (Ex. one track of a
+// CUE / BIN image, see psiso_cue_track), nLen is clipped to the end of the file. A range starting
+// at 0 of a CSO / ZSO is taken from the decompressed image, any other range from the file itself.
+int psxHashFileRange(psiso_ctx* ctx, const char* szPath, uint64_t nOffset, uint64_t nLen, uint32_t nAlgos, psiso_hash_result* res, psiso_progress_func progress, void* pProgressUser);
+
+#endif
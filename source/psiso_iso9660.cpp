@@ -0,0 +1,407 @@
+// ------------------------------------------------------------------------------
+// ISO9660 directory module
+// ------------------------------------------------------------------------------
+#include "psiso_iso9660.h"
+
+static bool iso_name_equal(const char* a, const char* b, size_t nLen)
+{
+	for(size_t i = 0; i < nLen; i++)
+	{
+		char ca = a[i];
+		char cb = b[i];
+		if(ca >= 'a' && ca <= 'z') ca -= 'a' - 'A';
+		if(cb >= 'a' && cb <= 'z') cb -= 'a' - 'A';
+		if(ca != cb) return false;
+		if(ca == 0) return true;
+	}
+	return true;
+}
+
+int psxNameEqual(const char* a, const char* b)
+{
+	size_t nLen = strlen(a);
+	return (strlen(b) == nLen && iso_name_equal(a, b, nLen)) ? 1 : 0;
+}
+
+int psxParseDirRecord(const uint8_t* p, size_t nAvail, psiso_dirent* ent)
+{
+	if(nAvail == 0 || p[0] == 0) {
+		return 0; // padding
+	}
+
+	uint8_t nLength = p[0];
+	if(nLength < ISO_DR_MIN_LEN || nLength > nAvail) {
+		return -1;
+	}
+
+	uint8_t nNameLen = p[32];
+	if(ISO_DR_MIN_LEN + nNameLen > nLength) {
+		return -1;
+	}
+
+	memset(ent, 0, sizeof(psiso_dirent));
+	ent->nLength	= nLength;
+	ent->nExtent	= psx_le32(p + 2);	// both-endian, LE half
+	ent->nDataLen	= psx_le32(p + 10);	// both-endian, LE half
+	ent->nFlags		= p[25];
+
+	// CD-XA field: owner (4), attributes (2, big-endian), "XA", file number, reserved (5)
+	uint32_t nSystemUse = ISO_DR_MIN_LEN + nNameLen + ((nNameLen & 1) ? 0 : 1);
+	if(nSystemUse + ISO_XA_LEN <= nLength && p[nSystemUse + 6] == 'X' && p[nSystemUse + 7] == 'A') {
+		ent->nXAAttr = (uint16_t)((p[nSystemUse + 4] << 8) | p[nSystemUse + 5]);
+	}
+
+	const char* name = (const char*)p + ISO_DR_MIN_LEN;
+
+	if(nNameLen == 1 && name[0] == 0) {
+		strcpy(ent->szName, ".");
+	} else if(nNameLen == 1 && name[0] == 1) {
+		strcpy(ent->szName, "..");
+	} else {
+		memcpy(ent->szName, name, nNameLen);
+		ent->szName[nNameLen] = 0;
+
+		// strip version suffix (Ex. "SYSTEM.CNF;1") and empty extension (Ex. "FILE.")
+		char* ch = strchr(ent->szName, ';');
+		if(ch) *ch = 0;
+
+		size_t nLen = strlen(ent->szName);
+		if(nLen > 1 && ent->szName[nLen - 1] == '.') {
+			ent->szName[nLen - 1] = 0;
+		}
+	}
+
+	return nLength;
+}
+
+int psxDirOpen(psiso_reader* r, const psiso_dirent* dir, psiso_dir* it)
+{
+	memset(it, 0, sizeof(psiso_dir));
+
+	if(!(dir->nFlags & ISO_DR_FLAG_DIRECTORY)) {
+		return 0;
+	}
+
+	// all sectors of the directory extent
+	size_t nLen = ((size_t)dir->nDataLen + PSISO_SECTOR_SIZE - 1) & ~(size_t)(PSISO_SECTOR_SIZE - 1);
+	if(nLen == 0 || nLen > ISO_MAX_DIR_LEN) {
+		return 0;
+	}
+
+	// mapped images are walked in place
+	it->pData = psxReaderView(r, dir->nExtent, nLen);
+	if(it->pData) {
+		it->nLen = nLen;
+		return 1;
+	}
+
+	it->pBuf = (uint8_t*)malloc(nLen);
+	if(!it->pBuf) return 0;
+	it->pData = it->pBuf;
+
+	it->nLen = psxReaderRead(r, dir->nExtent, 0, it->pBuf, nLen);
+	if(it->nLen == 0) {
+		psxDirClose(it);
+		return 0;
+	}
+	return 1;
+}
+
+int psxDirNext(psiso_dir* it, psiso_dirent* ent)
+{
+	while(it->nPos < it->nLen)
+	{
+		size_t nSectorEnd = (it->nPos / PSISO_SECTOR_SIZE + 1) * PSISO_SECTOR_SIZE;
+		if(nSectorEnd > it->nLen) nSectorEnd = it->nLen;
+
+		int ret = psxParseDirRecord(it->pData + it->nPos, nSectorEnd - it->nPos, ent);
+
+		if(ret <= 0) {
+			// records never cross sectors, continue on the next one
+			it->nPos = nSectorEnd;
+			continue;
+		}
+		it->nPos += ret;
+
+		if(strcmp(ent->szName, ".") == 0 || strcmp(ent->szName, "..") == 0) {
+			continue;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+void psxDirClose(psiso_dir* it)
+{
+	SAFE_FREE(it->pBuf);
+	it->pData = NULL;
+	it->nLen = 0;
+	it->nPos = 0;
+}
+
+int psxDirFind(psiso_reader* r, const psiso_dirent* dir, const char* szName, psiso_dirent* ent)
+{
+	psiso_dir it;
+	if(!psxDirOpen(r, dir, &it)) {
+		return 0;
+	}
+
+	size_t nNameLen = strlen(szName);
+	int ret = 0;
+
+	while(psxDirNext(&it, ent))
+	{
+		if(strlen(ent->szName) == nNameLen && iso_name_equal(ent->szName, szName, nNameLen)) {
+			ret = 1;
+			break;
+		}
+	}
+	psxDirClose(&it);
+	return ret;
+}
+
+int psxFindPath(psiso_reader* r, const psiso_dirent* dir, const char* szPath, psiso_dirent* ent)
+{
+	psiso_dirent cur = *dir;
+
+	while(*szPath)
+	{
+		while(*szPath == '/' || *szPath == '\\') szPath++;
+		if(!*szPath) break;
+
+		const char* end = szPath;
+		while(*end && *end != '/' && *end != '\\') end++;
+
+		char szName[ISO_MAX_NAME];
+		size_t nLen = (size_t)(end - szPath);
+		if(nLen >= sizeof(szName)) return 0;
+
+		memcpy(szName, szPath, nLen);
+		szName[nLen] = 0;
+
+		if(!psxDirFind(r, &cur, szName, &cur)) {
+			return 0;
+		}
+		szPath = end;
+	}
+
+	*ent = cur;
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+// Path table
+
+#define ISO_MAX_PATH_TABLE_LEN		(4 * 1024 * 1024)
+
+static uint32_t ptable_hash(uint32_t nParent, const char* szName, size_t nNameLen)
+{
+	// FNV-1a over the upper case name, seeded with the parent number
+	uint32_t h = 2166136261u ^ nParent;
+	h *= 16777619u;
+	for(size_t i = 0; i < nNameLen; i++)
+	{
+		char c = szName[i];
+		if(c >= 'a' && c <= 'z') c -= 'a' - 'A';
+		h ^= (uint8_t)c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int ptable_parse(const uint8_t* data, size_t nLen, bool bBigEndian, psiso_path_table* pt)
+{
+	// count entries first
+	uint32_t nEntries = 0;
+	size_t nPos = 0;
+	while(nPos + 8 <= nLen)
+	{
+		uint8_t nNameLen = data[nPos];
+		if(nNameLen == 0) break;
+		nPos += 8 + nNameLen + (nNameLen & 1);
+		nEntries++;
+	}
+	if(nEntries == 0 || nPos > nLen) {
+		return 0;
+	}
+
+	pt->pEntries = (psiso_ptable_entry*)malloc(nEntries * sizeof(psiso_ptable_entry));
+	pt->pNames = (char*)malloc(nLen);
+	if(!pt->pEntries || !pt->pNames) {
+		psxPathTableFree(pt);
+		return 0;
+	}
+
+	uint32_t nNamePos = 0;
+	nPos = 0;
+	for(uint32_t i = 0; i < nEntries; i++)
+	{
+		const uint8_t* p = data + nPos;
+		psiso_ptable_entry* e = &pt->pEntries[i];
+
+		e->nNameLen		= p[0];
+		e->nExtent		= bBigEndian ? psx_be32(p + 2) : psx_le32(p + 2);
+		e->nParent		= bBigEndian ? psx_be16(p + 6) : psx_le16(p + 6);
+		e->nNameOffset	= nNamePos;
+
+		// directories are listed after their parent
+		if(e->nParent == 0 || e->nParent > i + 1) {
+			psxPathTableFree(pt);
+			return 0;
+		}
+
+		memcpy(pt->pNames + nNamePos, p + 8, e->nNameLen);
+		nNamePos += e->nNameLen;
+		nPos += 8 + e->nNameLen + (e->nNameLen & 1);
+	}
+	pt->nEntries = nEntries;
+
+	// (parent, name) index
+	pt->nHashSize = 16;
+	while(pt->nHashSize < nEntries * 2) pt->nHashSize <<= 1;
+
+	pt->pHash = (uint32_t*)malloc(pt->nHashSize * sizeof(uint32_t));
+	if(!pt->pHash) {
+		psxPathTableFree(pt);
+		return 0;
+	}
+	memset(pt->pHash, 0, pt->nHashSize * sizeof(uint32_t));
+
+	for(uint32_t i = 1; i < nEntries; i++) // skip root
+	{
+		const psiso_ptable_entry* e = &pt->pEntries[i];
+		uint32_t h = ptable_hash(e->nParent, pt->pNames + e->nNameOffset, e->nNameLen) & (pt->nHashSize - 1);
+		while(pt->pHash[h]) {
+			h = (h + 1) & (pt->nHashSize - 1);
+		}
+		pt->pHash[h] = i + 1;
+	}
+	return 1;
+}
+
+int psxPathTableLoad(psiso_reader* r, const uint8_t* pvd, psiso_path_table* pt)
+{
+	memset(pt, 0, sizeof(psiso_path_table));
+
+	uint32_t nSize = psx_le32(pvd + ISO_PVD_PT_SIZE_OFFSET);
+	if(nSize == 0 || nSize > ISO_MAX_PATH_TABLE_LEN) {
+		return 0;
+	}
+
+	uint8_t* data = (uint8_t*)malloc(nSize);
+	if(!data) return 0;
+
+	int ret = 0;
+
+	if(psxReaderRead(r, psx_le32(pvd + ISO_PVD_PT_L_OFFSET), 0, data, nSize) == nSize) {
+		ret = ptable_parse(data, nSize, false, pt);
+	}
+	if(!ret && psxReaderRead(r, psx_be32(pvd + ISO_PVD_PT_M_OFFSET), 0, data, nSize) == nSize) {
+		ret = ptable_parse(data, nSize, true, pt);
+	}
+
+	SAFE_FREE(data);
+	return ret;
+}
+
+void psxPathTableFree(psiso_path_table* pt)
+{
+	SAFE_FREE(pt->pEntries);
+	SAFE_FREE(pt->pNames);
+	SAFE_FREE(pt->pHash);
+	pt->nEntries = 0;
+	pt->nHashSize = 0;
+}
+
+uint32_t psxPathTableChild(const psiso_path_table* pt, uint32_t nParent, const char* szName, size_t nNameLen)
+{
+	if(!pt->pHash) return 0;
+
+	uint32_t h = ptable_hash(nParent, szName, nNameLen) & (pt->nHashSize - 1);
+
+	while(pt->pHash[h])
+	{
+		uint32_t nIndex = pt->pHash[h] - 1;
+		const psiso_ptable_entry* e = &pt->pEntries[nIndex];
+
+		if(e->nParent == nParent && e->nNameLen == nNameLen && iso_name_equal(pt->pNames + e->nNameOffset, szName, nNameLen)) {
+			return nIndex + 1;
+		}
+		h = (h + 1) & (pt->nHashSize - 1);
+	}
+	return 0;
+}
+
+// Directory record of a directory, taken from its own "." record (the path table
+// only knows the extent location, not the data length)
+static int dir_self_record(psiso_reader* r, uint32_t nExtent, const char* szName, size_t nNameLen, psiso_dirent* ent)
+{
+	const uint8_t* sector = psxReaderSector(r, nExtent);
+	if(!sector) return 0;
+
+	if(psxParseDirRecord(sector, PSISO_SECTOR_SIZE, ent) <= 0 || !(ent->nFlags & ISO_DR_FLAG_DIRECTORY)) {
+		return 0;
+	}
+	ent->nExtent = nExtent;
+
+	if(nNameLen >= sizeof(ent->szName)) nNameLen = sizeof(ent->szName) - 1;
+	memcpy(ent->szName, szName, nNameLen);
+	ent->szName[nNameLen] = 0;
+	return 1;
+}
+
+int psxFindPathEx(psiso_reader* r, const psiso_dirent* root, const psiso_path_table* pt, const char* szPath, psiso_dirent* ent)
+{
+	if(!pt || !pt->nEntries) {
+		return psxFindPath(r, root, szPath, ent);
+	}
+
+	uint32_t nDir = 1; // root
+	const char* szDirName = "";
+	size_t nDirNameLen = 0;
+
+	while(*szPath)
+	{
+		while(*szPath == '/' || *szPath == '\\') szPath++;
+		if(!*szPath) break;
+
+		const char* end = szPath;
+		while(*end && *end != '/' && *end != '\\') end++;
+
+		size_t nLen = (size_t)(end - szPath);
+		uint32_t nChild = psxPathTableChild(pt, nDir, szPath, nLen);
+
+		if(!nChild)
+		{
+			// not a directory, must be the last component (a file inside nDir)
+			const char* rest = end;
+			while(*rest == '/' || *rest == '\\') rest++;
+			if(*rest) return 0;
+
+			char szName[ISO_MAX_NAME];
+			if(nLen >= sizeof(szName)) return 0;
+			memcpy(szName, szPath, nLen);
+			szName[nLen] = 0;
+
+			psiso_dirent dir;
+			if(nDir == 1) {
+				dir = *root;
+			} else if(!dir_self_record(r, pt->pEntries[nDir - 1].nExtent, szDirName, nDirNameLen, &dir)) {
+				return 0;
+			}
+			return psxDirFind(r, &dir, szName, ent);
+		}
+
+		// name as written on the image (the lookup is case-insensitive)
+		nDir = nChild;
+		szDirName = pt->pNames + pt->pEntries[nDir - 1].nNameOffset;
+		nDirNameLen = pt->pEntries[nDir - 1].nNameLen;
+		szPath = end;
+	}
+
+	if(nDir == 1) {
+		*ent = *root;
+		return 1;
+	}
+	return dir_self_record(r, pt->pEntries[nDir - 1].nExtent, szDirName, nDirNameLen, ent);
+}
@@ -0,0 +1,146 @@
+#ifndef PSISO_ISO9660_H
+#define PSISO_ISO9660_H
+
+#include "psiso_reader.h"
+
+// ------------------------------------------------------------------------------------------------
+// ISO9660 directory module
+// ------------------------------------------------------------------------------------------------
+
+#define ISO_PVD_SECTOR				16		// Primary Volume Descriptor location
+#define ISO_PVD_ROOT_DR_OFFSET		0x9C	// Root Directory Record inside the PVD
+#define ISO_PVD_PT_SIZE_OFFSET		0x84	// path table size (both-endian)
+#define ISO_PVD_PT_L_OFFSET			0x8C	// L path table location (LE), optional copy at +4
+#define ISO_PVD_PT_M_OFFSET			0x94	// M path table location (BE), optional copy at +4
+
+#define ISO_DR_FLAG_HIDDEN			0x01
+#define ISO_DR_FLAG_DIRECTORY		0x02
+#define ISO_DR_FLAG_MULTI_EXTENT	0x80
+
+#define ISO_DR_MIN_LEN				0x21	// fixed part of a directory record (33 bytes)
+#define ISO_XA_LEN					14		// CD-XA system use field after the file identifier
+
+// CD-XA attributes (PS1 / PS2 CD discs), psiso_dirent::nXAAttr
+#define ISO_XA_FORM1				0x0800
+#define ISO_XA_FORM2				0x1000	// Mode 2 Form 2 sectors (XA audio)
+#define ISO_XA_INTERLEAVED			0x2000	// Form 1 / Form 2 sectors mixed (STR video)
+#define ISO_XA_CDDA					0x4000	// CD audio track, no data on the data track
+#define ISO_XA_DIRECTORY			0x8000
+#define ISO_MAX_NAME				256
+#define ISO_MAX_DIR_LEN				(16 * 1024 * 1024)	// sanity limit for a directory extent
+
+struct psiso_dirent
+{
+	uint8_t		nLength;			// record length
+	uint32_t	nExtent;			// extent location (LBA)
+	uint32_t	nDataLen;			// data length in bytes
+	uint8_t		nFlags;				// ISO_DR_FLAG_*
+	uint16_t	nXAAttr;			// ISO_XA_* (0 if the record has no CD-XA field)
+	char		szName[ISO_MAX_NAME];	// file identifier, without ";1" version suffix
+};
+
+// Path table entry (one per directory, entry 1 is the root)
+struct psiso_ptable_entry
+{
+	uint32_t	nExtent;			// extent location (LBA)
+	uint16_t	nParent;			// parent directory number (1-based)
+	uint16_t	nNameLen;
+	uint32_t	nNameOffset;		// offset into psiso_path_table::pNames
+};
+
+struct psiso_path_table
+{
+	psiso_ptable_entry*	pEntries;	// pEntries[0] is directory number 1 (root)
+	uint32_t			nEntries;
+	char*				pNames;		// name pool (not NULL terminated)
+	uint32_t*			pHash;		// (parent, name) -> entry index + 1, open addressing
+	uint32_t			nHashSize;	// power of 2
+};
+
+// Iterator over the records of one directory extent
+struct psiso_dir
+{
+	const uint8_t*	pData;		// directory extent (on the image mapping or in pBuf)
+	uint8_t*		pBuf;		// owned copy when the image is not mapped
+	size_t			nLen;
+	size_t			nPos;
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	p				- Pointer to a directory record
+(in)	nAvail			- Bytes available from p (up to the end of the sector)
+(out)	ent				- Decoded record
+
+(out)	return			- Will return the record length, 0 if there is no record at p (zero
+						  padding up to the end of a sector) or -1 if the record is malformed.
+-------------------------------------------------------------------------------------------------
+*/
+int psxParseDirRecord(const uint8_t* p, size_t nAvail, psiso_dirent* ent);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	r				- Reader
+(in)	dir				- Directory record of the directory to walk
+(out)	it				- Iterator, release with psxDirClose()
+
+(out)	return			- Will return 1 for success and 0 for failure.
+
+The whole directory extent (data length of the record, any number of sectors) is fetched
+with one contiguous read.
+-------------------------------------------------------------------------------------------------
+*/
+int psxDirOpen(psiso_reader* r, const psiso_dirent* dir, psiso_dir* it);
+
+// Next record on the directory ("." and ".." are skipped). Returns 1 if a record was
+// returned, 0 at the end of the directory.
+int psxDirNext(psiso_dir* it, psiso_dirent* ent);
+void psxDirClose(psiso_dir* it);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	r				- Reader
+(in)	dir				- Directory record where the lookup starts (usually the root)
+(in)	szPath			- Name or path relative to dir (Ex. "SYSTEM.CNF", "PS3_GAME/PARAM.SFO")
+(out)	ent				- Record of the file / directory found
+
+(out)	return			- Will return 1 if found and 0 if not.
+
+Names are compared case-insensitive and the ";1" version suffix is ignored.
+-------------------------------------------------------------------------------------------------
+*/
+int psxDirFind(psiso_reader* r, const psiso_dirent* dir, const char* szName, psiso_dirent* ent);
+
+// Case insensitive (ASCII) comparison of two file names, 1 if equal
+int psxNameEqual(const char* a, const char* b);
+int psxFindPath(psiso_reader* r, const psiso_dirent* dir, const char* szPath, psiso_dirent* ent);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	r				- Reader
+(in)	pvd				- Primary Volume Descriptor (2048 bytes)
+(out)	pt				- Path table, release with psxPathTableFree()
+
+(out)	return			- Will return 1 for success and 0 for failure.
+
+The L (little endian) path table is loaded with one read, if it is damaged the M (big endian)
+copy is used instead. All directories are indexed by (parent, name) so resolving a directory
+path costs one lookup per path component, with no directory reads.
+-------------------------------------------------------------------------------------------------
+*/
+int psxPathTableLoad(psiso_reader* r, const uint8_t* pvd, psiso_path_table* pt);
+void psxPathTableFree(psiso_path_table* pt);
+
+// Directory number (1-based) of a child of nParent, or 0 if there is none with that name.
+uint32_t psxPathTableChild(const psiso_path_table* pt, uint32_t nParent, const char* szName, size_t nNameLen);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+Same as psxFindPath(), but the directory components of szPath are resolved with the path table
+(pass NULL to walk the directories). Ex. "PS3_GAME/USRDIR/EBOOT.BIN" only reads the USRDIR
+directory extent. szPath is relative to the root directory.
+-------------------------------------------------------------------------------------------------
+*/
+int psxFindPathEx(psiso_reader* r, const psiso_dirent* root, const psiso_path_table* pt, const char* szPath, psiso_dirent* ent);
+
+#endif
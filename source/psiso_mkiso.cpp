@@ -0,0 +1,1121 @@
+// ------------------------------------------------------------------------------
+// ISO builder module
+// ------------------------------------------------------------------------------
+#include "psiso_mkiso.h"
+#include "psiso_iso9660.h"
+#include <time.h>
+
+#ifdef WIN
+#include <windows.h>
+#define PATH_SEP	'\\'
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#define PATH_SEP	'/'
+#endif
+
+#if defined(__linux__) && !defined(PSISOTOOL_PS3BUILD)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <errno.h>
+#ifdef FICLONERANGE
+#define MKISO_CLONE
+#endif
+#ifdef __NR_copy_file_range
+#define MKISO_COPY_RANGE
+#endif
+#endif
+
+#define MKISO_FIRST_LBA			(ISO_PVD_SECTOR + 3)	// after the PVD, Joliet SVD and terminator
+#define MKISO_DOT_LEN			34						// "." and ".." records
+#define MKISO_MAX_DIRS			0xFFFF					// path table parent numbers are 16 bit
+#define MKISO_MAX_DEPTH			64
+#define MKISO_MAX_RECORD_LEN	255						// directory record length is one byte
+#define MKISO_NONE				0xFFFFFFFF
+
+#define MKISO_SECTORS(x)		((uint32_t)(((uint64_t)(x) + PSISO_SECTOR_SIZE - 1) / PSISO_SECTOR_SIZE))
+
+void psxMkISOOptsInit(psiso_mkiso_opts* opts)
+{
+	memset(opts, 0, sizeof(psiso_mkiso_opts));
+	opts->szVolumeID = PSISO_MKISO_VOLUME_ID;
+	opts->nFileAlign = PSISO_MKISO_FILE_ALIGN;
+	opts->bZeroCopy = true;
+	opts->nLayout = PSISO_MKISO_LAYOUT_PS3;
+}
+
+// ------------------------------------------------------------------------------
+// Source tree
+
+struct mkiso_node
+{
+	char*		szName;			// source name
+	uint8_t		nFlags;			// ISO_DR_FLAG_DIRECTORY for directories
+	uint64_t	nSize;			// files: size in bytes
+	uint32_t	nParent;		// node of the parent directory (the root is its own parent)
+	uint32_t	nFirstChild;	// directories: children are the nodes [nFirstChild, nFirstChild + nChildren)
+	uint32_t	nChildren;
+	uint32_t	nDirNum;		// directories: path table number (1-based)
+	uint32_t	nLBA;			// files: first data sector, directories: primary extent
+	uint32_t	nJolietLBA;		// directories: Joliet extent
+	uint32_t	nDirLen;		// directories: primary extent length in bytes
+	uint32_t	nJolietDirLen;	// directories: Joliet extent length in bytes
+};
+
+// Nodes are listed breadth first with the children of every directory sorted by name, which is
+// also the order of the path table, so directory numbers are just the order of the directories.
+struct mkiso_tree
+{
+	mkiso_node*	pNodes;
+	uint32_t	nCount;
+	uint32_t	nCapacity;
+	uint32_t	nDirs;
+	uint32_t	nFiles;
+	uint64_t	nBytes;
+};
+
+static uint32_t tree_add(mkiso_tree* t, const char* szName, uint8_t nFlags, uint64_t nSize, uint32_t nParent)
+{
+	if(t->nCount == t->nCapacity)
+	{
+		uint32_t nCapacity = t->nCapacity ? t->nCapacity * 2 : 256;
+		mkiso_node* nodes = (mkiso_node*)realloc(t->pNodes, nCapacity * sizeof(mkiso_node));
+		if(!nodes) return MKISO_NONE;
+		t->pNodes = nodes;
+		t->nCapacity = nCapacity;
+	}
+	char* name = (char*)malloc(strlen(szName) + 1);
+	if(!name) return MKISO_NONE;
+	strcpy(name, szName);
+
+	mkiso_node* n = &t->pNodes[t->nCount];
+	memset(n, 0, sizeof(mkiso_node));
+	n->szName	= name;
+	n->nFlags	= nFlags;
+	n->nSize	= nSize;
+	n->nParent	= nParent;
+	return t->nCount++;
+}
+
+static void tree_free(mkiso_tree* t)
+{
+	for(uint32_t i = 0; i < t->nCount; i++) {
+		SAFE_FREE(t->pNodes[i].szName);
+	}
+	SAFE_FREE(t->pNodes);
+	t->nCount = 0;
+	t->nCapacity = 0;
+}
+
+// Source path of a node (cSep = PATH_SEP), or its path relative to the source with szRoot = ""
+static int node_path(const mkiso_tree* t, const char* szRoot, uint32_t nNode, char cSep, char* szOut, size_t nOutSize)
+{
+	uint32_t chain[MKISO_MAX_DEPTH];
+	uint32_t nDepth = 0;
+	for(uint32_t i = nNode; i != 0; i = t->pNodes[i].nParent) {
+		if(nDepth == MKISO_MAX_DEPTH) return 0;
+		chain[nDepth++] = i;
+	}
+
+	size_t nLen = (size_t)snprintf(szOut, nOutSize, "%s", szRoot);
+	while(nDepth-- && nLen < nOutSize) {
+		if(nLen || szRoot[0]) szOut[nLen++] = cSep;
+		nLen += (size_t)snprintf(szOut + nLen, nOutSize - nLen, "%s", t->pNodes[chain[nDepth]].szName);
+	}
+	return nLen < nOutSize;
+}
+
+static int node_compare(const void* a, const void* b)
+{
+	return strcmp(((const mkiso_node*)a)->szName, ((const mkiso_node*)b)->szName);
+}
+
+static int list_dir(psiso_ctx* ctx, mkiso_tree* t, const char* szRoot, uint32_t nDir)
+{
+	char szPath[4096];
+	if(!node_path(t, szRoot, nDir, PATH_SEP, szPath, sizeof(szPath))) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Directory tree is too deep. \n");
+		return 0;
+	}
+
+	uint32_t nFirst = t->nCount;
+	bool bFailed = false;
+
+#ifdef WIN
+	char szFind[4096 + 4];
+	sprintf(szFind, "%s\\*", szPath);
+
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA(szFind, &fd);
+	if(h == INVALID_HANDLE_VALUE) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot open directory \"%s\". \n", szPath);
+		return 0;
+	}
+	do {
+		if(strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+		bool bDir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		uint64_t nSize = ((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+		const char* szName = fd.cFileName;
+#else
+	DIR* d = opendir(szPath);
+	if(!d) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot open directory \"%s\". \n", szPath);
+		return 0;
+	}
+
+	struct dirent* de = NULL;
+	while((de = readdir(d)))
+	{
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+		char szChild[4096 + ISO_MAX_NAME + 1];
+		snprintf(szChild, sizeof(szChild), "%s/%s", szPath, de->d_name);
+
+		struct stat st;
+		if(stat(szChild, &st) != 0) continue;
+		if(!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) continue;
+
+		bool bDir = S_ISDIR(st.st_mode);
+		uint64_t nSize = (uint64_t)st.st_size;
+		const char* szName = de->d_name;
+#endif
+		if(strlen(szName) > PSISO_MKISO_MAX_NAME) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Name is too long for the image \"%s%c%s\". \n", szPath, PATH_SEP, szName);
+			bFailed = true;
+			break;
+		}
+		if(tree_add(t, szName, bDir ? ISO_DR_FLAG_DIRECTORY : 0, bDir ? 0 : nSize, nDir) == MKISO_NONE) {
+			bFailed = true;
+			break;
+		}
+		if(!bDir) {
+			t->nFiles++;
+			t->nBytes += nSize;
+		}
+#ifdef WIN
+	} while(FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	}
+	closedir(d);
+#endif
+	if(bFailed) return 0;
+
+	// children go right after each other, sorted by name
+	mkiso_node* dir = &t->pNodes[nDir];
+	dir->nFirstChild	= nFirst;
+	dir->nChildren		= t->nCount - nFirst;
+
+	if(dir->nChildren) {
+		qsort(&t->pNodes[nFirst], dir->nChildren, sizeof(mkiso_node), node_compare);
+	}
+	return 1;
+}
+
+static int tree_build(psiso_ctx* ctx, mkiso_tree* t, const char* szRoot)
+{
+	memset(t, 0, sizeof(mkiso_tree));
+
+	if(tree_add(t, "", ISO_DR_FLAG_DIRECTORY, 0, 0) == MKISO_NONE) return 0;
+
+	// breadth first, new nodes are appended while walking
+	for(uint32_t i = 0; i < t->nCount; i++)
+	{
+		if(!(t->pNodes[i].nFlags & ISO_DR_FLAG_DIRECTORY)) continue;
+
+		if(t->nDirs == MKISO_MAX_DIRS) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Too many directories for the path table. \n");
+			return 0;
+		}
+		t->pNodes[i].nDirNum = ++t->nDirs;
+
+		if(!list_dir(ctx, t, szRoot, i)) return 0;
+	}
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+// File data layout
+
+#define MKISO_RANK_BOOT			0
+#define MKISO_RANK_MODULE		1
+#define MKISO_RANK_TRACE		2
+#define MKISO_RANK_OTHER		3
+
+// read by the console when the disc is mounted / the game boots, in this order
+static const char* mkiso_boot_files[] = {
+	"ps3_disc.sfb",
+	"ps3_game/param.sfo",
+	"ps3_game/icon0.png",
+	"ps3_game/usrdir/eboot.bin"
+};
+
+struct mkiso_order
+{
+	uint32_t	nNode;
+	uint32_t	nRank;		// MKISO_RANK_*
+	uint32_t	nKey;		// order inside the rank
+};
+
+struct mkiso_trace_entry
+{
+	char*		szPath;		// normalized
+	uint32_t	nPos;		// line order
+};
+
+// lower case, '/' separators and no leading "./" or "/"
+static void normalize_path(char* szPath)
+{
+	char* p = szPath;
+	while(p[0] == '.' && (p[1] == '/' || p[1] == '\\')) p += 2;
+	while(p[0] == '/' || p[0] == '\\') p++;
+
+	size_t nLen = 0;
+	for(; *p; p++) {
+		char c = (*p == '\\') ? '/' : *p;
+		szPath[nLen++] = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+	}
+	szPath[nLen] = 0;
+}
+
+static int trace_compare(const void* a, const void* b)
+{
+	const mkiso_trace_entry* ea = (const mkiso_trace_entry*)a;
+	const mkiso_trace_entry* eb = (const mkiso_trace_entry*)b;
+	int n = strcmp(ea->szPath, eb->szPath);
+	if(n) return n;
+	return (ea->nPos < eb->nPos) ? -1 : (ea->nPos > eb->nPos);
+}
+
+static void trace_free(mkiso_trace_entry* pEntries, uint32_t nCount)
+{
+	for(uint32_t i = 0; i < nCount; i++) {
+		SAFE_FREE(pEntries[i].szPath);
+	}
+	free(pEntries);
+}
+
+// Access trace sorted by path (first listing of each path only), NULL on failure
+static mkiso_trace_entry* trace_load(const char* szTraceFile, uint32_t* pnCount)
+{
+	*pnCount = 0;
+
+	FILE* fp = fopen(szTraceFile, "rb");
+	if(!fp) return NULL;
+
+	mkiso_trace_entry* pEntries = NULL;
+	uint32_t nCount = 0;
+	uint32_t nCapacity = 0;
+	bool bFailed = false;
+
+	char szLine[4096];
+	while(!bFailed && fgets(szLine, sizeof(szLine), fp))
+	{
+		size_t nLen = strlen(szLine);
+		while(nLen && (szLine[nLen - 1] == '\n' || szLine[nLen - 1] == '\r' || szLine[nLen - 1] == ' ' || szLine[nLen - 1] == '\t')) {
+			szLine[--nLen] = 0;
+		}
+		if(!nLen || szLine[0] == '#' || (szLine[0] == '/' && szLine[1] == '/')) continue;
+
+		normalize_path(szLine);
+
+		if(nCount == nCapacity)
+		{
+			uint32_t nNewCapacity = nCapacity ? nCapacity * 2 : 256;
+			mkiso_trace_entry* entries = (mkiso_trace_entry*)realloc(pEntries, nNewCapacity * sizeof(mkiso_trace_entry));
+			if(!entries) { bFailed = true; break; }
+			pEntries = entries;
+			nCapacity = nNewCapacity;
+		}
+		char* path = (char*)malloc(strlen(szLine) + 1);
+		if(!path) { bFailed = true; break; }
+		strcpy(path, szLine);
+
+		pEntries[nCount].szPath = path;
+		pEntries[nCount].nPos = nCount;
+		nCount++;
+	}
+	SAFE_FCLOSE(fp);
+
+	if(bFailed) {
+		trace_free(pEntries, nCount);
+		return NULL;
+	}
+	if(!pEntries) {
+		return (mkiso_trace_entry*)calloc(1, sizeof(mkiso_trace_entry));
+	}
+
+	// sorted by (path, position), only the first listing of a path is kept
+	qsort(pEntries, nCount, sizeof(mkiso_trace_entry), trace_compare);
+	uint32_t nUnique = 0;
+	for(uint32_t i = 0; i < nCount; i++) {
+		if(nUnique && strcmp(pEntries[nUnique - 1].szPath, pEntries[i].szPath) == 0) {
+			SAFE_FREE(pEntries[i].szPath);
+			continue;
+		}
+		pEntries[nUnique++] = pEntries[i];
+	}
+	*pnCount = nUnique;
+	return pEntries;
+}
+
+static int order_compare(const void* a, const void* b)
+{
+	const mkiso_order* oa = (const mkiso_order*)a;
+	const mkiso_order* ob = (const mkiso_order*)b;
+	if(oa->nRank != ob->nRank) return (oa->nRank < ob->nRank) ? -1 : 1;
+	if(oa->nKey != ob->nKey) return (oa->nKey < ob->nKey) ? -1 : 1;
+	return (oa->nNode < ob->nNode) ? -1 : (oa->nNode > ob->nNode);
+}
+
+static bool is_module(const char* szPath)
+{
+	size_t nLen = strlen(szPath);
+	return nLen > 5 && strcmp(szPath + nLen - 5, ".sprx") == 0;
+}
+
+// Order of the file data, returns the number of files in pOrder (t->nFiles) or -1 on failure
+static int layout_build(psiso_ctx* ctx, const mkiso_tree* t, const psiso_mkiso_opts* opts, mkiso_order* pOrder)
+{
+	mkiso_trace_entry* pTrace = NULL;
+	uint32_t nTrace = 0;
+
+	if(opts->nLayout == PSISO_MKISO_LAYOUT_PS3 && opts->szTraceFile) {
+		pTrace = trace_load(opts->szTraceFile, &nTrace);
+		if(!pTrace) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot read the access trace \"%s\". \n", opts->szTraceFile);
+			return -1;
+		}
+	}
+
+	uint32_t nRanks[4] = { 0, 0, 0, 0 };
+	uint32_t nFiles = 0;
+	char szPath[4096];
+
+	for(uint32_t i = 0; i < t->nCount; i++)
+	{
+		if(t->pNodes[i].nFlags & ISO_DR_FLAG_DIRECTORY) continue;
+
+		mkiso_order* o = &pOrder[nFiles++];
+		o->nNode = i;
+		o->nRank = MKISO_RANK_OTHER;
+		o->nKey = 0;
+
+		if(opts->nLayout != PSISO_MKISO_LAYOUT_PS3 || !node_path(t, "", i, '/', szPath, sizeof(szPath))) {
+			continue;
+		}
+		normalize_path(szPath);
+
+		for(uint32_t b = 0; b < sizeof(mkiso_boot_files) / sizeof(mkiso_boot_files[0]); b++) {
+			if(strcmp(szPath, mkiso_boot_files[b]) == 0) {
+				o->nRank = MKISO_RANK_BOOT;
+				o->nKey = b;
+				break;
+			}
+		}
+		if(o->nRank == MKISO_RANK_OTHER && is_module(szPath)) {
+			o->nRank = MKISO_RANK_MODULE;
+		}
+		if(o->nRank == MKISO_RANK_OTHER && nTrace) {
+			// paths are unique in the trace, lower bound by path
+			uint32_t lo = 0, hi = nTrace;
+			while(lo < hi) {
+				uint32_t mid = (lo + hi) / 2;
+				if(strcmp(pTrace[mid].szPath, szPath) < 0) lo = mid + 1; else hi = mid;
+			}
+			if(lo < nTrace && strcmp(pTrace[lo].szPath, szPath) == 0) {
+				o->nRank = MKISO_RANK_TRACE;
+				o->nKey = pTrace[lo].nPos;
+			}
+		}
+		nRanks[o->nRank]++;
+	}
+
+	if(pTrace) {
+		trace_free(pTrace, nTrace);
+	}
+
+	if(nFiles) {
+		qsort(pOrder, nFiles, sizeof(mkiso_order), order_compare);
+	}
+
+	if(opts->nLayout == PSISO_MKISO_LAYOUT_PS3) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Layout: %u boot files, %u modules, %u traced files first (%u trace entries) \n", 
+			nRanks[MKISO_RANK_BOOT], nRanks[MKISO_RANK_MODULE], nRanks[MKISO_RANK_TRACE], nTrace);
+	}
+	return (int)nFiles;
+}
+
+// ------------------------------------------------------------------------------
+// Names and records
+
+// Primary identifier (d-characters are relaxed to any printable ASCII, case is kept)
+static uint32_t iso_name(const mkiso_node* n, uint8_t* out)
+{
+	uint32_t nLen = 0;
+	for(const char* p = n->szName; *p; p++) {
+		uint8_t c = (uint8_t)*p;
+		out[nLen++] = (c < 0x20 || c >= 0x7F || c == ';' || c == '/') ? '_' : c;
+	}
+	if(!(n->nFlags & ISO_DR_FLAG_DIRECTORY)) {
+		out[nLen++] = ';';
+		out[nLen++] = '1';
+	}
+	return nLen;
+}
+
+// Joliet identifier (UCS-2 big-endian). Names are UTF-8, bytes that are not valid UTF-8 are
+// taken as Latin-1 (ANSI names on Windows).
+static uint32_t joliet_name(const mkiso_node* n, uint8_t* out)
+{
+	uint32_t nLen = 0;
+	const uint8_t* p = (const uint8_t*)n->szName;
+	while(*p)
+	{
+		uint32_t c = *p;
+		uint32_t nBytes = 1;
+		if((c & 0xE0) == 0xC0 && (p[1] & 0xC0) == 0x80) {
+			c = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+			nBytes = 2;
+		} else if((c & 0xF0) == 0xE0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+			c = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+			nBytes = 3;
+		} else if((c & 0xF8) == 0xF0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+			c = '_'; // outside of UCS-2
+			nBytes = 4;
+		}
+		p += nBytes;
+
+		if(c < 0x20 || c == '*' || c == '/' || c == ':' || c == ';' || c == '?' || c == '\\') c = '_';
+		out[nLen++] = (uint8_t)(c >> 8);
+		out[nLen++] = (uint8_t)c;
+	}
+	if(!(n->nFlags & ISO_DR_FLAG_DIRECTORY)) {
+		out[nLen++] = 0; out[nLen++] = ';';
+		out[nLen++] = 0; out[nLen++] = '1';
+	}
+	return nLen;
+}
+
+static uint32_t record_len(uint32_t nNameLen)
+{
+	// the record length is always even
+	return ISO_DR_MIN_LEN + nNameLen + ((nNameLen & 1) ? 0 : 1);
+}
+
+// Every name must fit a directory record on both trees. Joliet is the limit: a file name of n
+// UCS-2 characters takes 2n + 38 bytes (at most 108 characters), a directory name 2n + 34.
+static bool names_check(psiso_ctx* ctx, const mkiso_tree* t)
+{
+	uint8_t name[ISO_MAX_NAME];
+	for(uint32_t i = 1; i < t->nCount; i++) // skip root
+	{
+		const mkiso_node* n = &t->pNodes[i];
+		if(record_len(iso_name(n, name)) > MKISO_MAX_RECORD_LEN || record_len(joliet_name(n, name)) > MKISO_MAX_RECORD_LEN) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: Name is too long for the Joliet directory \"%s\" (at most %d characters for files, %d for directories). \n", 
+				n->szName, (MKISO_MAX_RECORD_LEN - ISO_DR_MIN_LEN - 5) / 2, (MKISO_MAX_RECORD_LEN - ISO_DR_MIN_LEN - 1) / 2);
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint32_t extent_count(const mkiso_node* n)
+{
+	if(n->nFlags & ISO_DR_FLAG_DIRECTORY || n->nSize == 0) return 1;
+	return (uint32_t)((n->nSize + PSISO_MKISO_EXTENT_MAX - 1) / PSISO_MKISO_EXTENT_MAX);
+}
+
+static void put_le16(uint8_t* p, uint16_t n) { p[0] = (uint8_t)n; p[1] = (uint8_t)(n >> 8); }
+static void put_be16(uint8_t* p, uint16_t n) { p[0] = (uint8_t)(n >> 8); p[1] = (uint8_t)n; }
+static void put_le32(uint8_t* p, uint32_t n) { put_le16(p, (uint16_t)n); put_le16(p + 2, (uint16_t)(n >> 16)); }
+static void put_be32(uint8_t* p, uint32_t n) { put_be16(p, (uint16_t)(n >> 16)); put_be16(p + 2, (uint16_t)n); }
+static void put_both16(uint8_t* p, uint16_t n) { put_le16(p, n); put_be16(p + 2, n); }
+static void put_both32(uint8_t* p, uint32_t n) { put_le32(p, n); put_be32(p + 4, n); }
+
+static void put_record(uint8_t* p, uint32_t nLBA, uint32_t nLen, uint8_t nFlags, const uint8_t* name, uint32_t nNameLen, const uint8_t* date)
+{
+	uint32_t nRecLen = record_len(nNameLen);
+	memset(p, 0, nRecLen);
+	p[0] = (uint8_t)nRecLen;
+	put_both32(p + 2, nLBA);
+	put_both32(p + 10, nLen);
+	memcpy(p + 18, date, 7);
+	p[25] = nFlags;
+	put_both16(p + 28, 1);	// volume sequence number
+	p[32] = (uint8_t)nNameLen;
+	memcpy(p + 33, name, nNameLen);
+}
+
+// Directory extent of nDir, returns its length in bytes (whole sectors). With pOut == NULL
+// only the length is computed.
+static uint32_t dir_build(const mkiso_tree* t, uint32_t nDir, bool bJoliet, uint8_t* pOut, const uint8_t* date)
+{
+	const mkiso_node* d = &t->pNodes[nDir];
+	const mkiso_node* parent = &t->pNodes[d->nParent];
+
+	uint8_t dot = 0x00;
+	uint8_t dotdot = 0x01;
+	if(pOut) {
+		put_record(pOut, bJoliet ? d->nJolietLBA : d->nLBA, bJoliet ? d->nJolietDirLen : d->nDirLen, ISO_DR_FLAG_DIRECTORY, &dot, 1, date);
+		put_record(pOut + MKISO_DOT_LEN, bJoliet ? parent->nJolietLBA : parent->nLBA, bJoliet ? parent->nJolietDirLen : parent->nDirLen, ISO_DR_FLAG_DIRECTORY, &dotdot, 1, date);
+	}
+	uint32_t nPos = 2 * MKISO_DOT_LEN;
+
+	uint8_t name[ISO_MAX_NAME];
+	for(uint32_t i = 0; i < d->nChildren; i++)
+	{
+		const mkiso_node* n = &t->pNodes[d->nFirstChild + i];
+		uint32_t nNameLen = bJoliet ? joliet_name(n, name) : iso_name(n, name);
+		uint32_t nRecLen = record_len(nNameLen);
+		uint32_t nExtents = extent_count(n);
+
+		for(uint32_t e = 0; e < nExtents; e++)
+		{
+			// records never cross a sector boundary
+			if((nPos % PSISO_SECTOR_SIZE) + nRecLen > PSISO_SECTOR_SIZE) {
+				nPos = MKISO_SECTORS(nPos) * PSISO_SECTOR_SIZE;
+			}
+			if(pOut)
+			{
+				if(n->nFlags & ISO_DR_FLAG_DIRECTORY) {
+					put_record(pOut + nPos, bJoliet ? n->nJolietLBA : n->nLBA, bJoliet ? n->nJolietDirLen : n->nDirLen, ISO_DR_FLAG_DIRECTORY, name, nNameLen, date);
+				} else {
+					uint64_t nOffset = (uint64_t)e * PSISO_MKISO_EXTENT_MAX;
+					uint64_t nLeft = n->nSize - nOffset;
+					uint32_t nLen = (nLeft > PSISO_MKISO_EXTENT_MAX) ? PSISO_MKISO_EXTENT_MAX : (uint32_t)nLeft;
+					uint8_t nFlags = (e + 1 < nExtents) ? ISO_DR_FLAG_MULTI_EXTENT : 0;
+					put_record(pOut + nPos, n->nLBA + (uint32_t)(nOffset / PSISO_SECTOR_SIZE), nLen, nFlags, name, nNameLen, date);
+				}
+			}
+			nPos += nRecLen;
+		}
+	}
+	return MKISO_SECTORS(nPos) * PSISO_SECTOR_SIZE;
+}
+
+// Path table (L or M), returns its length in bytes. With pOut == NULL only the length is computed.
+static uint32_t ptable_build(const mkiso_tree* t, bool bJoliet, bool bBigEndian, uint8_t* pOut)
+{
+	uint32_t nPos = 0;
+	uint8_t name[ISO_MAX_NAME];
+
+	for(uint32_t i = 0; i < t->nCount; i++)
+	{
+		const mkiso_node* n = &t->pNodes[i];
+		if(!(n->nFlags & ISO_DR_FLAG_DIRECTORY)) continue;
+
+		uint32_t nNameLen = 1;
+		if(i == 0) {
+			name[0] = 0x00;
+		} else {
+			nNameLen = bJoliet ? joliet_name(n, name) : iso_name(n, name);
+		}
+
+		if(pOut)
+		{
+			uint8_t* p = pOut + nPos;
+			uint32_t nLBA = bJoliet ? n->nJolietLBA : n->nLBA;
+			uint16_t nParent = (uint16_t)t->pNodes[n->nParent].nDirNum;
+
+			p[0] = (uint8_t)nNameLen;
+			p[1] = 0;
+			if(bBigEndian) {
+				put_be32(p + 2, nLBA);
+				put_be16(p + 6, nParent);
+			} else {
+				put_le32(p + 2, nLBA);
+				put_le16(p + 6, nParent);
+			}
+			memcpy(p + 8, name, nNameLen);
+			if(nNameLen & 1) p[8 + nNameLen] = 0;
+		}
+		nPos += 8 + nNameLen + (nNameLen & 1);
+	}
+	return nPos;
+}
+
+static void put_text(uint8_t* p, size_t nSize, const char* sz, bool bJoliet)
+{
+	size_t nLen = strlen(sz);
+	if(bJoliet) {
+		for(size_t i = 0; i + 1 < nSize; i += 2) {
+			p[i] = 0x00;
+			p[i + 1] = (i / 2 < nLen) ? (uint8_t)sz[i / 2] : ' ';
+		}
+		if(nSize & 1) p[nSize - 1] = 0x00;
+	} else {
+		memset(p, ' ', nSize);
+		memcpy(p, sz, (nLen < nSize) ? nLen : nSize);
+	}
+}
+
+struct mkiso_layout
+{
+	uint32_t	nVolumeSectors;
+	uint32_t	nPTLen;				// primary path table length in bytes
+	uint32_t	nPTL, nPTM;			// primary path tables LBA
+	uint32_t	nJolietPTLen;
+	uint32_t	nJolietPTL, nJolietPTM;
+	uint8_t		date[7];			// directory record date
+	char		szDate[17];			// volume descriptor date
+};
+
+static void put_volume_desc(uint8_t* p, const mkiso_tree* t, const mkiso_layout* l, const char* szVolumeID, bool bJoliet)
+{
+	memset(p, 0, PSISO_SECTOR_SIZE);
+
+	p[0] = bJoliet ? 2 : 1;
+	memcpy(p + 1, "CD001", 5);
+	p[6] = 1;
+
+	put_text(p + 8, 32, "", bJoliet);				// system identifier
+	put_text(p + 40, 32, szVolumeID, bJoliet);		// volume identifier
+	put_both32(p + 80, l->nVolumeSectors);
+	if(bJoliet) {
+		memcpy(p + 88, "%/E", 3);					// UCS-2 level 3
+	}
+	put_both16(p + 120, 1);							// volume set size
+	put_both16(p + 124, 1);							// volume sequence number
+	put_both16(p + 128, PSISO_SECTOR_SIZE);			// logical block size
+	put_both32(p + 132, bJoliet ? l->nJolietPTLen : l->nPTLen);
+	put_le32(p + 140, bJoliet ? l->nJolietPTL : l->nPTL);
+	put_be32(p + 148, bJoliet ? l->nJolietPTM : l->nPTM);
+
+	const mkiso_node* root = &t->pNodes[0];
+	uint8_t dot = 0x00;
+	put_record(p + ISO_PVD_ROOT_DR_OFFSET, bJoliet ? root->nJolietLBA : root->nLBA, bJoliet ? root->nJolietDirLen : root->nDirLen, ISO_DR_FLAG_DIRECTORY, &dot, 1, l->date);
+
+	put_text(p + 190, 128, "", bJoliet);			// volume set
+	put_text(p + 318, 128, "", bJoliet);			// publisher
+	put_text(p + 446, 128, "", bJoliet);			// data preparer
+	put_text(p + 574, 128, "PS ISO TOOL", bJoliet);	// application
+	put_text(p + 702, 37, "", bJoliet);				// copyright file
+	put_text(p + 739, 37, "", bJoliet);				// abstract file
+	put_text(p + 776, 37, "", bJoliet);				// bibliographic file
+
+	memcpy(p + 813, l->szDate, 17);					// creation
+	memcpy(p + 830, l->szDate, 17);					// modification
+	memset(p + 847, '0', 16);						// expiration (none)
+	memset(p + 864, '0', 16);						// effective (none)
+	p[881] = 1;										// file structure version
+}
+
+// ------------------------------------------------------------------------------
+// Sequential writer
+
+struct mkiso_writer
+{
+#ifdef WIN
+	FILE*		fp;
+#else
+	int			fd;
+#endif
+	uint8_t*	pAlloc;
+	uint8_t*	pBuf;			// PSISO_MKISO_BUFFER_SIZE, page aligned
+	size_t		nFill;
+	uint64_t	nWritten;
+	uint64_t	nTotal;
+	int			nPct;
+	const psiso_mkiso_opts* opts;
+
+	bool		bClone;			// still trying FICLONERANGE / copy_file_range
+	bool		bCopyRange;
+	uint64_t	nCloned;		// payload bytes by method
+	uint64_t	nCopied;
+	uint64_t	nBuffered;
+};
+
+static void wr_progress(mkiso_writer* w)
+{
+	if(!w->opts->progress) return;
+
+	int nPct = (int)(w->nWritten * 100 / (w->nTotal ? w->nTotal : 1));
+	if(nPct != w->nPct) {
+		w->nPct = nPct;
+		w->opts->progress(w->opts->pProgressUser, w->nWritten, w->nTotal);
+	}
+}
+
+static int wr_flush(mkiso_writer* w)
+{
+	if(!w->nFill) return 1;
+#ifdef WIN
+	size_t nDone = fwrite(w->pBuf, 1, w->nFill, w->fp);
+#else
+	size_t nDone = 0;
+	while(nDone < w->nFill)
+	{
+		ssize_t n = _write(w->fd, w->pBuf + nDone, w->nFill - nDone);
+		if(n <= 0) break;
+		nDone += (size_t)n;
+	}
+#endif
+	if(nDone != w->nFill) return 0;
+
+	w->nWritten += w->nFill;
+	w->nFill = 0;
+
+	wr_progress(w);
+	return 1;
+}
+
+static int wr_put(mkiso_writer* w, const void* pData, size_t nLen)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	while(nLen)
+	{
+		size_t n = PSISO_MKISO_BUFFER_SIZE - w->nFill;
+		if(n > nLen) n = nLen;
+		if(p) {
+			memcpy(w->pBuf + w->nFill, p, n);
+			p += n;
+		} else {
+			memset(w->pBuf + w->nFill, 0, n);
+		}
+		w->nFill += n;
+		nLen -= n;
+		if(w->nFill == PSISO_MKISO_BUFFER_SIZE && !wr_flush(w)) return 0;
+	}
+	return 1;
+}
+
+// zero fill up to the next sector boundary
+static int wr_pad(mkiso_writer* w)
+{
+	size_t nRem = (size_t)((w->nWritten + w->nFill) % PSISO_SECTOR_SIZE);
+	return nRem ? wr_put(w, NULL, PSISO_SECTOR_SIZE - nRem) : 1;
+}
+
+#ifndef WIN
+// Payload of fd at the current end of the image without going through user space, returns the
+// number of bytes done (the rest goes through the write buffer). Only called on a flushed writer.
+static uint64_t wr_file_kernel(mkiso_writer* w, int fd, uint64_t nSize)
+{
+	uint64_t nDone = 0;
+
+#ifdef MKISO_CLONE
+	// whole blocks only, the tail of the last block is copied with the padding
+	uint64_t nBody = nSize & ~(uint64_t)(w->opts->nFileAlign - 1);
+	if(w->bClone && nBody)
+	{
+		struct file_clone_range fcr;
+		fcr.src_fd		= fd;
+		fcr.src_offset	= 0;
+		fcr.src_length	= nBody;
+		fcr.dest_offset	= w->nWritten;
+		if(ioctl(w->fd, FICLONERANGE, &fcr) == 0) {
+			nDone = nBody;
+			w->nCloned += nBody;
+		} else {
+			// not supported here (other filesystem, block size, ...), do not try again
+			w->bClone = false;
+		}
+	}
+#endif
+
+#ifdef MKISO_COPY_RANGE
+	while(w->bCopyRange && nDone < nSize)
+	{
+		loff_t nIn = (loff_t)nDone;
+		loff_t nOut = (loff_t)(w->nWritten + nDone);
+		long n = syscall(__NR_copy_file_range, fd, &nIn, w->fd, &nOut, (size_t)(nSize - nDone), 0);
+		if(n <= 0) {
+			if(n < 0 && nDone == 0 && errno != EIO && errno != ENOSPC) w->bCopyRange = false;
+			break;
+		}
+		nDone += (uint64_t)n;
+		w->nCopied += (uint64_t)n;
+	}
+#endif
+
+	// positions are explicit above, move both files past the data
+	if(nDone) {
+		w->nWritten += nDone;
+		_lseek64(w->fd, w->nWritten, SEEK_SET);
+		_lseek64(fd, nDone, SEEK_SET);
+		wr_progress(w);
+	}
+	return nDone;
+}
+#endif
+
+// file data is cloned / copied in the kernel when possible, or read straight into the write buffer
+static int wr_file(psiso_ctx* ctx, mkiso_writer* w, const char* szPath, uint64_t nSize)
+{
+#ifdef WIN
+	FILE* fp = fopen(szPath, "rb");
+	if(!fp) {
+#else
+	int fd = _open(szPath, O_RDONLY);
+	if(fd == -1) {
+#endif
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot open \"%s\". \n", szPath);
+		return 0;
+	}
+#if !defined(WIN) && defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	int ret = 1;
+	uint64_t nLeft = nSize;
+
+#ifndef WIN
+	if((w->bClone || w->bCopyRange) && nSize >= PSISO_SECTOR_SIZE && wr_flush(w)) {
+		nLeft -= wr_file_kernel(w, fd, nSize);
+	}
+#endif
+
+	while(nLeft && ret)
+	{
+		size_t nWant = PSISO_MKISO_BUFFER_SIZE - w->nFill;
+		if(nWant > nLeft) nWant = (size_t)nLeft;
+#ifdef WIN
+		size_t nRead = fread(w->pBuf + w->nFill, 1, nWant, fp);
+#else
+		ssize_t nRead = _read(fd, w->pBuf + w->nFill, nWant);
+#endif
+		if(nRead <= 0) {
+			psxLog(ctx, PSISO_LOG_INFO, "Error: \"%s\" could not be read (was it changed?). \n", szPath);
+			ret = 0;
+			break;
+		}
+		w->nFill += (size_t)nRead;
+		w->nBuffered += (uint64_t)nRead;
+		nLeft -= (uint64_t)nRead;
+		if(w->nFill == PSISO_MKISO_BUFFER_SIZE && !wr_flush(w)) ret = 0;
+	}
+
+#ifdef WIN
+	SAFE_FCLOSE(fp);
+#else
+	_close(fd);
+#endif
+	return ret && wr_pad(w);
+}
+
+// ------------------------------------------------------------------------------
+
+int psxMakeISO(psiso_ctx* ctx, const char* szSourceDir, const char* szISO, const psiso_mkiso_opts* opts)
+{
+	psiso_mkiso_opts def;
+	if(!opts) {
+		psxMkISOOptsInit(&def);
+		opts = &def;
+	}
+	const char* szVolumeID = opts->szVolumeID ? opts->szVolumeID : PSISO_MKISO_VOLUME_ID;
+
+	uint32_t nAlignSectors = opts->nFileAlign / PSISO_SECTOR_SIZE;
+	if(nAlignSectors == 0 || opts->nFileAlign % PSISO_SECTOR_SIZE || (nAlignSectors & (nAlignSectors - 1))) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: File alignment must be a power of two multiple of %d. \n", PSISO_SECTOR_SIZE);
+		return 0;
+	}
+
+	// 1) list the source tree
+	mkiso_tree t;
+	if(!tree_build(ctx, &t, szSourceDir) || !names_check(ctx, &t)) {
+		tree_free(&t);
+		return 0;
+	}
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Source: %u directories, %u files, %.2f MB \n", t.nDirs, t.nFiles, (double)t.nBytes / (1024.0 * 1024.0));
+
+	// 2) order of the file data
+	mkiso_order* pOrder = (mkiso_order*)malloc((t.nFiles ? t.nFiles : 1) * sizeof(mkiso_order));
+	int nFiles = pOrder ? layout_build(ctx, &t, opts, pOrder) : -1;
+	if(nFiles < 0) {
+		SAFE_FREE(pOrder);
+		tree_free(&t);
+		return 0;
+	}
+
+	// 3) layout, every LBA is known before writing
+	mkiso_layout l;
+	ZERO(l);
+
+	time_t now = time(NULL);
+	struct tm* tm = gmtime(&now);
+	l.date[0] = (uint8_t)tm->tm_year;
+	l.date[1] = (uint8_t)(tm->tm_mon + 1);
+	l.date[2] = (uint8_t)tm->tm_mday;
+	l.date[3] = (uint8_t)tm->tm_hour;
+	l.date[4] = (uint8_t)tm->tm_min;
+	l.date[5] = (uint8_t)tm->tm_sec;
+	l.date[6] = 0; // GMT
+	char szDate[64];
+	sprintf(szDate, "%04d%02d%02d%02d%02d%02d00", tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec);
+	memcpy(l.szDate, szDate, 16);
+	l.szDate[16] = 0; // GMT
+
+	l.nPTLen		= ptable_build(&t, false, false, NULL);
+	l.nJolietPTLen	= ptable_build(&t, true, false, NULL);
+	l.nPTL			= MKISO_FIRST_LBA;
+	l.nPTM			= l.nPTL + MKISO_SECTORS(l.nPTLen);
+	l.nJolietPTL	= l.nPTM + MKISO_SECTORS(l.nPTLen);
+	l.nJolietPTM	= l.nJolietPTL + MKISO_SECTORS(l.nJolietPTLen);
+
+	uint64_t nLBA = l.nJolietPTM + MKISO_SECTORS(l.nJolietPTLen);
+
+	for(uint32_t i = 0; i < t.nCount; i++) {
+		mkiso_node* n = &t.pNodes[i];
+		if(!(n->nFlags & ISO_DR_FLAG_DIRECTORY)) continue;
+		n->nDirLen = dir_build(&t, i, false, NULL, NULL);
+		n->nLBA = (uint32_t)nLBA;
+		nLBA += MKISO_SECTORS(n->nDirLen);
+	}
+	for(uint32_t i = 0; i < t.nCount; i++) {
+		mkiso_node* n = &t.pNodes[i];
+		if(!(n->nFlags & ISO_DR_FLAG_DIRECTORY)) continue;
+		n->nJolietDirLen = dir_build(&t, i, true, NULL, NULL);
+		n->nJolietLBA = (uint32_t)nLBA;
+		nLBA += MKISO_SECTORS(n->nJolietDirLen);
+	}
+	uint32_t nDataLBA = (uint32_t)nLBA;
+	for(int i = 0; i < nFiles && nLBA <= 0xFFFFFFFF; i++) {
+		mkiso_node* n = &t.pNodes[pOrder[i].nNode];
+		if(n->nSize) {
+			nLBA = (nLBA + nAlignSectors - 1) & ~(uint64_t)(nAlignSectors - 1);
+		}
+		n->nLBA = (uint32_t)nLBA;
+		nLBA += MKISO_SECTORS(n->nSize);
+	}
+	if(nLBA > 0xFFFFFFFF) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Source is too big for an ISO9660 volume. \n");
+		SAFE_FREE(pOrder);
+		tree_free(&t);
+		return 0;
+	}
+	l.nVolumeSectors = (uint32_t)nLBA;
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Volume: %u sectors (directories: %u sectors, data from sector %u) \n", l.nVolumeSectors, nDataLBA - MKISO_FIRST_LBA, nDataLBA);
+
+	// 4) stream the image
+	mkiso_writer w;
+	ZERO(w);
+	w.opts		= opts;
+	w.nTotal	= (uint64_t)l.nVolumeSectors * PSISO_SECTOR_SIZE;
+	w.nPct		= -1;
+	w.bClone	= opts->bZeroCopy;
+	w.bCopyRange	= opts->bZeroCopy;
+#ifndef MKISO_CLONE
+	w.bClone	= false;
+#endif
+#ifndef MKISO_COPY_RANGE
+	w.bCopyRange	= false;
+#endif
+	w.pAlloc	= (uint8_t*)malloc(PSISO_MKISO_BUFFER_SIZE + 4096);
+	w.pBuf		= (uint8_t*)(((uintptr_t)w.pAlloc + 4095) & ~(uintptr_t)4095);
+
+#ifdef WIN
+	w.fp = fopen(szISO, "wb");
+	bool bOpen = (w.fp != NULL);
+#else
+	w.fd = _open(szISO, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	bool bOpen = (w.fd != -1);
+#endif
+	if(!bOpen || !w.pAlloc) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Cannot create \"%s\". \n", szISO);
+#ifdef WIN
+		SAFE_FCLOSE(w.fp);
+#else
+		if(w.fd != -1) _close(w.fd);
+#endif
+		SAFE_FREE(w.pAlloc);
+		SAFE_FREE(pOrder);
+		tree_free(&t);
+		return 0;
+	}
+
+	int ret = 1;
+	uint8_t* sector = (uint8_t*)malloc(2 * PSISO_SECTOR_SIZE);
+
+	// system area, PS3 disc header on sectors 0 and 1
+	if(sector && opts->szTitleID && strlen(opts->szTitleID) >= 9) {
+		psxPS3DiscHeader(opts->szTitleID, l.nVolumeSectors, sector);
+		ret = wr_put(&w, sector, 2 * PSISO_SECTOR_SIZE);
+	} else {
+		ret = wr_put(&w, NULL, 2 * PSISO_SECTOR_SIZE);
+	}
+	ret = ret && sector && wr_put(&w, NULL, (ISO_PVD_SECTOR - 2) * PSISO_SECTOR_SIZE);
+
+	// volume descriptors
+	if(ret) {
+		put_volume_desc(sector, &t, &l, szVolumeID, false);
+		ret = wr_put(&w, sector, PSISO_SECTOR_SIZE);
+	}
+	if(ret) {
+		put_volume_desc(sector, &t, &l, szVolumeID, true);
+		ret = wr_put(&w, sector, PSISO_SECTOR_SIZE);
+	}
+	if(ret) {
+		memset(sector, 0, PSISO_SECTOR_SIZE);
+		sector[0] = 0xFF;
+		memcpy(sector + 1, "CD001", 5);
+		sector[6] = 1;
+		ret = wr_put(&w, sector, PSISO_SECTOR_SIZE);
+	}
+
+	// path tables
+	uint32_t nPTMax = (l.nPTLen > l.nJolietPTLen) ? l.nPTLen : l.nJolietPTLen;
+	uint8_t* pt = (uint8_t*)malloc(nPTMax ? nPTMax : 1);
+	ret = ret && pt;
+	for(int i = 0; i < 4 && ret; i++) {
+		bool bJoliet = (i >= 2);
+		bool bBigEndian = (i & 1) != 0;
+		uint32_t nLen = ptable_build(&t, bJoliet, bBigEndian, pt);
+		ret = wr_put(&w, pt, nLen) && wr_pad(&w);
+	}
+	SAFE_FREE(pt);
+
+	// directories, primary then Joliet
+	for(int j = 0; j < 2 && ret; j++) {
+		for(uint32_t i = 0; i < t.nCount && ret; i++) {
+			const mkiso_node* n = &t.pNodes[i];
+			if(!(n->nFlags & ISO_DR_FLAG_DIRECTORY)) continue;
+
+			uint32_t nLen = j ? n->nJolietDirLen : n->nDirLen;
+			uint8_t* dir = (uint8_t*)calloc(1, nLen);
+			ret = dir && dir_build(&t, i, j != 0, dir, l.date) == nLen && wr_put(&w, dir, nLen);
+			SAFE_FREE(dir);
+		}
+	}
+
+	// file data
+	char szPath[4096];
+	for(int i = 0; i < nFiles && ret; i++) {
+		const mkiso_node* n = &t.pNodes[pOrder[i].nNode];
+
+		// alignment padding
+		uint64_t nPos = w.nWritten + w.nFill;
+		ret = wr_put(&w, NULL, (size_t)((uint64_t)n->nLBA * PSISO_SECTOR_SIZE - nPos));
+
+		ret = ret && node_path(&t, szSourceDir, pOrder[i].nNode, PATH_SEP, szPath, sizeof(szPath)) && wr_file(ctx, &w, szPath, n->nSize);
+	}
+
+	ret = ret && wr_flush(&w);
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "File data: %.2f MB cloned, %.2f MB copied by the kernel, %.2f MB buffered \n",
+		(double)w.nCloned / (1024.0 * 1024.0), (double)w.nCopied / (1024.0 * 1024.0), (double)w.nBuffered / (1024.0 * 1024.0));
+
+	if(ret && w.nWritten != w.nTotal) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Image size does not match the layout. \n");
+		ret = 0;
+	}
+
+#ifdef WIN
+	if(fclose(w.fp) != 0) ret = 0;
+#else
+	if(_close(w.fd) != 0) ret = 0;
+#endif
+
+	if(!ret) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: Writing \"%s\" failed, the partial image was deleted. \n", szISO);
+		remove(szISO);
+	}
+
+	SAFE_FREE(sector);
+	SAFE_FREE(w.pAlloc);
+	SAFE_FREE(pOrder);
+	tree_free(&t);
+	return ret;
+}
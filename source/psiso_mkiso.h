@@ -0,0 +1,82 @@
+#ifndef PSISO_MKISO_H
+#define PSISO_MKISO_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// ISO builder module
+// ------------------------------------------------------------------------------------------------
+// Builds an ISO9660 + Joliet image from a directory in one sequential pass. The whole tree is
+// listed first, so every LBA (and the volume size stored in the PS3 disc header) is known before
+// the first byte is written. After that the image is streamed from sector 0 to the end with
+// PSISO_MKISO_BUFFER_SIZE writes, nothing is seeked back or written twice.
+//
+//	0		PS3 disc header (see psxPS3DiscHeader(), zero when there is no title ID)
+//	1		PS3 disc header ("PlayStation3", title ID)
+//	2-15	zero
+//	16		Primary Volume Descriptor
+//	17		Joliet Supplementary Volume Descriptor
+//	18		Volume Descriptor Set Terminator
+//	19		Path tables (primary L / M, Joliet L / M)
+//			Primary directories, then Joliet directories (same order as the path tables)
+//			File data, every file starts on a sector boundary
+//
+// Primary names keep their case (PS3 games look files up by their exact name), files of 4GB or
+// more are stored as multi-extent files (ISO9660 level 3).
+//
+// File payloads do not go through the write buffer when the system can avoid it (Linux): the
+// block aligned part of each file is cloned into the image (FICLONERANGE, btrfs / XFS, shares the
+// blocks so it takes no time and no extra space), or else copied inside the kernel
+// (copy_file_range). Files start on nFileAlign boundaries so their data lines up with the
+// filesystem blocks of the image, which is what cloning needs.
+//
+// Directory records are always sorted by name, but the order of the file data is set by the
+// layout policy. PSISO_MKISO_LAYOUT_PS3 puts what the console (and psxProcessISOEx()) reads first
+// right after the directories, so mounting from a slow disk does not seek across the image:
+//
+//	1) PS3_DISC.SFB, PS3_GAME/PARAM.SFO, PS3_GAME/ICON0.PNG, PS3_GAME/USRDIR/EBOOT.BIN
+//	2) SPRX modules
+//	3) Files listed in the access trace (szTraceFile), in the order they are listed
+//	4) Everything else, in directory order
+//
+// The access trace is a text file with one path per line relative to the source directory
+// (Ex. "PS3_GAME/USRDIR/data/level1.pak", case is ignored), "#" and "//" start comments.
+
+#define PSISO_MKISO_BUFFER_SIZE		(4 * 1024 * 1024)	// bytes per write, multiple of the sector size
+#define PSISO_MKISO_MAX_NAME		110					// bytes per name, Joliet records also limit files to 108 characters
+#define PSISO_MKISO_EXTENT_MAX		0xFFFFF800			// bytes per extent of a multi-extent file
+#define PSISO_MKISO_VOLUME_ID		"PS3VOLUME"
+#define PSISO_MKISO_FILE_ALIGN		0x1000				// default file data alignment (filesystem block)
+
+#define PSISO_MKISO_LAYOUT_TREE		0	// file data in directory order
+#define PSISO_MKISO_LAYOUT_PS3		1	// boot files, modules and traced files first (default)
+
+struct psiso_mkiso_opts
+{
+	const char*			szVolumeID;		// PSISO_MKISO_VOLUME_ID
+	const char*			szTitleID;		// title ID for the PS3 disc header (Ex. BLUS12345), NULL = no header
+	uint32_t			nFileAlign;		// file data alignment in bytes, multiple of 2048 (PSISO_MKISO_FILE_ALIGN)
+	bool				bZeroCopy;		// clone / copy file data in the kernel when possible (true)
+	int					nLayout;		// PSISO_MKISO_LAYOUT_*
+	const char*			szTraceFile;	// access trace for PSISO_MKISO_LAYOUT_PS3 (optional)
+	psiso_progress_func	progress;		// called while the image is written (optional)
+	void*				pProgressUser;
+};
+
+// Initialize the options with the default settings
+void psxMkISOOptsInit(psiso_mkiso_opts* opts);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	ctx				- Context (errors and details go to its log sink)
+(in)	szSourceDir		- Directory to store, its contents become the root of the image
+						  (Ex. "BLUS12345-[Game]" with PS3_GAME inside)
+(in)	szISO			- Image to create (overwritten if it exists)
+(in)	opts			- Options (see psxMkISOOptsInit())
+
+(out)	return			- Will return 1 for success and 0 for failure (the partial image is deleted).
+-------------------------------------------------------------------------------------------------
+*/
+int psxMakeISO(psiso_ctx* ctx, const char* szSourceDir, const char* szISO, const psiso_mkiso_opts* opts);
+
+#endif
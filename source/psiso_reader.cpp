@@ -0,0 +1,381 @@
+// ------------------------------------------------------------------------------
+// Sector reader module
+// ------------------------------------------------------------------------------
+#include "psiso_reader.h"
+#include "psiso_cso.h"
+
+#ifdef PSISO_READER_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// ------------------------------------------------------------------------------
+// Low level I/O (positioned read on the image handle)
+
+// Read at an absolute position of the file
+static size_t reader_file_read(void* pUser, uint64_t nPos, void* pOut, size_t nLen)
+{
+	psiso_reader* r = (psiso_reader*)pUser;
+	size_t nDone = 0;
+#ifdef WIN
+	if(_fseeki64(r->fp, (int64_t)nPos, SEEK_SET) != 0) return 0;
+	nDone = fread(pOut, 1, nLen, r->fp);
+#else
+	if(_lseek64(r->fd, nPos, SEEK_SET) == -1) return 0;
+	while(nDone < nLen)
+	{
+		int ret = (int)_read(r->fd, (uint8_t*)pOut + nDone, nLen - nDone);
+		if(ret <= 0) break;
+		nDone += ret;
+	}
+#endif
+	return nDone;
+}
+
+// Mapped bytes [nOffset, nOffset + nLen) of the image are still on the file, so reading them
+// can not raise SIGBUS (the file may have been truncated since it was opened)
+static bool reader_map_valid(psiso_reader* r, uint64_t nOffset, uint64_t nLen)
+{
+#ifdef PSISO_READER_MMAP
+	struct stat st;
+	if(fstat(r->fd, &st) != 0) return false;
+	return (uint64_t)st.st_size >= r->nBase + nOffset + nLen;
+#else
+	(void)r; (void)nOffset; (void)nLen;
+	return true;
+#endif
+}
+
+static size_t reader_pread(psiso_reader* r, uint64_t nOffset, void* pOut, size_t nLen)
+{
+	if(nOffset >= r->nFileSize) return 0;
+	if(nLen > r->nFileSize - nOffset) nLen = (size_t)(r->nFileSize - nOffset);
+
+	if(r->pMap) {
+		if(!reader_map_valid(r, nOffset, nLen)) return 0;
+		memcpy(pOut, r->pMap + nOffset, nLen);
+		return nLen;
+	}
+	if(r->cso) {
+		return psxCSORead(r->cso, nOffset, pOut, nLen);
+	}
+	return reader_file_read(r, r->nBase + nOffset, pOut, nLen);
+}
+
+// Compressed images are served through psxCSORead(), the image size is the uncompressed one
+static int reader_open_cso(psiso_reader* r)
+{
+	uint8_t magic[4];
+	if(r->nFileSize < PSISO_CSO_HEADER_SIZE || reader_file_read(r, 0, magic, 4) != 4 || !psxCSOIsHeader(magic)) {
+		return 0;
+	}
+
+	r->cso = (psiso_cso*)malloc(sizeof(psiso_cso));
+	if(!r->cso) return 0;
+
+	if(!psxCSOOpen(r->cso, reader_file_read, r, r->nFileSize)) {
+		SAFE_FREE(r->cso);
+		return 0;
+	}
+	r->nFileSize = r->cso->nTotalBytes;
+	return 1;
+}
+
+static int reader_open(psiso_reader* r, const char* szPath, bool bWrite, uint64_t nOffset, uint64_t nLen, bool bMap)
+{
+	memset(r, 0, sizeof(psiso_reader));
+
+#ifdef WIN
+	r->fp = fopen(szPath, bWrite ? "r+b" : "rb");
+	if(!r->fp) return 0;
+	_fseeki64(r->fp, 0, SEEK_END);
+	r->nFileSize = (uint64_t)_ftelli64(r->fp);
+	_fseeki64(r->fp, 0, SEEK_SET);
+#else
+	r->fd = _open(szPath, bWrite ? O_RDWR : O_RDONLY);
+	if(r->fd == -1) return 0;
+	r->nFileSize = (uint64_t)_lseek64(r->fd, 0, SEEK_END);
+	_lseek64(r->fd, 0, SEEK_SET);
+#endif
+
+	// a range past the end of the file is an empty image
+	if(nOffset > r->nFileSize) nOffset = r->nFileSize;
+	if(nLen > r->nFileSize - nOffset) nLen = r->nFileSize - nOffset;
+	r->nBase = nOffset;
+	r->nFileSize = nLen;
+
+	// a CSO / ZSO is only recognized as a whole file, never patched
+	bool bCSO = !bWrite && nOffset == 0 && reader_open_cso(r);
+
+#ifdef PSISO_READER_MMAP
+	// if the image can not be mapped (Ex. too big for a 32 bit address space) the block cache is used
+	uint64_t nMapStart = r->nBase & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+	uint64_t nMapLen = r->nFileSize + (r->nBase - nMapStart);
+	if(bMap && !bWrite && !bCSO && r->nFileSize > 0 && nMapLen <= (uint64_t)(size_t)-1)
+	{
+		void* p = mmap(NULL, (size_t)nMapLen, PROT_READ, MAP_SHARED, r->fd, (off_t)nMapStart);
+		if(p != MAP_FAILED) {
+			r->pMapMem = p;
+			r->nMapLen = (size_t)nMapLen;
+			r->pMap = (const uint8_t*)p + (r->nBase - nMapStart);
+			psxReaderAdvise(r, 0, 0, PSISO_ADVISE_RANDOM);
+			psxReaderSetMode(r, PSISO_SECTOR_SIZE, 0);
+			return 1;
+		}
+	}
+#endif
+
+	r->pCacheMem = (uint8_t*)malloc(PSISO_CACHE_BLOCKS * PSISO_CACHE_BLOCK_SECTORS * PSISO_RAW_SECTOR_SIZE);
+	if(!r->pCacheMem) {
+		psxReaderClose(r);
+		return 0;
+	}
+	for(int i = 0; i < PSISO_CACHE_BLOCKS; i++) {
+		r->cache[i].pData = r->pCacheMem + (i * PSISO_CACHE_BLOCK_SECTORS * PSISO_RAW_SECTOR_SIZE);
+	}
+
+	psxReaderSetMode(r, PSISO_SECTOR_SIZE, 0);
+	return 1;
+}
+
+int psxReaderOpen(psiso_reader* r, const char* szPath, bool bWrite)
+{
+	return reader_open(r, szPath, bWrite, 0, (uint64_t)-1, true);
+}
+
+int psxReaderOpenRange(psiso_reader* r, const char* szPath, uint64_t nOffset, uint64_t nLen)
+{
+	return reader_open(r, szPath, false, nOffset, nLen, true);
+}
+
+int psxReaderOpenEx(psiso_reader* r, const char* szPath, uint64_t nOffset, uint64_t nLen, bool bMap)
+{
+	return reader_open(r, szPath, false, nOffset, nLen, bMap);
+}
+
+void psxReaderClose(psiso_reader* r)
+{
+#ifdef PSISO_READER_MMAP
+	if(r->pMapMem) {
+		munmap(r->pMapMem, r->nMapLen);
+		r->pMapMem = NULL;
+		r->pMap = NULL;
+	}
+#endif
+#ifdef WIN
+	SAFE_FCLOSE(r->fp);
+#else
+	if(r->fd != -1) {
+		_close(r->fd);
+		r->fd = -1;
+	}
+#endif
+	if(r->cso) {
+		psxCSOClose(r->cso);
+		SAFE_FREE(r->cso);
+	}
+	SAFE_FREE(r->pCacheMem);
+}
+
+void psxReaderSetMode(psiso_reader* r, uint32_t nSectorSize, uint32_t nSectorHeader)
+{
+	r->nSectorSize = nSectorSize;
+	r->nSectorHeader = nSectorHeader;
+	psxReaderInvalidate(r);
+}
+
+void psxReaderInvalidate(psiso_reader* r)
+{
+	for(int i = 0; i < PSISO_CACHE_BLOCKS; i++) {
+		r->cache[i].nBlock = -1;
+		r->cache[i].nStamp = 0;
+		r->cache[i].nSectors = 0;
+	}
+}
+
+const uint8_t* psxReaderSector(psiso_reader* r, uint32_t nLBA)
+{
+	if(r->pMap)
+	{
+		uint64_t nPos = (uint64_t)nLBA * r->nSectorSize;
+		if(nPos + r->nSectorSize > r->nFileSize || !reader_map_valid(r, nPos, r->nSectorSize)) {
+			return NULL; // beyond EOF (or the file was truncated)
+		}
+		return r->pMap + nPos + r->nSectorHeader;
+	}
+
+	int64_t nBlock = nLBA / PSISO_CACHE_BLOCK_SECTORS;
+	uint32_t nIndex = nLBA % PSISO_CACHE_BLOCK_SECTORS;
+
+	psiso_cache_block* block = NULL;
+	psiso_cache_block* victim = &r->cache[0];
+
+	for(int i = 0; i < PSISO_CACHE_BLOCKS; i++)
+	{
+		if(r->cache[i].nBlock == nBlock) {
+			block = &r->cache[i];
+			break;
+		}
+		if(r->cache[i].nStamp < victim->nStamp) {
+			victim = &r->cache[i];
+		}
+	}
+
+	if(!block)
+	{
+		// miss, fetch the whole aligned block with one read
+		block = victim;
+		uint64_t nBlockLen = (uint64_t)PSISO_CACHE_BLOCK_SECTORS * r->nSectorSize;
+		size_t nRead = reader_pread(r, (uint64_t)nBlock * nBlockLen, block->pData, (size_t)nBlockLen);
+
+		block->nBlock = nBlock;
+		block->nSectors = (uint32_t)(nRead / r->nSectorSize);
+	}
+
+	block->nStamp = ++r->nStamp;
+
+	if(nIndex >= block->nSectors) {
+		return NULL; // beyond EOF
+	}
+
+	return block->pData + (nIndex * r->nSectorSize) + r->nSectorHeader;
+}
+
+size_t psxReaderRead(psiso_reader* r, uint32_t nLBA, uint64_t nOffset, void* pOut, size_t nLen)
+{
+	uint8_t* out = (uint8_t*)pOut;
+
+	nLBA += (uint32_t)(nOffset / PSISO_SECTOR_SIZE);
+	nOffset %= PSISO_SECTOR_SIZE;
+
+	uint64_t nSectors = (nOffset + nLen + PSISO_SECTOR_SIZE - 1) / PSISO_SECTOR_SIZE;
+	uint64_t nLastLBA = nLBA + (nSectors ? nSectors - 1 : 0);
+
+	if(nLBA / PSISO_CACHE_BLOCK_SECTORS != nLastLBA / PSISO_CACHE_BLOCK_SECTORS)
+	{
+		// request spans more than one cache block, do one contiguous read of all the sectors
+		size_t nRawLen = (size_t)(nSectors * r->nSectorSize);
+		uint8_t* raw = NULL;
+
+		if(r->nSectorSize == PSISO_SECTOR_SIZE) {
+			// no framing, read straight into the destination
+			return reader_pread(r, ((uint64_t)nLBA * PSISO_SECTOR_SIZE) + nOffset, out, nLen);
+		}
+
+		raw = (uint8_t*)malloc(nRawLen);
+		if(!raw) return 0;
+
+		size_t nRead = reader_pread(r, (uint64_t)nLBA * r->nSectorSize, raw, nRawLen);
+		size_t nDone = 0;
+
+		for(uint64_t i = 0; i < nSectors && nDone < nLen; i++)
+		{
+			if((i + 1) * r->nSectorSize > nRead) break;
+
+			size_t nSkip = (i == 0) ? (size_t)nOffset : 0;
+			size_t nCopy = PSISO_SECTOR_SIZE - nSkip;
+			if(nCopy > nLen - nDone) nCopy = nLen - nDone;
+
+			memcpy(out + nDone, raw + (i * r->nSectorSize) + r->nSectorHeader + nSkip, nCopy);
+			nDone += nCopy;
+		}
+		SAFE_FREE(raw);
+		return nDone;
+	}
+
+	size_t nDone = 0;
+	while(nDone < nLen)
+	{
+		const uint8_t* sector = psxReaderSector(r, nLBA);
+		if(!sector) break;
+
+		size_t nCopy = PSISO_SECTOR_SIZE - (size_t)nOffset;
+		if(nCopy > nLen - nDone) nCopy = nLen - nDone;
+
+		memcpy(out + nDone, sector + nOffset, nCopy);
+		nDone += nCopy;
+		nOffset = 0;
+		nLBA++;
+	}
+	return nDone;
+}
+
+void psxReaderDeframe(const psiso_reader* r, const uint8_t* pRaw, uint32_t nSectors, uint8_t* pOut)
+{
+	const uint8_t* p = pRaw + r->nSectorHeader;
+
+	// fixed size copies, the compiler turns them into unrolled vector moves
+	for(uint32_t i = 0; i < nSectors; i++)
+	{
+		memcpy(pOut, p, PSISO_SECTOR_SIZE);
+		pOut += PSISO_SECTOR_SIZE;
+		p += r->nSectorSize;
+	}
+}
+
+size_t psxReaderReadRaw(psiso_reader* r, uint64_t nOffset, void* pOut, size_t nLen)
+{
+	return reader_pread(r, nOffset, pOut, nLen);
+}
+
+const uint8_t* psxReaderView(psiso_reader* r, uint32_t nLBA, size_t nLen)
+{
+	if(!r->pMap || r->nSectorSize != PSISO_SECTOR_SIZE) return NULL;
+
+	uint64_t nPos = (uint64_t)nLBA * PSISO_SECTOR_SIZE;
+	if(nPos > r->nFileSize || nLen > r->nFileSize - nPos || !reader_map_valid(r, nPos, nLen)) return NULL;
+
+	return r->pMap + nPos;
+}
+
+const uint8_t* psxReaderViewRaw(psiso_reader* r, uint64_t nOffset, size_t nLen)
+{
+	if(!r->pMap) return NULL;
+	if(nOffset > r->nFileSize || nLen > r->nFileSize - nOffset || !reader_map_valid(r, nOffset, nLen)) return NULL;
+
+	return r->pMap + nOffset;
+}
+
+void psxReaderAdvise(psiso_reader* r, uint64_t nOffset, uint64_t nLen, int nAdvice)
+{
+	if(nOffset >= r->nFileSize) return;
+	if(nLen == 0 || nLen > r->nFileSize - nOffset) nLen = r->nFileSize - nOffset;
+
+#ifdef PSISO_READER_MMAP
+	if(r->pMap)
+	{
+		int nMAdv = MADV_NORMAL;
+		switch(nAdvice) {
+			case PSISO_ADVISE_RANDOM:		nMAdv = MADV_RANDOM; break;
+			case PSISO_ADVISE_SEQUENTIAL:	nMAdv = MADV_SEQUENTIAL; break;
+			case PSISO_ADVISE_WILLNEED:		nMAdv = MADV_WILLNEED; break;
+			case PSISO_ADVISE_DONTNEED:		nMAdv = MADV_DONTNEED; break;
+		}
+		// madvise wants a page aligned start (the mapping of a range starts inside a page)
+		uintptr_t nPage = (uintptr_t)sysconf(_SC_PAGESIZE);
+		uintptr_t nAddr = (uintptr_t)(r->pMap + nOffset);
+		uintptr_t nStart = nAddr & ~(nPage - 1);
+		madvise((void*)nStart, (size_t)(nLen + (nAddr - nStart)), nMAdv);
+		return;
+	}
+#endif
+
+#if !defined(WIN) && defined(POSIX_FADV_SEQUENTIAL)
+	int nFAdv = POSIX_FADV_NORMAL;
+	switch(nAdvice) {
+		case PSISO_ADVISE_RANDOM:		nFAdv = POSIX_FADV_RANDOM; break;
+		case PSISO_ADVISE_SEQUENTIAL:	nFAdv = POSIX_FADV_SEQUENTIAL; break;
+		case PSISO_ADVISE_WILLNEED:		nFAdv = POSIX_FADV_WILLNEED; break;
+		case PSISO_ADVISE_DONTNEED:		nFAdv = POSIX_FADV_DONTNEED; break;
+	}
+	if(r->cso) {
+		// offsets are on the uncompressed image, only the pattern applies to the file
+		if(nAdvice == PSISO_ADVISE_WILLNEED || nAdvice == PSISO_ADVISE_DONTNEED) return;
+		nOffset = 0;
+		nLen = 0;
+	}
+	posix_fadvise(r->fd, (off_t)(r->nBase + nOffset), (off_t)nLen, nFAdv);
+#else
+	(void)nAdvice;
+#endif
+}
@@ -0,0 +1,168 @@
+#ifndef PSISO_READER_H
+#define PSISO_READER_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// Sector reader module
+// ------------------------------------------------------------------------------------------------
+// Serves 2048-byte user data sectors from (ISO9660 / MODE1 / 2048) and (MODE2 / 2352) images.
+// Sectors are fetched from disk in aligned blocks of PSISO_CACHE_BLOCK_SECTORS and kept in a
+// small LRU cache, so field reads (volume descriptor, directory records, SYSTEM.CNF, etc...)
+// are served from memory instead of doing one seek + read per field.
+//
+// A reader can also be opened on a byte range of a file (Ex. one track of a CUE / BIN image),
+// the range is then seen as the whole image: offsets, LBAs and sizes are relative to its start.
+//
+// CSO / ZSO compressed images are detected on open (read only) and decompressed on the fly, see
+// psiso_cso.h: every offset, LBA and size is then on the uncompressed image, so the rest of the
+// tool (probe, PARAM.SFO, hashing, extraction...) does not need to know about it.
+
+#define PSISO_SECTOR_SIZE			0x800	// user data bytes per sector (ISO9660 logical block)
+#define PSISO_RAW_SECTOR_SIZE		0x930	// MODE2 / 2352 raw sector
+#define PSISO_RAW_SECTOR_HEADER		0x18	// sync (12) + header (4) + subheader (8)
+
+#define PSISO_CACHE_BLOCKS			8		// number of cached blocks
+#define PSISO_CACHE_BLOCK_SECTORS	16		// sectors per block (32KB on 2048 images)
+
+// Read only readers map the whole image where mmap() is available, sectors are then served
+// straight from the mapping (shared page cache, no copies) and the block cache is not used.
+// Touching a mapped page past the end of a file that was truncated meanwhile raises SIGBUS, so
+// the mapped accessors check the file size first, and images that can change while they are
+// read (library scans, see psiso_ctx::bNoMap) are opened with psxReaderOpenEx() unmapped.
+#if !defined(WIN) && !defined(PSISOTOOL_PS3BUILD)
+#define PSISO_READER_MMAP
+#endif
+
+// Access pattern hints for psxReaderAdvise()
+#define PSISO_ADVISE_NORMAL			0
+#define PSISO_ADVISE_RANDOM			1		// directory walks, volume descriptor, PARAM.SFO
+#define PSISO_ADVISE_SEQUENTIAL		2		// whole image passes (hashing, verification)
+#define PSISO_ADVISE_WILLNEED		3		// range will be needed soon
+#define PSISO_ADVISE_DONTNEED		4		// range is done
+
+struct psiso_cache_block
+{
+	int64_t		nBlock;		// block index on the image (-1 if unused)
+	uint32_t	nStamp;		// last access (LRU)
+	uint32_t	nSectors;	// valid sectors on this block (less than a full block at EOF)
+	uint8_t*	pData;
+};
+
+struct psiso_cso;
+
+struct psiso_reader
+{
+#ifdef WIN
+	FILE*		fp;
+#else
+	int			fd;
+#endif
+	uint64_t	nBase;			// start of the image on the file (0 unless opened on a range)
+	uint64_t	nFileSize;		// size of the image (of the range, uncompressed size of a CSO)
+	const uint8_t* pMap;		// image mapping (read only readers), NULL if not mapped
+	void*		pMapMem;		// mapping as returned by mmap() (page aligned, see pMap)
+	size_t		nMapLen;
+	psiso_cso*	cso;			// compressed image (CSO / ZSO), NULL otherwise
+	uint32_t	nSectorSize;	// 0x800 or 0x930
+	uint32_t	nSectorHeader;	// 0 or 0x18
+
+	uint32_t	nStamp;
+	uint8_t*	pCacheMem;
+	psiso_cache_block cache[PSISO_CACHE_BLOCKS];
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	r				- Reader to initialize
+(in)	szPath			- Path to image
+(in)	bWrite			- Open for read / write. Inspection should always use read only readers
+						  (works on read only media and gets mapped), patching is done through
+						  its own write handle (see psxPatchPS3ISOFile()).
+
+(out)	return			- Will return 1 for success and 0 for failure.
+
+Reader starts in (MODE1 / 2048) mode, use psxReaderSetMode() to switch to (MODE2 / 2352).
+-------------------------------------------------------------------------------------------------
+*/
+int psxReaderOpen(psiso_reader* r, const char* szPath, bool bWrite);
+
+// Read only reader on the bytes [nOffset, nOffset + nLen) of szPath, nLen is clipped to the end
+// of the file. Same as psxReaderOpen() otherwise.
+int psxReaderOpenRange(psiso_reader* r, const char* szPath, uint64_t nOffset, uint64_t nLen);
+
+// Same as psxReaderOpenRange(), bMap = false reads through the block cache (pread) even where
+// the image could be mapped.
+int psxReaderOpenEx(psiso_reader* r, const char* szPath, uint64_t nOffset, uint64_t nLen, bool bMap);
+void psxReaderClose(psiso_reader* r);
+
+// Change sector framing, this drops all cached blocks.
+void psxReaderSetMode(psiso_reader* r, uint32_t nSectorSize, uint32_t nSectorHeader);
+
+// Drop all cached blocks (call after writing to the image).
+void psxReaderInvalidate(psiso_reader* r);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	r				- Reader
+(in)	nLBA			- Logical sector number
+
+(out)	return			- Pointer to the 2048 bytes of user data of the sector, or NULL if the
+						  sector is beyond the end of the image. The pointer is only valid until
+						  the next call on the same reader.
+-------------------------------------------------------------------------------------------------
+*/
+const uint8_t* psxReaderSector(psiso_reader* r, uint32_t nLBA);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	r				- Reader
+(in)	nLBA			- First logical sector
+(in)	nOffset			- Byte offset into the user data, may be bigger than a sector
+(out)	pOut			- Destination buffer
+(in)	nLen			- Bytes to read
+
+(out)	return			- Number of bytes read (less than nLen at the end of the image).
+
+Reads that fall inside one cache block go through the cache, anything spanning more blocks is
+fetched with one contiguous read and de-framed in memory.
+-------------------------------------------------------------------------------------------------
+*/
+size_t psxReaderRead(psiso_reader* r, uint32_t nLBA, uint64_t nOffset, void* pOut, size_t nLen);
+
+// User data of nSectors raw sectors (current framing) from pRaw into pOut, 2048 bytes each.
+void psxReaderDeframe(const psiso_reader* r, const uint8_t* pRaw, uint32_t nSectors, uint8_t* pOut);
+
+// Uncached read of raw image bytes (no sector de-framing).
+size_t psxReaderReadRaw(psiso_reader* r, uint64_t nOffset, void* pOut, size_t nLen);
+
+// Zero-copy access to nLen bytes of user data starting at nLBA. Only possible on mapped
+// (MODE1 / 2048) images, returns NULL otherwise (use psxReaderRead() then). The pointer is valid
+// until psxReaderClose().
+const uint8_t* psxReaderView(psiso_reader* r, uint32_t nLBA, size_t nLen);
+
+// Same as psxReaderView() for raw image bytes [nOffset, nOffset + nLen) in any mode (no sector
+// de-framing). NULL when the image is not mapped (use psxReaderReadRaw() then).
+const uint8_t* psxReaderViewRaw(psiso_reader* r, uint64_t nOffset, size_t nLen);
+
+// Access pattern hint (PSISO_ADVISE_*) for raw image bytes [nOffset, nOffset + nLen), nLen 0 = up
+// to the end of the image. madvise() on mapped images, posix_fadvise() where available otherwise.
+void psxReaderAdvise(psiso_reader* r, uint64_t nOffset, uint64_t nLen, int nAdvice);
+
+// -----------------------------------------------------------------------------------------------
+// Byte order helpers for on-disc fields
+// -----------------------------------------------------------------------------------------------
+static inline uint32_t psx_be32(const uint8_t* p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+static inline uint32_t psx_le32(const uint8_t* p) {
+	return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+}
+static inline uint16_t psx_be16(const uint8_t* p) {
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+static inline uint16_t psx_le16(const uint8_t* p) {
+	return (uint16_t)((p[1] << 8) | p[0]);
+}
+
+#endif
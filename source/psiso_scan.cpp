@@ -0,0 +1,464 @@
+// ------------------------------------------------------------------------------
+// Batch scan module
+// ------------------------------------------------------------------------------
+#include "psiso_scan.h"
+#include "psiso_thread.h"
+#include "psiso_cue.h"
+#include "psiso_catalog.h"
+
+#ifdef WIN
+#include <windows.h>
+#define PATH_SEP	'\\'
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#define PATH_SEP	'/'
+#endif
+
+#define SCAN_MAX_DEPTH		32
+
+// ------------------------------------------------------------------------------
+// Directory walk
+
+bool psxIsImageName(const char* szName)
+{
+	const char* ext = strrchr(szName, '.');
+	if(!ext) return false;
+
+	char szExt[8];
+	ZERO(szExt);
+	for(int i = 0; i < 7 && ext[i]; i++) {
+		szExt[i] = (ext[i] >= 'A' && ext[i] <= 'Z') ? (char)(ext[i] + ('a' - 'A')) : ext[i];
+	}
+	return (strcmp(szExt, ".iso") == 0 || strcmp(szExt, ".bin") == 0 || strcmp(szExt, ".cue") == 0 ||
+		strcmp(szExt, ".cso") == 0 || strcmp(szExt, ".zso") == 0);
+}
+
+int psxFileListAdd(psiso_file_list* list, const char* szPath)
+{
+	if(list->nCount == list->nCapacity)
+	{
+		uint32_t nCapacity = list->nCapacity ? list->nCapacity * 2 : 256;
+		char** paths = (char**)realloc(list->pszPaths, nCapacity * sizeof(char*));
+		if(!paths) return 0;
+		list->pszPaths = paths;
+		list->nCapacity = nCapacity;
+	}
+	char* path = (char*)malloc(strlen(szPath) + 1);
+	if(!path) return 0;
+	strcpy(path, szPath);
+	list->pszPaths[list->nCount++] = path;
+	return 1;
+}
+
+static int name_compare(const void* a, const void* b)
+{
+	return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// szDir + separator + szName, false if it does not fit in szOut (the entry is skipped then)
+static bool join_path(char* szOut, size_t nOutSize, const char* szDir, char cSep, const char* szName)
+{
+	int nLen = snprintf(szOut, nOutSize, "%s%c%s", szDir, cSep, szName);
+	return nLen >= 0 && (size_t)nLen < nOutSize;
+}
+
+static int scan_dir(const char* szDir, psiso_file_list* list, int nDepth)
+{
+	if(nDepth > SCAN_MAX_DEPTH) return 1;
+
+	// collect names first so each directory is listed in a stable order
+	psiso_file_list names;
+	ZERO(names);
+	psiso_file_list dirs;
+	ZERO(dirs);
+
+#ifdef WIN
+	char szFind[4096];
+	if(!join_path(szFind, sizeof(szFind), szDir, '\\', "*")) return 0;
+
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA(szFind, &fd);
+	if(h == INVALID_HANDLE_VALUE) return 0;
+	do {
+		if(strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+		if(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			// junctions / directory links are not followed (they can loop back to a parent)
+			if(!(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) psxFileListAdd(&dirs, fd.cFileName);
+		} else if(psxIsImageName(fd.cFileName)) {
+			psxFileListAdd(&names, fd.cFileName);
+		}
+	} while(FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR* d = opendir(szDir);
+	if(!d) return 0;
+
+	struct dirent* de = NULL;
+	while((de = readdir(d)))
+	{
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+		char szPath[4096];
+		if(!join_path(szPath, sizeof(szPath), szDir, '/', de->d_name)) continue;
+
+		// directory links are not followed (they can loop back to a parent), links to images are
+		struct stat st;
+		if(lstat(szPath, &st) != 0) continue;
+		if(S_ISLNK(st.st_mode) && (stat(szPath, &st) != 0 || S_ISDIR(st.st_mode))) continue;
+
+		if(S_ISDIR(st.st_mode)) {
+			psxFileListAdd(&dirs, de->d_name);
+		} else if(S_ISREG(st.st_mode) && psxIsImageName(de->d_name)) {
+			psxFileListAdd(&names, de->d_name);
+		}
+	}
+	closedir(d);
+#endif
+
+	if(names.nCount) qsort(names.pszPaths, names.nCount, sizeof(char*), name_compare);
+	if(dirs.nCount) qsort(dirs.pszPaths, dirs.nCount, sizeof(char*), name_compare);
+
+	char szPath[4096];
+
+	for(uint32_t i = 0; i < names.nCount; i++) {
+		if(join_path(szPath, sizeof(szPath), szDir, PATH_SEP, names.pszPaths[i])) psxFileListAdd(list, szPath);
+	}
+	for(uint32_t i = 0; i < dirs.nCount; i++) {
+		if(join_path(szPath, sizeof(szPath), szDir, PATH_SEP, dirs.pszPaths[i])) scan_dir(szPath, list, nDepth + 1);
+	}
+
+	psxFileListFree(&names);
+	psxFileListFree(&dirs);
+	return 1;
+}
+
+int psxScanDirectory(const char* szDir, psiso_file_list* list)
+{
+	memset(list, 0, sizeof(psiso_file_list));
+
+	char szRoot[4096];
+	ZERO(szRoot);
+	strncpy(szRoot, szDir, sizeof(szRoot) - 1);
+
+	// remove ending slash
+	size_t nLen = strlen(szRoot);
+	while(nLen > 1 && (szRoot[nLen - 1] == '\\' || szRoot[nLen - 1] == '/')) {
+		szRoot[--nLen] = 0;
+	}
+	return scan_dir(szRoot, list, 0);
+}
+
+int psxFullPath(const char* szPath, char* szOut, size_t nOutSize)
+{
+#ifdef WIN
+	if(!_fullpath(szOut, szPath, nOutSize)) return 0;
+
+	DWORD nAttr = GetFileAttributesA(szOut);
+	if(nAttr == INVALID_FILE_ATTRIBUTES) return 0;
+
+	// remove ending slash (kept on drive roots, "C:\")
+	size_t nLen = strlen(szOut);
+	while(nLen > 3 && (szOut[nLen - 1] == '\\' || szOut[nLen - 1] == '/')) {
+		szOut[--nLen] = 0;
+	}
+	return 1;
+#else
+	char* szFull = realpath(szPath, NULL);
+	if(!szFull) return 0;
+
+	size_t nLen = strlen(szFull);
+	int ret = (nLen < nOutSize);
+	if(ret) memcpy(szOut, szFull, nLen + 1);
+	free(szFull);
+	return ret;
+#endif
+}
+
+void psxFileListFree(psiso_file_list* list)
+{
+	for(uint32_t i = 0; i < list->nCount; i++) {
+		SAFE_FREE(list->pszPaths[i]);
+	}
+	SAFE_FREE(list->pszPaths);
+	list->nCount = 0;
+	list->nCapacity = 0;
+}
+
+static void quiet_log_sink(void* pUser, int nLevel, const char* szMsg)
+{
+	(void)pUser;
+	(void)nLevel;
+	(void)szMsg;
+}
+
+// Tracks of CUE sheets are probed through their sheet, so they are dropped from the list (a
+// broken sheet keeps its files, it will be reported when probed)
+static void drop_cue_tracks(psiso_file_list* list)
+{
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.log = quiet_log_sink;
+	ctx.bNoMap = true;
+
+	bool* pDrop = (bool*)calloc(list->nCount ? list->nCount : 1, sizeof(bool));
+	if(!pDrop) return;
+
+	for(uint32_t i = 0; i < list->nCount; i++)
+	{
+		if(!psxCUEIsSheet(list->pszPaths[i])) continue;
+
+		psiso_cue cue;
+		if(!psxCUELoad(&ctx, &cue, list->pszPaths[i])) continue;
+
+		for(uint32_t f = 0; f < cue.nFiles; f++) {
+			for(uint32_t k = 0; k < list->nCount; k++) {
+				if(strcmp(list->pszPaths[k], cue.pFiles[f].szPath) == 0) pDrop[k] = true;
+			}
+		}
+		psxCUEFree(&cue);
+	}
+
+	uint32_t nKept = 0;
+	for(uint32_t i = 0; i < list->nCount; i++) {
+		if(pDrop[i]) {
+			SAFE_FREE(list->pszPaths[i]);
+		} else {
+			list->pszPaths[nKept++] = list->pszPaths[i];
+		}
+	}
+	list->nCount = nKept;
+	free(pDrop);
+}
+
+// ------------------------------------------------------------------------------
+// Parallel probe + ordered writer
+
+// messages of one image, kept until the writer gets to it so logs never interleave
+struct scan_log
+{
+	char*	pText;
+	size_t	nLen;
+	size_t	nCapacity;
+};
+
+struct scan_slot
+{
+	bool				bDone;
+	bool				bCached;	// taken from the catalog
+	psiso_catalog_entry	entry;		// probe result (szPath / pSFO only with a catalog)
+	scan_log			log;
+};
+
+struct scan_job
+{
+	const psiso_file_list*	list;
+	scan_slot*				slots;
+	const psiso_catalog*	cat;		// previous scan (NULL = no catalog)
+	int						nSystem;
+	bool					bVerbose;
+	psx_mutex				m;
+	psx_sem					done;
+};
+
+static void scan_log_sink(void* pUser, int nLevel, const char* szMsg)
+{
+	(void)nLevel;
+	scan_log* log = (scan_log*)pUser;
+
+	size_t nMsgLen = strlen(szMsg);
+	if(log->nLen + nMsgLen + 1 > log->nCapacity)
+	{
+		size_t nCapacity = log->nCapacity ? log->nCapacity : 1024;
+		while(log->nLen + nMsgLen + 1 > nCapacity) nCapacity *= 2;
+		char* pText = (char*)realloc(log->pText, nCapacity);
+		if(!pText) return;
+		log->pText = pText;
+		log->nCapacity = nCapacity;
+	}
+	memcpy(log->pText + log->nLen, szMsg, nMsgLen + 1);
+	log->nLen += nMsgLen;
+}
+
+static void scan_worker(void* pUser, uint32_t nJob, int nWorker)
+{
+	(void)nWorker;
+	scan_job* job = (scan_job*)pUser;
+
+	// only this worker touches the slot until bDone is set
+	scan_slot* slot = &job->slots[nJob];
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose	= job->bVerbose;
+	ctx.log			= scan_log_sink;
+	ctx.pLogUser	= &slot->log;
+	ctx.bNoMap		= true;		// images may be truncated while the library is scanned (SIGBUS)
+
+	// the catalog is only read until all the workers are done
+	psiso_catalog_entry entry;
+	bool bCached = false;
+	if(job->cat) {
+		if(!psxCatalogProbe(&ctx, job->cat, job->list->pszPaths[nJob], job->nSystem, &entry, &bCached)) {
+			memset(&entry, 0, sizeof(entry));
+		}
+	} else {
+		memset(&entry, 0, sizeof(entry));
+		entry.nRet = psxProcessISOEx(&ctx, job->list->pszPaths[nJob], job->nSystem, false, &entry.res);
+	}
+
+	psxMutexLock(job->m);
+	slot->entry = entry;
+	slot->bCached = bCached;
+	slot->bDone = true;
+	psxMutexUnlock(job->m);
+
+	psxSemPost(job->done);
+}
+
+int psxScanFiles(const psiso_file_list* list, const psiso_catalog* prev, psiso_catalog* cat, int nSystem, int nJobs, bool bVerbose, psiso_scan_stats* stats)
+{
+	if(nJobs <= 0) nJobs = psxCpuCount();
+
+	memset(stats, 0, sizeof(psiso_scan_stats));
+	stats->nThreads = nJobs;
+	if(!list->nCount) return 1;
+
+	scan_job job;
+	job.list	= list;
+	job.cat		= prev;
+	job.nSystem	= nSystem;
+	job.bVerbose	= bVerbose;
+	job.slots	= (scan_slot*)calloc(list->nCount, sizeof(scan_slot));
+	job.m		= psxMutexCreate();
+	job.done	= psxSemCreate(0);
+
+	if(!job.slots || !job.m || !job.done) {
+		SAFE_FREE(job.slots);
+		psxMutexDestroy(job.m);
+		psxSemDestroy(job.done);
+		return 0;
+	}
+
+	psx_pool* pool = psxPoolStart(list->nCount, nJobs, scan_worker, &job);
+	if(!pool) {
+		SAFE_FREE(job.slots);
+		psxMutexDestroy(job.m);
+		psxSemDestroy(job.done);
+		return 0;
+	}
+
+	// single writer, results go out in list order as soon as they are ready
+	uint32_t nNext = 0;
+
+	while(nNext < list->nCount)
+	{
+		psxSemWait(job.done);
+
+		while(nNext < list->nCount)
+		{
+			psxMutexLock(job.m);
+			bool bDone = job.slots[nNext].bDone;
+			psxMutexUnlock(job.m);
+			if(!bDone) break;
+
+			scan_slot* slot = &job.slots[nNext];
+			if(slot->log.nLen) {
+				fputs(slot->log.pText, stdout);
+			}
+			SAFE_FREE(slot->log.pText);
+
+			const psiso_result* res = &slot->entry.res;
+			if(slot->entry.nRet == 1 && res->szTitleID[0]) {
+				printf("OK\t%s\t%s\t%s\t%s\n", szISOSystem[res->nSystem], res->szTitleID, res->szTitle, list->pszPaths[nNext]);
+			} else {
+				printf("FAIL\t\t\t\t%s\n", list->pszPaths[nNext]);
+				stats->nFailed++;
+			}
+			if(slot->bCached) stats->nCached++;
+			fflush(stdout);
+			nNext++;
+		}
+	}
+
+	psxPoolWait(pool);
+	stats->nImages = list->nCount;
+
+	// prev is not read anymore (it may be cat)
+	int ret = 1;
+	for(uint32_t i = 0; i < list->nCount; i++) {
+		if(cat && (!job.slots[i].entry.szPath || !psxCatalogSet(cat, &job.slots[i].entry))) ret = 0;
+		psxCatalogEntryFree(&job.slots[i].entry);
+	}
+
+	SAFE_FREE(job.slots);
+	psxMutexDestroy(job.m);
+	psxSemDestroy(job.done);
+
+	return ret;
+}
+
+int psxScanUpdate(const char* szDir, psiso_catalog* cat, int nSystem, int nJobs, bool bVerbose, psiso_scan_stats* stats)
+{
+	memset(stats, 0, sizeof(psiso_scan_stats));
+	stats->nThreads = (nJobs <= 0) ? psxCpuCount() : nJobs;
+
+	psiso_file_list list;
+	if(!psxScanDirectory(szDir, &list)) {
+		psxFileListFree(&list);
+		return -1;
+	}
+	drop_cue_tracks(&list);
+
+	// images no longer under szDir are dropped, other directories of the catalog are kept
+	psiso_catalog prev;
+	ZERO(prev);
+	if(cat) psxCatalogRemoveDir(cat, szDir, &prev);
+
+	int ret = psxScanFiles(&list, cat ? &prev : NULL, cat, nSystem, nJobs, bVerbose, stats);
+
+	psxCatalogFree(&prev);
+	psxFileListFree(&list);
+	return ret;
+}
+
+int psxScanLibrary(const char* szDir, int nSystem, int nJobs, bool bVerbose, const char* szCatalog)
+{
+	// catalog entries are keyed by the full path, relative and absolute runs share them
+	char szFull[4096];
+	if(szCatalog) {
+		if(!psxFullPath(szDir, szFull, sizeof(szFull))) return -1;
+		szDir = szFull;
+	}
+
+	psiso_catalog cat;
+	ZERO(cat);
+	if(szCatalog && psxCatalogLoad(&cat, szCatalog) < 0) {
+		return -4; // never overwrite a file that is not a catalog
+	}
+
+	double fStart = psxTimeNow();
+
+	psiso_scan_stats stats;
+	int ret = psxScanUpdate(szDir, szCatalog ? &cat : NULL, nSystem, nJobs, bVerbose, &stats);
+
+	double fElapsed = psxTimeNow() - fStart;
+
+	if(ret != 1) {
+		psxCatalogFree(&cat);
+		return (ret == -1) ? -1 : -3;
+	}
+	if(szCatalog && !psxCatalogSave(&cat, szCatalog)) {
+		ret = -2;
+	}
+	psxCatalogFree(&cat);
+
+	printf(SEP_LINE_2);
+	if(szCatalog) {
+		printf("Scanned %u images (%u failed, %u from the catalog) in %.2f seconds using %d threads. \n", stats.nImages, stats.nFailed, stats.nCached, fElapsed, stats.nThreads);
+	} else {
+		printf("Scanned %u images (%u failed) in %.2f seconds using %d threads. \n", stats.nImages, stats.nFailed, fElapsed, stats.nThreads);
+	}
+
+	return (ret == -2) ? -2 : (int)stats.nFailed;
+}
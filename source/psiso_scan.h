@@ -0,0 +1,119 @@
+#ifndef PSISO_SCAN_H
+#define PSISO_SCAN_H
+
+#include "psiso_tool.h"
+#include "psiso_catalog.h"
+
+// ------------------------------------------------------------------------------------------------
+// Batch scan module
+// ------------------------------------------------------------------------------------------------
+
+struct psiso_file_list
+{
+	char**		pszPaths;
+	uint32_t	nCount;
+	uint32_t	nCapacity;
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	szDir			- Directory to walk (recursively)
+(out)	list			- Paths of all the disc images found (.iso / .bin / .cue / .cso / .zso), in directory order
+						  with each directory sorted by name. Release with psxFileListFree().
+						  Links to images are listed, links to directories (and junctions) are
+						  not followed so a link back to a parent can not repeat the tree.
+
+(out)	return			- Will return 1 for success and 0 if szDir could not be opened.
+-------------------------------------------------------------------------------------------------
+*/
+int psxScanDirectory(const char* szDir, psiso_file_list* list);
+void psxFileListFree(psiso_file_list* list);
+
+// True if szName has one of the disc image extensions listed above
+bool psxIsImageName(const char* szName);
+
+// Append a copy of szPath, returns 0 if out of memory
+int psxFileListAdd(psiso_file_list* list, const char* szPath);
+
+// Absolute path of szPath with no "." / ".." parts (symbolic links resolved on POSIX), so the
+// same directory always gives the same catalog keys. Returns 0 if it does not exist or does not
+// fit in szOut.
+int psxFullPath(const char* szPath, char* szOut, size_t nOutSize);
+
+struct psiso_scan_stats
+{
+	uint32_t	nImages;	// images probed or taken from the catalog
+	uint32_t	nFailed;
+	uint32_t	nCached;	// taken from the catalog
+	int			nThreads;	// workers used
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	list			- Disc images to probe
+(in)	prev			- Catalog with the results of the previous scan (NULL = probe them all)
+(in)	cat				- Catalog that receives the results (NULL = not kept), may be prev
+(in)	nSystem			- One of the ISO_SYSTEM_* values (ISO_SYSTEM_AUTO to detect each image)
+(in)	nJobs			- Maximum number of images probed at once (0 = one per CPU)
+(in)	bVerbose		- Display the details of every image probed
+(out)	stats			- Images, failures and catalog hits
+
+(out)	return			- Will return 1 for success and 0 if out of memory (or the worker threads
+						  could not be started).
+
+Images are probed on a thread pool, one line per image is written to stdout in list
+order (see psxScanLibrary()). prev and cat are only used with a catalog, both or none.
+-------------------------------------------------------------------------------------------------
+*/
+int psxScanFiles(const psiso_file_list* list, const psiso_catalog* prev, psiso_catalog* cat, int nSystem, int nJobs, bool bVerbose, psiso_scan_stats* stats);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+Bring the entries of a directory up to date on an in-memory catalog: images that changed are
+probed (psxScanFiles()) and images no longer under szDir are removed.
+
+(in)	szDir			- Directory with the game library
+(in)	cat				- Catalog to update (NULL = probe everything, nothing is kept)
+(in)	nSystem			- Same as psxScanFiles()
+(in)	nJobs			- Same as psxScanFiles()
+(in)	bVerbose		- Same as psxScanFiles()
+(out)	stats			- Same as psxScanFiles()
+
+(out)	return			- Will return 1 for success, 0 if out of memory and -1 if szDir could not
+						  be opened.
+-------------------------------------------------------------------------------------------------
+*/
+int psxScanUpdate(const char* szDir, psiso_catalog* cat, int nSystem, int nJobs, bool bVerbose, psiso_scan_stats* stats);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	szDir			- Directory with the game library
+(in)	nSystem			- One of the ISO_SYSTEM_* values, used for every image found, or
+						  ISO_SYSTEM_AUTO to detect the console of each image
+(in)	nJobs			- Maximum number of images probed at once (0 = one per CPU). Use 1 or 2
+						  for libraries on spinning disks, so the heads are not thrashed.
+(in)	bVerbose		- Display the details of every image probed
+(in)	szCatalog		- Catalog file of the library (see psiso_catalog.h), or NULL. Only the
+						  images that changed since the last scan are probed, the catalog is
+						  then updated (images no longer under szDir are dropped from it).
+						  szDir is turned into a full path first (psxFullPath()), so the
+						  images are keyed and listed the same way on every run.
+
+(out)	return			- Number of images that could not be processed, -1 if szDir could not
+						  be opened, -2 if the catalog could not be written, -3 if out of
+						  memory (or the worker threads could not be started) or -4 if
+						  szCatalog exists but could not be read or is not a valid catalog
+						  (nothing is scanned then, a missing file starts an empty catalog).
+
+Images are probed on a thread pool, results are written to stdout in directory
+order (one line per image) as soon as all the images before them are done:
+
+	OK<TAB>SYSTEM<TAB>TITLE ID<TAB>TITLE<TAB>PATH
+	FAIL<TAB><TAB><TAB><TAB>PATH
+
+Files listed on a CUE sheet are not probed on their own, the sheet is (one line per disc).
+-------------------------------------------------------------------------------------------------
+*/
+int psxScanLibrary(const char* szDir, int nSystem, int nJobs, bool bVerbose, const char* szCatalog);
+
+#endif
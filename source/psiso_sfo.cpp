@@ -0,0 +1,207 @@
+// ------------------------------------------------------------------------------
+// PARAM.SFO module
+// ------------------------------------------------------------------------------
+#include "psiso_sfo.h"
+#include "psiso_reader.h"
+
+static const uint8_t sfo_magic[4] = { 0x00, 'P', 'S', 'F' };
+
+int psxSFOParse(psiso_sfo* sfo, const void* pData, size_t nSize)
+{
+	memset(sfo, 0, sizeof(psiso_sfo));
+
+	const uint8_t* p = (const uint8_t*)pData;
+	if(!p || nSize < PSISO_SFO_HEADER_SIZE || nSize > PSISO_SFO_MAX_SIZE) return 0;
+	if(memcmp(p, sfo_magic, sizeof(sfo_magic)) != 0) return 0;
+
+	uint32_t nKeyTable	= psx_le32(p + 0x08);
+	uint32_t nDataTable	= psx_le32(p + 0x0C);
+	uint32_t nKeys		= psx_le32(p + 0x10);
+
+	if(nKeys > (nSize - PSISO_SFO_HEADER_SIZE) / PSISO_SFO_INDEX_SIZE) return 0;
+	if(nKeyTable > nSize || nDataTable > nSize) return 0;
+
+	for(uint32_t i = 0; i < nKeys; i++)
+	{
+		const uint8_t* index = p + PSISO_SFO_HEADER_SIZE + i * PSISO_SFO_INDEX_SIZE;
+		uint32_t nKeyPos	= nKeyTable + psx_le16(index + 0x00);
+		uint32_t nLen		= psx_le32(index + 0x04);
+		uint32_t nDataPos	= nDataTable + psx_le32(index + 0x0C);
+
+		// name must be terminated and the value must be inside the blob
+		if(nKeyPos >= nSize || !memchr(p + nKeyPos, 0, nSize - nKeyPos)) return 0;
+		if(nDataPos > nSize || nLen > nSize - nDataPos) return 0;
+	}
+
+	sfo->pData		= p;
+	sfo->nSize		= (uint32_t)nSize;
+	sfo->nKeys		= nKeys;
+	sfo->nKeyTable	= nKeyTable;
+	sfo->nDataTable	= nDataTable;
+	return 1;
+}
+
+#ifdef WIN
+int psxSFORead(psiso_sfo* sfo, FILE* fp, uint64_t nOffset, size_t nLen, void* pBuf, size_t nBufSize)
+#else
+int psxSFORead(psiso_sfo* sfo, int fd, uint64_t nOffset, size_t nLen, void* pBuf, size_t nBufSize)
+#endif
+{
+	memset(sfo, 0, sizeof(psiso_sfo));
+
+	if(nLen == 0 || nLen > nBufSize) nLen = nBufSize;
+	if(nLen > PSISO_SFO_MAX_SIZE) nLen = PSISO_SFO_MAX_SIZE;
+
+	size_t nRead = 0;
+#ifdef WIN
+	if(!fp) return 0;
+	if(_fseeki64(fp, (int64_t)nOffset, SEEK_SET) != 0) return 0;
+	nRead = fread(pBuf, 1, nLen, fp);
+#else
+	if(fd == -1) return 0;
+	if(_lseek64(fd, nOffset, SEEK_SET) == -1) return 0;
+	while(nRead < nLen)
+	{
+		ssize_t n = _read(fd, (uint8_t*)pBuf + nRead, nLen - nRead);
+		if(n <= 0) break;
+		nRead += (size_t)n;
+	}
+#endif
+	return psxSFOParse(sfo, pBuf, nRead);
+}
+
+int psxSFOReadImage(psiso_sfo* sfo, psiso_reader* r, uint64_t nOffset, size_t nLen, void* pBuf, size_t nBufSize)
+{
+	memset(sfo, 0, sizeof(psiso_sfo));
+
+	if(nLen == 0 || nLen > nBufSize) nLen = nBufSize;
+	if(nLen > PSISO_SFO_MAX_SIZE) nLen = PSISO_SFO_MAX_SIZE;
+
+	size_t nRead = psxReaderReadRaw(r, nOffset, pBuf, nLen);
+	return psxSFOParse(sfo, pBuf, nRead);
+}
+
+int psxSFOKeyAt(const psiso_sfo* sfo, uint32_t nIndex, psiso_sfo_key* key)
+{
+	memset(key, 0, sizeof(psiso_sfo_key));
+	if(nIndex >= sfo->nKeys) return 0;
+
+	const uint8_t* index = sfo->pData + PSISO_SFO_HEADER_SIZE + nIndex * PSISO_SFO_INDEX_SIZE;
+
+	key->szName		= (const char*)(sfo->pData + sfo->nKeyTable + psx_le16(index + 0x00));
+	key->nFormat	= psx_le16(index + 0x02);
+	key->nLen		= psx_le32(index + 0x04);
+	key->pData		= sfo->pData + sfo->nDataTable + psx_le32(index + 0x0C);
+
+	if(key->nFormat == SFO_FORMAT_INT32 && key->nLen >= 4) {
+		key->nValue = psx_le32(key->pData);
+	} else if(key->nFormat == SFO_FORMAT_INT32 && key->nLen >= 2) {
+		key->nValue = psx_le16(key->pData);
+	}
+	return 1;
+}
+
+int psxSFOFind(const psiso_sfo* sfo, const char* szName, psiso_sfo_key* key)
+{
+	for(uint32_t i = 0; i < sfo->nKeys; i++)
+	{
+		psxSFOKeyAt(sfo, i, key);
+		if(strcmp(key->szName, szName) == 0) {
+			return 1;
+		}
+	}
+	memset(key, 0, sizeof(psiso_sfo_key));
+	return 0;
+}
+
+int psxSFOGetString(const psiso_sfo* sfo, const char* szName, char* szOut, size_t nOutSize)
+{
+	if(nOutSize) szOut[0] = 0;
+
+	psiso_sfo_key key;
+	if(!psxSFOFind(sfo, szName, &key)) return 0;
+	if(key.nFormat != SFO_FORMAT_UTF8 && key.nFormat != SFO_FORMAT_UTF8_SPECIAL) return 0;
+	if(!nOutSize) return 1;
+
+	// stop at the terminator (if any) or at the end of the value
+	size_t nLen = 0;
+	while(nLen < key.nLen && key.pData[nLen]) nLen++;
+	if(nLen > nOutSize - 1) nLen = nOutSize - 1;
+
+	memcpy(szOut, key.pData, nLen);
+	szOut[nLen] = 0;
+	return 1;
+}
+
+int psxSFOGetInt(const psiso_sfo* sfo, const char* szName, uint32_t* pnValue)
+{
+	psiso_sfo_key key;
+	if(!psxSFOFind(sfo, szName, &key) || key.nFormat != SFO_FORMAT_INT32) return 0;
+	*pnValue = key.nValue;
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+
+uint64_t psxSFOLookup(psiso_ctx* ctx, const psiso_sfo* sfo, const char* szEntry, char* szOut, size_t nOutSize)
+{
+	if(!ctx->bSFOInfoDisplayed) 
+	{
+		psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+		psxLog(ctx, PSISO_LOG_VERBOSE,  "Preparing to process PARAM.SFO \n");
+		psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+		psxSFODump(ctx, sfo);
+		ctx->bSFOInfoDisplayed = true;
+	}
+
+	// If a variable name entry is specified then look for it...
+	if(szEntry == NULL) return 0;
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Searching variable data for [ %s ] \n", szEntry);
+
+	psiso_sfo_key key;
+	if(!psxSFOFind(sfo, szEntry, &key)) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Error: Variable data \"%s\" not found on SFO. \n", szEntry);
+		return 0;
+	}
+
+	if(key.nFormat == SFO_FORMAT_INT32) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Found variable data for [ %s ]... [ 0x%04X ] \n", szEntry, key.nValue);
+		return key.nValue;
+	}
+
+	if(szOut && nOutSize) {
+		psxSFOGetString(sfo, szEntry, szOut, nOutSize);
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Found variable data for [ %s ]... [ %s ]\n", szEntry, szOut);
+	}
+	return 0;
+}
+
+void psxSFODump(psiso_ctx* ctx, const psiso_sfo* sfo)
+{
+	if(!ctx->bVerbose) return;
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, "SFO Version: 0x%08X \n"						, psx_le32(sfo->pData + 0x04));
+	psxLog(ctx, PSISO_LOG_VERBOSE, "SFO Variable Name Table Offset: 0x%08X \n"	, sfo->nKeyTable);
+	psxLog(ctx, PSISO_LOG_VERBOSE, "SFO Data Table Offset: 0x%08X \n"			, sfo->nDataTable);
+	psxLog(ctx, PSISO_LOG_VERBOSE, "SFO Total Variables: %d \n"					, sfo->nKeys);
+
+	psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+	psxLog(ctx, PSISO_LOG_VERBOSE, "SFO Variable Table Entries: \n");
+	psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+
+	for(uint32_t i = 0; i < sfo->nKeys; i++)
+	{
+		psiso_sfo_key key;
+		psxSFOKeyAt(sfo, i, &key);
+
+		if(key.nFormat == SFO_FORMAT_INT32) {
+			psxLog(ctx, PSISO_LOG_VERBOSE, " >> %s: 0x%04X \n", key.szName, key.nValue);
+		} else {
+			char szText[1024];
+			psxSFOGetString(sfo, key.szName, szText, sizeof(szText));
+			psxLog(ctx, PSISO_LOG_VERBOSE, " >> %s: %s \n", key.szName, szText);
+		}
+	}
+	psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+}
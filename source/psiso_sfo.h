@@ -0,0 +1,102 @@
+#ifndef PSISO_SFO_H
+#define PSISO_SFO_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// PARAM.SFO module
+// ------------------------------------------------------------------------------------------------
+// The whole PARAM.SFO is read once into a caller buffer (or used in place when it is already in
+// memory) and validated, after that keys are looked up directly on the blob. Nothing is allocated
+// and nothing is copied until a value is requested.
+//
+//	0x00	"\0PSF"
+//	0x04	uint32		Version
+//	0x08	uint32		Key table offset
+//	0x0C	uint32		Data table offset
+//	0x10	uint32		Number of keys
+//	0x14	index table, 16 bytes per key:
+//			uint16 key offset, uint16 format, uint32 length, uint32 max length, uint32 data offset
+//
+// All values are little-endian.
+
+#define PSISO_SFO_MAX_SIZE			0x10000	// real PARAM.SFO files are just a few KB
+#define PSISO_SFO_HEADER_SIZE		0x14
+#define PSISO_SFO_INDEX_SIZE		0x10
+
+#define SFO_FORMAT_UTF8_SPECIAL		0x0004	// text, not '\0' terminated
+#define SFO_FORMAT_UTF8				0x0204	// text
+#define SFO_FORMAT_INT32			0x0404	// numeric
+
+struct psiso_sfo
+{
+	const uint8_t*	pData;		// blob (not owned)
+	uint32_t		nSize;
+	uint32_t		nKeys;
+	uint32_t		nKeyTable;
+	uint32_t		nDataTable;
+};
+
+struct psiso_sfo_key
+{
+	const char*		szName;
+	uint16_t		nFormat;	// SFO_FORMAT_*
+	const uint8_t*	pData;		// value on the blob
+	uint32_t		nLen;		// value length in bytes
+	uint32_t		nValue;		// SFO_FORMAT_INT32 value
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(out)	sfo				- View over the PARAM.SFO
+(in)	pData			- PARAM.SFO data, must stay valid while sfo is in use
+(in)	nSize			- Length in bytes of pData
+
+(out)	return			- Will return 1 for success and 0 if the data is not a valid PARAM.SFO
+						  (every key is bounds checked here, so lookups do not need to).
+-------------------------------------------------------------------------------------------------
+*/
+int psxSFOParse(psiso_sfo* sfo, const void* pData, size_t nSize);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+Same as psxSFOParse() reading the PARAM.SFO from a file in a single read.
+
+(in)	fp / fd			- Open handle of the file containing the PARAM.SFO
+(in)	nOffset			- Offset of the PARAM.SFO data (0 if the file is the actual PARAM.SFO)
+(in)	nLen			- Length in bytes of the PARAM.SFO data (0 = up to nBufSize)
+(in)	pBuf			- Caller buffer that receives the data, sfo points into it
+(in)	nBufSize		- Size of pBuf (PSISO_SFO_MAX_SIZE is always enough)
+-------------------------------------------------------------------------------------------------
+*/
+#ifdef WIN
+int psxSFORead(psiso_sfo* sfo, FILE* fp, uint64_t nOffset, size_t nLen, void* pBuf, size_t nBufSize);
+#else
+int psxSFORead(psiso_sfo* sfo, int fd, uint64_t nOffset, size_t nLen, void* pBuf, size_t nBufSize);
+#endif
+
+// Same as psxSFORead() through a sector reader, nOffset is a raw offset on the image (on the
+// uncompressed image for CSO / ZSO, see psiso_reader.h).
+struct psiso_reader;
+int psxSFOReadImage(psiso_sfo* sfo, psiso_reader* r, uint64_t nOffset, size_t nLen, void* pBuf, size_t nBufSize);
+
+// Key by index [0, nKeys), returns 0 if out of range
+int psxSFOKeyAt(const psiso_sfo* sfo, uint32_t nIndex, psiso_sfo_key* key);
+
+// Key by name (Ex. TITLE_ID), returns 0 if not found
+int psxSFOFind(const psiso_sfo* sfo, const char* szName, psiso_sfo_key* key);
+
+// Text value of szName into szOut (always terminated), returns 0 if not found or not text
+int psxSFOGetString(const psiso_sfo* sfo, const char* szName, char* szOut, size_t nOutSize);
+
+// Numeric value of szName, returns 0 if not found or not numeric
+int psxSFOGetInt(const psiso_sfo* sfo, const char* szName, uint32_t* pnValue);
+
+// Display all the keys (verbose)
+void psxSFODump(psiso_ctx* ctx, const psiso_sfo* sfo);
+
+// ParseSFOEx() on an already parsed PARAM.SFO: dumps all the keys once per ctx image (verbose),
+// then copies the text value of szEntry into szOut or returns its numeric value.
+uint64_t psxSFOLookup(psiso_ctx* ctx, const psiso_sfo* sfo, const char* szEntry, char* szOut, size_t nOutSize);
+
+#endif
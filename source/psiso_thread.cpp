@@ -0,0 +1,349 @@
+// ------------------------------------------------------------------------------
+// Threading module
+// ------------------------------------------------------------------------------
+#include "psiso_thread.h"
+
+#ifdef WIN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+// ------------------------------------------------------------------------------
+// Threads
+
+struct thread_start
+{
+	psx_thread_func	func;
+	void*			pArg;
+};
+
+#ifdef WIN
+static DWORD WINAPI thread_entry(LPVOID pParam)
+#else
+static void* thread_entry(void* pParam)
+#endif
+{
+	thread_start start = *(thread_start*)pParam;
+	free(pParam);
+	start.func(start.pArg);
+	return 0;
+}
+
+psx_thread psxThreadStart(psx_thread_func func, void* pArg)
+{
+	thread_start* start = (thread_start*)malloc(sizeof(thread_start));
+	if(!start) return NULL;
+	start->func = func;
+	start->pArg = pArg;
+
+#ifdef WIN
+	HANDLE h = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+	if(!h) {
+		free(start);
+		return NULL;
+	}
+	return (psx_thread)h;
+#else
+	pthread_t* t = (pthread_t*)malloc(sizeof(pthread_t));
+	if(!t || pthread_create(t, NULL, thread_entry, start) != 0) {
+		SAFE_FREE(t);
+		free(start);
+		return NULL;
+	}
+	return (psx_thread)t;
+#endif
+}
+
+void psxThreadJoin(psx_thread thread)
+{
+	if(!thread) return;
+#ifdef WIN
+	WaitForSingleObject((HANDLE)thread, INFINITE);
+	CloseHandle((HANDLE)thread);
+#else
+	pthread_join(*(pthread_t*)thread, NULL);
+	free(thread);
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// Mutex
+
+psx_mutex psxMutexCreate()
+{
+#ifdef WIN
+	CRITICAL_SECTION* cs = (CRITICAL_SECTION*)malloc(sizeof(CRITICAL_SECTION));
+	if(cs) InitializeCriticalSection(cs);
+	return (psx_mutex)cs;
+#else
+	pthread_mutex_t* m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+	if(m) pthread_mutex_init(m, NULL);
+	return (psx_mutex)m;
+#endif
+}
+
+void psxMutexDestroy(psx_mutex m)
+{
+	if(!m) return;
+#ifdef WIN
+	DeleteCriticalSection((CRITICAL_SECTION*)m);
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)m);
+#endif
+	free(m);
+}
+
+void psxMutexLock(psx_mutex m)
+{
+#ifdef WIN
+	EnterCriticalSection((CRITICAL_SECTION*)m);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)m);
+#endif
+}
+
+void psxMutexUnlock(psx_mutex m)
+{
+#ifdef WIN
+	LeaveCriticalSection((CRITICAL_SECTION*)m);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)m);
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// Once (0 = not started, 1 = running, 2 = done)
+
+static long once_cas(psx_once* once, long nExchange, long nComparand)
+{
+#ifdef WIN
+	return InterlockedCompareExchange((LONG volatile*)once, nExchange, nComparand);
+#else
+	return __sync_val_compare_and_swap(once, nComparand, nExchange);
+#endif
+}
+
+void psxOnce(psx_once* once, psx_once_func func)
+{
+	long nState = once_cas(once, 1, 0);
+	if(nState == 0) {
+		func();
+		once_cas(once, 2, 1);
+		return;
+	}
+	while(nState != 2) {
+		psxSleepMs(0);
+		nState = once_cas(once, 2, 2); // plain read with a full barrier
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Semaphore (no unnamed POSIX semaphores on DARWIN, so build it from a mutex + condition)
+
+#ifndef WIN
+struct posix_sem
+{
+	pthread_mutex_t	m;
+	pthread_cond_t	c;
+	int				nCount;
+};
+#endif
+
+psx_sem psxSemCreate(int nInitial)
+{
+#ifdef WIN
+	return (psx_sem)CreateSemaphore(NULL, nInitial, 0x7FFFFFFF, NULL);
+#else
+	posix_sem* s = (posix_sem*)malloc(sizeof(posix_sem));
+	if(!s) return NULL;
+	pthread_mutex_init(&s->m, NULL);
+	pthread_cond_init(&s->c, NULL);
+	s->nCount = nInitial;
+	return (psx_sem)s;
+#endif
+}
+
+void psxSemDestroy(psx_sem s)
+{
+	if(!s) return;
+#ifdef WIN
+	CloseHandle((HANDLE)s);
+#else
+	posix_sem* ps = (posix_sem*)s;
+	pthread_cond_destroy(&ps->c);
+	pthread_mutex_destroy(&ps->m);
+	free(ps);
+#endif
+}
+
+void psxSemPost(psx_sem s)
+{
+#ifdef WIN
+	ReleaseSemaphore((HANDLE)s, 1, NULL);
+#else
+	posix_sem* ps = (posix_sem*)s;
+	pthread_mutex_lock(&ps->m);
+	ps->nCount++;
+	pthread_cond_signal(&ps->c);
+	pthread_mutex_unlock(&ps->m);
+#endif
+}
+
+void psxSemWait(psx_sem s)
+{
+#ifdef WIN
+	WaitForSingleObject((HANDLE)s, INFINITE);
+#else
+	posix_sem* ps = (posix_sem*)s;
+	pthread_mutex_lock(&ps->m);
+	while(ps->nCount == 0) {
+		pthread_cond_wait(&ps->c, &ps->m);
+	}
+	ps->nCount--;
+	pthread_mutex_unlock(&ps->m);
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// Misc
+
+int psxCpuCount()
+{
+	int nCount = 1;
+#ifdef WIN
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	nCount = (int)info.dwNumberOfProcessors;
+#else
+	nCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (nCount < 1) ? 1 : nCount;
+}
+
+double psxTimeNow()
+{
+#ifdef WIN
+	return (double)GetTickCount() / 1000.0;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+#endif
+}
+
+void psxSleepMs(unsigned int nMs)
+{
+#ifdef WIN
+	Sleep(nMs);
+#else
+	usleep(nMs * 1000);
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// Job pool
+
+struct pool_worker
+{
+	psx_pool*	pool;
+	int			nIndex;
+};
+
+struct psx_pool
+{
+	int				nThreads;
+	psx_job_func	func;
+	void*			pUser;
+	psx_mutex		m;			// guards nNext
+	uint32_t		nNext;		// next job to hand out
+	uint32_t		nJobs;
+	pool_worker*	workers;
+	psx_thread*		threads;
+};
+
+// next job in index order, false once all of them were handed out
+static bool pool_take(psx_pool* pool, uint32_t* pnJob)
+{
+	bool bTaken = false;
+	psxMutexLock(pool->m);
+	if(pool->nNext < pool->nJobs) {
+		*pnJob = pool->nNext++;
+		bTaken = true;
+	}
+	psxMutexUnlock(pool->m);
+	return bTaken;
+}
+
+static void pool_worker_main(void* pArg)
+{
+	pool_worker* worker = (pool_worker*)pArg;
+	psx_pool* pool = worker->pool;
+
+	uint32_t nJob = 0;
+	while(pool_take(pool, &nJob)) {
+		pool->func(pool->pUser, nJob, worker->nIndex);
+	}
+}
+
+psx_pool* psxPoolStart(uint32_t nJobs, int nThreads, psx_job_func func, void* pUser)
+{
+	if(nThreads <= 0) nThreads = psxCpuCount();
+	if(nJobs && (uint32_t)nThreads > nJobs) nThreads = (int)nJobs;
+	if(nThreads < 1) nThreads = 1;
+
+	psx_pool* pool = (psx_pool*)malloc(sizeof(psx_pool));
+	if(!pool) return NULL;
+	memset(pool, 0, sizeof(psx_pool));
+
+	pool->nThreads	= nThreads;
+	pool->func		= func;
+	pool->pUser		= pUser;
+	pool->nJobs		= nJobs;
+	pool->m			= psxMutexCreate();
+	pool->workers	= (pool_worker*)malloc(nThreads * sizeof(pool_worker));
+	pool->threads	= (psx_thread*)malloc(nThreads * sizeof(psx_thread));
+
+	if(!pool->m || !pool->workers || !pool->threads) {
+		if(pool->m) psxMutexDestroy(pool->m);
+		SAFE_FREE(pool->workers);
+		SAFE_FREE(pool->threads);
+		free(pool);
+		return NULL;
+	}
+
+	for(int i = 0; i < nThreads; i++)
+	{
+		pool->workers[i].pool	= pool;
+		pool->workers[i].nIndex	= i;
+	}
+
+	for(int i = 0; i < nThreads; i++) {
+		pool->threads[i] = psxThreadStart(pool_worker_main, &pool->workers[i]);
+	}
+
+	// if a thread could not be started the others take its share, but with no threads at all
+	// do the work right here
+	bool bAnyThread = false;
+	for(int i = 0; i < nThreads; i++) {
+		if(pool->threads[i]) bAnyThread = true;
+	}
+	if(!bAnyThread) {
+		pool_worker_main(&pool->workers[0]);
+	}
+	return pool;
+}
+
+void psxPoolWait(psx_pool* pool)
+{
+	if(!pool) return;
+
+	for(int i = 0; i < pool->nThreads; i++) {
+		psxThreadJoin(pool->threads[i]);
+	}
+	psxMutexDestroy(pool->m);
+	SAFE_FREE(pool->workers);
+	SAFE_FREE(pool->threads);
+	free(pool);
+}
@@ -0,0 +1,77 @@
+#ifndef PSISO_THREAD_H
+#define PSISO_THREAD_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// Threading module (Win32 threads on Windows, pthreads everywhere else)
+// ------------------------------------------------------------------------------------------------
+// OS objects are kept behind opaque handles so this header does not pull <windows.h>.
+
+typedef void* psx_thread;
+typedef void* psx_mutex;
+typedef void* psx_sem;
+
+typedef void (*psx_thread_func)(void* pArg);
+
+psx_thread psxThreadStart(psx_thread_func func, void* pArg);
+void psxThreadJoin(psx_thread thread);
+
+psx_mutex psxMutexCreate();
+void psxMutexDestroy(psx_mutex m);
+void psxMutexLock(psx_mutex m);
+void psxMutexUnlock(psx_mutex m);
+
+// One-time initialization, func runs exactly once even when several threads get here at the
+// same time (the others wait until it is done). Declare as: static psx_once once = PSX_ONCE_INIT;
+typedef volatile long psx_once;
+#define PSX_ONCE_INIT	0
+
+typedef void (*psx_once_func)();
+
+void psxOnce(psx_once* once, psx_once_func func);
+
+// Counting semaphore
+psx_sem psxSemCreate(int nInitial);
+void psxSemDestroy(psx_sem s);
+void psxSemPost(psx_sem s);
+void psxSemWait(psx_sem s);
+
+// Number of online CPUs (at least 1)
+int psxCpuCount();
+
+// Monotonic-ish wall clock in seconds, for throughput reports
+double psxTimeNow();
+
+// Sleep the calling thread
+void psxSleepMs(unsigned int nMs);
+
+// ------------------------------------------------------------------------------------------------
+// Job pool
+// ------------------------------------------------------------------------------------------------
+// Jobs [0, nJobs) are handed out one at a time in index order from a shared counter, every
+// worker takes the next one as soon as it is done. All the callers write the results in job
+// order, so the jobs in flight are always the next ones to be written (no result waits behind
+// a far away range), images are read front to back, and a slow job (Ex. a NAS hiccup) only
+// holds its own worker while the others keep going until the last job.
+
+typedef void (*psx_job_func)(void* pUser, uint32_t nJob, int nWorker);
+
+struct psx_pool;
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	nJobs			- Number of jobs
+(in)	nThreads		- Number of worker threads (concurrency limit), 0 = one per CPU
+(in)	func			- Job function, called once per job from any of the workers
+(in)	pUser			- User data passed to func
+
+(out)	return			- Running pool or NULL on failure. Call psxPoolWait() to wait for all
+						  the jobs and release it. The calling thread is free to do other work
+						  meanwhile (Ex. writing results in order).
+-------------------------------------------------------------------------------------------------
+*/
+psx_pool* psxPoolStart(uint32_t nJobs, int nThreads, psx_job_func func, void* pUser);
+void psxPoolWait(psx_pool* pool);
+
+#endif
@@ -0,0 +1,526 @@
+// ------------------------------------------------------------------------------
+// Title database module
+// ------------------------------------------------------------------------------
+#include "psiso_titledb.h"
+#include "psiso_reader.h"
+#include "psiso_thread.h"
+
+#ifdef WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+
+#define TITLEDB_MAX_FILE	(64 * 1024 * 1024)
+
+static uint32_t titledb_hash(const char* szID)
+{
+	uint32_t h = 2166136261U;
+	while(*szID) {
+		h ^= (uint8_t)*szID++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static char* titledb_read_file(const char* szPath, uint32_t* pnLen)
+{
+	char* pData = NULL;
+	int64_t nSize = 0;
+
+#ifdef WIN
+	FILE* fp = fopen(szPath, "rb");
+	if(!fp) return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	nSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if(nSize >= 0 && nSize <= TITLEDB_MAX_FILE) {
+		pData = (char*)malloc((size_t)nSize + 1);
+	}
+	if(pData && fread(pData, 1, (size_t)nSize, fp) != (size_t)nSize) {
+		SAFE_FREE(pData);
+	}
+	SAFE_FCLOSE(fp);
+#else
+	int fd = _open(szPath, O_RDONLY);
+	if(fd == -1) return NULL;
+
+	nSize = _lseek64(fd, 0, SEEK_END);
+	_lseek64(fd, 0, SEEK_SET);
+
+	if(nSize >= 0 && nSize <= TITLEDB_MAX_FILE) {
+		pData = (char*)malloc((size_t)nSize + 1);
+	}
+	int64_t nDone = 0;
+	while(pData && nDone < nSize)
+	{
+		ssize_t nRead = _read(fd, pData + nDone, (size_t)(nSize - nDone));
+		if(nRead <= 0) {
+			SAFE_FREE(pData);
+			break;
+		}
+		nDone += nRead;
+	}
+	_close(fd);
+#endif
+
+	if(!pData) return NULL;
+	pData[nSize] = 0;
+	*pnLen = (uint32_t)nSize;
+	return pData;
+}
+
+// insert ID at pool offset nEntry - 1, returns false if the ID was already there
+static bool titledb_insert(psiso_titledb* db, uint32_t nHash, uint32_t nEntry)
+{
+	const char* szID = db->pPool + nEntry - 1;
+	uint32_t nMask = db->nSlots - 1;
+
+	for(uint32_t i = nHash & nMask; ; i = (i + 1) & nMask)
+	{
+		psiso_titledb_slot* slot = &db->pSlots[i];
+		if(!slot->nEntry) {
+			slot->nHash = nHash;
+			slot->nEntry = nEntry;
+			db->nEntries++;
+			return true;
+		}
+		if(slot->nHash == nHash && strcmp(db->pPool + slot->nEntry - 1, szID) == 0) {
+			return false;
+		}
+	}
+}
+
+int psxTitleDBLoad(psiso_titledb* db, const char* szPath)
+{
+	memset(db, 0, sizeof(psiso_titledb));
+
+	uint32_t nLen = 0;
+	char* pText = titledb_read_file(szPath, &nLen);
+	if(!pText) return 0;
+
+	// pool never grows past the file itself (+ terminator for the last line)
+	db->pPool = (char*)malloc(nLen + 2);
+
+	// count lines to size the table (load factor <= 0.5)
+	uint32_t nLines = 1;
+	for(uint32_t i = 0; i < nLen; i++) {
+		if(pText[i] == '\n') nLines++;
+	}
+	db->nSlots = 16;
+	while(db->nSlots < nLines * 2) db->nSlots *= 2;
+	db->pSlots = (psiso_titledb_slot*)calloc(db->nSlots, sizeof(psiso_titledb_slot));
+
+	if(!db->pPool || !db->pSlots) {
+		free(pText);
+		psxTitleDBFree(db);
+		return 0;
+	}
+
+	char* pLine = pText;
+	while(*pLine)
+	{
+		char* pEnd = strchr(pLine, '\n');
+		char* pNext = pEnd ? pEnd + 1 : pLine + strlen(pLine);
+		if(!pEnd) pEnd = pLine + strlen(pLine);
+
+		// strip new line / trailing whitespace
+		while(pEnd > pLine && (pEnd[-1] == '\r' || pEnd[-1] == ' ' || pEnd[-1] == '\t')) pEnd--;
+		*pEnd = 0;
+
+		char* pSpc = strchr(pLine, ' ');
+
+		if(strncmp(pLine, "//", 2) != 0 && (pEnd - pLine) >= 11 && pSpc)
+		{
+			// "ID\0Title\0" into the pool
+			uint32_t nEntry = db->nPoolLen + 1;
+			size_t nIDLen = (size_t)(pSpc - pLine);
+			size_t nTitleLen = (size_t)(pEnd - (pSpc + 1));
+
+			memcpy(db->pPool + db->nPoolLen, pLine, nIDLen);
+			db->pPool[db->nPoolLen + nIDLen] = 0;
+			memcpy(db->pPool + db->nPoolLen + nIDLen + 1, pSpc + 1, nTitleLen);
+			db->pPool[db->nPoolLen + nIDLen + 1 + nTitleLen] = 0;
+
+			if(titledb_insert(db, titledb_hash(db->pPool + db->nPoolLen), nEntry)) {
+				db->nPoolLen += (uint32_t)(nIDLen + 1 + nTitleLen + 1);
+			}
+		}
+		pLine = pNext;
+	}
+	free(pText);
+
+	// give back the unused part of the pool
+	char* pPool = (char*)realloc(db->pPool, db->nPoolLen ? db->nPoolLen : 1);
+	if(pPool) db->pPool = pPool;
+
+	return 1;
+}
+
+// ------------------------------------------------------------------------------
+// Binary database
+
+int psxTitleDBMap(psiso_titledb* db, const char* szPath)
+{
+	memset(db, 0, sizeof(psiso_titledb));
+
+	const uint8_t* pMap = NULL;
+	uint64_t nMapSize = 0;
+
+#ifdef WIN
+	HANDLE hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hFile == INVALID_HANDLE_VALUE) return 0;
+
+	DWORD nSizeHigh = 0;
+	DWORD nSizeLow = GetFileSize(hFile, &nSizeHigh);
+	nMapSize = ((uint64_t)nSizeHigh << 32) | nSizeLow;
+
+	HANDLE hMap = NULL;
+	if(nMapSize >= PSISO_TITLEDB_HEADER_SIZE && nMapSize <= TITLEDB_MAX_FILE) {
+		hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	CloseHandle(hFile); // the mapping keeps its own reference
+
+	if(!hMap) return 0;
+	pMap = (const uint8_t*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if(!pMap) {
+		CloseHandle(hMap);
+		return 0;
+	}
+	db->hMap = (void*)hMap;
+#else
+	int fd = _open(szPath, O_RDONLY);
+	if(fd == -1) return 0;
+
+	int64_t nSize = _lseek64(fd, 0, SEEK_END);
+	if(nSize < PSISO_TITLEDB_HEADER_SIZE || nSize > TITLEDB_MAX_FILE) {
+		_close(fd);
+		return 0;
+	}
+	nMapSize = (uint64_t)nSize;
+
+	void* p = mmap(NULL, (size_t)nMapSize, PROT_READ, MAP_SHARED, fd, 0);
+	_close(fd); // the mapping stays valid
+	if(p == MAP_FAILED) return 0;
+	pMap = (const uint8_t*)p;
+#endif
+
+	db->pMap = pMap;
+	db->nMapSize = nMapSize;
+
+	// validate once, lookups trust the header after this
+	uint32_t nHeaderSize	= psx_le32(pMap + 0x0C);
+	uint32_t nEntries		= psx_le32(pMap + 0x10);
+	uint32_t nEntrySize		= psx_le32(pMap + 0x14);
+	uint32_t nPoolOffset	= psx_le32(pMap + 0x18);
+	uint32_t nPoolSize		= psx_le32(pMap + 0x1C);
+
+	bool bValid = (memcmp(pMap, PSISO_TITLEDB_MAGIC, 8) == 0) &&
+		psx_le32(pMap + 0x08) == PSISO_TITLEDB_VERSION &&
+		nHeaderSize >= PSISO_TITLEDB_HEADER_SIZE && nHeaderSize <= nMapSize &&
+		nEntrySize >= PSISO_TITLEDB_ENTRY_SIZE &&
+		(uint64_t)nEntries * nEntrySize <= nMapSize - nHeaderSize &&
+		nPoolSize > 0 && nPoolOffset >= nHeaderSize + (uint64_t)nEntries * nEntrySize &&
+		(uint64_t)nPoolOffset + nPoolSize <= nMapSize &&
+		pMap[nPoolOffset + nPoolSize - 1] == 0;
+
+	if(!bValid) {
+		psxTitleDBFree(db);
+		return 0;
+	}
+
+	db->pBinEntries		= pMap + nHeaderSize;
+	db->nBinEntries		= nEntries;
+	db->nBinEntrySize	= nEntrySize;
+	db->pBinPool		= (const char*)(pMap + nPoolOffset);
+	db->nBinPoolSize	= nPoolSize;
+	return 1;
+}
+
+static const char* bin_string(const psiso_titledb* db, uint32_t nOffset)
+{
+	return (nOffset < db->nBinPoolSize) ? db->pBinPool + nOffset : "";
+}
+
+static const uint8_t* bin_find(const psiso_titledb* db, const char* szTitleID)
+{
+	char key[PSISO_TITLEDB_ID_LEN];
+	ZERO(key);
+	if(strlen(szTitleID) >= PSISO_TITLEDB_ID_LEN) return NULL;
+	strcpy(key, szTitleID);
+
+	uint32_t nLow = 0;
+	uint32_t nHigh = db->nBinEntries;
+	while(nLow < nHigh)
+	{
+		uint32_t nMid = nLow + (nHigh - nLow) / 2;
+		const uint8_t* entry = db->pBinEntries + (uint64_t)nMid * db->nBinEntrySize;
+		int nCmp = memcmp(entry, key, PSISO_TITLEDB_ID_LEN);
+		if(nCmp == 0) return entry;
+		if(nCmp < 0) nLow = nMid + 1;
+		else nHigh = nMid;
+	}
+	return NULL;
+}
+
+uint8_t psxTitleRegion(const char* szTitleID)
+{
+	if(strlen(szTitleID) < 4) return PSISO_REGION_UNKNOWN;
+
+	// S[L|C][U|E|P|A|K]..
+	switch(szTitleID[2])
+	{
+		case 'U': return PSISO_REGION_NTSC_U;
+		case 'E': return PSISO_REGION_PAL;
+		case 'P': return PSISO_REGION_NTSC_J;
+		case 'A':
+		case 'K': return PSISO_REGION_ASIA;
+	}
+	return PSISO_REGION_UNKNOWN;
+}
+
+// ------------------------------------------------------------------------------
+
+void psxTitleDBFree(psiso_titledb* db)
+{
+	SAFE_FREE(db->pPool);
+	SAFE_FREE(db->pSlots);
+	db->nPoolLen = 0;
+	db->nSlots = 0;
+	db->nEntries = 0;
+
+	if(db->pMap)
+	{
+#ifdef WIN
+		UnmapViewOfFile((LPCVOID)db->pMap);
+		CloseHandle((HANDLE)db->hMap);
+#else
+		munmap((void*)db->pMap, (size_t)db->nMapSize);
+#endif
+	}
+	db->pMap = NULL;
+	db->hMap = NULL;
+	db->nMapSize = 0;
+	db->pBinEntries = NULL;
+	db->nBinEntries = 0;
+	db->pBinPool = NULL;
+	db->nBinPoolSize = 0;
+}
+
+int psxTitleDBFindEx(const psiso_titledb* db, const char* szTitleID, psiso_title_info* info)
+{
+	memset(info, 0, sizeof(psiso_title_info));
+	if(!db) return 0;
+
+	if(db->pMap)
+	{
+		const uint8_t* entry = bin_find(db, szTitleID);
+		if(!entry) return 0;
+
+		info->szTitle		= bin_string(db, psx_le32(entry + 0x10));
+		info->szPublisher	= bin_string(db, psx_le32(entry + 0x14));
+		info->nYear			= psx_le16(entry + 0x18);
+		info->nRegion		= entry[0x1A];
+		return 1;
+	}
+
+	info->szTitle = psxTitleDBFind(db, szTitleID);
+	if(!info->szTitle) return 0;
+
+	info->szPublisher	= "";
+	info->nRegion		= psxTitleRegion(szTitleID);
+	return 1;
+}
+
+const char* psxTitleDBFind(const psiso_titledb* db, const char* szTitleID)
+{
+	if(db && db->pMap) {
+		const uint8_t* entry = bin_find(db, szTitleID);
+		return entry ? bin_string(db, psx_le32(entry + 0x10)) : NULL;
+	}
+
+	if(!db || !db->nEntries) return NULL;
+
+	uint32_t nHash = titledb_hash(szTitleID);
+	uint32_t nMask = db->nSlots - 1;
+
+	for(uint32_t i = nHash & nMask; ; i = (i + 1) & nMask)
+	{
+		const psiso_titledb_slot* slot = &db->pSlots[i];
+		if(!slot->nEntry) return NULL;
+
+		const char* szID = db->pPool + slot->nEntry - 1;
+		if(slot->nHash == nHash && strcmp(szID, szTitleID) == 0) {
+			return szID + strlen(szID) + 1;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Binary database generator
+
+static void put_le32(uint8_t* p, uint32_t n)
+{
+	p[0] = (uint8_t)(n);
+	p[1] = (uint8_t)(n >> 8);
+	p[2] = (uint8_t)(n >> 16);
+	p[3] = (uint8_t)(n >> 24);
+}
+
+static const psiso_titledb* sort_db = NULL; // qsort has no user pointer (compile is CLI only, not reentrant)
+
+static int entry_compare(const void* a, const void* b)
+{
+	const char* szA = sort_db->pPool + *(const uint32_t*)a;
+	const char* szB = sort_db->pPool + *(const uint32_t*)b;
+	return strcmp(szA, szB);
+}
+
+int psxTitleDBCompile(const char* szTextPath, const char* szBinPath, int nSystem)
+{
+	psiso_titledb db;
+	if(!psxTitleDBLoad(&db, szTextPath)) {
+		return -1;
+	}
+
+	// collect the (first) entries and sort them by ID
+	uint32_t* pIDs = (uint32_t*)malloc((db.nEntries ? db.nEntries : 1) * sizeof(uint32_t));
+	uint32_t nCount = 0;
+	for(uint32_t i = 0; pIDs && i < db.nSlots; i++)
+	{
+		uint32_t nEntry = db.pSlots[i].nEntry;
+		if(nEntry && strlen(db.pPool + nEntry - 1) < PSISO_TITLEDB_ID_LEN) {
+			pIDs[nCount++] = nEntry - 1;
+		}
+	}
+
+	// strcmp order == memcmp order of the '\0' padded IDs
+	sort_db = &db;
+	if(pIDs) qsort(pIDs, nCount, sizeof(uint32_t), entry_compare);
+	sort_db = NULL;
+
+	uint32_t nPoolOffset = PSISO_TITLEDB_HEADER_SIZE + nCount * PSISO_TITLEDB_ENTRY_SIZE;
+	uint32_t nPoolSize = 1; // offset 0 = ""
+	for(uint32_t i = 0; pIDs && i < nCount; i++) {
+		const char* szID = db.pPool + pIDs[i];
+		nPoolSize += (uint32_t)strlen(szID + strlen(szID) + 1) + 1;
+	}
+
+	uint32_t nFileSize = nPoolOffset + nPoolSize;
+	uint8_t* pFile = pIDs ? (uint8_t*)calloc(nFileSize, 1) : NULL;
+	if(!pFile) {
+		SAFE_FREE(pIDs);
+		psxTitleDBFree(&db);
+		return -1;
+	}
+
+	memcpy(pFile, PSISO_TITLEDB_MAGIC, 8);
+	put_le32(pFile + 0x08, PSISO_TITLEDB_VERSION);
+	put_le32(pFile + 0x0C, PSISO_TITLEDB_HEADER_SIZE);
+	put_le32(pFile + 0x10, nCount);
+	put_le32(pFile + 0x14, PSISO_TITLEDB_ENTRY_SIZE);
+	put_le32(pFile + 0x18, nPoolOffset);
+	put_le32(pFile + 0x1C, nPoolSize);
+	put_le32(pFile + 0x20, (uint32_t)nSystem);
+
+	uint32_t nPoolPos = 1;
+	for(uint32_t i = 0; i < nCount; i++)
+	{
+		const char* szID = db.pPool + pIDs[i];
+		const char* szTitle = szID + strlen(szID) + 1;
+		uint8_t* entry = pFile + PSISO_TITLEDB_HEADER_SIZE + i * PSISO_TITLEDB_ENTRY_SIZE;
+
+		memcpy(entry, szID, strlen(szID));
+		put_le32(entry + 0x10, nPoolPos);
+		entry[0x1A] = psxTitleRegion(szID);
+
+		size_t nTitleLen = strlen(szTitle) + 1;
+		memcpy(pFile + nPoolOffset + nPoolPos, szTitle, nTitleLen);
+		nPoolPos += (uint32_t)nTitleLen;
+	}
+
+	SAFE_FREE(pIDs);
+	psxTitleDBFree(&db);
+
+	bool bWritten = false;
+#ifdef WIN
+	FILE* fp = fopen(szBinPath, "wb");
+	if(fp) {
+		bWritten = (fwrite(pFile, 1, nFileSize, fp) == nFileSize);
+		if(fclose(fp) != 0) bWritten = false;
+	}
+#else
+	int fd = _open(szBinPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd != -1) {
+		bWritten = (_write(fd, pFile, nFileSize) == (ssize_t)nFileSize);
+		if(_close(fd) != 0) bWritten = false;
+	}
+#endif
+	free(pFile);
+
+	return bWritten ? (int)nCount : -1;
+}
+
+// ------------------------------------------------------------------------------
+// Process-wide databases
+
+static psiso_titledb shared_db[2];
+static psx_once shared_once[2] = { PSX_ONCE_INIT, PSX_ONCE_INIT };
+
+static void full_db_path(const char* szDatabase, char* szOut, size_t nOutSize)
+{
+	memset(szOut, 0, nOutSize);
+
+#ifndef PSISOTOOL_PS3BUILD
+	char cCurrentPath[FILENAME_MAX];
+	if (!GetCurrentDir(cCurrentPath, sizeof(cCurrentPath))) {
+		// error...
+		return;
+	}
+	cCurrentPath[sizeof(cCurrentPath) - 1] = '\0';
+
+	snprintf(szOut, nOutSize - 1, "%s/%s", cCurrentPath, szDatabase);
+#else
+	strncpy(szOut, szDatabase, nOutSize - 1);
+#endif
+}
+
+static void shared_load(int nIndex, const char* szDatabase, const char* szBinDatabase)
+{
+	char szTextPath[FILENAME_MAX + 256];
+	char szBinPath[FILENAME_MAX + 256];
+	full_db_path(szDatabase, szTextPath, sizeof(szTextPath));
+	full_db_path(szBinDatabase, szBinPath, sizeof(szBinPath));
+
+	// binary database, unless the text one was edited after it was compiled
+	struct _stat stText;
+	struct _stat stBin;
+	bool bHasText = (_stat(szTextPath, &stText) == 0);
+	bool bHasBin = (_stat(szBinPath, &stBin) == 0);
+
+	if(bHasBin && (!bHasText || stBin.st_mtime >= stText.st_mtime)) {
+		if(psxTitleDBMap(&shared_db[nIndex], szBinPath)) {
+			return;
+		}
+	}
+	psxTitleDBLoad(&shared_db[nIndex], szTextPath);
+}
+
+static void shared_load_ps1() { shared_load(0, PS1_TITLE_DB, PS1_TITLE_DB_BIN); }
+static void shared_load_ps2() { shared_load(1, PS2_TITLE_DB, PS2_TITLE_DB_BIN); }
+
+const psiso_titledb* psxTitleDBShared(int nSystem)
+{
+	if(nSystem == ISO_SYSTEM_PS1) {
+		psxOnce(&shared_once[0], shared_load_ps1);
+		return &shared_db[0];
+	}
+	if(nSystem == ISO_SYSTEM_PS2) {
+		psxOnce(&shared_once[1], shared_load_ps2);
+		return &shared_db[1];
+	}
+	return NULL;
+}
@@ -0,0 +1,144 @@
+#ifndef PSISO_TITLEDB_H
+#define PSISO_TITLEDB_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// Title database module
+// ------------------------------------------------------------------------------------------------
+// Two formats are supported:
+//
+// - Text ("TITLEID Title" per line, "//" comments). Read in one go and indexed with an open
+//   addressing hash table keyed by the title ID. IDs and titles are interned in a single string
+//   pool (ID\0Title\0 ...) so a lookup touches one slot and one pool line.
+//
+// - Binary (.bin, built with psxTitleDBCompile()). Memory mapped and used as is, no parsing.
+//   All values are little-endian:
+//
+//		header		psiso_titledb_header (PSISO_TITLEDB_HEADER_SIZE bytes)
+//		entries		nEntries * nEntrySize bytes, sorted by ID (binary search)
+//		pool		nPoolSize bytes of '\0' terminated strings, offset 0 is always ""
+//
+//   Entry layout (PSISO_TITLEDB_ENTRY_SIZE bytes, newer versions may only append fields):
+//
+//		0x00	char[16]	Title ID, '\0' padded
+//		0x10	uint32		Title (pool offset)
+//		0x14	uint32		Publisher (pool offset, 0 = unknown)
+//		0x18	uint16		Year (0 = unknown)
+//		0x1A	uint8		Region (PSISO_REGION_*)
+//		0x1B	uint8		Reserved
+//		0x1C	uint32		Reserved
+
+#define PSISO_TITLEDB_MAGIC			"PSISODB"	// 8 bytes with the terminator
+#define PSISO_TITLEDB_VERSION		1
+#define PSISO_TITLEDB_HEADER_SIZE	0x40
+#define PSISO_TITLEDB_ENTRY_SIZE	0x20
+#define PSISO_TITLEDB_ID_LEN		16
+
+#define PSISO_REGION_UNKNOWN		0
+#define PSISO_REGION_NTSC_U			1	// SLUS / SCUS ...
+#define PSISO_REGION_PAL			2	// SLES / SCES ...
+#define PSISO_REGION_NTSC_J			3	// SLPS / SLPM / SCPS ...
+#define PSISO_REGION_ASIA			4	// SLAJ / SCAJ / SLKA ...
+
+struct psiso_titledb_header
+{
+	char		szMagic[8];			// PSISO_TITLEDB_MAGIC
+	uint32_t	nVersion;			// PSISO_TITLEDB_VERSION
+	uint32_t	nHeaderSize;		// offset of the entries
+	uint32_t	nEntries;
+	uint32_t	nEntrySize;			// PSISO_TITLEDB_ENTRY_SIZE or bigger
+	uint32_t	nPoolOffset;
+	uint32_t	nPoolSize;
+	uint32_t	nSystem;			// ISO_SYSTEM_*
+	uint32_t	reserved[7];
+};
+
+struct psiso_titledb_slot
+{
+	uint32_t	nHash;		// FNV-1a of the title ID
+	uint32_t	nEntry;		// pool offset of the title ID + 1 (0 = empty slot)
+};
+
+struct psiso_titledb
+{
+	// text database
+	char*				pPool;		// interned strings
+	uint32_t			nPoolLen;
+	psiso_titledb_slot*	pSlots;
+	uint32_t			nSlots;		// power of two
+	uint32_t			nEntries;
+
+	// binary database (mapped)
+	const uint8_t*		pMap;
+	uint64_t			nMapSize;
+	void*				hMap;		// mapping handle (WIN)
+	const uint8_t*		pBinEntries;
+	uint32_t			nBinEntries;
+	uint32_t			nBinEntrySize;
+	const char*			pBinPool;
+	uint32_t			nBinPoolSize;
+};
+
+struct psiso_title_info
+{
+	const char*	szTitle;
+	const char*	szPublisher;	// "" when unknown
+	uint16_t	nYear;			// 0 when unknown
+	uint8_t		nRegion;		// PSISO_REGION_*
+};
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	db				- Database to load
+(in)	szPath			- Path to the text database
+
+(out)	return			- Will return 1 for success and 0 for failure (db is left empty, lookups
+						  will not find anything). Release with psxTitleDBFree().
+
+When an ID is listed more than once, the first title wins (same as the old linear search).
+-------------------------------------------------------------------------------------------------
+*/
+int psxTitleDBLoad(psiso_titledb* db, const char* szPath);
+
+// Same as psxTitleDBLoad() for a binary database, the file is mapped (read only) until
+// psxTitleDBFree(). Fails if the file is not a valid binary database of a supported version.
+int psxTitleDBMap(psiso_titledb* db, const char* szPath);
+
+void psxTitleDBFree(psiso_titledb* db);
+
+// Title for an ID already in the database format (Ex. SLUS-01234 / SLUS01234), or NULL.
+const char* psxTitleDBFind(const psiso_titledb* db, const char* szTitleID);
+
+// Same as psxTitleDBFind() with all the fields, returns 1 if found and 0 if not.
+// Text databases only have the title, the other fields are taken from the ID prefix when possible.
+int psxTitleDBFindEx(const psiso_titledb* db, const char* szTitleID, psiso_title_info* info);
+
+// Region from the title ID prefix (Ex. SLUS -> PSISO_REGION_NTSC_U)
+uint8_t psxTitleRegion(const char* szTitleID);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	szTextPath		- Text database
+(in)	szBinPath		- Binary database to write
+(in)	nSystem			- ISO_SYSTEM_PS1 or ISO_SYSTEM_PS2 (stored in the header)
+
+(out)	return			- Number of entries written, or -1 on failure.
+-------------------------------------------------------------------------------------------------
+*/
+int psxTitleDBCompile(const char* szTextPath, const char* szBinPath, int nSystem);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	nSystem			- ISO_SYSTEM_PS1 or ISO_SYSTEM_PS2
+
+(out)	return			- Process-wide database for nSystem, loaded on first use from
+						  PS1_TITLE_DB_BIN / PS2_TITLE_DB_BIN when present and up to date, or
+						  from PS1_TITLE_DB / PS2_TITLE_DB (relative to the current directory, or
+						  the application directory on PS3 builds). Safe to call from several
+						  threads, it is never released. NULL for other systems.
+-------------------------------------------------------------------------------------------------
+*/
+const psiso_titledb* psxTitleDBShared(int nSystem);
+
+#endif
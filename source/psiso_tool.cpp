@@ -11,19 +11,20 @@
  - [PS1 / PS2] Get game Title ID from SYSTEM.CNF and obtain Title from a text database.
  - [PS3 / PSP] Get game Title and ID from the PARAM.SFO inside the ISO (no need for text database).
  - Titles gets automatically converted from UTF-8 to ASCII.
- - Provide a function to patch PS3 ISOs created with different applications than 
-   GenPS3iso (Ex. ImgBurn, PowerISO).
+ - Build a PS3 ISO from a game folder with the PS3 disc header written directly (psxMakeISO()).
+ - Provide a function to patch PS3 ISOs created with other applications (Ex. ImgBurn, PowerISO).
 
  When used as application:
 
- - Users can generate a ISO that will instantly be compatible with the PS3
- running on Cobra CFW v7.00 (mixed w/Rogero CFW 4.46 v1.00).
+ - Users can generate a ISO ("--mkps3iso") that will instantly be compatible with the PS3
+ running on Cobra CFW v7.00 (mixed w/Rogero CFW 4.46 v1.00). The disc header is written
+ while the ISO is built, no external tools (GenPS3iso, ImgBurn, PowerISO) are needed.
  
- - Users can quickly patch any specified PS3 ISO created with different application than 
-   GenPS3iso (Ex. ImgBurn, PowerISO).
+ - Users can quickly patch any specified PS3 ISO created with other applications 
+   (Ex. ImgBurn, PowerISO).
 
- Note: Patching will make the ISO valid for the PS3 system, if you try to mount 
- it without patching, the system will not detect it.
+ Note: Patching will make those ISOs valid for the PS3 system, if you try to mount 
+ them without patching, the system will not detect them.
 
  Additional Note: Only PS3 ISO need to be patched, so if you specify "--patch" with other
  kind of ISO nothing will be done to them. If you are curious and fool "PS ISO Tool" to 
@@ -73,82 +74,52 @@ available free space, at least until it gets implemented.
 ================================================================================
 */
 #include "psiso_tool.h"
+#include "psiso_iso9660.h"
+#include "psiso_titledb.h"
+#include "psiso_sfo.h"
+#include "psiso_cue.h"
+#include "psiso_cso.h"
 
 // ------------------------------------------------------------------------------
-char cCurrentPath[FILENAME_MAX];
 const char szISOSystem[][64] = {{"PS1"},{"PS2"},{"PS3"}, {"PSP"}};
 
-#define MAX_MSG_SZ      1024
-
-// info display control
+// info display control (used by the legacy API, the Ex API takes it from psiso_ctx)
 bool bPSISOTool_verbose = false;
-#define _verbose_printf if(bPSISOTool_verbose)printf
-
-// ------------------------------------------------------------------------------
 
-#ifndef WIN
- 
-bool isWhitespace(char c)
+void psxCtxInit(psiso_ctx* ctx)
 {
-    switch (c)
-    {
-        case '\r':
-        case '\n':
-        case ' ':
-        case '\0':
-            return true;
-        default:
-            return false;
-    }
+	memset(ctx, 0, sizeof(psiso_ctx));
+	ctx->bVerbose = bPSISOTool_verbose;
 }
 
-// Strip off whitespace characters from the end of the line
-void chomp(char *line)
+void psxLog(psiso_ctx* ctx, int nLevel, const char* szFormat, ...)
 {
-    int len = strlen(line);    
-	while (isWhitespace(line[len])) {
-        line[len--] = '\0';
-    }
-}
+	if(nLevel == PSISO_LOG_VERBOSE && !ctx->bVerbose) {
+		return;
+	}
 
-char * GetLine(int fds)
-{
-    char tline[MAX_MSG_SZ];
-    char *line;
-    
-    int messagesize = 0;
-    int amtread = 0;
-    
-	while((amtread = _read(fds, tline + messagesize, 1)) < MAX_MSG_SZ)
-    {
-        if (amtread > 0)
-            messagesize += amtread;
-        else
-        {
-            // error...
-			return NULL;
-        }
-        if (tline[messagesize - 1] == '\n')
-            break;
-    }
-    tline[messagesize] = '\0';
-    
-	chomp(tline);
-    
-	line = (char *)malloc((strlen(tline) + 1) * sizeof(char));
-    
-	strcpy(line, tline);
-    
-	return line;
+	char szMsg[2048];
+	va_list args;
+	va_start(args, szFormat);
+	vsnprintf(szMsg, sizeof(szMsg), szFormat, args);
+	va_end(args);
+	szMsg[sizeof(szMsg) - 1] = 0;
+
+	if(ctx->log) {
+		ctx->log(ctx->pLogUser, nLevel, szMsg);
+	} else {
+		fputs(szMsg, stdout);
+	}
 }
-#endif
 
-int GetTitle(char *_szTitleID, char* szDatabase, char* szTitle, int nSystem)
+// ------------------------------------------------------------------------------
+
+int GetTitle(psiso_ctx* ctx, const char *_szTitleID, char* szTitle, size_t nTitleSize, int nSystem)
 {
 	char szTitleID[32];
 	ZERO(szTitleID);
 
-	strcpy(szTitleID, _szTitleID);
+	strncpy(szTitleID, _szTitleID, sizeof(szTitleID) - 1);
 
 	if(nSystem == ISO_SYSTEM_PS1) 
 	{
@@ -210,91 +181,16 @@ int GetTitle(char *_szTitleID, char* szDatabase, char* szTitle, int nSystem)
 		}
 	}
 
-	_verbose_printf("Getting title for: %s\n", szTitleID);
-
-	bool bFoundTitle = false;
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Getting title for: %s\n", szTitleID);
 
-	char szFullDatabasePath[2048];
-	ZERO(szFullDatabasePath);
-
-#ifndef PSISOTOOL_PS3BUILD
-	if (!GetCurrentDir(cCurrentPath, sizeof(cCurrentPath))) {
-		// error...
+	const char* szDBTitle = psxTitleDBFind(psxTitleDBShared(nSystem), szTitleID);
+	if(!szDBTitle) {
 		return 0;
 	}
-	cCurrentPath[sizeof(cCurrentPath) - 1] = '\0';
-
-	sprintf(szFullDatabasePath, "%s/%s", cCurrentPath, szDatabase); 
-#else
-	strcpy(szFullDatabasePath, szDatabase);
-#endif
-
-#ifdef WIN
-	FILE *fp = NULL;
-	fp = fopen(szFullDatabasePath, "r");
-	if(fp)
-	{
-#else
-	int fd = _open(szFullDatabasePath, O_RDONLY);
-	if(fd != -1) 
-	{
-#endif
-		char *buffer = NULL;
-		buffer = (char*)malloc(MAX_MSG_SZ);
-		memset(buffer, 0, MAX_MSG_SZ);
-
-#ifdef WIN
-		while(fgets(buffer , MAX_MSG_SZ, fp))
-		{
-#else
-		while((buffer = GetLine(fd))) 
-		{
-#endif
-			char szLine[MAX_MSG_SZ];
-			ZERO(szLine);
-			strcpy(szLine, buffer);
-
-			if(strncmp(szLine, "//", 2)==0) continue;
-			if(strlen(szLine) < 11) continue;
-
-			char *p1 = strchr(szLine, ' ');
-			uint32_t nSpcPos = (uint32_t)(p1-szLine);
-				
-			char _szTitle[256];
-			ZERO(_szTitle);
-			strcpy(_szTitle, szLine + nSpcPos + 1);
-
-			if(_szTitle[strlen(_szTitle)-1] == '\n' || _szTitle[strlen(_szTitle)-1] == '\r') {
-				_szTitle[strlen(_szTitle)-1] = 0; // remove new line
-			}
-			szLine[p1-szLine] = 0;
-
-			char szFinalTitleID[32]; 
-			ZERO(szFinalTitleID)
-			strncpy(szFinalTitleID, szLine, strlen(szTitleID));
-
-			if(strcmp(szFinalTitleID, szTitleID) == 0 && strlen(szTitleID) == strlen(szFinalTitleID))
-			{
-				strncpy(szTitle, _szTitle, strlen(_szTitle));
-
-				SAFE_FREE(buffer);
-#ifdef WIN
-				SAFE_FCLOSE(fp);
-#else
-				SAFE_CLOSE(fd);
-#endif
-				bFoundTitle = true;
-				return 1;
-			}
-		}
-#ifdef WIN
-		SAFE_FCLOSE(fp);
-#else
-		SAFE_CLOSE(fd);
-#endif
-	}
 
-	return 0;
+	strncpy(szTitle, szDBTitle, nTitleSize - 1);
+	szTitle[nTitleSize - 1] = 0;
+	return 1;
 }
 
 // UTF-8 modules were Imported from Iris Manager (utils.c), thanks to Iris devs.
@@ -442,316 +338,96 @@ uint32_t data_to_u8(uint8_t* data)
 	return ret;
 }
 
-bool bSFOInfoDisplayed = false;
-
-// New function coded from scratch to properly parse PARAM.SFO
 #ifdef WIN
 uint64_t ParseSFO(FILE* fp, uint64_t nOffset, size_t nLen, char* szEntry, char* szOut)
 {
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	return ParseSFOEx(&ctx, fp, nOffset, nLen, szEntry, szOut, szOut ? PSISO_TITLE_SIZE : 0);
+}
 #else
 uint64_t ParseSFO(int fd, uint64_t nOffset, size_t nLen, char* szEntry, char* szOut)
 {
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	return ParseSFOEx(&ctx, fd, nOffset, nLen, szEntry, szOut, szOut ? PSISO_TITLE_SIZE : 0);
+}
 #endif
-	(void)nLen;
-	
-	if(!bSFOInfoDisplayed) 
-	{
-		_verbose_printf(SEP_LINE_2);
-		_verbose_printf( "Preparing to process PARAM.SFO \n");
-		_verbose_printf(SEP_LINE_2);
-	}
-
-#ifdef WIN
-	if(!fp) {
-#else
-	if(fd == -1) {
-#endif
-		_verbose_printf("Fatal error: File cannot be found / accessed. \n");
-		return 0;
-	}
-
-#ifdef WIN
-	fseek(fp, (long)nOffset, SEEK_SET);
-#else
-	_lseek64(fd, nOffset, SEEK_SET);
-#endif
-
-	struct sfo_header_data
-	{
-		char type;
-		uint8_t id[3];
-		uint8_t version[4];
-		uint8_t variable_table_offset[4];
-		uint8_t data_table_offset[4];
-		uint8_t total_variables[4];
-	};
-
-	sfo_header_data header_data;
-	memset(&header_data, 0, sizeof(sfo_header_data));
 
+// New function coded from scratch to properly parse PARAM.SFO
 #ifdef WIN
-	fread(&header_data, 1, sizeof(sfo_header_data), fp);
+uint64_t ParseSFOEx(psiso_ctx* ctx, FILE* fp, uint64_t nOffset, size_t nLen, const char* szEntry, char* szOut, size_t nOutSize)
+{
 #else
-	_read(fd, &header_data, sizeof(sfo_header_data));
+uint64_t ParseSFOEx(psiso_ctx* ctx, int fd, uint64_t nOffset, size_t nLen, const char* szEntry, char* szOut, size_t nOutSize)
+{
 #endif
-
-	struct sfo_header
-	{		
-		uint32_t nType;
-		char szId[4];
-		uint32_t nVersion;		
-		uint32_t nVarNameTableOffset;
-		uint32_t nDataTableOffset;		
-		uint32_t nTotalVariables;
-	};
-
-	sfo_header header;
-	memset(&header, 0, sizeof(sfo_header));
-	
-	// TYPE (always 0 ?)
-	header.nType = (uint32_t)strtol(&header_data.type, NULL, 16);
-	
-	// ID (should be PSF)
-	memcpy(header.szId, header_data.id, sizeof(header_data.id));
-
-	// VARIABLES TABLE OFFSET
-	swap16_data((uint8_t*)header_data.variable_table_offset);
-	header.nVarNameTableOffset = data_to_u16((uint8_t*)header_data.variable_table_offset);
-	
-	// DATA TABLE OFFSET
-	swap16_data((uint8_t*)header_data.data_table_offset);
-	header.nDataTableOffset = data_to_u16((uint8_t*)header_data.data_table_offset);
-
-	// TOTAL VARIABLES
-	swap16_data((uint8_t*)header_data.total_variables);
-	header.nTotalVariables = data_to_u16((uint8_t*)header_data.total_variables);
-
-	if(!bSFOInfoDisplayed) 
-	{
-		_verbose_printf("SFO Type: 0x%02X \n"					, header.nType);
-		_verbose_printf("SFO Identifier: %s \n"					, header.szId);
-		_verbose_printf("SFO Variable Name Table Offset: 0x%08X \n"	, (uint32_t)header.nVarNameTableOffset);
-		_verbose_printf("SFO Data Table Offset: 0x%08X \n"			, (uint32_t)header.nDataTableOffset);
-		_verbose_printf("SFO Total Variables: %d \n"					, header.nTotalVariables);
+	if(szOut && nOutSize) {
+		szOut[0] = 0;
 	}
 
-	struct sfo_vartbl_entry_data
-	{
-		uint8_t name_offset[2];
-		uint8_t type[2];
-		uint8_t data_size[4];
-		uint8_t data_block_size[4];
-		uint8_t data_offset[4];
-	};
-
-	struct sfo_vartbl_entry
-	{
-		uint32_t nNameOffset;
-		uint32_t nType;
-		uint32_t nDataSize;
-		uint32_t nDataBlockSize;
-		uint32_t nDataOffset;
-		
-		uint32_t nNumData;			// This will hold numeric values when needed		
-		char	 szName[32];		// Variable names should not surpass this...LOL
-		char	 szTxtData[1024];	// 1024 should be enough for any possible text data entry
-		
-	};
-
-	// Obtain variable table entries
-	size_t nVarTableDataLen = header.nTotalVariables * sizeof(sfo_vartbl_entry_data);
-	sfo_vartbl_entry_data* var_table_entries_data = NULL;
-	var_table_entries_data = (sfo_vartbl_entry_data*)malloc( nVarTableDataLen);
-	memset(var_table_entries_data, 0, nVarTableDataLen);
-
-	uint32_t nVarTableOffset = 0x14;
+	uint8_t* pBuf = (uint8_t*)malloc(PSISO_SFO_MAX_SIZE);
+	if(!pBuf) return 0;
 
+	psiso_sfo sfo;
 #ifdef WIN
-	fseek(fp, (long)(nOffset + nVarTableOffset), SEEK_SET);
-	fread(var_table_entries_data, 1, nVarTableDataLen, fp);
+	int ret = psxSFORead(&sfo, fp, nOffset, nLen, pBuf, PSISO_SFO_MAX_SIZE);
 #else
-	_lseek64(fd, nOffset + nVarTableOffset, SEEK_SET);
-	_read(fd, var_table_entries_data, nVarTableDataLen);
+	int ret = psxSFORead(&sfo, fd, nOffset, nLen, pBuf, PSISO_SFO_MAX_SIZE);
 #endif
-
-	size_t nVarTableLen = header.nTotalVariables * sizeof(sfo_vartbl_entry);	
-	sfo_vartbl_entry* var_table_entries = NULL;
-	var_table_entries = (sfo_vartbl_entry*)malloc( nVarTableLen );
-	memset(var_table_entries, 0, nVarTableLen);
-
-	if(!bSFOInfoDisplayed) 
-	{
-		_verbose_printf(SEP_LINE_2);
-		_verbose_printf( "SFO Variable Table Entries: \n");
-		_verbose_printf(SEP_LINE_2);
+	if(!ret) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Error: PARAM.SFO cannot be accessed or is not valid. \n");
+		free(pBuf);
+		return 0;
 	}
 
-	uint32_t i;
-	for(i = 0; i < header.nTotalVariables; i++) 
-	{		
-		// NAME OFFSET
-		swap8_data((uint8_t*)var_table_entries_data[i].name_offset);
-		var_table_entries[i].nNameOffset = data_to_u8((uint8_t*)var_table_entries_data[i].name_offset);
-
-		// TYPE
-		swap8_data((uint8_t*)var_table_entries_data[i].type);
-		var_table_entries[i].nType = data_to_u8((uint8_t*)var_table_entries_data[i].type);
-		
-		// DATA SIZE
-		swap16_data((uint8_t*)var_table_entries_data[i].data_size);
-		var_table_entries[i].nDataSize = data_to_u16((uint8_t*)var_table_entries_data[i].data_size);
-
-		// DATA BLOCK SIZE
-		swap16_data((uint8_t*)var_table_entries_data[i].data_block_size);
-		var_table_entries[i].nDataBlockSize = data_to_u16((uint8_t*)var_table_entries_data[i].data_block_size);
-
-		// DATA OFFSET
-		swap16_data((uint8_t*)var_table_entries_data[i].data_offset);
-		var_table_entries[i].nDataOffset = data_to_u16((uint8_t*)var_table_entries_data[i].data_offset);
-
-		// ====
+	uint64_t nValue = psxSFOLookup(ctx, &sfo, szEntry, szOut, nOutSize);
+	free(pBuf);
+	return nValue;
+}
 
-		memset(var_table_entries[i].szName, 0, 32);
-		memset(var_table_entries[i].szTxtData, 0, 1024);
-		*&var_table_entries[i].nNumData = 0;
+void psxPS3DiscHeader(const char* szTitleID, uint32_t nVolumeSectors, uint8_t* pHeader)
+{
+	memset(pHeader, 0, 0x1000);
 
-#ifdef WIN
-		fseek(fp, (long)(nOffset + header.nVarNameTableOffset + var_table_entries[i].nNameOffset), SEEK_SET);
-		fread(var_table_entries[i].szName, 1, 32, fp);
-#else
-		_lseek64(fd, nOffset + header.nVarNameTableOffset + var_table_entries[i].nNameOffset, SEEK_SET);
-		_read(fd, var_table_entries[i].szName, 32);
-#endif
-		// CHECK FOR NUMERIC or TEXT DATA
-		if(var_table_entries[i].nType == 0x0204)
-		{
-			// text
-#ifdef WIN
-			fseek(fp, (long)(nOffset + header.nDataTableOffset + var_table_entries[i].nDataOffset), SEEK_SET);
-			fread(var_table_entries[i].szTxtData, 1, var_table_entries[i].nDataSize, fp);
-#else
-			_lseek64(fd, nOffset + header.nDataTableOffset + var_table_entries[i].nDataOffset, SEEK_SET);
-			_read(fd, var_table_entries[i].szTxtData, var_table_entries[i].nDataSize);
-#endif
-			if(!bSFOInfoDisplayed) 
-			{
-				_verbose_printf(" >> %s: %s \n", var_table_entries[i].szName, var_table_entries[i].szTxtData);
-			}
-		} else if(var_table_entries[i].nType == 0x0404) {
-			
-			// numeric
-			if(var_table_entries[i].nDataBlockSize == 0x04)
-			{
-				uint8_t temp[4];
-				memset(&temp, 0, 4);
-#ifdef WIN
-				fseek(fp, (long)(nOffset + header.nDataTableOffset + var_table_entries[i].nDataOffset), SEEK_SET);
-				fread(temp, 1, 4, fp);
-#else
-				_lseek64(fd, nOffset + header.nDataTableOffset + var_table_entries[i].nDataOffset, SEEK_SET);
-				_read(fd, temp, 4);
-#endif								
-				swap16_data((uint8_t*)temp);
-				var_table_entries[i].nNumData = data_to_u16((uint8_t*)temp);
-				
-				if(!bSFOInfoDisplayed) 
-				{
-					_verbose_printf(" >> %s: 0x%04X \n", var_table_entries[i].szName, var_table_entries[i].nNumData);
-				}
-			} 
-			else if(var_table_entries[i].nDataBlockSize == 0x02) 
-			{
-				uint8_t temp[2];
-				memset(&temp, 0, 2);
-#ifdef WIN
-				fseek(fp, (long)(nOffset + header.nDataTableOffset + var_table_entries[i].nDataOffset), SEEK_SET);
-				fread(temp, 1, 2, fp);
-#else
-				_lseek64(fd, nOffset + header.nDataTableOffset + var_table_entries[i].nDataOffset, SEEK_SET);
-				_read(fd, temp, 2);
-#endif								
-				swap8_data((uint8_t*)temp);
-				var_table_entries[i].nNumData = data_to_u8((uint8_t*)temp);
-
-				if(!bSFOInfoDisplayed) 
-				{
-					_verbose_printf(" >> %s: 0x%02X \n", var_table_entries[i].szName, var_table_entries[i].nNumData);
-				}
-			}
-		}
-	}
+	uint8_t _ps3_hdr_p1[32] = {
+		0x00, 0x00, 0x00, 0x02,								// unknown (always 0x02)
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+		(uint8_t)(nVolumeSectors >> 24), (uint8_t)(nVolumeSectors >> 16),
+		(uint8_t)(nVolumeSectors >> 8), (uint8_t)nVolumeSectors,	// total volume sectors (TOT_BYTES = TOT_VOL_SEC * 0x800)
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
 	
-	if(!bSFOInfoDisplayed) 
+	uint8_t _ps3_hdr_p2[64] = 
 	{
-		_verbose_printf(SEP_LINE_2);
-	}
-
-	// If a variable name entry is specified then look for it...
-	if(szEntry != NULL) 
-	{		
-		_verbose_printf("Searching variable data for [ %s ] \n", szEntry);
-
-		for(i = 0; i < header.nTotalVariables; i++) 
-		{	
-			// CHECK FOR NUMERIC or TEXT DATA
-			if(var_table_entries[i].nType == 0x0204)
-			{
-				// text
-				if(memcmp(szEntry, var_table_entries[i].szName, strlen(szEntry))==0)
-				{
-					_verbose_printf("Found variable data for [ %s ]... [ %s ]\n", szEntry, var_table_entries[i].szTxtData);
-					strcpy(szOut, var_table_entries[i].szTxtData);
-					SAFE_FREE(var_table_entries);
-					SAFE_FREE(var_table_entries_data);
-#ifdef WIN
-					fseek(fp, (long)nOffset, SEEK_SET);
-#else
-					_lseek64(fd, nOffset, SEEK_SET);
-#endif
-					bSFOInfoDisplayed = true;
-					return 0;
-				}
+		// PlayStation3
+		0x50, 0x6C, 0x61, 0x79, 0x53, 0x74, 0x61, 0x74, 0x69, 0x6F, 0x6E, 0x33,
+		// zeros
+		0x00, 0x00, 0x00, 0x00,
+		// title id (Ex. BLUS-00000)
+		(uint8_t)szTitleID[0], (uint8_t)szTitleID[1], (uint8_t)szTitleID[2], (uint8_t)szTitleID[3], (uint8_t)'-', (uint8_t)szTitleID[4], (uint8_t)szTitleID[5], (uint8_t)szTitleID[6], (uint8_t)szTitleID[7], (uint8_t)szTitleID[8],
+		// blank spaces
+		0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+		0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+		0x20, 0x20,
+		// zeros
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00
+	};
 
-			} else if(var_table_entries[i].nType == 0x0404) {
-			
-				// numeric
-				if(strcmp(szEntry, var_table_entries[i].szName)==0)
-				{
-					if(var_table_entries[i].nDataBlockSize == 0x04) {
-						_verbose_printf("Found variable data for [ %s ]... [ 0x%04X ] \n", szEntry, var_table_entries[i].nNumData);
-					} else if(var_table_entries[i].nDataBlockSize == 0x02) 
-					{
-						_verbose_printf("Found variable data for [ %s]... [ 0x%02X ] \n", szEntry, var_table_entries[i].nNumData);
-					}
-
-					uint64_t ret = var_table_entries[i].nNumData;
-					
-					SAFE_FREE(var_table_entries);
-					SAFE_FREE(var_table_entries_data);
-#ifdef WIN
-					fseek(fp, (long)nOffset, SEEK_SET);
-#else
-					_lseek64(fd, nOffset, SEEK_SET);
-#endif
-					bSFOInfoDisplayed = true;
-					return ret;
-				}
-			}	
-		}
-		_verbose_printf("Error: Variable data \"%s\" not found on SFO. \n", szEntry);
-	}
-	bSFOInfoDisplayed = true;
-	return 0;
+	memcpy(pHeader, _ps3_hdr_p1, sizeof(_ps3_hdr_p1));
+	memcpy(pHeader + 0x800, _ps3_hdr_p2, sizeof(_ps3_hdr_p2));
 }
 
 #ifdef WIN
-int PatchPS3ISO(FILE* fp, char* szTitleID, uint8_t* vol_size)
+int PatchPS3ISO(psiso_ctx* ctx, FILE* fp, const char* szTitleID, const uint8_t* vol_size)
 {
-	_verbose_printf("Preparing to patch PS3 ISO (%s)... \n", szTitleID);
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Preparing to patch PS3 ISO (%s)... \n", szTitleID);
 
 	if(!fp) return 0; // wth?... xD
 #else
-int PatchPS3ISO(int fd, char* szTitleID, uint8_t* vol_size)
+int PatchPS3ISO(psiso_ctx* ctx, int fd, const char* szTitleID, const uint8_t* vol_size)
 {
 	if(fd == -1) return 0; // wth?... xD
 #endif
@@ -778,633 +454,493 @@ int PatchPS3ISO(int fd, char* szTitleID, uint8_t* vol_size)
 	if(memcmp(_ps3_disc_id, ps3_disc_id, 0xC)==0)
 	{
 		// patched
-		printf("PS3 ISO has proper disc header. No patching will be done. \n");
+		psxLog(ctx, PSISO_LOG_INFO, "PS3 ISO has proper disc header. No patching will be done. \n");
 		return 1;
 	} else {
-		printf("PS3 ISO does not have a valid disc header, it will be patched now... \n");
+		psxLog(ctx, PSISO_LOG_INFO, "PS3 ISO does not have a valid disc header, it will be patched now... \n");
 	}
 
-	uint8_t _ps3_hdr_p1[32] = {
-		0x00, 0x00, 0x00, 0x02,								// unknown (always 0x02)
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-		vol_size[0], vol_size[1], vol_size[2], vol_size[3],	// total volume sectors (TOT_BYTES = TOT_VOL_SEC * 0x800)
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-	};
-	
-	uint8_t _ps3_hdr_p2[64] = 
-	{
-		// PlayStation3
-		0x50, 0x6C, 0x61, 0x79, 0x53, 0x74, 0x61, 0x74, 0x69, 0x6F, 0x6E, 0x33,
-		// zeros
-		0x00, 0x00, 0x00, 0x00,
-		// title id (Ex. BLUS-00000)
-		(uint8_t)szTitleID[0], (uint8_t)szTitleID[1], (uint8_t)szTitleID[2], (uint8_t)szTitleID[3], (uint8_t)'-', (uint8_t)szTitleID[4], (uint8_t)szTitleID[5], (uint8_t)szTitleID[6], (uint8_t)szTitleID[7], (uint8_t)szTitleID[8],
-		// blank spaces
-		0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-		0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
-		0x20, 0x20,
-		// zeros
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00
-	};
+	uint8_t* hdr = (uint8_t*)malloc(0x1000);
+	if(!hdr) return 0;
+	psxPS3DiscHeader(szTitleID, psx_be32(vol_size), hdr);
 
+	// only the used part of each sector is written, the rest of the image is left as is
 #ifdef WIN
 	fseek(fp, 0, SEEK_SET);
-	fwrite(_ps3_hdr_p1, 1, sizeof(_ps3_hdr_p1), fp);
+	fwrite(hdr, 1, 0x20, fp);
 
 	fseek(fp, 0x800, SEEK_SET);
-	fwrite(_ps3_hdr_p2, 1, sizeof(_ps3_hdr_p2), fp);
+	fwrite(hdr + 0x800, 1, 0x40, fp);
 #else
 	_lseek64(fd, 0, SEEK_SET);
-	_write(fd, _ps3_hdr_p1, sizeof(_ps3_hdr_p1));
+	_write(fd, hdr, 0x20);
 
 	_lseek64(fd, 0x800, SEEK_SET);
-	_write(fd, _ps3_hdr_p2, sizeof(_ps3_hdr_p2)); 
+	_write(fd, hdr + 0x800, 0x40); 
 #endif
+	free(hdr);
 	
-	printf("PS3 ISO patching done! \n");
+	psxLog(ctx, PSISO_LOG_INFO, "PS3 ISO patching done! \n");
 
 	return 1;
 }
 
-int psxProcessISO(char *szISO, int nSystem, char* szTitleID, char* szTitle, bool bPatchPS3ISO)
+int psxPatchPS3ISOFile(psiso_ctx* ctx, const char* szISO, const char* szTitleID, const uint8_t* vol_size)
 {
-	// always display file name
-	printf("ISO file: %s \n", szISO);
-
+	int ret = 0;
 #ifdef WIN
-	FILE* fp = NULL;
-	fp = fopen(szISO, "r+b");
-	if(fp) 
-	{
+	FILE* fp = fopen(szISO, "r+b");
+	if(fp) {
+		ret = PatchPS3ISO(ctx, fp, szTitleID, vol_size);
+		SAFE_FCLOSE(fp);
+	}
 #else
 	int fd = _open(szISO, O_RDWR);
-	if(fd != -1) 
-	{
-#endif	
-		uint64_t nSectorSize	= 0x800;
-		uint64_t nSectorHeader	= 0;
-		uint64_t nOffset		= ((nSectorSize * 16) + nSectorHeader);
-
-		// CD001
-		uint64_t nStdIDOffset = 1;
-#ifdef WIN
-		fseek(fp, (long)(nOffset + nStdIDOffset), SEEK_SET);
-#else
-		_lseek64(fd, nOffset + nStdIDOffset, SEEK_SET);
+	if(fd != -1) {
+		ret = PatchPS3ISO(ctx, fd, szTitleID, vol_size);
+		_close(fd);
+	}
 #endif
-		unsigned char* std_id = NULL;
-		std_id = (unsigned char*)malloc(5);
-		memset(std_id, 0, 5);
+	if(!ret) {
+		psxLog(ctx, PSISO_LOG_INFO, "Error: PS3 ISO cannot be opened for writing, it was not patched. \n");
+	}
+	return ret;
+}
 
-#ifdef WIN
-		fread(std_id, 1, 5, fp);
-#else
-		_read(fd, std_id, 5);
-#endif
-		unsigned char _std_id[5] = {'C','D','0','0','1'};
+int psxProcessISO(char *szISO, int nSystem, char* szTitleID, char* szTitle, bool bPatchPS3ISO)
+{
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
 
-		bool bSupportedISO = false;
+	// always display file name
+	psxLog(&ctx, PSISO_LOG_INFO, "ISO file: %s \n", szISO);
 
-		int nMode = 0;
+	psiso_result res;
+	int ret = psxProcessISOEx(&ctx, szISO, nSystem, bPatchPS3ISO, &res);
 
-		if(memcmp(std_id, _std_id, 5) == 0) 
-		{
-			_verbose_printf("Supported %s ISO (ISO9660/MODE1/2048) \n", szISOSystem[nSystem]);
-			bSupportedISO = true;
-			nMode = 1;
-		} else {
-		
-			if(nSystem != ISO_SYSTEM_PS3)
-			{
-				// Try 0x930 sector size
-				nSectorSize = 0x930;
-				nSectorHeader = 0x18;
-				nOffset = ((nSectorSize * 16) + nSectorHeader);
-#ifdef WIN
-				fseek(fp, (long)(nOffset + nStdIDOffset), SEEK_SET);
-				fread(std_id, 1, 5, fp);
-#else
-				_lseek64(fd, nOffset + nStdIDOffset, SEEK_SET);
-				_read(fd, std_id, 5);
-#endif
-				if(memcmp(std_id, _std_id, 5) == 0) {
-					_verbose_printf("Supported %s ISO (ISO9660/MODE2/FORM1/2352) \n", szISOSystem[nSystem]);
-					bSupportedISO = true;
-					nMode = 2;
-				}
-			}
+	strcpy(szTitleID, res.szTitleID);
+	strcpy(szTitle, res.szTitle);
+	return ret;
+}
+
+// Root directory entries used to tell the systems apart, filled with one walk of the root
+struct iso_probe
+{
+	bool			bPS3Header;		// "PlayStation3" disc header at 0x800
+	bool			bSystemCnf;
+	bool			bPS3Game;
+	bool			bPSPGame;
+	bool			bUMDData;
+	psiso_dirent	system_cnf;
+	psiso_dirent	ps3_game;
+	psiso_dirent	psp_game;
+};
+
+static void probe_root(psiso_reader* r, const psiso_dirent* root, iso_probe* probe)
+{
+	psiso_dir it;
+	if(!psxDirOpen(r, root, &it)) {
+		return;
+	}
+
+	psiso_dirent ent;
+	while(psxDirNext(&it, &ent))
+	{
+		bool bDir = (ent.nFlags & ISO_DR_FLAG_DIRECTORY) != 0;
+
+		if(!bDir && !probe->bSystemCnf && psxNameEqual(ent.szName, "SYSTEM.CNF")) {
+			probe->bSystemCnf = true;
+			probe->system_cnf = ent;
 		}
-		
-		if(!bSupportedISO) {
-			_verbose_printf("Error: The %s disc image is not supported / valid \n", szISOSystem[nSystem]);
-			SAFE_FREE(std_id);
-			return -1;
+		if(bDir && !probe->bPS3Game && psxNameEqual(ent.szName, "PS3_GAME")) {
+			probe->bPS3Game = true;
+			probe->ps3_game = ent;
 		}
+		if(bDir && !probe->bPSPGame && psxNameEqual(ent.szName, "PSP_GAME")) {
+			probe->bPSPGame = true;
+			probe->psp_game = ent;
+		}
+		if(!bDir && psxNameEqual(ent.szName, "UMD_DATA.BIN")) {
+			probe->bUMDData = true;
+		}
+	}
+	psxDirClose(&it);
+}
 
-		// VOLUME SIZE
-		uint64_t nVolSize = 0;
-		uint64_t nVolSizeOffset = nOffset + 0x50 + 4; // BE
+// Boot line of SYSTEM.CNF, "BOOT2 = cdrom0:\SLUS_200.62;1" (PS2) or "BOOT = cdrom:\SCUS_941.63;1" (PS1).
+// Returns the system (ISO_SYSTEM_AUTO if unknown) and the offset of the executable name.
+static int parse_system_cnf(const char* szCnf, size_t nLen, size_t* pnNameOffset)
+{
+	char szLower[PSISO_SECTOR_SIZE + 1];
+	ZERO(szLower);
+	for(size_t i = 0; i < nLen && i < PSISO_SECTOR_SIZE; i++) {
+		char c = szCnf[i];
+		szLower[i] = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : (c ? c : ' ');
+	}
 
-#ifdef WIN
-		fseek(fp, (long)nVolSizeOffset, SEEK_SET);
-#else
-		_lseek64(fd, nVolSizeOffset, SEEK_SET);
-#endif
+	int nSystem = ISO_SYSTEM_AUTO;
+	const char* p = strstr(szLower, "cdrom0:");
+	if(p) {
+		nSystem = ISO_SYSTEM_PS2;
+		p += strlen("cdrom0:");
+	} else {
+		p = strstr(szLower, "cdrom:");
+		if(p) {
+			nSystem = ISO_SYSTEM_PS1;
+			p += strlen("cdrom:");
+		}
+	}
+	if(!p) {
+		// no device name, the key is enough to tell them apart
+		if(strstr(szLower, "boot2")) return ISO_SYSTEM_PS2;
+		if(strstr(szLower, "boot")) return ISO_SYSTEM_PS1;
+		return ISO_SYSTEM_AUTO;
+	}
 
-		uint8_t* vol_size = NULL;
-		vol_size = (uint8_t*)malloc(4);
-		memset(vol_size, 0, 4);
+	while(*p == '\\' || *p == '/') p++;
+	*pnNameOffset = (size_t)(p - szLower);
+	return nSystem;
+}
 
-#ifdef WIN
-		fread(vol_size, 1, 4, fp);
-#else
-		_read(fd, vol_size, 4);
-#endif
+int psxProcessISOEx(psiso_ctx* ctx, const char *szISO, int nSystem, bool bPatchPS3ISO, psiso_result* res)
+{
+	memset(res, 0, sizeof(psiso_result));
+	res->nSystem = nSystem;
 
-		char szVolSize[32]; // BE
-		ZERO(szVolSize);
-		sprintf(szVolSize, "%02X%02X%02X%02X", vol_size[0], vol_size[1], vol_size[2], vol_size[3]);
+	char* szTitleID	= res->szTitleID;
+	char* szTitle	= res->szTitle;
 
-#ifdef WIN
-		nVolSize = strtoul(szVolSize, NULL, 16);
-#else
-		nVolSize = strtoull(szVolSize, NULL, 16);
-#endif
-		uint64_t nTotalVolSize = (nVolSize * 0x800);
-		_verbose_printf("Volume Size: (0x%s sectors) (%lu bytes)\n", szVolSize, (unsigned long)nTotalVolSize);
+	const char* szSystem = (nSystem == ISO_SYSTEM_AUTO) ? "disc" : szISOSystem[nSystem];
 
-		// ROOT DR
-		uint64_t nRootDRLocOffset = 0x9E;
-#ifdef WIN
-		fseek(fp, (long)(nOffset + nRootDRLocOffset), SEEK_SET);
-#else
-		_lseek64(fd, nOffset + nRootDRLocOffset, SEEK_SET);
-#endif		
-		unsigned char *root_dr_sector = NULL;
-		root_dr_sector = (unsigned char*)malloc(8);
-		memset(root_dr_sector, 0, 8);		
-#ifdef WIN
-		fread(root_dr_sector, 1, 8, fp);
-#else		
-		_read(fd, root_dr_sector, 8);
-#endif
-		char szRootDROffset[64]; // BE
-		ZERO(szRootDROffset);
-		sprintf(szRootDROffset, "%02X%02X%02X%02X", root_dr_sector[4], root_dr_sector[5], root_dr_sector[6], root_dr_sector[7]);
+	// every image gets its own PARAM.SFO dump
+	ctx->bSFOInfoDisplayed = false;
+	ctx->nSFOLen = 0;
 
-		uint64_t nRootDROffset = 0;
-#ifdef WIN
-		nRootDROffset = strtoul(szRootDROffset, NULL, 16);
-#else
-		nRootDROffset = strtoull(szRootDROffset, NULL, 16);
-#endif
-		nRootDROffset = nRootDROffset * nSectorSize;
+	psiso_reader reader;
 
-		_verbose_printf("Root Directory Record Offset: 0x%08X \n", (uint32_t)nRootDROffset);
-		
-#ifdef WIN
-		fseek(fp, (long)nRootDROffset, SEEK_SET);
-#else
-		_lseek64(fd, nRootDROffset, SEEK_SET);
-#endif
-		// ======================================================
-		// FIND SYSTEM.CNF (used for both PS1 and PS2 ISO)
-		// ======================================================
+	// CUE sheets are probed on their first data track only, framing comes from the sheet
+	bool bCUE = psxCUEIsSheet(szISO);
+	int nCUETrackType = PSISO_TRACK_AUDIO;
 
-		if(nSystem == ISO_SYSTEM_PS1 || nSystem == ISO_SYSTEM_PS2)
-		{
-			// ...
+	if(bCUE)
+	{
+		if(nSystem == ISO_SYSTEM_PS3 || nSystem == ISO_SYSTEM_PSP) {
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: %s discs are not stored as CUE / BIN \n", szSystem);
+			return -1;
+		}
 
-			unsigned char _SYSTEM_CNF[]	= { 'S','Y','S','T','E','M','.','C','N','F' };		
-			unsigned char *SYSTEM_CNF	= NULL;
-			size_t nLen = sizeof(_SYSTEM_CNF);
-			SYSTEM_CNF = (unsigned char*)malloc(nLen);
+		psiso_cue cue;
+		if(!psxCUELoad(ctx, &cue, szISO)) {
+			return 0;
+		}
+		int nTrack = psxCUEDataTrack(&cue);
+		if(nTrack < 0 || !psxCUEOpenTrack(&cue, (uint32_t)nTrack, &reader)) {
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: No readable data track on \"%s\" \n", szISO);
+			psxCUEFree(&cue);
+			return 0;
+		}
+		psxLog(ctx, PSISO_LOG_VERBOSE, "CUE sheet: %u tracks, data track %02u (%s) on \"%s\" \n", cue.nTracks,
+			cue.tracks[nTrack].nNumber, psxCUETrackType(cue.tracks[nTrack].nType), cue.pFiles[cue.tracks[nTrack].nFile].szPath);
+		nCUETrackType = cue.tracks[nTrack].nType;
+		psxCUEFree(&cue);
+	}
+	// inspection is read only (mapped when possible), patching opens its own write handle
+	else if(!psxReaderOpenEx(&reader, szISO, 0, (uint64_t)-1, !ctx->bNoMap)) {
+		return 0; // error: file not found
+	}
 
-			bool bFoundTitleIDFile = false;		
-			uint64_t nPos = 0;
+	if(reader.cso) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Compressed image (%s v%u, %u byte blocks, %llu bytes uncompressed) \n",
+			reader.cso->nFormat == PSISO_CSO_FORMAT_ZSO ? "ZSO" : "CSO", reader.cso->nVersion, reader.cso->nBlockSize,
+			(unsigned long long)reader.cso->nTotalBytes);
+	}
 
-			while(nPos < nSectorSize) 
-			{
-				memset(SYSTEM_CNF, 0, nLen);
-#ifdef WIN
-				fread(SYSTEM_CNF, 1, nLen, fp);
-#else
-				_read(fd, SYSTEM_CNF, nLen);
-#endif
-				if(memcmp(SYSTEM_CNF, _SYSTEM_CNF, nLen) == 0)
-				{
-					_verbose_printf("SYSTEM.CNF file record found at pos: 0x%03X \n", (uint32_t)nPos);
-					bFoundTitleIDFile = true;
-					break;
-				}
-				nPos++;
-#ifdef WIN
-				fseek(fp, (long)(nRootDROffset + nPos), SEEK_SET);
-#else
-				_lseek64(fd, nRootDROffset + nPos, SEEK_SET);
-#endif
+	// CD001
+	uint64_t nStdIDOffset = 1;
+	unsigned char _std_id[5] = {'C','D','0','0','1'};
+
+	bool bSupportedISO = false;
+
+	const uint8_t* pvd_sector = psxReaderSector(&reader, ISO_PVD_SECTOR);
+
+	if(bCUE)
+	{
+		if(pvd_sector && memcmp(pvd_sector + nStdIDOffset, _std_id, 5) == 0) {
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Supported %s CUE / BIN (ISO9660/%s) \n", szSystem, psxCUETrackType(nCUETrackType));
+			bSupportedISO = true;
+		}
+	}
+	else if(pvd_sector && memcmp(pvd_sector + nStdIDOffset, _std_id, 5) == 0) 
+	{
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Supported %s ISO (ISO9660/MODE1/2048) \n", szSystem);
+		bSupportedISO = true;
+	} else {
+	
+		// PS3 / PSP discs are always 2048
+		if(nSystem != ISO_SYSTEM_PS3 && nSystem != ISO_SYSTEM_PSP)
+		{
+			// Try 0x930 sector size
+			psxReaderSetMode(&reader, PSISO_RAW_SECTOR_SIZE, PSISO_RAW_SECTOR_HEADER);
+			pvd_sector = psxReaderSector(&reader, ISO_PVD_SECTOR);
+
+			if(pvd_sector && memcmp(pvd_sector + nStdIDOffset, _std_id, 5) == 0) {
+				psxLog(ctx, PSISO_LOG_VERBOSE, "Supported %s ISO (ISO9660/MODE2/FORM1/2352) \n", szSystem);
+				bSupportedISO = true;
 			}
+		}
+	}
+	
+	if(!bSupportedISO) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Error: The %s disc image is not supported / valid \n", szSystem);
+		psxReaderClose(&reader);
+		return -1;
+	}
 
-			if(!bFoundTitleIDFile) 
-			{
-				// Corrupted ISO, this should be present...
-				_verbose_printf("Error: Couldn't find SYSTEM.CNF entry on the specified sector.\n");		
-				SAFE_FREE(root_dr_sector);
-				SAFE_FREE(SYSTEM_CNF);
-#ifdef WIN
-				SAFE_FCLOSE(fp);
-#else
-				SAFE_CLOSE(fd);
-#endif
-			} else {
-				// SYSTEM.CNF Extent Location (Data location)
-				uint64_t nDataOffset = (nRootDROffset + nPos) - 0x1F;
+	res->nSectorSize = reader.nSectorSize;
+
+	// keep our own copy, the cached block can be recycled by the next reads
+	uint8_t pvd[PSISO_SECTOR_SIZE];
+	memcpy(pvd, pvd_sector, PSISO_SECTOR_SIZE);
+
+	// VOLUME SIZE
+	uint8_t* vol_size = pvd + 0x50 + 4; // BE
+	uint64_t nVolSize = psx_be32(vol_size);
+	uint64_t nTotalVolSize = (nVolSize * 0x800);
+	res->nVolumeSectors = (uint32_t)nVolSize;
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Volume Size: (0x%08X sectors) (%lu bytes)\n", (uint32_t)nVolSize, (unsigned long)nTotalVolSize);
+
+	// ROOT DR
+	psiso_dirent root;
+	if(psxParseDirRecord(pvd + ISO_PVD_ROOT_DR_OFFSET, ISO_DR_MIN_LEN + 1, &root) <= 0) {
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Error: The %s disc image has an invalid root directory record \n", szSystem);
+		psxReaderClose(&reader);
+		return -1;
+	}
+	uint64_t nRootDROffset = (uint64_t)root.nExtent * reader.nSectorSize;
 
-				unsigned char *extent_loc = NULL;
-				extent_loc = (unsigned char*)malloc(8);
-				memset(extent_loc, 0, 8);
-#ifdef WIN
-				fseek(fp, (long)nDataOffset, SEEK_SET);
-				fread(extent_loc, 1, 8, fp);
-#else
-				_lseek64(fd, nDataOffset, SEEK_SET);
-				_read(fd, extent_loc, 8);
-#endif
-				char szExtentOffset[64]; // BE
-				ZERO(szExtentOffset);
-				sprintf(szExtentOffset, "%02X%02X%02X%02X", extent_loc[4], extent_loc[5], extent_loc[6], extent_loc[7]);
+	psxLog(ctx, PSISO_LOG_VERBOSE, "Root Directory Record Offset: 0x%08X \n", (uint32_t)nRootDROffset);
 
-				uint64_t nExtentOffset = 0;
-#ifdef WIN
-				nExtentOffset = strtoul(szExtentOffset, NULL, 16);
-#else
-				nExtentOffset = strtoull(szExtentOffset, NULL, 16);
-#endif
-				nExtentOffset = nExtentOffset * nSectorSize;
-				_verbose_printf("SYSTEM.CNF Extent (data) Offset: 0x%08X \n", (uint32_t)nExtentOffset);
+	// ======================================================
+	// PROBE (disc header + one walk of the root directory)
+	// ======================================================
 
-				// Data length(size)
-				uint64_t nDataLenOffset = (nRootDROffset + nPos) - 0x17;
+	iso_probe probe;
+	memset(&probe, 0, sizeof(iso_probe));
 
-				unsigned char *data_len = NULL;
-				data_len = (unsigned char*)malloc(8);
-				memset(data_len, 0, 8);
-#ifdef WIN
-				fseek(fp, (long)nDataLenOffset, SEEK_SET);
-				fread(data_len, 1, 8, fp);
-#else
-				_lseek64(fd, nDataLenOffset, SEEK_SET);
-				_read(fd, data_len, 8);
-#endif
-				char szDataLen[64]; // BE
-				ZERO(szDataLen);
-				sprintf(szDataLen, "%02X%02X%02X%02X", data_len[4], data_len[5], data_len[6], data_len[7]);
+	if(reader.nSectorSize == PSISO_SECTOR_SIZE)
+	{
+		uint8_t _ps3_disc_id[] = { 'P', 'l', 'a', 'y', 'S', 't', 'a', 't', 'i', 'o', 'n', '3'};
+		const uint8_t* hdr_sector = psxReaderSector(&reader, 1);
+		probe.bPS3Header = (hdr_sector && memcmp(hdr_sector, _ps3_disc_id, sizeof(_ps3_disc_id)) == 0);
+	}
+	probe_root(&reader, &root, &probe);
 
-				size_t nDataLen = 0;
-#ifdef WIN
-				nDataLen = strtoul(szDataLen, NULL, 16);
-#else
-				nDataLen = strtoull(szDataLen, NULL, 16);
-#endif		
-				_verbose_printf("SYSTEM.CNF Data Length: 0x%08X \n", nDataLen);
+	// SYSTEM.CNF is a few lines of text, read it here so the boot line can be checked
+	char title_id_file_extent_data[PSISO_SECTOR_SIZE + 64];
+	ZERO(title_id_file_extent_data);
+	size_t nCnfNameOffset = 0;
+	int nCnfSystem = ISO_SYSTEM_AUTO;
 
-				char *title_id_file_extent_data = NULL;
-				title_id_file_extent_data = (char*)malloc(nDataLen+1);
-				memset(title_id_file_extent_data, 0, nDataLen+1);
-#ifdef WIN
-				fseek(fp, (long)(nExtentOffset + nSectorHeader), SEEK_SET);
-				fread(title_id_file_extent_data, 1, nDataLen, fp);
-#else
-				_lseek64(fd, nExtentOffset + nSectorHeader, SEEK_SET);
-				_read(fd, title_id_file_extent_data, nDataLen);
-#endif						
-				int nCount = 0;
-				while(nCount < 30) 
-				{
-					nCount++;
-					
-					if(nSystem == ISO_SYSTEM_PS1) 
-					{
-						char* check = NULL;
-						check = (char*)malloc(PS1_TITLE_ID_LEN);
-						memset(check, 0, PS1_TITLE_ID_LEN);
-						strncpy(check, title_id_file_extent_data+nCount, PS1_TITLE_ID_LEN);
-
-						char _check_ps1[] = {'c','d','r','o','m',':','\\'};
-
-						if(strncmp(check, _check_ps1, sizeof(_check_ps1))==0)
-						{
-							// 
-							memcpy(szTitleID, title_id_file_extent_data+nCount+sizeof(_check_ps1), PS1_TITLE_ID_LEN);
-							SAFE_FREE(check);
-							break;
-						}
-						SAFE_FREE(check);
-					}
-					if(nSystem == ISO_SYSTEM_PS2) 
-					{
-						char* check = NULL;
-						check = (char*)malloc(PS2_TITLE_ID_LEN);
-						memset(check, 0, PS2_TITLE_ID_LEN);
-						strncpy(check, title_id_file_extent_data+nCount, PS2_TITLE_ID_LEN);
-
-						char _check_ps2[] = {'c','d','r','o','m','0',':','\\'};
-
-						if(strncmp(check, _check_ps2, sizeof(_check_ps2))==0)
-						{
-							// 
-							memcpy(szTitleID, title_id_file_extent_data+nCount+sizeof(_check_ps2), PS2_TITLE_ID_LEN);
-							SAFE_FREE(check);
-							break;
-						}
-						SAFE_FREE(check);
-					}
-				}
- 
-				if(nSystem == ISO_SYSTEM_PS1) {
-					GetTitle(szTitleID, (char*)PS1_TITLE_DB, szTitle, ISO_SYSTEM_PS1);
-				}
-				if(nSystem == ISO_SYSTEM_PS2) {
-					GetTitle(szTitleID, (char*)PS2_TITLE_DB, szTitle, ISO_SYSTEM_PS2);
-				}
+	if(probe.bSystemCnf && (nSystem == ISO_SYSTEM_AUTO || nSystem == ISO_SYSTEM_PS1 || nSystem == ISO_SYSTEM_PS2))
+	{
+		psxLog(ctx, PSISO_LOG_VERBOSE, "SYSTEM.CNF file record found \n");
 
-				SAFE_FREE(root_dr_sector);
-				SAFE_FREE(SYSTEM_CNF);
-				SAFE_FREE(extent_loc);
-				SAFE_FREE(data_len);
-				SAFE_FREE(title_id_file_extent_data);
-#ifdef WIN
-				SAFE_FCLOSE(fp);
-#else
-				SAFE_CLOSE(fd);
-#endif
-				return 1;
-			}
+		// SYSTEM.CNF Extent Location (Data location)
+		uint32_t nExtentSector = probe.system_cnf.nExtent;
+		uint64_t nExtentOffset = (uint64_t)nExtentSector * reader.nSectorSize;
+		psxLog(ctx, PSISO_LOG_VERBOSE, "SYSTEM.CNF Extent (data) Offset: 0x%08X \n", (uint32_t)nExtentOffset);
+
+		// Data length(size)
+		size_t nDataLen = probe.system_cnf.nDataLen;
+		psxLog(ctx, PSISO_LOG_VERBOSE, "SYSTEM.CNF Data Length: 0x%08X \n", (uint32_t)nDataLen);
+
+		// a valid SYSTEM.CNF is just a few lines of text, do not trust bigger sizes
+		if(nDataLen > PSISO_SECTOR_SIZE) {
+			nDataLen = PSISO_SECTOR_SIZE;
 		}
+		nDataLen = psxReaderRead(&reader, nExtentSector, 0, title_id_file_extent_data, nDataLen);
+		nCnfSystem = parse_system_cnf(title_id_file_extent_data, nDataLen, &nCnfNameOffset);
+	}
 
-		// ======================================================
-		// FIND PARAM.SFO (used for both PS3 and PSP ISOs)
-		// ======================================================
+	if(nSystem == ISO_SYSTEM_AUTO)
+	{
+		if(!bCUE && reader.nSectorSize == PSISO_SECTOR_SIZE && (probe.bPS3Header || probe.bPS3Game)) {
+			nSystem = ISO_SYSTEM_PS3;
+		} else if(!bCUE && reader.nSectorSize == PSISO_SECTOR_SIZE && (probe.bPSPGame || probe.bUMDData)) {
+			nSystem = ISO_SYSTEM_PSP;
+		} else if(nCnfSystem != ISO_SYSTEM_AUTO) {
+			nSystem = nCnfSystem;
+		} else if(probe.bSystemCnf) {
+			nSystem = ISO_SYSTEM_PS1; // SYSTEM.CNF without a boot line, old PS1 discs boot PSX.EXE
+		}
 
-		if(nSystem == ISO_SYSTEM_PS3 || nSystem == ISO_SYSTEM_PSP) 
-		{
-			uint64_t nPos = 0;
-			uint64_t nParamOffset = 0;
+		if(nSystem == ISO_SYSTEM_AUTO) {
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: Couldn't detect the system of the disc image (no SYSTEM.CNF, PS3_GAME or PSP_GAME).\n");
+			psxReaderClose(&reader);
+			return -1;
+		}
+		psxLog(ctx, PSISO_LOG_VERBOSE, "Detected system: %s \n", szISOSystem[nSystem]);
+		res->nSystem = nSystem;
+	}
 
-			char szPS3_SYSTEM_FILE[] = { "PARAM.SFO" };
-			unsigned char _PS3_SYSTEM_FILE[]	= { 'P','A','R','A','M','.','S','F','O' };
+	// ======================================================
+	// SYSTEM.CNF (used for both PS1 and PS2 ISO)
+	// ======================================================
 
-			unsigned char _PS3_GAME[] = { 'P','S','3','_','G','A','M','E'};
+	if(nSystem == ISO_SYSTEM_PS1 || nSystem == ISO_SYSTEM_PS2)
+	{
+		if(!probe.bSystemCnf) 
+		{
+			// Corrupted ISO, this should be present...
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: Couldn't find SYSTEM.CNF entry on the root directory.\n");		
+			psxReaderClose(&reader);
+			return -1;
+		}
 
-			if(nSystem == ISO_SYSTEM_PSP) {
-				_PS3_GAME[2] = 'P';
+		// executable name on the boot line (Ex. SLUS_200.62)
+		if(nCnfSystem != ISO_SYSTEM_AUTO && nCnfNameOffset)
+		{
+			size_t nIDLen = (nSystem == ISO_SYSTEM_PS1) ? PS1_TITLE_ID_LEN : PS2_TITLE_ID_LEN;
+			const char* pName = title_id_file_extent_data + nCnfNameOffset;
+			for(size_t i = 0; i < nIDLen && pName[i] && pName[i] != ';' && pName[i] != '\r' && pName[i] != '\n'; i++) {
+				szTitleID[i] = pName[i];
 			}
+		}
 
-			unsigned char *PS3_GAME	= NULL;
-			PS3_GAME = (unsigned char*)malloc(sizeof(_PS3_GAME));
-			
-			bool bFoundPS3GameDir = false;
+		GetTitle(ctx, szTitleID, szTitle, PSISO_TITLE_SIZE, nSystem);
 
-			while(nPos < nSectorSize) 
-			{
-				memset(PS3_GAME, 0, sizeof(_PS3_GAME));
-#ifdef WIN
-				fread(PS3_GAME, 1, sizeof(_PS3_GAME), fp);
-#else
-				_read(fd, PS3_GAME, sizeof(_PS3_GAME));
-#endif
-				if(memcmp(PS3_GAME, _PS3_GAME, sizeof(_PS3_GAME)) == 0)
-				{
-					if(nSystem == ISO_SYSTEM_PS3) {
-						_verbose_printf("PS3_GAME file record found at pos: 0x%03X \n", (uint32_t)nPos);
-					}
-					if(nSystem == ISO_SYSTEM_PSP) {
-						_verbose_printf("PSP_GAME file record found at pos: 0x%03X \n", (uint32_t)nPos);
-					}
-					bFoundPS3GameDir = true;
-					break;
-				}
-				nPos++;
-#ifdef WIN
-				fseek(fp, (long)(nRootDROffset + nPos), SEEK_SET);
-#else
-				_lseek64(fd, nRootDROffset + nPos, SEEK_SET);
-#endif
-			}
+		psxReaderClose(&reader);
+		return 1;
+	}
 
-			if(!bFoundPS3GameDir) 
-			{
-				// Corrupted ISO, this should be present...
-				if(nSystem == ISO_SYSTEM_PS3) {
-					_verbose_printf("Error: Couldn't find PS3_GAME entry on the specified sector. ISO is invalid.\n");
-				}
+	// ======================================================
+	// FIND PARAM.SFO (used for both PS3 and PSP ISOs)
+	// ======================================================
 
-				if(nSystem == ISO_SYSTEM_PSP) {
-					_verbose_printf("Error: Couldn't find PSP_GAME entry on the specified sector. ISO is invalid.\n");
-				}
+	if(nSystem == ISO_SYSTEM_PS3 || nSystem == ISO_SYSTEM_PSP) 
+	{
+		char szPS3_SYSTEM_FILE[] = { "PARAM.SFO" };
+		char szPS3_GAME[] = { "PS3_GAME" };
 
-				SAFE_FREE(root_dr_sector);
-				SAFE_FREE(PS3_GAME);
-#ifdef WIN
-				SAFE_FCLOSE(fp);
-#else
-				SAFE_CLOSE(fd);
-#endif
-				return -1;
-			} else {
-				// PS3_GAME Extent Location (Data location)
-				uint64_t nDataOffset = (nRootDROffset + nPos) - 0x1F;
+		if(nSystem == ISO_SYSTEM_PSP) {
+			szPS3_GAME[2] = 'P';
+		}
 
-				unsigned char *extent_loc = NULL;
-				extent_loc = (unsigned char*)malloc(8);
-				memset(extent_loc, 0, 8);
-#ifdef WIN
-				fseek(fp, (long)nDataOffset, SEEK_SET);
-				fread(extent_loc, 1, 8, fp);
-#else
-				_lseek64(fd, nDataOffset, SEEK_SET);
-				_read(fd, extent_loc, 8);
-#endif
-				char szExtentOffset[64]; // BE
-				ZERO(szExtentOffset);
-				sprintf(szExtentOffset, "%02X%02X%02X%02X", extent_loc[4], extent_loc[5], extent_loc[6], extent_loc[7]);
+		bool bFoundPS3GameDir = (nSystem == ISO_SYSTEM_PS3) ? probe.bPS3Game : probe.bPSPGame;
+		psiso_dirent game_dir = (nSystem == ISO_SYSTEM_PS3) ? probe.ps3_game : probe.psp_game;
 
-				uint64_t nExtentOffset = 0;
-#ifdef WIN
-				nExtentOffset = strtoul(szExtentOffset, NULL, 16);
-#else
-				nExtentOffset = strtoull(szExtentOffset, NULL, 16);
-#endif
-				nExtentOffset = nExtentOffset * nSectorSize;
+		if(!bFoundPS3GameDir) 
+		{
+			// Corrupted ISO, this should be present...
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: Couldn't find %s entry on the root directory. ISO is invalid.\n", szPS3_GAME);
+			psxReaderClose(&reader);
+			return -1;
+		}
+		psxLog(ctx, PSISO_LOG_VERBOSE, "%s file record found \n", szPS3_GAME);
 
-				if(nSystem == ISO_SYSTEM_PS3) {
-					_verbose_printf("PS3_GAME Extent (data) Offset: 0x%08X \n", (uint32_t)nExtentOffset);
-				}
+		// PS3_GAME Extent Location (Data location)
+		uint64_t nParamOffset = (uint64_t)game_dir.nExtent * reader.nSectorSize;
+		psxLog(ctx, PSISO_LOG_VERBOSE, "%s Extent (data) Offset: 0x%08X \n", szPS3_GAME, (uint32_t)nParamOffset);
 
-				if(nSystem == ISO_SYSTEM_PSP) {
-					_verbose_printf("PSP_GAME Extent (data) Offset: 0x%08X \n", (uint32_t)nExtentOffset);
-				}
+		// PS3_GAME/PARAM.SFO, the directory is resolved with the path table when it can be loaded
+		char szSFOPath[32];
+		ZERO(szSFOPath);
+		sprintf(szSFOPath, "%s/%s", szPS3_GAME, szPS3_SYSTEM_FILE);
 
-				nParamOffset = nExtentOffset;
+		psiso_path_table pt;
+		if(!psxPathTableLoad(&reader, pvd, &pt)) {
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Warning: The path table could not be read, walking the directories instead.\n");
+		}
 
-				SAFE_FREE(PS3_GAME);
-			}
-			unsigned char *PS3_SYSTEM_FILE	= NULL;
-			size_t nLen = sizeof(_PS3_SYSTEM_FILE);
-			PS3_SYSTEM_FILE = (unsigned char*)malloc(nLen);
+		psiso_dirent param_sfo;
+		int nFound = psxFindPathEx(&reader, &root, &pt, szSFOPath, &param_sfo);
+		if(!nFound && pt.nEntries) {
+			// path table out of sync with the directories, look in the one found on the root
+			nFound = psxDirFind(&reader, &game_dir, szPS3_SYSTEM_FILE, &param_sfo);
+		}
+		psxPathTableFree(&pt);
 
-			bool bFoundTitleIDFile = false;		
-			nPos = 0;
+		if(!nFound) 
+		{
+			// Corrupted ISO, this should be present...
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: Couldn't find %s entry on the %s directory.\n", szPS3_SYSTEM_FILE, szPS3_GAME);		
+			psxReaderClose(&reader);
+			return -1;
+		}
+		psxLog(ctx, PSISO_LOG_VERBOSE, "%s file record found \n", szPS3_SYSTEM_FILE);
 
-#ifdef WIN
-			fseek(fp, (long)(nParamOffset + nPos), SEEK_SET);
-#else
-			_lseek64(fd, nParamOffset + nPos, SEEK_SET);
-#endif
-			while(nPos < nSectorSize) 
-			{
-				memset(PS3_SYSTEM_FILE, 0, nLen);
-#ifdef WIN
-				fread(PS3_SYSTEM_FILE, 1, nLen, fp);
-#else
-				_read(fd, PS3_SYSTEM_FILE, nLen);
-#endif
-				if(memcmp(PS3_SYSTEM_FILE, _PS3_SYSTEM_FILE, nLen) == 0)
-				{
-					_verbose_printf("%s file record found at pos: 0x%03X \n", szPS3_SYSTEM_FILE, (uint32_t)nPos);
-					bFoundTitleIDFile = true;
-					break;
-				}
-				nPos++;
-#ifdef WIN
-				fseek(fp, (long)(nParamOffset + nPos), SEEK_SET);
-#else
-				_lseek64(fd, nParamOffset + nPos, SEEK_SET);
-#endif
-			}
-			
-			if(!bFoundTitleIDFile) 
-			{
-				// Corrupted ISO, this should be present...
-				_verbose_printf("Error: Couldn't find %s entry on the specified sector.\n", szPS3_SYSTEM_FILE);		
-				SAFE_FREE(root_dr_sector);
-				SAFE_FREE(PS3_SYSTEM_FILE);
-#ifdef WIN
-				SAFE_FCLOSE(fp);
-#else
-				SAFE_CLOSE(fd);
-#endif
-				return -1;
-			} else {
-				// PARAM.SFO Extent Location (Data location)
-				uint64_t nDataOffset = (nParamOffset + nPos) - 0x1F;
+		// PARAM.SFO Extent Location (Data location)
+		uint64_t nExtentOffset = (uint64_t)param_sfo.nExtent * reader.nSectorSize;
+		psxLog(ctx, PSISO_LOG_VERBOSE, "%s Extent (data) Offset: 0x%08X \n", szPS3_SYSTEM_FILE, (uint32_t)nExtentOffset);
 
-				unsigned char *extent_loc = NULL;
-				extent_loc = (unsigned char*)malloc(8);
-				memset(extent_loc, 0, 8);
-#ifdef WIN
-				fseek(fp, (long)nDataOffset, SEEK_SET);
-				fread(extent_loc, 1, 8, fp);
-#else
-				_lseek64(fd, nDataOffset, SEEK_SET);
-				_read(fd, extent_loc, 8);
-#endif
-				char szExtentOffset[64]; // BE
-				ZERO(szExtentOffset);
-				sprintf(szExtentOffset, "%02X%02X%02X%02X", extent_loc[4], extent_loc[5], extent_loc[6], extent_loc[7]);
+		// Data length(size)
+		size_t nDataLen = param_sfo.nDataLen;
+		psxLog(ctx, PSISO_LOG_VERBOSE, "%s Data Length: 0x%08X \n", szPS3_SYSTEM_FILE, (uint32_t)nDataLen);
 
-				uint64_t nExtentOffset = 0;
-#ifdef WIN
-				nExtentOffset = strtoul(szExtentOffset, NULL, 16);
-#else
-				nExtentOffset = strtoull(szExtentOffset, NULL, 16);
-#endif
-				nExtentOffset = nExtentOffset * nSectorSize;
-				_verbose_printf("%s Extent (data) Offset: 0x%08X \n", szPS3_SYSTEM_FILE, (uint32_t)nExtentOffset);
+		// whole PARAM.SFO in one read (through the sector cache), then all the fields from memory
+		if(nDataLen > PSISO_SFO_MAX_SIZE) {
+			nDataLen = PSISO_SFO_MAX_SIZE;
+		}
 
-				// Data length(size)
-				uint64_t nDataLenOffset = (nParamOffset + nPos) - 0x17;
+		// parsed in place on mapped images
+		uint8_t* pSFO = NULL;
+		const uint8_t* pSFOData = psxReaderView(&reader, param_sfo.nExtent, nDataLen);
+		if(!pSFOData) {
+			pSFO = (uint8_t*)malloc(nDataLen ? nDataLen : 1);
+			if(pSFO && psxReaderRead(&reader, param_sfo.nExtent, 0, pSFO, nDataLen) == nDataLen) {
+				pSFOData = pSFO;
+			}
+		}
+		psiso_sfo sfo;
 
-				unsigned char *data_len = NULL;
-				data_len = (unsigned char*)malloc(8);
-				memset(data_len, 0, 8);
-#ifdef WIN
-				fseek(fp, (long)nDataLenOffset, SEEK_SET);
-				fread(data_len, 1, 8, fp);
-#else
-				_lseek64(fd, nDataLenOffset, SEEK_SET);
-				_read(fd, data_len, 8);
-#endif
-				char szDataLen[64]; // BE
-				ZERO(szDataLen);
-				sprintf(szDataLen, "%02X%02X%02X%02X", data_len[4], data_len[5], data_len[6], data_len[7]);
+		if(!pSFOData || !psxSFOParse(&sfo, pSFOData, nDataLen))
+		{
+			psxLog(ctx, PSISO_LOG_VERBOSE, "Error: %s cannot be read or is not valid.\n", szPS3_SYSTEM_FILE);
+			SAFE_FREE(pSFO);
+			psxReaderClose(&reader);
+			return -1;
+		}
 
-				size_t nDataLen = 0;
-#ifdef WIN
-				nDataLen = strtoul(szDataLen, NULL, 16);
-#else
-				nDataLen = strtoull(szDataLen, NULL, 16);
-#endif
-				_verbose_printf("%s Data Length: 0x%08X \n", szPS3_SYSTEM_FILE, nDataLen);
+		// the caller keeps all the fields (catalog)
+		if(ctx->pSFOBuf && nDataLen <= ctx->nSFOBufSize) {
+			memcpy(ctx->pSFOBuf, pSFOData, nDataLen);
+			ctx->nSFOLen = (uint32_t)nDataLen;
+		}
 
-#ifdef WIN
-				fseek(fp, (long)(nExtentOffset + nSectorHeader), SEEK_SET);
-#else
-				_lseek64(fd, nExtentOffset + nSectorHeader, SEEK_SET);
-#endif
-				if(nSystem == ISO_SYSTEM_PS3) {
-#ifdef WIN
-					ParseSFO(fp, nExtentOffset + nSectorHeader, nDataLen, (char*)"TITLE_ID", szTitleID);
-#else
-					ParseSFO(fd, nExtentOffset + nSectorHeader, nDataLen, (char*)"TITLE_ID", szTitleID);
-#endif
-				} 
-				if(nSystem == ISO_SYSTEM_PSP) {
-#ifdef WIN
-					ParseSFO(fp, nExtentOffset + nSectorHeader, nDataLen, (char*)"DISC_ID", szTitleID);
-				}
-				ParseSFO(fp, nExtentOffset + nSectorHeader, nDataLen, (char*)"TITLE", szTitle);
-#else
-					ParseSFO(fd, nExtentOffset + nSectorHeader, nDataLen, (char*)"DISC_ID", szTitleID);
-				}
-				ParseSFO(fd, nExtentOffset + nSectorHeader, nDataLen, (char*)"TITLE", szTitle);
-#endif
-				char szTmp[256];
-				ZERO(szTmp);
-				strcpy(szTmp, szTitle);
-				utf8_to_ansi(szTmp, szTitle, (int)strlen(szTitle));
-
-				// Patch PS3 ISO if needed
-				if(nSystem == ISO_SYSTEM_PS3) 
-				{
-					if(bPatchPS3ISO == true) {
-						_verbose_printf(SEP_LINE_2);
-#ifdef WIN
-						PatchPS3ISO(fp, szTitleID, vol_size); // this function assumes that the ISO was validated previously, so it will not do any extensive tests.
-#else
-						PatchPS3ISO(fd, szTitleID, vol_size); // this function assumes that the ISO was validated previously, so it will not do any extensive tests.
-#endif
-					} else {
-						_verbose_printf(SEP_LINE_2);
-						_verbose_printf("No PS3 ISO patching option flag detected (no patching done). \n");
-					}
-				}
+		psxSFOLookup(ctx, &sfo, (nSystem == ISO_SYSTEM_PS3) ? "TITLE_ID" : "DISC_ID", szTitleID, PSISO_TITLE_ID_SIZE);
+		psxSFOLookup(ctx, &sfo, "TITLE", szTitle, PSISO_TITLE_SIZE);
+		SAFE_FREE(pSFO);
 
-				SAFE_FREE(root_dr_sector);
-				SAFE_FREE(PS3_SYSTEM_FILE);
-				SAFE_FREE(extent_loc);
-				SAFE_FREE(data_len);
-#ifdef WIN
-				SAFE_FCLOSE(fp);
-#else
-				SAFE_CLOSE(fd);
-#endif
+		char szTmp[PSISO_TITLE_SIZE];
+		ZERO(szTmp);
+		strcpy(szTmp, szTitle);
+		utf8_to_ansi(szTmp, szTitle, (int)strlen(szTitle));
+
+		// Patch PS3 ISO if needed
+		if(nSystem == ISO_SYSTEM_PS3) 
+		{
+			if(bPatchPS3ISO == true && reader.cso) {
+				psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+				psxLog(ctx, PSISO_LOG_VERBOSE, "Compressed images can not be patched (no patching done). \n");
+			} else if(bPatchPS3ISO == true) {
+				psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+				psxReaderClose(&reader);
+				// this function assumes that the ISO was validated previously, so it will not do any extensive tests.
+				if(psxPatchPS3ISOFile(ctx, szISO, szTitleID, vol_size) != 1) {
+					return -1;
+				}
 				return 1;
+			} else {
+				psxLog(ctx, PSISO_LOG_VERBOSE, SEP_LINE_2);
+				psxLog(ctx, PSISO_LOG_VERBOSE, "No PS3 ISO patching option flag detected (no patching done). \n");
 			}
 		}
+
+		psxReaderClose(&reader);
+		return 1;
 	}
-	return 0; // error: file not found
+
+	psxReaderClose(&reader);
+	return 0;
 }
 
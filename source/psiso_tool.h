@@ -16,19 +16,20 @@ http://stackoverflow.com/questions/19649634/clang-error-unsupported-option-stati
  - [PS1 / PS2] Get game Title ID from SYSTEM.CNF and obtain Title from a text database.
  - [PS3 / PSP] Get game Title and ID from the PARAM.SFO inside the ISO (no need for text database).
  - Titles gets automatically converted from UTF-8 to ASCII.
- - Provide a function to patch PS3 ISOs created with different applications than 
-   GenPS3iso (Ex. ImgBurn, PowerISO).
+ - Build a PS3 ISO from a game folder with the PS3 disc header written directly (psxMakeISO()).
+ - Provide a function to patch PS3 ISOs created with other applications (Ex. ImgBurn, PowerISO).
 
  When used as application:
 
- - Users can generate a ISO that will instantly be compatible with the PS3
- running on Cobra CFW v7.00 (mixed w/Rogero CFW 4.46 v1.00).
+ - Users can generate a ISO ("--mkps3iso") that will instantly be compatible with the PS3
+ running on Cobra CFW v7.00 (mixed w/Rogero CFW 4.46 v1.00). The disc header is written
+ while the ISO is built, no external tools (GenPS3iso, ImgBurn, PowerISO) are needed.
  
- - Users can quickly patch any specified PS3 ISO created with different application than 
-   GenPS3iso (Ex. ImgBurn, PowerISO).
+ - Users can quickly patch any specified PS3 ISO created with other applications 
+   (Ex. ImgBurn, PowerISO).
 
- Note: Patching will make the ISO valid for the PS3 system, if you try to mount 
- it without patching, the system will not detect it.
+ Note: Patching will make those ISOs valid for the PS3 system, if you try to mount 
+ them without patching, the system will not detect them.
 
  Additional Note: Only PS3 ISO need to be patched, so if you specify "--patch" with other
  kind of ISO nothing will be done to them. If you are curious and fool "PS ISO Tool" to 
@@ -78,6 +79,9 @@ available free space, at least until it gets implemented.
 ================================================================================
 */
 
+#ifndef PSISO_TOOL_H
+#define PSISO_TOOL_H
+
 #if defined(_WIN32) || defined(WIN32) || defined(__CYGWIN__) || defined(__MINGW32__) || defined(__BORLANDC__) || defined(_MSC_VER)
 #define WIN
 #endif
@@ -88,6 +92,8 @@ available free space, at least until it gets implemented.
 #pragma warning(disable:4514)		// [*] : unreferenced inline function has been removed
 #pragma warning(disable:4711)		// function [*] selected for automatic inline expansion
 #pragma warning(disable:4996)		// [*] : This function or variable may be unsafe. Consider using [*] instead
+#define snprintf _snprintf
+#define vsnprintf _vsnprintf
 #endif
 
 #ifdef WIN
@@ -129,10 +135,12 @@ For PS3 build, just add this flags to your makefile
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 
-extern bool bPSISOTool_verbose; // info display control
+extern bool bPSISOTool_verbose; // info display control (legacy API, see psiso_ctx)
+extern const char szISOSystem[][64]; // display names, indexed by ISO_SYSTEM_*
 
 // This should work on any compiler that is not Microsoft Visual C++...
 #ifndef _MSC_VER
@@ -201,18 +209,23 @@ The reason you can just use lseek is because off_t is a 64bit wide value.
 	memset(&x, 0, sizeof(x));
 
 // ---------------------------------------------------------------------------------------------------------
-// TODO: Create a structure array included with source to avoid this, plus it will allow adding more fields
-// like "Year", "Manufacturer", "Max Players", etc...(of course, if someone wants to expand this)
+// Text databases are the source, "psiso_tool --mkdb" (or "make db") compiles them to the binary (.bin)
+// format which has room for more fields like "Year", "Region", "Publisher" (see psiso_titledb.h).
+// When a .bin is present and not older than its .txt it is used instead of the text database.
 
 #ifdef PSISOTOOL_PS3BUILD
 
-#define PS1_TITLE_DB	PS3_GAME_CWD "/db/ps1titles_us_eu_jp.txt"	// by CaptainCPS-X based on (http://sonyindex.com/)
-#define PS2_TITLE_DB	PS3_GAME_CWD "/db/ps2titleid.txt"			// by aldostools [?]
+#define PS1_TITLE_DB		PS3_GAME_CWD "/db/ps1titles_us_eu_jp.txt"	// by CaptainCPS-X based on (http://sonyindex.com/)
+#define PS2_TITLE_DB		PS3_GAME_CWD "/db/ps2titleid.txt"			// by aldostools [?]
+#define PS1_TITLE_DB_BIN	PS3_GAME_CWD "/db/ps1titles_us_eu_jp.bin"
+#define PS2_TITLE_DB_BIN	PS3_GAME_CWD "/db/ps2titleid.bin"
 
 #else
 
 #define PS1_TITLE_DB "db/ps1titles_us_eu_jp.txt" // by CaptainCPS-X based on (http://sonyindex.com/)
 #define PS2_TITLE_DB "db/ps2titleid.txt"		 // by aldostools [?]
+#define PS1_TITLE_DB_BIN "db/ps1titles_us_eu_jp.bin"
+#define PS2_TITLE_DB_BIN "db/ps2titleid.bin"
 
 #endif
 // ---------------------------------------------------------------------------------------------------------
@@ -222,15 +235,67 @@ The reason you can just use lseek is because off_t is a 64bit wide value.
 #define ISO_SYSTEM_PS2	1	// ---ISO9660 / MODE1 / 2048--- or ---ISO9660 / MODE2 / 2352---
 #define ISO_SYSTEM_PS3	2	// ---ISO9660 / MODE1 / 2048 / Joliet (ONLY)---
 #define ISO_SYSTEM_PSP	3	// ---ISO9660 / MODE1 / 2048 (ONLY)---
+#define ISO_SYSTEM_AUTO	-1	// detect from the disc header, root directory and SYSTEM.CNF
 
 #define PS1_TITLE_ID_LEN	11					// EX. SCUS_941.65
 #define PS2_TITLE_ID_LEN	PS1_TITLE_ID_LEN
 
+// ------------------------------------------------------------------------------------------------
+// Context & results
+// ------------------------------------------------------------------------------------------------
+// Everything the processing modules used to keep in globals lives in a psiso_ctx, so each thread
+// (or each image) can use its own context and log sink. A context must not be shared by two
+// threads at once.
+
+#define PSISO_LOG_INFO		0	// always displayed
+#define PSISO_LOG_VERBOSE	1	// only displayed when psiso_ctx::bVerbose is set
+
+// Log sink, szMsg is a complete formatted message (may hold several lines)
+typedef void (*psiso_log_func)(void* pUser, int nLevel, const char* szMsg);
+
+// Progress of long operations (building, hashing), nDone / nTotal in bytes
+typedef void (*psiso_progress_func)(void* pUser, uint64_t nDone, uint64_t nTotal);
+
+struct psiso_ctx
+{
+	bool			bVerbose;			// display detailed info
+	psiso_log_func	log;				// log sink, NULL = stdout
+	void*			pLogUser;			// user data passed to log
+
+	bool			bSFOInfoDisplayed;	// PARAM.SFO fields already dumped for the current image
+
+	uint8_t*		pSFOBuf;			// receives a copy of the PARAM.SFO of PS3 / PSP images (NULL = not kept)
+	uint32_t		nSFOBufSize;		// size of pSFOBuf (PSISO_SFO_MAX_SIZE is always enough)
+	uint32_t		nSFOLen;			// bytes copied to pSFOBuf for the current image (0 = none)
+
+	bool			bNoMap;				// do not map the images (they may be truncated while read, library scans)
+};
+
+#define PSISO_TITLE_ID_SIZE		32
+#define PSISO_TITLE_SIZE		1024
+
+struct psiso_result
+{
+	int			nSystem;							// ISO_SYSTEM_*
+	uint32_t	nSectorSize;						// 0x800 or 0x930 (0x920 on MODE2/2336 CUE tracks)
+	uint32_t	nVolumeSectors;						// from the Primary Volume Descriptor
+	char		szTitleID[PSISO_TITLE_ID_SIZE];		// Ex. BLUS-00123
+	char		szTitle[PSISO_TITLE_SIZE];			// Ex. The Last of Us
+};
+
+// Initialize a context with the default settings (stdout, verbose as bPSISOTool_verbose)
+void psxCtxInit(psiso_ctx* ctx);
+
+// Format a message and send it to the context log sink
+void psxLog(psiso_ctx* ctx, int nLevel, const char* szFormat, ...);
+
 // ------------------------------------------------------------------------------------------------
 // PS ISO Processing module (by CaptainCPS-X, 2013)
 /* ------------------------------------------------------------------------------------------------
 (in)	szISO			- Path to ISO
 (in)	nSystem			- One of the following: (ISO_SYSTEM_PS1) (ISO_SYSTEM_PS2) (ISO_SYSTEM_PS3) (ISO_SYSTEM_PSP) 
+						  or (ISO_SYSTEM_AUTO) to detect it (PS3 disc header / PS3_GAME, PSP_GAME /
+						  UMD_DATA.BIN, SYSTEM.CNF BOOT2 "cdrom0:" for PS2 and BOOT "cdrom:" for PS1)
 (out)	szTitleID		- String buffer to store Game Title ID (Ex. BLUS-00123)
 (out)	szTitle			- String buffer to store Game Title (Ex. The Last of Us)
 (in)	bPatchPS3ISO	- Flag to specify if ISO header should be patched to be PS3 compliant (Ex. If ISO was done with PowerISO, ImgBurn, etc...) 
@@ -241,6 +306,48 @@ The reason you can just use lseek is because off_t is a 64bit wide value.
 */
 int psxProcessISO(char* szISO, int nSystem, char* szTitleID, char* szTitle, bool bPatchPS3ISO);
 
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+Reentrant version of psxProcessISO(), the ISO file name is not displayed and all the messages go
+to the ctx log sink. Can be called from several threads at once, each one with its own ctx.
+
+(in)	ctx				- Context (see psxCtxInit())
+(in)	szISO			- Path to ISO
+(in)	nSystem			- One of the ISO_SYSTEM_* values (ISO_SYSTEM_AUTO to detect it)
+(in)	bPatchPS3ISO	- Same as psxProcessISO()
+(out)	res				- Title ID, Title and disc image details (res->nSystem is the detected
+						  system when ISO_SYSTEM_AUTO was used)
+
+(out)	return			- Will return 1 for success, 0 if the file could not be opened and -1
+						  if the image is not valid.
+-------------------------------------------------------------------------------------------------
+*/
+int psxProcessISOEx(psiso_ctx* ctx, const char* szISO, int nSystem, bool bPatchPS3ISO, psiso_result* res);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+Write the PS3 disc header (sectors 0 and 1) on a PS3 ISO that does not have it yet. The image is
+opened for writing only here, so inspecting images never needs write access.
+
+(in)	ctx				- Context
+(in)	szISO			- Path to a validated PS3 ISO
+(in)	szTitleID		- Title ID from PARAM.SFO (Ex. BLUS12345)
+(in)	vol_size		- Volume space size field (big-endian, 4 bytes) from the PVD
+
+(out)	return			- Will return 1 if the header is present / was written, 0 on failure.
+-------------------------------------------------------------------------------------------------
+*/
+int psxPatchPS3ISOFile(psiso_ctx* ctx, const char* szISO, const char* szTitleID, const uint8_t* vol_size);
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	szTitleID		- Title ID from PARAM.SFO (Ex. BLUS12345)
+(in)	nVolumeSectors	- Total volume sectors of the image
+(out)	pHeader			- Sectors 0 and 1 of the image (0x1000 bytes), the unused bytes are zero
+-------------------------------------------------------------------------------------------------
+*/
+void psxPS3DiscHeader(const char* szTitleID, uint32_t nVolumeSectors, uint8_t* pHeader);
+
 // -----------------------------------------------------------------------------------------------
 // PARAM.SFO Processing module (by CaptainCPS-X, 2013)
 /* -----------------------------------------------------------------------------------------------
@@ -262,6 +369,13 @@ extern uint64_t ParseSFO(FILE* fp, uint64_t nOffset, size_t nLen, char* szEntry,
 uint64_t ParseSFO(int fd, uint64_t nOffset, size_t nLen, char* szEntry, char* szOut);
 #endif
 
+// Reentrant version of ParseSFO(), szOut is limited to nOutSize bytes (including the terminator)
+#ifdef WIN
+uint64_t ParseSFOEx(psiso_ctx* ctx, FILE* fp, uint64_t nOffset, size_t nLen, const char* szEntry, char* szOut, size_t nOutSize);
+#else
+uint64_t ParseSFOEx(psiso_ctx* ctx, int fd, uint64_t nOffset, size_t nLen, const char* szEntry, char* szOut, size_t nOutSize);
+#endif
+
 // -----------------------------------------------------------------------------------------------
 // Utility modules
 // -----------------------------------------------------------------------------------------------
@@ -273,3 +387,5 @@ uint32_t data_to_u8(uint8_t* data);
 
 #define SEP_LINE_1 "=========================================================================\n"
 #define SEP_LINE_2 "-------------------------------------------------------------------------\n"
+
+#endif
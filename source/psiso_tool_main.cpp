@@ -11,19 +11,20 @@
  - [PS1 / PS2] Get game Title ID from SYSTEM.CNF and obtain Title from a text database.
  - [PS3 / PSP] Get game Title and ID from the PARAM.SFO inside the ISO (no need for text database).
  - Titles gets automatically converted from UTF-8 to ASCII.
- - Provide a function to patch PS3 ISOs created with different applications than 
-   GenPS3iso (Ex. ImgBurn, PowerISO).
+ - Build a PS3 ISO from a game folder with the PS3 disc header written directly (psxMakeISO()).
+ - Provide a function to patch PS3 ISOs created with other applications (Ex. ImgBurn, PowerISO).
 
  When used as application:
 
- - Users can generate a ISO that will instantly be compatible with the PS3
- running on Cobra CFW v7.00 (mixed w/Rogero CFW 4.46 v1.00).
+ - Users can generate a ISO ("--mkps3iso") that will instantly be compatible with the PS3
+ running on Cobra CFW v7.00 (mixed w/Rogero CFW 4.46 v1.00). The disc header is written
+ while the ISO is built, no external tools (GenPS3iso, ImgBurn, PowerISO) are needed.
  
- - Users can quickly patch any specified PS3 ISO created with different application than 
-   GenPS3iso (Ex. ImgBurn, PowerISO).
+ - Users can quickly patch any specified PS3 ISO created with other applications 
+   (Ex. ImgBurn, PowerISO).
 
- Note: Patching will make the ISO valid for the PS3 system, if you try to mount 
- it without patching, the system will not detect it.
+ Note: Patching will make those ISOs valid for the PS3 system, if you try to mount 
+ them without patching, the system will not detect them.
 
  Additional Note: Only PS3 ISO need to be patched, so if you specify "--patch" with other
  kind of ISO nothing will be done to them. If you are curious and fool "PS ISO Tool" to 
@@ -50,8 +51,10 @@
 	ps_isotool --ps2 --verbose "C:\PS2ISO\MyPS2ISO.iso"
 	ps_isotool --ps3 --verbose "C:\PS3ISO\MyPS3ISO.iso"
 	ps_isotool --psp --verbose "C:\PSPISO\MyPSPISO.iso"
+	ps_isotool --verbose "C:\ISO\MyISO.iso"
 	
 Note: If you don't specify "--verbose" then only the Title ID and Title will be displayed.
+If you don't specify the system it will be detected from the disc image.
 
 --------------------------------------------------------------------------------
 
@@ -66,6 +69,14 @@ you just need to specify "Source Directory" and "Destination Directory".
 If you do not specify "Destination Directory" the ISO will be created on the root 
 directory of "PS ISO Tool".
 
+The ISO (ISO9660 + Joliet) is written directly with the PS3 disc header in a single pass,
+no external tools are needed and it does not need to be patched afterwards.
+
+Boot files (PARAM.SFO, ICON0, EBOOT.BIN, *.sprx) are placed first on the ISO. Files listed
+on an access trace (one path per line) can be placed right after them:
+
+	psiso_tool --mkps3iso "C:\GAMES\BCUS98174-[The Last of Us]" --trace "C:\TRACES\BCUS98174.txt"
+
 Important: There is no HDD space verification implemented yet so, if you plan to
 make a batch for a big list of games, make sure you check your destination HDD 
 available free space, at least until it gets implemented.
@@ -73,6 +84,20 @@ available free space, at least until it gets implemented.
 ================================================================================
 */
 #include "psiso_tool.h"
+#include "psiso_scan.h"
+#include "psiso_catalog.h"
+#include "psiso_watch.h"
+#include "psiso_titledb.h"
+#include "psiso_sfo.h"
+#include "psiso_mkiso.h"
+#include "psiso_hash.h"
+#include "psiso_dat.h"
+#include "psiso_ecc.h"
+#include "psiso_cue.h"
+#include "psiso_cso.h"
+#include "psiso_extract.h"
+#include "psiso_convert.h"
+#include "psiso_thread.h"
 
 #define APP_VER "1.03"
 
@@ -94,8 +119,11 @@ void print_usage()
 		"ps_isotool --ps2 --verbose \"C:\\PS2ISO\\MyPS2ISO.iso\" \n"
 		"ps_isotool --ps3 --verbose \"C:\\PS3ISO\\MyPS3ISO.iso\" \n"
 		"ps_isotool --psp --verbose \"C:\\PSPISO\\MyPSPISO.iso\" \n"
+		"ps_isotool --verbose \"C:\\ISO\\MyISO.iso\" \n"
 		"\n"
 		"Note: If you don't specify \"--verbose\" then only the Title ID and Title will be displayed.\n"
+		"If you don't specify the system it will be detected from the disc image.\n"
+		"CSO / ZSO compressed images (v1 / v2) can be used anywhere an ISO is expected (never patched).\n"
 		"\n"
 		"Example 3 - Creating a PS3 ISO in compliance with the PS3 system standard disc format:\n"
 		"\n"
@@ -104,6 +132,99 @@ void print_usage()
 		"\n"
 		"Note: You don't have to specify the ISO file name, it will be generated automatically,"
 		"you just need to specify \"Source Directory\" and \"Destination Directory\". \n"
+		"The ISO is written directly with the PS3 disc header, it does not need to be patched. \n"
+		"Boot files (PARAM.SFO, ICON0, EBOOT.BIN, *.sprx) are placed first, add \"--trace file\" to place \n"
+		"the files listed on it (one path per line, Ex. PS3_GAME/USRDIR/data.pak) right after them, \n"
+		"or \"--layout tree\" to keep the directory order. \n"
+		"\n"
+		"Example 4 - Scanning a whole game library (all sub-directories): \n"
+		"\n"
+		"psiso_tool --scan \"D:\\ISO\" \n"
+		"psiso_tool --ps2 --scan \"D:\\PS2ISO\" --jobs 2 \n"
+		"psiso_tool --scan \"D:\\ISO\" --catalog \"D:\\ISO\\library.cat\" \n"
+		"psiso_tool --catalog \"D:\\ISO\\library.cat\" --verbose \n"
+		"\n"
+		"Note: \"--jobs\" sets how many images are processed at once (default: one per CPU), "
+		"use 1 or 2 for libraries on spinning disks. \n"
+		"With \"--catalog\" the results are kept on the catalog file and the next scans only probe the \n"
+		"images that changed (size, date, file identity or volume descriptor). Without \"--scan\" the \n"
+		"catalog is listed (\"--verbose\" adds the sector size, volume size and PARAM.SFO fields). \n"
+		"\n"
+		"Example 5 - Compiling the title databases (db/*.txt) to the binary format: \n"
+		"\n"
+		"psiso_tool --mkdb \n"
+		"psiso_tool --mkdb --ps2 \"db\\mytitles.txt\" \"db\\mytitles.bin\" \n"
+		"\n"
+		"Note: Binary databases are used instead of the text ones when present and up to date. \n"
+		"The system of a single database comes from \"--ps1\" / \"--ps2\", or from \"ps1\" / \"ps2\" in its \n"
+		"file name when neither is given. \n"
+		"\n"
+		"Example 6 - Checksums of disc images (read once, all digests computed at the same time): \n"
+		"\n"
+		"psiso_tool --hash \"C:\\PS3ISO\\MyPS3ISO.iso\" \n"
+		"psiso_tool --hash --crc32 --sha1 \"C:\\PSXISO\\MyPS1ISO.bin\" \"C:\\PS2ISO\\MyPS2ISO.iso\" \n"
+		"psiso_tool --hash \"C:\\PSXISO\\MyPS1Game.cue\" \n"
+		"\n"
+		"Note: Without \"--crc32\", \"--md5\", \"--sha1\" or \"--sha256\" all of them are computed. \n"
+		"CUE sheets are hashed per track (the byte range of each track on its BIN file). \n"
+		"CSO / ZSO images are hashed uncompressed (same digests as the ISO). \n"
+		"\n"
+		"Example 7 - Identifying and verifying images with DAT files (Redump / No-Intro, XML or ClrMamePro): \n"
+		"\n"
+		"psiso_tool --identify \"D:\\PSXISO\" --dat \"dat\\Sony - PlayStation.dat\" \n"
+		"psiso_tool --identify \"D:\\ISO\\MyPS2ISO.iso\" --dat \"dat\\ps2.dat\" --dat \"dat\\ps2-extra.dat\" \n"
+		"\n"
+		"Note: Only images with the size of some DAT entry are read, one line is written per image: \n"
+		"OK / BAD (CRC32 matches, SHA-1 does not) / UNKNOWN / SKIP (size not in the DAT) / FAIL. \n"
+		"\n"
+		"Example 8 - Checking the EDC / ECC of every sector of a (MODE2 / 2352) image: \n"
+		"\n"
+		"psiso_tool --verify-sectors \"C:\\PSXISO\\MyPS1ISO.bin\" \n"
+		"psiso_tool --verify-sectors \"C:\\PSXISO\\MyPS1ISO.bin\" --jobs 4 \n"
+		"\n"
+		"Note: Bad sectors are listed by LBA and MSF, audio sectors (no sync) are skipped. \n"
+		"\n"
+		"Example 9 - Compressing / decompressing PSP and PS2 images (CSO v1 / v2 and ZSO): \n"
+		"\n"
+		"psiso_tool --compress \"C:\\PSPISO\\MyPSPISO.iso\" \n"
+		"psiso_tool --compress \"C:\\PSPISO\\MyPSPISO.iso\" \"D:\\PSP\\MyPSPISO.zso\" --jobs 4 \n"
+		"psiso_tool --compress \"C:\\PS2ISO\\MyPS2ISO.iso\" --v2 --block 16384 --level 6 \n"
+		"psiso_tool --decompress \"C:\\PSPISO\\MyPSPISO.cso\" \n"
+		"\n"
+		"Note: The format follows the output extension (.cso / .zso), or use \"--zso\" / \"--v2\". \n"
+		"New images are decompressed and compared with the source (SHA-1), \"--no-verify\" skips it. \n"
+		"\n"
+		"Example 10 - Extracting files from an image (ISO, BIN, CUE / BIN, CSO / ZSO): \n"
+		"\n"
+		"psiso_tool --extract \"C:\\PSPISO\\MyPSPISO.iso\" PSP_GAME/ICON0.PNG \"C:\\OUT\" \n"
+		"psiso_tool --extract \"C:\\PSXISO\\MyPS1ISO.cue\" all \"C:\\OUT\\MyPS1ISO\" \n"
+		"\n"
+		"Note: Files keep their path on the image under the output directory. On (MODE2 / 2352) images \n"
+		"Form 2 files (XA audio, STR video) are written as whole raw sectors, CD audio is skipped. \n"
+		"\n"
+		"Example 11 - Converting raw (MODE1 / 2352 or MODE2 / 2352) images to ISO (2048): \n"
+		"\n"
+		"psiso_tool --to-iso \"C:\\PSXISO\\MyPS1ISO.bin\" \n"
+		"psiso_tool --to-iso \"C:\\PS2ISO\\MyPS2ISO.cue\" \"D:\\PS2ISO\\MyPS2ISO.iso\" --jobs 4 \n"
+		"\n"
+		"Note: The EDC of every sector is checked, \"--force\" converts images with bad sectors anyway. \n"
+		"Images with audio or Form 2 (XA audio, STR video) sectors can not be converted. \n"
+		"\n"
+		"Example 12 - Rebuilding raw (2352) images from ISO (2048) images: \n"
+		"\n"
+		"psiso_tool --to-raw \"C:\\PSXISO\\MyPS1ISO.iso\" \n"
+		"psiso_tool --to-raw \"C:\\ISO\\MyCD.iso\" \"D:\\BIN\\MyCD.bin\" --mode1 --jobs 4 \n"
+		"\n"
+		"Note: Sync, header, EDC and ECC are generated for every sector. Sectors are Mode 2 Form 1 \n"
+		"(PS1 / PS2 CD) unless \"--mode1\" is given. \n"
+		"\n"
+		"Example 13 - Keeping the catalog of a library up to date as images are added / removed (Linux): \n"
+		"\n"
+		"psiso_tool --watch \"/srv/iso\" --catalog \"/srv/iso/library.cat\" \n"
+		"psiso_tool --watch \"/srv/upload\" --catalog \"/srv/upload.cat\" --jobs 2 --debounce 5000 \n"
+		"\n"
+		"Note: The library is scanned first, then only the images that were written, moved in or deleted \n"
+		"are probed / removed. Images are probed once no change was seen for \"--debounce\" ms (2000). \n"
 		"\n"
 		SEP_LINE_2
 		"\n"
@@ -114,22 +235,18 @@ void print_usage()
 
 #define _WIN32_WINNT 0x0501 // this is for XP
 #include <windows.h>
-#include <shellapi.h>
 #include <process.h>
 
-int upd_progress_bar(char* szPct, char* szProgressBar)
+#define PATH_SEP	'\\'
+#else
+#define PATH_SEP	'/'
+#endif
+
+int upd_progress_bar(int nPct, char* szProgressBar)
 {
-	// get percent from txt string as number
-	int nPct = 0;
-	for(nPct = 0; nPct <= 100; nPct++) 
-	{
-		char _szPct[256];
-		ZERO(_szPct);
-		sprintf(_szPct, "%d%%", nPct);
-		if(strncmp(szPct, _szPct, strlen(szPct))==0) {
-			break;
-		}
-	}
+	if(nPct < 0) nPct = 0;
+	if(nPct > 100) nPct = 100;
+
 	char szBar1[] = "[ ";
 	char szBar2[55] = "||||||||||||||||||||||||||||||||||||||||||||||||||";
 	char szBar3[] = " ]";
@@ -137,11 +254,10 @@ int upd_progress_bar(char* szPct, char* szProgressBar)
 	ZERO(szProgress);
 	
 	int nBars = nPct/2;
-	if(nBars < 0) nBars = 0;
-	for(; nBars <= 50; nBars++) {
+	for(; nBars < 50; nBars++) {
 		szBar2[nBars] = '-';
 	}
-	szBar2[51] = 0;
+	szBar2[50] = 0;
 
 	printf("\r                                                                   ");
 	printf("\r");
@@ -151,308 +267,969 @@ int upd_progress_bar(char* szPct, char* szProgressBar)
 
 	return nPct;
 }
+
+int scan_main(int argc, const char* argv[])
+{
+	int nSystem = ISO_SYSTEM_AUTO;
+	int nJobs = 0;
+	bool bVerbose = false;
+	const char* szDir = NULL;
+	const char* szWatch = NULL;
+	const char* szCatalog = NULL;
+	int nDebounceMs = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--ps1")==0) nSystem = ISO_SYSTEM_PS1;
+		else if(strcmp(argv[i], "--ps2")==0) nSystem = ISO_SYSTEM_PS2;
+		else if(strcmp(argv[i], "--ps3")==0) nSystem = ISO_SYSTEM_PS3;
+		else if(strcmp(argv[i], "--psp")==0) nSystem = ISO_SYSTEM_PSP;
+		else if(strcmp(argv[i], "--scan")==0 && i + 1 < argc) szDir = argv[++i];
+		else if(strcmp(argv[i], "--catalog")==0 && i + 1 < argc) szCatalog = argv[++i];
+		else if(strcmp(argv[i], "--watch")==0 && i + 1 < argc) szWatch = argv[++i];
+		else if(strcmp(argv[i], "--debounce")==0 && i + 1 < argc) nDebounceMs = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--jobs")==0 && i + 1 < argc) nJobs = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else {
+			print_usage(); return 1;
+		}
+	}
+
+	// live catalog, ex. psiso_tool --watch "/srv/iso" --catalog "/srv/iso/library.cat"
+	if(szWatch)
+	{
+		if(szDir || nJobs < 0 || nDebounceMs < 0) {
+			print_usage(); return 1;
+		}
+		int ret = psxWatchLibrary(szWatch, szCatalog, nSystem, nJobs, nDebounceMs, bVerbose);
+		if(ret == -1) {
+			printf("Error: Directory \"%s\" could not be watched, please verify the path. \n", szWatch);
+			return 1;
+		}
+		if(ret == -3) {
+			printf("Error: \"%s\" is not a valid catalog, it will not be overwritten. \n", szCatalog);
+			return 1;
+		}
+		return (ret == 0) ? 0 : 1;
+	}
+
+	// catalog listing, ex. psiso_tool --catalog "D:\ISO\library.cat" --verbose
+	if(!szDir && szCatalog && nJobs == 0 && nSystem == ISO_SYSTEM_AUTO)
+	{
+		psiso_catalog cat;
+		int ret = psxCatalogLoad(&cat, szCatalog);
+		if(ret == 0) {
+			printf("Error: Catalog \"%s\" does not exist, please verify the path. \n", szCatalog);
+			return 1;
+		}
+		if(ret < 0) {
+			printf("Error: \"%s\" is not a valid catalog. \n", szCatalog);
+			return 1;
+		}
+		psxCatalogPrint(&cat, bVerbose);
+		psxCatalogFree(&cat);
+		return 0;
+	}
+
+	// directory must always be present, system is detected per image unless specified
+	if(!szDir || nJobs < 0 || nDebounceMs) {
+		print_usage(); return 1;
+	}
+
+	int ret = psxScanLibrary(szDir, nSystem, nJobs, bVerbose, szCatalog);
+	if(ret == -1) {
+		printf("Error: Directory \"%s\" could not be opened, please verify the path. \n", szDir);
+		return 1;
+	}
+	if(ret == -2) {
+		printf("Error: Catalog \"%s\" could not be written. \n", szCatalog);
+		return 1;
+	}
+	if(ret == -3) {
+		printf("Error: Out of memory (or the worker threads could not be started) while scanning \"%s\". \n", szDir);
+		return 1;
+	}
+	if(ret == -4) {
+		printf("Error: \"%s\" is not a valid catalog, it will not be overwritten. \n", szCatalog);
+		return 1;
+	}
+	return 0;
+}
+
+// system of a title database from its file name ("ps1" / "ps2" in it), -1 if unknown
+static int titledb_system(const char* szPath)
+{
+	const char* szName = strrchr(szPath, PATH_SEP);
+	if(!szName) szName = strrchr(szPath, '/');
+	szName = szName ? szName + 1 : szPath;
+
+	int nSystem = -1;
+	for(const char* p = szName; *p; p++)
+	{
+		if((p[0] != 'p' && p[0] != 'P') || (p[1] != 's' && p[1] != 'S')) continue;
+		int nFound = (p[2] == '1') ? ISO_SYSTEM_PS1 : (p[2] == '2') ? ISO_SYSTEM_PS2 : -1;
+		if(nFound == -1) continue;
+		if(nSystem != -1 && nSystem != nFound) return -1;	// both, ambiguous
+		nSystem = nFound;
+	}
+	return nSystem;
+}
+
+int mkdb_main(int argc, const char* argv[])
+{
+	// psiso_tool --mkdb [--ps1 | --ps2] [in.txt out.bin]
+	const char* szFiles[2] = { NULL, NULL };
+	int nFiles = 0;
+	int nSystemParam = -1;
+
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--ps1")==0 && nSystemParam == -1) nSystemParam = ISO_SYSTEM_PS1;
+		else if(strcmp(argv[i], "--ps2")==0 && nSystemParam == -1) nSystemParam = ISO_SYSTEM_PS2;
+		else if(argv[i][0] != '-' && nFiles < 2) szFiles[nFiles++] = argv[i];
+		else {
+			print_usage(); return 1;
+		}
+	}
+
+	if(nFiles == 2) {
+		// the system is stored in the header, take it from the option or the file names
+		int nSystem = nSystemParam;
+		if(nSystem == -1) nSystem = titledb_system(szFiles[0]);
+		if(nSystem == -1) nSystem = titledb_system(szFiles[1]);
+		if(nSystem == -1) {
+			printf("Error: Could not tell the system of \"%s\", please add \"--ps1\" or \"--ps2\". \n", szFiles[0]);
+			return 1;
+		}
+		int nCount = psxTitleDBCompile(szFiles[0], szFiles[1], nSystem);
+		if(nCount < 0) {
+			printf("Error: Could not compile \"%s\" to \"%s\". \n", szFiles[0], szFiles[1]);
+			return 1;
+		}
+		printf("%s: %d titles \n", szFiles[1], nCount);
+		return 0;
+	}
+	if(nFiles != 0 || nSystemParam != -1) {
+		print_usage(); return 1;
+	}
+
+	const char* szText[2]	= { PS1_TITLE_DB, PS2_TITLE_DB };
+	const char* szBin[2]	= { PS1_TITLE_DB_BIN, PS2_TITLE_DB_BIN };
+	int nSystem[2]			= { ISO_SYSTEM_PS1, ISO_SYSTEM_PS2 };
+
+	int ret = 0;
+	for(int i = 0; i < 2; i++)
+	{
+		int nCount = psxTitleDBCompile(szText[i], szBin[i], nSystem[i]);
+		if(nCount < 0) {
+			printf("Error: Could not compile \"%s\" to \"%s\". \n", szText[i], szBin[i]);
+			ret = 1;
+			continue;
+		}
+		printf("%s: %d titles \n", szBin[i], nCount);
+	}
+	return ret;
+}
+
+// check if directories have ending slash and remove them...
+static void remove_ending_slash(char* szPath)
+{
+	size_t nLen = strlen(szPath);
+	if(nLen > 1 && szPath[nLen-1] == ' ' && szPath[nLen-2] == '"') {
+		// in case windows convert the last slash into a --> "
+		szPath[nLen-2] = 0;
+		nLen -= 2;
+	}
+	while(nLen > 1 && (szPath[nLen-1] == '\\' || szPath[nLen-1] == '/')) {
+		szPath[--nLen] = 0;
+	}
+}
+
+static void show_progress(void* pUser, uint64_t nDone, uint64_t nTotal)
+{
+	*(uint64_t*)pUser = nTotal;
+
+	char szProgress[256];
+	ZERO(szProgress);
+	upd_progress_bar(nTotal ? (int)(nDone * 100 / nTotal) : 100, szProgress);
+
+	printf("%s", szProgress);
+	if(nDone == nTotal) {
+		printf("\n");
+	}
+	fflush(stdout);
+#ifdef WIN
+	SetWindowText(GetConsoleWindow(), szProgress);
 #endif
+}
 
-int main(int argc, const char* argv[])
+int mkps3iso_main(int argc, const char* argv[])
 {
+	// psiso_tool --mkps3iso source_dir [destination_dir] [--trace file] [--layout ps3|tree]
+	const char* szArgs[2] = { NULL, NULL };
+	int nArgs = 0;
+	const char* szTraceFile = NULL;
+	int nLayout = PSISO_MKISO_LAYOUT_PS3;
+
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--trace")==0 && i + 1 < argc) szTraceFile = argv[++i];
+		else if(strcmp(argv[i], "--layout")==0 && i + 1 < argc && strcmp(argv[i + 1], "ps3")==0) { nLayout = PSISO_MKISO_LAYOUT_PS3; i++; }
+		else if(strcmp(argv[i], "--layout")==0 && i + 1 < argc && strcmp(argv[i + 1], "tree")==0) { nLayout = PSISO_MKISO_LAYOUT_TREE; i++; }
+		else if(strncmp(argv[i], "--", 2) != 0 && nArgs < 2) szArgs[nArgs++] = argv[i];
+		else {
+			print_usage(); return 1;
+		}
+	}
+	if(nArgs == 0) {
+		print_usage(); return 1;
+	}
+
+	printf("Preparing to create ISO... \n");
+
+	char szSource[1024];
+	char szDest[1024];
+	char szISO[2048 + 256];
+	char szParamSfo[1024 + 32];
+	ZERO(szSource);
+	ZERO(szDest);
+	ZERO(szISO);
+	ZERO(szParamSfo);
+
+	strncpy(szSource, szArgs[0], sizeof(szSource) - 1);
+	remove_ending_slash(szSource);
+
+	if(nArgs == 2) {
+		strncpy(szDest, szArgs[1], sizeof(szDest) - 1);
+
+		// force proper naming of iso when user pass a destination file instead of directory...
+		if(strstr(szDest, ".iso") || strstr(szDest, ".ISO"))
+		{
+			char* ch = strrchr(szDest, '\\');
+			if(!ch) {
+				ch = strrchr(szDest, '/');
+			}
+			if(ch) {
+				*ch = 0;
+			} else {
+				szDest[0] = 0;
+			}
+		}
+		remove_ending_slash(szDest);
+	}
+
+	printf(">> Source directory: %s \n"		, szSource);
+	printf(">> Destination directory: %s \n"	, szDest[0] ? szDest : ".");
+
+	sprintf(szParamSfo, "%s%cPS3_GAME%cPARAM.SFO", szSource, PATH_SEP, PATH_SEP);
+
+	printf("Checking PARAM.SFO... \n");
+
 #ifdef WIN
-	HWND hAppWnd = GetConsoleWindow();
+	FILE* fp = fopen(szParamSfo, "rb");
+	if(!fp) {
+#else
+	int fd = _open(szParamSfo, O_RDONLY);
+	if(fd == -1) {
 #endif
+		printf("Error: Cannot locate PARAM.SFO, please verify that the path contain a valid PS3 game directory. \n");
+		return 1;
+	}
 
-	char _argv[15][512];
+	char szTitleID[32];
+	char szTitle[128];
+	ZERO(szTitleID);
+	ZERO(szTitle);
 
-	for(int i = 0; i < argc; i++) {
-		memset(&_argv[i], 0, strlen(argv[i])+1);
-		strcpy(_argv[i], argv[i]);
+	// read it once, then take both fields from memory
+	uint8_t* pSFO = (uint8_t*)malloc(PSISO_SFO_MAX_SIZE);
+	psiso_sfo sfo;
+#ifdef WIN
+	if(pSFO && psxSFORead(&sfo, fp, 0, 0, pSFO, PSISO_SFO_MAX_SIZE)) {
+#else
+	if(pSFO && psxSFORead(&sfo, fd, 0, 0, pSFO, PSISO_SFO_MAX_SIZE)) {
+#endif
+		psxSFOGetString(&sfo, "TITLE_ID", szTitleID, sizeof(szTitleID));
+		psxSFOGetString(&sfo, "TITLE", szTitle, sizeof(szTitle));
 	}
+	SAFE_FREE(pSFO);
+#ifdef WIN
+	SAFE_FCLOSE(fp);
+#else
+	_close(fd);
+#endif
 
-	printf(
-		SEP_LINE_1
-		"PS ISO Tool v"APP_VER" (supports PS1/PS2/PS3/PSP) (CaptainCPS-X, 2013) \n"
-		SEP_LINE_1
-	);
+	const char* szPrefix = szDest[0] ? szDest : ".";
+
+	if(szTitleID[0] && szTitle[0]) {
+		printf("Successfully acquired TITLE_ID and TITLE from PARAM.SFO! \n");
+		printf(">> Title ID: %s \n", szTitleID);
+		printf(">> Title: %s \n", szTitle);
+		sprintf(szISO, "%s%c%s-[%s].iso", szPrefix, PATH_SEP, szTitleID, szTitle);
+	} else {
+		printf("Warning: Couldn't acquire TITLE_ID and TITLE from PARAM.SFO, probably is corrupted. \n");
+		const char* szName = strrchr(szSource, PATH_SEP);
+		if(!szName) szName = strrchr(szSource, '/');
+		szName = szName ? szName + 1 : szSource;
+		sprintf(szISO, "%s%c%s.iso", szPrefix, PATH_SEP, szName);
+	}
+	if(strlen(szTitleID) < 9) {
+		printf("Warning: No valid TITLE_ID, the ISO will not have the PS3 disc header. \n");
+	}
+	
+	printf(">> Output ISO file: %s \n", szISO);
+	printf("Creating PS3 ISO, please wait... \n");
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = true;
+
+	psiso_mkiso_opts opts;
+	psxMkISOOptsInit(&opts);
+	opts.szTitleID	= (strlen(szTitleID) >= 9) ? szTitleID : NULL;
+	opts.progress	= show_progress;
+	opts.nLayout	= nLayout;
+	opts.szTraceFile	= szTraceFile;
+
+	uint64_t nTotal = 0;
+	opts.pProgressUser = &nTotal;
+
+#ifdef WIN
+	HWND hAppWnd = GetConsoleWindow();
+	HMENU hmenu = GetSystemMenu(hAppWnd, FALSE);
+	EnableMenuItem(hmenu, SC_CLOSE, MF_GRAYED);
+#endif
+
+	double fStart = psxTimeNow();
+	int ret = psxMakeISO(&ctx, szSource, szISO, &opts);
+	double fElapsed = psxTimeNow() - fStart;
 
 #ifdef WIN
+	EnableMenuItem(hmenu, SC_CLOSE, MF_ENABLED);
 	SetWindowText(hAppWnd, "PS ISO Tool v"APP_VER" (supports PS1/PS2/PS3/PSP) (CaptainCPS-X, 2013)");
 #endif
 
-	bool bPatch = false;
+	printf(SEP_LINE_2);
 
-	// prog [opt] [file]
-	char szISO[1024];
-	ZERO(szISO);
+	if(!ret) {
+		printf("Error: PS3 ISO could not be created. \n");
+		return 1;
+	}
 
-	int nSystem = -1;
+	double fMB = (double)nTotal / (1024.0 * 1024.0);
+	printf("PS3 ISO created: %.2f MB in %.2f seconds (%.2f MB/s). \n", fMB, fElapsed, fElapsed > 0.0 ? fMB / fElapsed : 0.0);
+	printf(SEP_LINE_2);
 
-	// paramater 1 - 3 :	(system)(vervose)(patch) any order
-	// parameter 4:			(path) no exception
+	return 0;
+}
 
-	int nSystemParam = -1;
-	int nVerboseParam = -1;
-	int nPatchParam = -1;
+// Digests of [nOffset, nOffset + nLen) of szPath, written to stdout
+static int hash_one(psiso_ctx* ctx, const char* szPath, uint64_t nOffset, uint64_t nLen, uint32_t nAlgos)
+{
+	uint64_t nTotal = 0;
+	psiso_hash_result res;
 
-	if(argc > 1 && argc <= 5 ) 
+	double fStart = psxTimeNow();
+	if(!psxHashFileRange(ctx, szPath, nOffset, nLen, nAlgos, &res, show_progress, &nTotal)) {
+		return 0;
+	}
+	double fElapsed = psxTimeNow() - fStart;
+
+	char szHex[PSISO_SHA256_SIZE * 2 + 1];
+	if(nAlgos & PSISO_HASH_CRC32) {
+		printf("CRC32: %08x \n", res.nCRC32);
+	}
+	if(nAlgos & PSISO_HASH_MD5) {
+		psxHashToHex(res.md5, PSISO_MD5_SIZE, szHex);
+		printf("MD5: %s \n", szHex);
+	}
+	if(nAlgos & PSISO_HASH_SHA1) {
+		psxHashToHex(res.sha1, PSISO_SHA1_SIZE, szHex);
+		printf("SHA-1: %s \n", szHex);
+	}
+	if(nAlgos & PSISO_HASH_SHA256) {
+		psxHashToHex(res.sha256, PSISO_SHA256_SIZE, szHex);
+		printf("SHA-256: %s \n", szHex);
+	}
+
+	double fMB = (double)res.nBytes / (1024.0 * 1024.0);
+	printf("Hashed %.2f MB in %.2f seconds (%.2f MB/s). \n", fMB, fElapsed, fElapsed > 0.0 ? fMB / fElapsed : 0.0);
+	return 1;
+}
+
+int hash_main(int argc, const char* argv[])
+{
+	// psiso_tool --hash [--crc32] [--md5] [--sha1] [--sha256] [--verbose] file [file ...]
+	uint32_t nAlgos = 0;
+	bool bVerbose = false;
+	int nFiles = 0;
+
+	for(int i = 2; i < argc; i++)
 	{
-#ifdef WIN
-		// Create ISO with ImgBurn (WINDOWS ONLY)
-		if( ((argc == 3) && (strncmp(_argv[1], "--mkps3iso", strlen("--mkps3iso"))==0)) ||	// No destination dir specified
-			((argc == 4) && (strncmp(_argv[1], "--mkps3iso", strlen("--mkps3iso"))==0)) )	// destination dir specified
-		{	
-			printf("Preparing to create ISO (using ImgBurn)... \n");
-			
-			char szCurrentPath[512];
-			ZERO(szCurrentPath);
-			
-			if (!GetCurrentDir(szCurrentPath, sizeof(szCurrentPath))) {
-				// error...
-				printf("Error: Problem acquiring current working directory. Please report this. \n");
-				return 0;
+		if(strcmp(argv[i], "--crc32")==0) nAlgos |= PSISO_HASH_CRC32;
+		else if(strcmp(argv[i], "--md5")==0) nAlgos |= PSISO_HASH_MD5;
+		else if(strcmp(argv[i], "--sha1")==0) nAlgos |= PSISO_HASH_SHA1;
+		else if(strcmp(argv[i], "--sha256")==0) nAlgos |= PSISO_HASH_SHA256;
+		else if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else if(strncmp(argv[i], "--", 2) != 0) nFiles++;
+		else {
+			print_usage(); return 1;
+		}
+	}
+	if(nFiles == 0) {
+		print_usage(); return 1;
+	}
+	if(nAlgos == 0) {
+		nAlgos = PSISO_HASH_ALL;
+	}
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = bVerbose;
+
+	int ret = 0;
+	for(int i = 2; i < argc; i++)
+	{
+		if(strncmp(argv[i], "--", 2) == 0) continue;
+
+		printf("ISO file: %s \n", argv[i]);
+
+		// CUE sheets get one set of digests per track (Redump lists every track file)
+		if(psxCUEIsSheet(argv[i]))
+		{
+			psiso_cue cue;
+			if(!psxCUELoad(&ctx, &cue, argv[i])) {
+				printf("Error: CUE sheet \"%s\" could not be loaded. \n", argv[i]);
+				printf(SEP_LINE_2);
+				ret = 1;
+				continue;
 			}
-			szCurrentPath[sizeof(szCurrentPath) - 1] = '\0';
-
-			printf(">> Current Working Path: %s \n", szCurrentPath);
-
-			if(argc==3) 
-			{ 
-				// check source path only...
-				if(!strchr(_argv[2], '\\') && !strchr(_argv[2], '/')) 
-				{
-					// directory appears to be on root of application...
-					char szTemp[256];
-					ZERO(szTemp);
-					sprintf(szTemp, "%s\\%s", szCurrentPath, _argv[2]);
-					strcpy(_argv[2], szTemp);
-				}
-			} else {
-				// check valid source and destination paths...
-				if( !strchr(_argv[2], '\\') && !strchr(_argv[2], '/') )
-				{
-					// directory appears to be on root of application...
-					char szTemp[256];
-					ZERO(szTemp);
-					sprintf(szTemp, "%s\\%s", szCurrentPath, _argv[2]);
-					strcpy(_argv[2], szTemp);
-				}
-				if(	!strchr(_argv[3], '\\') && !strchr(_argv[3], '/') ) 
-				{
-					// directory appears to be on root of application...
-					char szTemp[256];
-					ZERO(szTemp);
-					sprintf(szTemp, "%s\\%s", szCurrentPath, _argv[3]);
-					strcpy(_argv[3], szTemp);
+			for(uint32_t t = 0; t < cue.nTracks; t++)
+			{
+				const psiso_cue_track* track = &cue.tracks[t];
+				const char* szFile = cue.pFiles[track->nFile].szPath;
+				printf("Track %02u (%s): %s \n", track->nNumber, psxCUETrackType(track->nType), szFile);
+
+				if(!hash_one(&ctx, szFile, track->nFileOffset, track->nFileLen, nAlgos)) {
+					printf("Error: Track %02u could not be hashed. \n", track->nNumber);
+					ret = 1;
 				}
+				printf(SEP_LINE_2);
 			}
+			psxCUEFree(&cue);
+			continue;
+		}
 
-			char szSource[512];
-			char szDest[512];
-			char szParamSfo[512];
-			char szCommand[1024];
-			ZERO(szDest);
-			ZERO(szSource);
-			ZERO(szParamSfo);
-			ZERO(szCommand);
+		if(!hash_one(&ctx, argv[i], 0, (uint64_t)-1, nAlgos)) {
+			printf("Error: ISO file \"%s\" could not be hashed. \n", argv[i]);
+			ret = 1;
+		}
+		printf(SEP_LINE_2);
+	}
 
-			strcpy(szSource, _argv[2]);
-	
-			// check if directories have ending slash and remove them...
-			if( (szSource[strlen(szSource)-1] == '\\' || szSource[strlen(szSource)-1] == '/')) 
-			{
-				szSource[strlen(szSource)-1] = 0; // remove ending slash
-			}
-			if( (szSource[strlen(szSource)-1] == ' ' && szSource[strlen(szSource)-2] == '"')) 
-			{	
-				// in case windows convert the last slash into a --> "
-				szSource[strlen(szSource)-2] = 0;				
-			}
+#ifdef WIN
+	SetWindowText(GetConsoleWindow(), "PS ISO Tool v"APP_VER" (supports PS1/PS2/PS3/PSP) (CaptainCPS-X, 2013)");
+#endif
+	return ret;
+}
 
-			if(argc == 4) {
-				// force proper naming of iso when user pass a destination file instead of directory...
-				if(strstr(_argv[3], ".iso") || strstr(_argv[3], ".ISO"))
-				{
-					char* ch = NULL;					
-					ch = strrchr(_argv[3], '\\');
-
-					if(!ch) {
-						ch = strrchr(_argv[3], '/');
-					}
-
-					if(ch) {
-						_argv[3][ch-_argv[3]] = 0;
-						strcpy(szDest, _argv[3]);
-					}
-				} else {
-					strcpy(szDest, _argv[3]);
-				}
+int identify_main(int argc, const char* argv[])
+{
+	// psiso_tool --identify path --dat file [--dat file ...] [--verbose]
+	const char* szPath = NULL;
+	bool bVerbose = false;
+	int nDATs = 0;
 
-				// check if directories have ending slash and remove them...
-				if( (szDest[strlen(szDest)-1] == '\\' || szDest[strlen(szDest)-1] == '/')) 
-				{
-					szDest[strlen(szDest)-1] = 0; // remove ending slash
-				}
-				if( (szDest[strlen(szDest)-1] == ' ' && szDest[strlen(szDest)-2] == '"')) 
-				{	
-					// in case windows convert the last slash into a --> "
-					szDest[strlen(szDest)-2] = 0;			
-				}
+	psiso_dat dat;
+	psxDATInit(&dat);
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--identify")==0 && i + 1 < argc) szPath = argv[++i];
+		else if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else if(strcmp(argv[i], "--dat")==0 && i + 1 < argc)
+		{
+			int nRoms = psxDATLoad(&dat, argv[++i]);
+			if(nRoms < 0) {
+				printf("Error: DAT file \"%s\" could not be loaded. \n", argv[i]);
+				psxDATFree(&dat);
+				return 1;
 			}
+			printf("%s: %d ROMs \n", argv[i], nRoms);
+			nDATs++;
+		}
+		else {
+			psxDATFree(&dat);
+			print_usage(); return 1;
+		}
+	}
+	if(!szPath || nDATs == 0) {
+		psxDATFree(&dat);
+		print_usage(); return 1;
+	}
 
-			printf(">> Source directory: %s \n"		, szSource);
-			printf(">> Destination directory: %s \n"	, szDest);
+	// a directory is walked like --scan does, anything else is a single image
+	psiso_file_list list;
+	if(!psxScanDirectory(szPath, &list)) {
+		psxFileListFree(&list);
+		char* szCopy = (char*)malloc(strlen(szPath) + 1);
+		list.pszPaths = (char**)malloc(sizeof(char*));
+		if(!szCopy || !list.pszPaths) {
+			SAFE_FREE(szCopy);
+			psxFileListFree(&list);
+			psxDATFree(&dat);
+			return 1;
+		}
+		strcpy(szCopy, szPath);
+		list.pszPaths[0] = szCopy;
+		list.nCount = list.nCapacity = 1;
+	}
 
-			sprintf(szParamSfo, "%s\\PS3_GAME\\PARAM.SFO", szSource);
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = bVerbose;
 
-			printf("Checking PARAM.SFO... \n");
+	uint32_t nCount[5] = { 0, 0, 0, 0, 0 }; // PSISO_DAT_*, failed
+	uint64_t nHashed = 0;
+	double fStart = psxTimeNow();
 
-			FILE* fp = fopen(szParamSfo, "rb");
+	for(uint32_t i = 0; i < list.nCount; i++)
+	{
+		const char* szImage = list.pszPaths[i];
 
-			if(fp) 
-			{
-				fseek(fp, 0, SEEK_END);
-				size_t nLen = ftell(fp);
-				fseek(fp, 0, SEEK_SET);
-
-				char szTitleID[32];
-				char szTitle[128];
-				ZERO(szTitleID);
-				ZERO(szTitle);
-
-				ParseSFO(fp, 0, nLen, (char*)"TITLE_ID", (char*)szTitleID);
-				fseek(fp, 0, SEEK_SET);
-				ParseSFO(fp, 0, nLen, (char*)"TITLE", (char*)szTitle);
-
-				if(szTitleID[0] && szTitle[0]) {
-					printf("Successfully acquired TITLE_ID and TITLE from PARAM.SFO! \n");
-					printf(">> Title ID: %s \n", szTitleID);
-					printf(">> Title: %s \n", szTitle);
-					if(argc == 3) {
-						// create iso on program directory...
-						sprintf(szDest, "%s\\%s-[%s].iso", szCurrentPath, szTitleID, szTitle);
-					} else {
-						char szTemp[512];
-						ZERO(szTemp);
-						// create iso on directory specified by user...
-						sprintf(szTemp, "\\%s-[%s].iso", szTitleID, szTitle);
-						strcat(szDest, szTemp);
-					}
-				} else {
-					printf("Warning: Couldn't acquire TITLE_ID and TITLE from PARAM.SFO, probably is corrupted. \n");
-					if(argc == 3) {
-						// create iso on program directory...
-						sprintf(szDest, "%s\\%s.iso", szCurrentPath, szSource); 
-					} else {
-						char szTemp[512];
-						ZERO(szTemp);
-						// create iso on directory specified by user...
-						sprintf(szTemp, "\\%s.iso", szSource);
-						strcat(szDest, szTemp);
-					}
-				}
-				SAFE_FCLOSE(fp);
-			} else {
-				printf("Error: Cannot locate PARAM.SFO, please verify that the path contain a valid PS3 game directory. \n");
-				return 0;
+		psiso_dat_match match;
+		if(!psxDATIdentify(&ctx, &dat, szImage, &match)) {
+			printf("FAIL\t\t\t%s\n", szImage);
+			nCount[4]++;
+			continue;
+		}
+		nCount[match.nStatus]++;
+		if(match.nStatus != PSISO_DAT_SKIPPED) {
+			nHashed += match.nSize;
+		}
+
+		switch(match.nStatus)
+		{
+			case PSISO_DAT_MATCH:
+			case PSISO_DAT_BAD:
+				printf("%s\t%s\t%s\t%s\n", (match.nStatus == PSISO_DAT_MATCH) ? "OK" : "BAD",
+					psxDATString(&dat, match.rom->nGame), psxDATString(&dat, match.rom->nName), szImage);
+				break;
+			case PSISO_DAT_UNKNOWN:
+				printf("UNKNOWN\t\t\t%s\n", szImage);
+				break;
+			default:
+				printf("SKIP\t\t\t%s\n", szImage);
+				break;
+		}
+		fflush(stdout);
+	}
+
+	double fElapsed = psxTimeNow() - fStart;
+	double fMB = (double)nHashed / (1024.0 * 1024.0);
+
+	printf(SEP_LINE_2);
+	printf("%u images: %u OK, %u BAD, %u UNKNOWN, %u skipped by size, %u failed \n", list.nCount,
+		nCount[PSISO_DAT_MATCH], nCount[PSISO_DAT_BAD], nCount[PSISO_DAT_UNKNOWN], nCount[PSISO_DAT_SKIPPED], nCount[4]);
+	printf("Hashed %.2f MB in %.2f seconds (%.2f MB/s). \n", fMB, fElapsed, fElapsed > 0.0 ? fMB / fElapsed : 0.0);
+
+	psxFileListFree(&list);
+	psxDATFree(&dat);
+	return (nCount[PSISO_DAT_BAD] || nCount[4]) ? 1 : 0;
+}
+
+static const char* szSectorType[PSISO_SECTOR_TYPES] = {
+	"Audio", "Mode 0", "Mode 1", "Mode 2 Form 1", "Mode 2 Form 2"
+};
+
+static void print_bad_sector(void* pUser, uint32_t nLBA, int nType, uint32_t nErrors)
+{
+	(void)pUser;
+	uint32_t nAddress = nLBA + 150;
+
+	printf("BAD\t%u\t%02u:%02u:%02u\t%s\t%s%s%s%s%s\n", nLBA, nAddress / (60 * 75), (nAddress / 75) % 60, nAddress % 75, szSectorType[nType],
+		(nErrors & PSISO_SECTOR_ERR_EDC) ? "EDC " : "",
+		(nErrors & PSISO_SECTOR_ERR_ECC_P) ? "ECC-P " : "",
+		(nErrors & PSISO_SECTOR_ERR_ECC_Q) ? "ECC-Q " : "",
+		(nErrors & PSISO_SECTOR_ERR_MODE) ? "MODE " : "",
+		(nErrors & PSISO_SECTOR_ERR_SUBHEADER) ? "SUBHEADER " : "");
+}
+
+int verify_sectors_main(int argc, const char* argv[])
+{
+	// psiso_tool --verify-sectors image [--jobs N] [--verbose]
+	const char* szPath = NULL;
+	int nJobs = 0;
+	bool bVerbose = false;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--verify-sectors")==0 && i + 1 < argc) szPath = argv[++i];
+		else if(strcmp(argv[i], "--jobs")==0 && i + 1 < argc) nJobs = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else {
+			print_usage(); return 1;
+		}
+	}
+	if(!szPath || nJobs < 0) {
+		print_usage(); return 1;
+	}
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = bVerbose;
+
+	double fStart = psxTimeNow();
+
+	psiso_verify_result res;
+	if(!psxVerifySectors(&ctx, szPath, nJobs, &res, print_bad_sector, NULL)) {
+		return 1;
+	}
+
+	double fElapsed = psxTimeNow() - fStart;
+	double fMB = (double)res.nSectors * PSISO_RAW_SECTOR_SIZE / (1024.0 * 1024.0);
+
+	printf(SEP_LINE_2);
+	for(int i = 0; i < PSISO_SECTOR_TYPES; i++) {
+		if(res.nTypes[i]) printf("%-14s %u sectors \n", szSectorType[i], res.nTypes[i]);
+	}
+	printf("%u sectors, %u bad. \n", res.nSectors, res.nBad);
+	printf("Verified %.2f MB in %.2f seconds (%.2f MB/s). \n", fMB, fElapsed, fElapsed > 0.0 ? fMB / fElapsed : 0.0);
+
+	return res.nBad ? 1 : 0;
+}
+
+// szPath with its extension replaced by szExt (Ex. ".cso")
+static void replace_ext(const char* szPath, const char* szExt, char* szOut, size_t nOutSize)
+{
+	snprintf(szOut, nOutSize, "%s", szPath);
+	char* pExt = strrchr(szOut, '.');
+	char* pName = strrchr(szOut, PATH_SEP);
+	if(!pName) pName = strrchr(szOut, '/');
+	if(pExt && (!pName || pExt > pName)) *pExt = 0;
+	if(strlen(szOut) + strlen(szExt) < nOutSize) strcat(szOut, szExt);
+}
+
+int compress_main(int argc, const char* argv[], bool bCompress)
+{
+	// psiso_tool --compress image [output] [--zso] [--v2] [--block N] [--level N] [--jobs N] [--no-verify] [--verbose]
+	// psiso_tool --decompress image [output] [--jobs N] [--verbose]
+	const char* szArgs[2] = { NULL, NULL };
+	int nArgs = 0;
+	bool bVerbose = false;
+	bool bZSO = false;
+
+	psiso_cso_opts opts;
+	psxCSOOptsInit(&opts);
+
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--jobs")==0 && i + 1 < argc) opts.nThreads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else if(bCompress && strcmp(argv[i], "--zso")==0) bZSO = true;
+		else if(bCompress && strcmp(argv[i], "--v2")==0) opts.nVersion = 2;
+		else if(bCompress && strcmp(argv[i], "--block")==0 && i + 1 < argc) opts.nBlockSize = (uint32_t)atoi(argv[++i]);
+		else if(bCompress && strcmp(argv[i], "--level")==0 && i + 1 < argc) opts.nLevel = atoi(argv[++i]);
+		else if(bCompress && strcmp(argv[i], "--no-verify")==0) opts.bVerify = false;
+		else if(strncmp(argv[i], "--", 2) != 0 && nArgs < 2) szArgs[nArgs++] = argv[i];
+		else {
+			print_usage(); return 1;
+		}
+	}
+	if(!nArgs || opts.nThreads < 0 || opts.nLevel < 1 || opts.nLevel > 9) {
+		print_usage(); return 1;
+	}
+
+	char szOut[1024];
+	ZERO(szOut);
+	if(szArgs[1]) {
+		snprintf(szOut, sizeof(szOut), "%s", szArgs[1]);
+	}
+
+	if(bCompress)
+	{
+		const char* pExt = strrchr(szOut, '.');
+		if(pExt && (strcmp(pExt, ".zso") == 0 || strcmp(pExt, ".ZSO") == 0)) bZSO = true;
+		if(bZSO) {
+			if(opts.nVersion == 2) {
+				printf("Error: ZSO images are always version 1, \"--v2\" is for CSO. \n");
+				return 1;
 			}
-			
-			printf(">> Output ISO file: %s \n", szDest);
-
-			printf("Booting ImgBurn for PS3 ISO creation, please wait... \n");
-
-			sprintf(szCommand, 				
-				"/MODE BUILD "
-				"/BUILDMODE IMAGEFILE "
-				"/SRC \"%s\" "
-				"/DEST \"%s\" "
-				"/FILESYSTEM \"ISO9660 + Joliet\" "
-				"/VOLUMELABEL \"PS3VOLUME\" "
-				"/OVERWRITE \"YES\" "
-				"/CLOSE "
-				"/NOIMAGEDETAILS "
-				"/ROOTFOLDER \"YES\" "
-				"/START "
-				"/SETTINGS \"%s\\imgburn\\ImgBurn.ini\" "
-				"/PORTABLE",
-				szSource, 
-				szDest,
-				szCurrentPath
-			);
-			char szImgBurn[512];
-			ZERO(szImgBurn);
-			sprintf(szImgBurn, "\"%s\\imgburn\\ImgBurn.exe\"", szCurrentPath);
-			ShellExecute(NULL, "open", szImgBurn, szCommand, NULL, SW_SHOWMINIMIZED);
-			
-			HMENU hmenu = GetSystemMenu(hAppWnd, FALSE);
-		    EnableMenuItem(hmenu, SC_CLOSE, MF_GRAYED);
-			
-			bool bFound = false;
-			bool bDone = false;
-			HWND hWnd = NULL;
-			while(1) 
-			{
-				if(!bFound) 
-				{ 
-					for(int i =0; i <= 100; i++) {
-						char szSearch[64];
-						ZERO(szSearch);
-						sprintf(szSearch, "%d%% - ImgBurn", i);
-						hWnd = (HWND)FindWindow(NULL, szSearch);
-						if(hWnd) {
-							bFound = true;
-							break;
-						}
-					}
-				}
-				if(!hWnd) continue;
-
-				char szBuf[2048];
-				ZERO(szBuf);
-				LONG lResult;
-				lResult = SendMessage(hWnd, WM_GETTEXT, sizeof( szBuf ) / sizeof( szBuf[0] ), (LPARAM)szBuf );
-				
-				if(lResult && !bDone) {
-					char* ch = strrchr(szBuf, '-');
-					if(ch) {
-						szBuf[(ch-szBuf)-1]=0;
-						char szDisplayProgress[256];
-						ZERO(szDisplayProgress);
-						upd_progress_bar(szBuf, szDisplayProgress);
-						
-						printf("%s", szDisplayProgress);
-						SetWindowText(hAppWnd, szDisplayProgress);
-					} else {
-						bDone = true;				
-					}
-				}
-				
-				// Finished ? (todo: do more checks, to detect errors)
-				if(bDone)
-				{
-					printf("\r100%% - [ |||||||||||||||||||||||||||||||||||||||||||||||||| ]    \n");
-					printf(SEP_LINE_2);
-					break;
-				}
-				Sleep((unsigned long)((1.0/60.0)*1000.0));
-			}			
+			opts.nFormat = PSISO_CSO_FORMAT_ZSO;
+		}
+		if(!szOut[0]) replace_ext(szArgs[0], bZSO ? ".zso" : ".cso", szOut, sizeof(szOut));
+	}
+	else if(!szOut[0]) {
+		replace_ext(szArgs[0], ".iso", szOut, sizeof(szOut));
+	}
+
+	if(strcmp(szOut, szArgs[0]) == 0) {
+		printf("Error: The output file would overwrite the source image. \n");
+		return 1;
+	}
+
+	printf("%s: %s \n", bCompress ? "Compressing" : "Decompressing", szArgs[0]);
+	printf(">> Output file: %s \n", szOut);
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = bVerbose;
+
+	uint64_t nTotal = 0;
+	opts.progress = show_progress;
+	opts.pProgressUser = &nTotal;
+
+	psiso_cso_stats stats;
+	double fStart = psxTimeNow();
+	int ret = bCompress ? psxCSOCompress(&ctx, szArgs[0], szOut, &opts, &stats) : psxCSODecompress(&ctx, szArgs[0], szOut, &opts, &stats);
+	double fElapsed = psxTimeNow() - fStart;
+
+	printf(SEP_LINE_2);
+	if(!ret) {
+		printf("Error: \"%s\" could not be %s. \n", szArgs[0], bCompress ? "compressed" : "decompressed");
+		return 1;
+	}
+
+	char szHex[PSISO_SHA1_SIZE * 2 + 1];
+	psxHashToHex(stats.sha1, PSISO_SHA1_SIZE, szHex);
+
+	double fMB = (double)stats.nImageBytes / (1024.0 * 1024.0);
+	if(bCompress) {
+		printf("Blocks: %u (%u deflate, %u LZ4, %u stored) \n", stats.nBlocks, stats.nDeflate, stats.nLZ4, stats.nPlain);
+		printf("Size: %.2f MB -> %.2f MB (%.1f%%) \n", fMB, (double)stats.nOutBytes / (1024.0 * 1024.0),
+			stats.nImageBytes ? (double)stats.nOutBytes * 100.0 / (double)stats.nImageBytes : 0.0);
+	}
+	printf("SHA-1: %s %s\n", szHex, stats.bVerified ? "(verified) " : "");
+	printf("%s %.2f MB in %.2f seconds (%.2f MB/s) using %d threads. \n", bCompress ? "Compressed" : "Decompressed",
+		fMB, fElapsed, fElapsed > 0.0 ? fMB / fElapsed : 0.0, stats.nThreads);
+
+	return 0;
+}
+
+int extract_main(int argc, const char* argv[])
+{
+	// psiso_tool --extract image <path|all> outdir [--verbose]
+	const char* szArgs[3] = { NULL, NULL, NULL };
+	int nArgs = 0;
+	bool bVerbose = false;
+
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else if(strncmp(argv[i], "--", 2) != 0 && nArgs < 3) szArgs[nArgs++] = argv[i];
+		else {
+			print_usage(); return 1;
+		}
+	}
+	if(nArgs != 3) {
+		print_usage(); return 1;
+	}
+
+	char szOutDir[1024];
+	snprintf(szOutDir, sizeof(szOutDir), "%s", szArgs[2]);
+	remove_ending_slash(szOutDir);
+
+	printf("Extracting: %s (%s) \n", szArgs[0], szArgs[1]);
+	printf(">> Output directory: %s \n", szOutDir);
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = bVerbose;
+
+	psiso_extract_stats stats;
+	double fStart = psxTimeNow();
+	int ret = psxExtract(&ctx, szArgs[0], szArgs[1], szOutDir, &stats);
+	double fElapsed = psxTimeNow() - fStart;
+
+	double fMB = (double)stats.nBytes / (1024.0 * 1024.0);
 
-			EnableMenuItem(hmenu, SC_CLOSE, MF_ENABLED);
+	printf(SEP_LINE_2);
+	printf("Extracted %u files (%u directories, %u raw, %u skipped) %.2f MB in %.2f seconds (%.2f MB copied by the kernel). \n",
+		stats.nFiles, stats.nDirs, stats.nRawFiles, stats.nSkipped, fMB, fElapsed, (double)stats.nKernelBytes / (1024.0 * 1024.0));
 
-			printf("Preparing to patch the created PS3 ISO... \n");
-			printf(SEP_LINE_2);
+	if(!ret) {
+		printf("Error: \"%s\" could not be extracted. \n", szArgs[1]);
+		return 1;
+	}
+	return 0;
+}
 
-			SetWindowText(hAppWnd, "PS ISO Tool v"APP_VER" (supports PS1/PS2/PS3/PSP) (CaptainCPS-X, 2013) \n");
+int convert_main(int argc, const char* argv[], bool bToRaw)
+{
+	// psiso_tool --to-iso image [output] [--jobs N] [--force] [--verbose]
+	// psiso_tool --to-raw image [output] [--mode1] [--jobs N] [--verbose]
+	const char* szArgs[2] = { NULL, NULL };
+	int nArgs = 0;
+	bool bVerbose = false;
 
-			memset(_argv[1], 0, 512);
-			memset(_argv[2], 0, 512);
-			memset(_argv[3], 0, 512);
-			memset(_argv[4], 0, 512);
+	psiso_convert_opts opts;
+	psxConvertOptsInit(&opts);
 
-			strcpy(_argv[1], "--ps3");
-			strcpy(_argv[2], "--verbose");
-			strcpy(_argv[3], "--patch");
-			strcpy(_argv[4], szDest);
-			*_argv[5] = 0;
-			argc = 5;
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--jobs")==0 && i + 1 < argc) opts.nThreads = atoi(argv[++i]);
+		else if(!bToRaw && strcmp(argv[i], "--force")==0) opts.bForce = true;
+		else if(bToRaw && strcmp(argv[i], "--mode1")==0) opts.nSectorType = PSISO_SECTOR_MODE1;
+		else if(strcmp(argv[i], "--verbose")==0 || strcmp(argv[i], "--v")==0) bVerbose = true;
+		else if(strncmp(argv[i], "--", 2) != 0 && nArgs < 2) szArgs[nArgs++] = argv[i];
+		else {
+			print_usage(); return 1;
 		}
+	}
+	if(!nArgs || opts.nThreads < 0) {
+		print_usage(); return 1;
+	}
+
+	char szOut[1024];
+	if(szArgs[1]) {
+		snprintf(szOut, sizeof(szOut), "%s", szArgs[1]);
+	} else {
+		replace_ext(szArgs[0], bToRaw ? ".bin" : ".iso", szOut, sizeof(szOut));
+	}
+
+	if(strcmp(szOut, szArgs[0]) == 0) {
+		printf("Error: The output file would overwrite the source image. \n");
+		return 1;
+	}
+
+	printf("Converting: %s \n", szArgs[0]);
+	printf(">> Output file: %s \n", szOut);
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.bVerbose = bVerbose;
+
+	uint64_t nTotal = 0;
+	opts.progress = show_progress;
+	opts.pProgressUser = &nTotal;
+
+	psiso_convert_stats stats;
+	double fStart = psxTimeNow();
+	int ret = bToRaw ? psxConvertToRaw(&ctx, szArgs[0], szOut, &opts, &stats) : psxConvertToISO(&ctx, szArgs[0], szOut, &opts, &stats);
+	double fElapsed = psxTimeNow() - fStart;
+
+	printf(SEP_LINE_2);
+	if(!ret) {
+		printf("Error: \"%s\" could not be converted. \n", szArgs[0]);
+		return 1;
+	}
+
+	double fMB = (double)stats.nSectors * PSISO_RAW_SECTOR_SIZE / (1024.0 * 1024.0);
+	for(int i = 0; i < PSISO_SECTOR_TYPES; i++) {
+		if(stats.nTypes[i]) printf("%-14s %u sectors \n", szSectorType[i], stats.nTypes[i]);
+	}
+	if(!bToRaw) {
+		printf("%u sectors (%u zero filled), %u with a bad EDC. \n", stats.nWritten, stats.nZero, stats.nBadEDC);
+	}
+	printf("Converted %.2f MB in %.2f seconds (%.2f MB/s) using %d threads. \n", fMB, fElapsed,
+		fElapsed > 0.0 ? fMB / fElapsed : 0.0, stats.nThreads);
+
+	return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+#ifdef WIN
+	HWND hAppWnd = GetConsoleWindow();
 #endif
+
+	char _argv[15][512];
+
+	for(int i = 0; i < argc && i < 15; i++) {
+		memset(&_argv[i], 0, sizeof(_argv[i]));
+		strncpy(_argv[i], argv[i], sizeof(_argv[i]) - 1);
+	}
+
+	printf(
+		SEP_LINE_1
+		"PS ISO Tool v"APP_VER" (supports PS1/PS2/PS3/PSP) (CaptainCPS-X, 2013) \n"
+		SEP_LINE_1
+	);
+
+#ifdef WIN
+	SetWindowText(hAppWnd, "PS ISO Tool v"APP_VER" (supports PS1/PS2/PS3/PSP) (CaptainCPS-X, 2013)");
+#endif
+
+	// Batch scan of a whole library (or listing / watching of its catalog)
+	// ex. psiso_tool --ps2 --scan "D:\PS2ISO" --jobs 4
+	for(int i = 1; i < argc; i++) 
+	{
+		if(strcmp(argv[i], "--scan")==0 || strcmp(argv[i], "--catalog")==0 || strcmp(argv[i], "--watch")==0) {
+			return scan_main(argc, argv);
+		}
+	}
+
+	// Title database compiler
+	// ex. psiso_tool --mkdb
+	if(argc > 1 && strcmp(argv[1], "--mkdb")==0) {
+		return mkdb_main(argc, argv);
+	}
+
+	// Create a PS3 ISO from a game directory
+	// ex. psiso_tool --mkps3iso "C:\GAMES\BCUS98174-[The Last of Us]" "C:\DESTINATION_DIR"
+	if(argc > 1 && strcmp(argv[1], "--mkps3iso")==0) {
+		return mkps3iso_main(argc, argv);
+	}
+
+	// Checksums of whole images
+	// ex. psiso_tool --hash --sha1 "C:\PS3ISO\MyPS3ISO.iso"
+	if(argc > 1 && strcmp(argv[1], "--hash")==0) {
+		return hash_main(argc, argv);
+	}
+
+	// Identify images by their contents with DAT files
+	// ex. psiso_tool --identify "D:\PSXISO" --dat "dat\Sony - PlayStation.dat"
+	for(int i = 1; i < argc; i++) 
+	{
+		if(strcmp(argv[i], "--identify")==0) {
+			return identify_main(argc, argv);
+		}
+	}
+
+	// EDC / ECC check of raw images
+	// ex. psiso_tool --verify-sectors "C:\PSXISO\MyPS1ISO.bin"
+	for(int i = 1; i < argc; i++) 
+	{
+		if(strcmp(argv[i], "--verify-sectors")==0) {
+			return verify_sectors_main(argc, argv);
+		}
+	}
+
+	// CSO / ZSO conversion
+	// ex. psiso_tool --compress "C:\PSPISO\MyPSPISO.iso"
+	if(argc > 1 && (strcmp(argv[1], "--compress")==0 || strcmp(argv[1], "--decompress")==0)) {
+		return compress_main(argc, argv, strcmp(argv[1], "--compress")==0);
+	}
+
+	// File extraction
+	// ex. psiso_tool --extract "C:\PSPISO\MyPSPISO.iso" all "C:\OUT"
+	if(argc > 1 && strcmp(argv[1], "--extract")==0) {
+		return extract_main(argc, argv);
+	}
+
+	// Raw <-> ISO conversion
+	// ex. psiso_tool --to-iso "C:\PSXISO\MyPS1ISO.bin"
+	if(argc > 1 && (strcmp(argv[1], "--to-iso")==0 || strcmp(argv[1], "--to-raw")==0)) {
+		return convert_main(argc, argv, strcmp(argv[1], "--to-raw")==0);
+	}
+
+	bool bPatch = false;
+
+	// prog [opt] [file]
+	char szISO[1024];
+	ZERO(szISO);
+
+	int nSystem = ISO_SYSTEM_AUTO;
+
+	// paramater 1 - 3 :	(system)(vervose)(patch) any order, system is optional
+	// parameter 4:			(path) no exception
+
+	int nSystemParam = -1;
+	int nVerboseParam = -1;
+	int nPatchParam = -1;
+
+	if(argc > 1 && argc <= 5 ) 
+	{
 		for(int nParam = 1; nParam < 4; nParam++)
 		{
 			// System
@@ -494,7 +1271,7 @@ int main(int argc, const char* argv[])
 			}
 
 			// Patch
-			if( (nSystem == ISO_SYSTEM_PS3) && 
+			if( (nSystem == ISO_SYSTEM_PS3 || nSystem == ISO_SYSTEM_AUTO) && 
 				(strncmp(_argv[nParam], "--patch", strlen("--patch"))==0) && 
 				(nPatchParam == -1) )
 			{
@@ -511,29 +1288,11 @@ int main(int argc, const char* argv[])
 			}
 		}
 
-		// system parameter must always be present
-		if(nSystemParam == -1) {
-			print_usage(); return 1;
-		}
-
-		// parameters specified but path was not...
-		// ex. psiso_tool --ps3
-		if(argc == 2) {
-			print_usage(); return 1;
-		}
-
-		// parameters specified but path was not...
-		// ex1. psiso_tool --ps3 --verbose
-		// ex2. psiso_tool --ps3 --patch
-		if( (argc == 3 && nVerboseParam != -1) || 
-			(argc == 3 && nPatchParam != -1 && nSystem == ISO_SYSTEM_PS3)) 
-		{
-			print_usage(); return 1;
-		}
-
 		// parameters specified but path was not...
-		// ex. psiso_tool --ps3 --verbose --patch
-		if(argc == 4 && nVerboseParam != -1 && nPatchParam != -1 && nSystem == ISO_SYSTEM_PS3) 
+		// ex1. psiso_tool --ps3
+		// ex2. psiso_tool --ps3 --verbose --patch
+		int nOptions = (nSystemParam != -1) + (nVerboseParam != -1) + (nPatchParam != -1);
+		if(argc - 1 <= nOptions || strncmp(_argv[argc-1], "--", 2)==0) 
 		{
 			print_usage(); return 1;
 		}
@@ -546,12 +1305,17 @@ int main(int argc, const char* argv[])
 		return 1;
 	}
 
-	char szTitleID[32];	
-	char szTitle[1024];
-	ZERO(szTitleID);
-	ZERO(szTitle);
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+
+	// always display file name
+	psxLog(&ctx, PSISO_LOG_INFO, "ISO file: %s \n", szISO);
 
-	int ret = psxProcessISO((char*)szISO, nSystem, (char*)szTitleID, (char*)szTitle, bPatch);
+	psiso_result res;
+	int ret = psxProcessISOEx(&ctx, szISO, nSystem, bPatch, &res);
+
+	const char* szTitleID = res.szTitleID;
+	const char* szTitle = res.szTitle;
 
 	if(ret == 0) {
 		printf("Error: ISO file \"%s\" could not be located, please verify the path. \n", szISO);
@@ -565,6 +1329,10 @@ int main(int argc, const char* argv[])
 
 	printf(SEP_LINE_2);
 
+	if(nSystem == ISO_SYSTEM_AUTO && res.nSystem >= ISO_SYSTEM_PS1 && res.nSystem <= ISO_SYSTEM_PSP) {
+		printf("SYSTEM: ( %s ) \n", szISOSystem[res.nSystem]);
+	}
+
 	if(!szTitleID[0]) {
 		printf("error: szTitleID[0] == NULL\n");
 	} else {
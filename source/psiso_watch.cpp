@@ -0,0 +1,593 @@
+// ------------------------------------------------------------------------------
+// Library watch module
+// ------------------------------------------------------------------------------
+#include "psiso_watch.h"
+#include "psiso_scan.h"
+#include "psiso_catalog.h"
+#include "psiso_cue.h"
+#include "psiso_thread.h"
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+
+#define WATCH_DIR_MASK		(IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_ONLYDIR | IN_DONT_FOLLOW)
+#define WATCH_EVENT_BUF		65536
+
+struct watch_dir
+{
+	int		wd;
+	char*	szPath;
+};
+
+struct watch_pending
+{
+	char*			szPath;
+	double			fDue;		// probed after this time (psxTimeNow()) if it did not change
+	psiso_file_key	key;		// at the last event / check (zero if it could not be read)
+};
+
+struct watch_state
+{
+	int					fd;			// inotify
+	watch_dir*			pDirs;
+	uint32_t			nDirs;
+	uint32_t			nDirCapacity;
+	watch_pending*		pPending;
+	uint32_t			nPending;
+	uint32_t			nPendingCapacity;
+
+	psiso_catalog		cat;
+	const char*			szCatalog;
+	bool				bDirty;		// catalog changed since it was saved
+	bool				bRescan;	// kernel queue overflow
+
+	const char*			szRoot;
+	int					nSystem;
+	int					nJobs;
+	double				fDebounce;	// seconds
+	bool				bVerbose;
+};
+
+static volatile sig_atomic_t bStop = 0;
+
+static void watch_signal(int nSignal)
+{
+	(void)nSignal;
+	bStop = 1;
+}
+
+static void quiet_log_sink(void* pUser, int nLevel, const char* szMsg)
+{
+	(void)pUser;
+	(void)nLevel;
+	(void)szMsg;
+}
+
+static bool is_under(const char* szPath, const char* szDir)
+{
+	size_t nLen = strlen(szDir);
+	return strncmp(szPath, szDir, nLen) == 0 && (szPath[nLen] == '/' || szPath[nLen] == 0);
+}
+
+// szDir/szName, false if it does not fit in szOut (the entry is skipped then)
+static bool join_path(char* szOut, size_t nOutSize, const char* szDir, const char* szName)
+{
+	int nLen = snprintf(szOut, nOutSize, "%s/%s", szDir, szName);
+	return nLen >= 0 && (size_t)nLen < nOutSize;
+}
+
+// ------------------------------------------------------------------------------
+// Watched directories
+
+static void watch_add_tree(watch_state* st, const char* szDir, int nDepth)
+{
+	if(nDepth > PSISO_WATCH_MAX_DEPTH) return;
+
+	int wd = inotify_add_watch(st->fd, szDir, WATCH_DIR_MASK);
+	if(wd < 0) {
+		printf("Warning: \"%s\" can not be watched (%s). \n", szDir, strerror(errno));
+		return;
+	}
+
+	// the same directory gives the same wd (moved back, rescan)
+	uint32_t i = 0;
+	while(i < st->nDirs && st->pDirs[i].wd != wd) i++;
+	if(i == st->nDirs)
+	{
+		if(st->nDirs == st->nDirCapacity)
+		{
+			uint32_t nCapacity = st->nDirCapacity ? st->nDirCapacity * 2 : 64;
+			watch_dir* pDirs = (watch_dir*)realloc(st->pDirs, nCapacity * sizeof(watch_dir));
+			if(!pDirs) return;
+			st->pDirs = pDirs;
+			st->nDirCapacity = nCapacity;
+		}
+		st->pDirs[i].wd = wd;
+		st->pDirs[i].szPath = NULL;
+		st->nDirs++;
+	}
+	char* szCopy = (char*)malloc(strlen(szDir) + 1);
+	if(szCopy) strcpy(szCopy, szDir);
+	SAFE_FREE(st->pDirs[i].szPath);
+	st->pDirs[i].szPath = szCopy;
+
+	DIR* d = opendir(szDir);
+	if(!d) return;
+
+	struct dirent* de = NULL;
+	while((de = readdir(d)))
+	{
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+		char szPath[4096];
+		if(!join_path(szPath, sizeof(szPath), szDir, de->d_name)) continue;
+
+		// directory links are not followed, same tree as psxScanDirectory()
+		struct stat sb;
+		if(lstat(szPath, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+			watch_add_tree(st, szPath, nDepth + 1);
+		}
+	}
+	closedir(d);
+}
+
+static const char* watch_dir_path(const watch_state* st, int wd)
+{
+	for(uint32_t i = 0; i < st->nDirs; i++) {
+		if(st->pDirs[i].wd == wd) return st->pDirs[i].szPath;
+	}
+	return NULL;
+}
+
+// stop watching szDir and everything under it (moved out of the library / deleted)
+static void watch_forget_tree(watch_state* st, const char* szDir, bool bRemoveWatch)
+{
+	uint32_t nKept = 0;
+	for(uint32_t i = 0; i < st->nDirs; i++)
+	{
+		if(st->pDirs[i].szPath && is_under(st->pDirs[i].szPath, szDir)) {
+			if(bRemoveWatch) inotify_rm_watch(st->fd, st->pDirs[i].wd);
+			SAFE_FREE(st->pDirs[i].szPath);
+		} else {
+			st->pDirs[nKept++] = st->pDirs[i];
+		}
+	}
+	st->nDirs = nKept;
+}
+
+// inotify dropped the watch (directory deleted / unmounted)
+static void watch_forget_wd(watch_state* st, int wd)
+{
+	uint32_t nKept = 0;
+	for(uint32_t i = 0; i < st->nDirs; i++)
+	{
+		if(st->pDirs[i].wd == wd) {
+			SAFE_FREE(st->pDirs[i].szPath);
+		} else {
+			st->pDirs[nKept++] = st->pDirs[i];
+		}
+	}
+	st->nDirs = nKept;
+}
+
+// ------------------------------------------------------------------------------
+// Pending images
+
+static void pending_touch(watch_state* st, const char* szPath, double fNow)
+{
+	uint32_t i = 0;
+	while(i < st->nPending && strcmp(st->pPending[i].szPath, szPath) != 0) i++;
+
+	if(i == st->nPending)
+	{
+		if(st->nPending == st->nPendingCapacity)
+		{
+			uint32_t nCapacity = st->nPendingCapacity ? st->nPendingCapacity * 2 : 256;
+			watch_pending* pPending = (watch_pending*)realloc(st->pPending, nCapacity * sizeof(watch_pending));
+			if(!pPending) return;
+			st->pPending = pPending;
+			st->nPendingCapacity = nCapacity;
+		}
+		char* szCopy = (char*)malloc(strlen(szPath) + 1);
+		if(!szCopy) return;
+		strcpy(szCopy, szPath);
+		st->pPending[i].szPath = szCopy;
+		st->nPending++;
+	}
+
+	st->pPending[i].fDue = fNow + st->fDebounce;
+	if(!psxCatalogFileKey(szPath, &st->pPending[i].key)) {
+		memset(&st->pPending[i].key, 0, sizeof(psiso_file_key));
+	}
+}
+
+// drop szPath, or everything under it when bTree is set
+static void pending_remove(watch_state* st, const char* szPath, bool bTree)
+{
+	uint32_t nKept = 0;
+	for(uint32_t i = 0; i < st->nPending; i++)
+	{
+		const char* szPending = st->pPending[i].szPath;
+		if(bTree ? is_under(szPending, szPath) : strcmp(szPending, szPath) == 0) {
+			SAFE_FREE(st->pPending[i].szPath);
+		} else {
+			st->pPending[nKept++] = st->pPending[i];
+		}
+	}
+	st->nPending = nKept;
+}
+
+// CUE sheets of the directory of szPath
+static void list_sheets(const char* szPath, psiso_file_list* list)
+{
+	memset(list, 0, sizeof(psiso_file_list));
+
+	char szDir[4096];
+	ZERO(szDir);
+	strncpy(szDir, szPath, sizeof(szDir) - 1);
+	char* pSep = strrchr(szDir, '/');
+	if(!pSep) return;
+	*pSep = 0;
+
+	DIR* d = opendir(szDir);
+	if(!d) return;
+
+	struct dirent* de = NULL;
+	while((de = readdir(d)))
+	{
+		if(!psxCUEIsSheet(de->d_name)) continue;
+
+		char szSheet[4096];
+		if(join_path(szSheet, sizeof(szSheet), szDir, de->d_name)) psxFileListAdd(list, szSheet);
+	}
+	closedir(d);
+}
+
+// BIN files listed on a CUE sheet of their directory are probed through the sheet
+static bool is_cue_track(const char* szPath)
+{
+	if(psxCUEIsSheet(szPath)) return false;
+
+	psiso_ctx ctx;
+	psxCtxInit(&ctx);
+	ctx.log = quiet_log_sink;
+	ctx.bNoMap = true;
+
+	psiso_file_list sheets;
+	list_sheets(szPath, &sheets);
+
+	bool bTrack = false;
+	for(uint32_t i = 0; i < sheets.nCount && !bTrack; i++)
+	{
+		psiso_cue cue;
+		if(!psxCUELoad(&ctx, &cue, sheets.pszPaths[i])) continue;
+		for(uint32_t f = 0; f < cue.nFiles; f++) {
+			if(strcmp(cue.pFiles[f].szPath, szPath) == 0) bTrack = true;
+		}
+		psxCUEFree(&cue);
+	}
+	psxFileListFree(&sheets);
+	return bTrack;
+}
+
+// ------------------------------------------------------------------------------
+// Events
+
+static void catalog_remove(watch_state* st, const char* szPath, bool bTree)
+{
+	if(!bTree) {
+		if(psxCatalogRemove(&st->cat, szPath)) {
+			printf("DEL\t\t\t\t%s\n", szPath);
+			st->bDirty = true;
+		}
+		return;
+	}
+
+	psiso_catalog removed;
+	ZERO(removed);
+	if(psxCatalogRemoveDir(&st->cat, szPath, &removed)) {
+		for(uint32_t i = 0; i < removed.nCount; i++) {
+			printf("DEL\t\t\t\t%s\n", removed.pEntries[i].szPath);
+		}
+		st->bDirty = true;
+	}
+	psxCatalogFree(&removed);
+}
+
+static void handle_event(watch_state* st, const struct inotify_event* ev, double fNow)
+{
+	if(ev->mask & IN_Q_OVERFLOW) {
+		st->bRescan = true;
+		return;
+	}
+	if(ev->mask & IN_IGNORED) {
+		watch_forget_wd(st, ev->wd);
+		return;
+	}
+
+	const char* szDir = watch_dir_path(st, ev->wd);
+	if(!szDir || !ev->len || !ev->name[0]) return;
+
+	char szPath[4096];
+	if(!join_path(szPath, sizeof(szPath), szDir, ev->name)) return;
+
+	if(ev->mask & IN_ISDIR)
+	{
+		if(ev->mask & (IN_CREATE | IN_MOVED_TO))
+		{
+			// copied / moved in with its contents, those produce no events of their own
+			watch_add_tree(st, szPath, 0);
+
+			psiso_file_list list;
+			if(psxScanDirectory(szPath, &list)) {
+				for(uint32_t i = 0; i < list.nCount; i++) pending_touch(st, list.pszPaths[i], fNow);
+			}
+			psxFileListFree(&list);
+		}
+		else if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+		{
+			watch_forget_tree(st, szPath, (ev->mask & IN_MOVED_FROM) != 0);
+			pending_remove(st, szPath, true);
+			catalog_remove(st, szPath, true);
+		}
+		return;
+	}
+
+	if(!psxIsImageName(ev->name)) return;
+
+	if(ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+		pending_touch(st, szPath, fNow);
+	} else if(ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+		pending_remove(st, szPath, false);
+		catalog_remove(st, szPath, false);
+	} else {
+		return;
+	}
+
+	// sheets get the new key / fingerprint of their BIN files (cached if not affected)
+	if(!psxCUEIsSheet(szPath))
+	{
+		psiso_file_list sheets;
+		list_sheets(szPath, &sheets);
+		for(uint32_t i = 0; i < sheets.nCount; i++) pending_touch(st, sheets.pszPaths[i], fNow);
+		psxFileListFree(&sheets);
+	}
+}
+
+static void read_events(watch_state* st)
+{
+	// aligned for struct inotify_event
+	static uint64_t buf[WATCH_EVENT_BUF / sizeof(uint64_t)];
+
+	for(;;)
+	{
+		ssize_t nLen = read(st->fd, buf, sizeof(buf));
+		if(nLen <= 0) break;
+
+		double fNow = psxTimeNow();
+		const uint8_t* p = (const uint8_t*)buf;
+		const uint8_t* pEnd = p + nLen;
+		while(p + sizeof(struct inotify_event) <= pEnd)
+		{
+			const struct inotify_event* ev = (const struct inotify_event*)p;
+			handle_event(st, ev, fNow);
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Probes
+
+static bool save_catalog(watch_state* st)
+{
+	if(!st->bDirty || !st->szCatalog) {
+		st->bDirty = false;
+		return true;
+	}
+	if(!psxCatalogSave(&st->cat, st->szCatalog)) {
+		printf("Error: Catalog \"%s\" could not be written. \n", st->szCatalog);
+		return false;
+	}
+	st->bDirty = false;
+	return true;
+}
+
+// probe the pending images that did not change over the debounce delay, as one batch
+static bool probe_due(watch_state* st, double fNow)
+{
+	psiso_file_list batch;
+	ZERO(batch);
+
+	uint32_t nKept = 0;
+	for(uint32_t i = 0; i < st->nPending; i++)
+	{
+		watch_pending* p = &st->pPending[i];
+		if(p->fDue > fNow) {
+			st->pPending[nKept++] = *p;
+			continue;
+		}
+
+		psiso_file_key key;
+		if(!psxCatalogFileKey(p->szPath, &key)) {
+			// gone again, its delete event takes care of the catalog
+			SAFE_FREE(p->szPath);
+			continue;
+		}
+		if(memcmp(&key, &p->key, sizeof(psiso_file_key)) != 0) {
+			// still being written
+			p->key = key;
+			p->fDue = fNow + st->fDebounce;
+			st->pPending[nKept++] = *p;
+			continue;
+		}
+
+		if(is_cue_track(p->szPath)) {
+			catalog_remove(st, p->szPath, false);
+		} else {
+			psxFileListAdd(&batch, p->szPath);
+		}
+		SAFE_FREE(p->szPath);
+	}
+	st->nPending = nKept;
+
+	bool bOk = true;
+	if(batch.nCount)
+	{
+		// the catalog is only read by the workers, entries are set once they are done
+		psiso_scan_stats stats;
+		if(!psxScanFiles(&batch, &st->cat, &st->cat, st->nSystem, st->nJobs, st->bVerbose, &stats)) {
+			printf("Error: Out of memory, some images were not added to the catalog. \n");
+		}
+		st->bDirty = true;
+	}
+	psxFileListFree(&batch);
+
+	if(!save_catalog(st)) bOk = false;
+	return bOk;
+}
+
+// milliseconds until the next pending image is due (-1 = nothing pending)
+static int next_timeout_ms(const watch_state* st, double fNow)
+{
+	if(!st->nPending) return -1;
+
+	double fDue = st->pPending[0].fDue;
+	for(uint32_t i = 1; i < st->nPending; i++) {
+		if(st->pPending[i].fDue < fDue) fDue = st->pPending[i].fDue;
+	}
+	double fWait = (fDue - fNow) * 1000.0 + 1.0;
+	return (fWait <= 0.0) ? 0 : (int)fWait;
+}
+
+static bool rescan(watch_state* st)
+{
+	for(uint32_t i = 0; i < st->nPending; i++) {
+		SAFE_FREE(st->pPending[i].szPath);
+	}
+	st->nPending = 0;
+
+	// directories created while the queue was full are not watched yet
+	watch_add_tree(st, st->szRoot, 0);
+
+	psiso_scan_stats stats;
+	if(psxScanUpdate(st->szRoot, &st->cat, st->nSystem, st->nJobs, st->bVerbose, &stats) != 1) {
+		printf("Error: Directory \"%s\" could not be scanned. \n", st->szRoot);
+	}
+	st->bDirty = true;
+	st->bRescan = false;
+	return save_catalog(st);
+}
+
+int psxWatchLibrary(const char* szDir, const char* szCatalog, int nSystem, int nJobs, int nDebounceMs, bool bVerbose)
+{
+	// same catalog keys as psxScanLibrary(), whatever form szDir is given in
+	char szRoot[4096];
+	ZERO(szRoot);
+	if(!psxFullPath(szDir, szRoot, sizeof(szRoot))) {
+		return -1;
+	}
+
+	struct stat sb;
+	if(stat(szRoot, &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+		return -1;
+	}
+
+	watch_state st;
+	memset(&st, 0, sizeof(watch_state));
+	st.szRoot		= szRoot;
+	st.szCatalog	= szCatalog;
+	st.nSystem		= nSystem;
+	st.nJobs		= (nJobs <= 0) ? psxCpuCount() : nJobs;
+	st.fDebounce	= (nDebounceMs > 0 ? nDebounceMs : PSISO_WATCH_DEBOUNCE_MS) / 1000.0;
+	st.bVerbose		= bVerbose;
+
+	// never overwrite a file that is not a catalog, a missing one starts empty
+	if(szCatalog && psxCatalogLoad(&st.cat, szCatalog) < 0) {
+		return -3;
+	}
+
+	st.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(st.fd < 0) {
+		printf("Error: inotify is not available (%s). \n", strerror(errno));
+		psxCatalogFree(&st.cat);
+		return -1;
+	}
+
+	// watches first, so nothing that changes during the first scan is missed
+	watch_add_tree(&st, szRoot, 0);
+
+	int ret = rescan(&st) ? 0 : -2;
+
+	printf(SEP_LINE_2);
+	printf("Watching %u directories under \"%s\" (Ctrl+C to stop). \n", st.nDirs, szRoot);
+	fflush(stdout);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watch_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while(!bStop && ret == 0)
+	{
+		struct pollfd pfd;
+		pfd.fd		= st.fd;
+		pfd.events	= POLLIN;
+		pfd.revents	= 0;
+
+		int n = poll(&pfd, 1, next_timeout_ms(&st, psxTimeNow()));
+		if(n < 0 && errno != EINTR) break;
+
+		if(n > 0) read_events(&st);
+
+		if(!st.nDirs) {
+			printf("Error: Directory \"%s\" is gone, nothing left to watch. \n", szRoot);
+			break;
+		}
+
+		if(st.bRescan) {
+			printf("Warning: Too many changes at once, rescanning the library. \n");
+			if(!rescan(&st)) ret = -2;
+		}
+		if(ret == 0 && !probe_due(&st, psxTimeNow())) ret = -2;
+		fflush(stdout);
+	}
+
+	if(ret == 0 && !save_catalog(&st)) ret = -2;
+
+	close(st.fd);
+	for(uint32_t i = 0; i < st.nDirs; i++) SAFE_FREE(st.pDirs[i].szPath);
+	for(uint32_t i = 0; i < st.nPending; i++) SAFE_FREE(st.pPending[i].szPath);
+	SAFE_FREE(st.pDirs);
+	SAFE_FREE(st.pPending);
+	psxCatalogFree(&st.cat);
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	return ret;
+}
+
+#else
+
+int psxWatchLibrary(const char* szDir, const char* szCatalog, int nSystem, int nJobs, int nDebounceMs, bool bVerbose)
+{
+	(void)szDir;
+	(void)szCatalog;
+	(void)nSystem;
+	(void)nJobs;
+	(void)nDebounceMs;
+	(void)bVerbose;
+
+	printf("Error: Watching a library needs inotify (Linux), use \"--scan\" with \"--catalog\" instead. \n");
+	return -1;
+}
+
+#endif
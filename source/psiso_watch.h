@@ -0,0 +1,57 @@
+#ifndef PSISO_WATCH_H
+#define PSISO_WATCH_H
+
+#include "psiso_tool.h"
+
+// ------------------------------------------------------------------------------------------------
+// Library watch module
+// ------------------------------------------------------------------------------------------------
+// Keeps the catalog of a library (see psiso_catalog.h) up to date while images are copied,
+// replaced, renamed or deleted, without rescanning the whole library.
+//
+// Every directory of the library is watched with inotify (close_write, moved_to, moved_from,
+// delete and create for new directories). Events only mark images as pending, an image is probed
+// once PSISO_WATCH_DEBOUNCE_MS (or the given delay) passed since its last event and its size /
+// modification time did not change over that delay (still being uploaded otherwise). All the
+// images due at the same time are probed as one batch on the scan thread pool (at most nJobs at
+// once), so a burst of hundreds of files becomes a few batches. Events that arrive meanwhile are
+// queued by the kernel and handled after the batch.
+//
+// A changed BIN file also marks the CUE sheets of its directory, BIN files listed on a sheet are
+// only probed through it (same as psxScanLibrary()). Deleted images and directories are removed
+// from the catalog right away. When the kernel event queue overflows the library is rescanned
+// (only images that changed are probed).
+//
+// Links to directories are not followed (same tree as psxScanDirectory()), so a link back to a
+// parent does not add a watch per path variant.
+//
+// Only available on Linux (inotify).
+
+#define PSISO_WATCH_DEBOUNCE_MS		2000
+#define PSISO_WATCH_MAX_DEPTH		32
+
+// -----------------------------------------------------------------------------------------------
+/* -----------------------------------------------------------------------------------------------
+(in)	szDir			- Directory with the game library
+(in)	szCatalog		- Catalog file, saved after every change (NULL = kept in memory only)
+(in)	nSystem			- One of the ISO_SYSTEM_* values (ISO_SYSTEM_AUTO to detect each image)
+(in)	nJobs			- Maximum number of images probed at once (0 = one per CPU)
+(in)	nDebounceMs		- Quiet time before an image is probed (0 = PSISO_WATCH_DEBOUNCE_MS)
+(in)	bVerbose		- Display the details of every image probed
+
+(out)	return			- Will return 0 when stopped (SIGINT / SIGTERM), -1 if szDir could not
+						  be watched (or watching is not supported), -2 if the catalog could
+						  not be written and -3 if szCatalog exists but could not be read or
+						  is not a valid catalog (a missing file starts an empty catalog).
+
+The library is scanned first (psxScanUpdate()), then one line per image is written to stdout
+every time it is probed or removed:
+
+	OK<TAB>SYSTEM<TAB>TITLE ID<TAB>TITLE<TAB>PATH
+	FAIL<TAB><TAB><TAB><TAB>PATH
+	DEL<TAB><TAB><TAB><TAB>PATH
+-------------------------------------------------------------------------------------------------
+*/
+int psxWatchLibrary(const char* szDir, const char* szCatalog, int nSystem, int nJobs, int nDebounceMs, bool bVerbose);
+
+#endif